@@ -0,0 +1,151 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "BufferArena.hpp"
+#include <SoapySDR/Logger.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+//huge pages are 2 MiB on the common platforms
+#define HUGE_PAGE_SIZE            (2 * 1024 * 1024)
+
+SoapySDRPlayBufferArena::SoapySDRPlayBufferArena(void):
+    _base(nullptr),
+    _mappedBytes(0),
+    _stride(0),
+    _numSlots(0),
+    _slotBytes(0),
+    _hugePages(false),
+    _locked(false)
+{
+    return;
+}
+
+SoapySDRPlayBufferArena::~SoapySDRPlayBufferArena(void)
+{
+    this->release();
+}
+
+void SoapySDRPlayBufferArena::allocate(const size_t numSlots, const size_t slotBytes, const bool hugePages, const bool lock)
+{
+    this->release();
+
+    // every slot starts on its own cache line
+    const size_t stride = (slotBytes + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+    size_t bytes = std::max<size_t>(stride * numSlots, CACHE_LINE_SIZE);
+
+#ifdef _WIN32
+    if (hugePages)
+    {
+        SoapySDR_log(SOAPY_SDR_INFO, "Buffer arena: huge pages are not used on this platform");
+    }
+    void *base = VirtualAlloc(nullptr, bytes, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if (base == nullptr) throw std::bad_alloc();
+    if (lock and not VirtualLock(base, bytes))
+    {
+        SoapySDR_logf(SOAPY_SDR_WARNING, "Buffer arena: VirtualLock of %zu bytes failed, error %lu", bytes, GetLastError());
+    }
+    else if (lock)
+    {
+        _locked = true;
+    }
+#else
+    void *base = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (hugePages)
+    {
+        // explicit huge pages need a reserved pool, transparent ones are the fallback
+        const size_t hugeBytes = (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+        base = mmap(nullptr, hugeBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (base != MAP_FAILED)
+        {
+            bytes = hugeBytes;
+            _hugePages = true;
+        }
+    }
+#endif
+    if (base == MAP_FAILED)
+    {
+        base = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED) throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+        if (hugePages and madvise(base, bytes, MADV_HUGEPAGE) == 0)
+        {
+            _hugePages = true;
+        }
+#endif
+        if (hugePages and not _hugePages)
+        {
+            SoapySDR_log(SOAPY_SDR_INFO, "Buffer arena: no huge pages available, using normal pages");
+        }
+    }
+    if (lock and mlock(base, bytes) != 0)
+    {
+        SoapySDR_logf(SOAPY_SDR_WARNING, "Buffer arena: mlock of %zu bytes failed: %s%s", bytes, std::strerror(errno),
+                      (errno == ENOMEM or errno == EPERM) ? " (raise RLIMIT_MEMLOCK or grant CAP_IPC_LOCK)" : "");
+    }
+    else if (lock)
+    {
+        _locked = true;
+    }
+#endif
+
+    // fault every page in now rather than in rx_callback
+    std::memset(base, 0, bytes);
+
+    _base = (char *)base;
+    _mappedBytes = bytes;
+    _stride = stride;
+    _numSlots = numSlots;
+    _slotBytes = slotBytes;
+}
+
+void SoapySDRPlayBufferArena::release(void)
+{
+    if (_base != nullptr)
+    {
+#ifdef _WIN32
+        if (_locked) VirtualUnlock(_base, _mappedBytes);
+        VirtualFree(_base, 0, MEM_RELEASE);
+#else
+        if (_locked) munlock(_base, _mappedBytes);
+        munmap(_base, _mappedBytes);
+#endif
+    }
+    _base = nullptr;
+    _mappedBytes = 0;
+    _stride = 0;
+    _numSlots = 0;
+    _slotBytes = 0;
+    _hugePages = false;
+    _locked = false;
+}
@@ -0,0 +1,90 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+#include <cstddef>
+
+/*******************************************************************
+ * Buffer arena
+ *
+ * One contiguous allocation carved into fixed size slots, each slot
+ * starts on a cache line. The pages are touched or locked when the
+ * arena is allocated, so the streaming threads never fault one in
+ * and never call into the heap.
+ ******************************************************************/
+
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE           (64)
+#endif
+
+class SoapySDRPlayBufferArena
+{
+public:
+    SoapySDRPlayBufferArena(void);
+
+    ~SoapySDRPlayBufferArena(void);
+
+    //replace the arena, only while no thread uses a slot,
+    //hugePages and lock are best effort, what failed is logged
+    void allocate(const size_t numSlots, const size_t slotBytes, const bool hugePages, const bool lock);
+
+    void release(void);
+
+    char *slot(const size_t index) const
+    {
+        return _base + index * _stride;
+    }
+
+    size_t numSlots(void) const
+    {
+        return _numSlots;
+    }
+
+    size_t slotBytes(void) const
+    {
+        return _slotBytes;
+    }
+
+    bool hugePages(void) const
+    {
+        return _hugePages;
+    }
+
+    bool locked(void) const
+    {
+        return _locked;
+    }
+
+private:
+    SoapySDRPlayBufferArena(const SoapySDRPlayBufferArena &);
+    SoapySDRPlayBufferArena &operator=(const SoapySDRPlayBufferArena &);
+
+    char *_base;
+    size_t _mappedBytes;
+    size_t _stride;
+    size_t _numSlots;
+    size_t _slotBytes;
+    bool _hugePages;
+    bool _locked;
+};
@@ -0,0 +1,500 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "Channelizer.hpp"
+#include <SoapySDR/Constants.h>
+#include <SoapySDR/Errors.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+SoapySDRPlayChannelizer::SoapySDRPlayChannelizer(const size_t numChannels, const size_t numThreads, const size_t maxSamples):
+    _blocks(DDC_NUM_BLOCKS),
+    _published(0),
+    _stop(false),
+    _scheduleSeq(0)
+{
+    for (auto &block : _blocks)
+    {
+        block.xi.reserve(maxSamples);
+        block.xq.reserve(maxSamples);
+    }
+
+    for (size_t ch = 0; ch < numChannels; ch++)
+    {
+        std::unique_ptr<Channel> chan(new Channel());
+        chan->frequency = std::numeric_limits<double>::quiet_NaN();
+        chan->rate = 250000;
+        chan->active = false;
+        chan->restart = true;
+        chan->format = FORMAT_CS16;
+        chan->bytesPerSample = 2 * sizeof(short);
+        chan->cs8Shift = 8;
+        chan->round = true;
+        chan->rateNum = 0;
+        chan->rateDen = 1;
+        chan->outRate = 0;
+        chan->phase = 0.0;
+        chan->started = false;
+        chan->lost = false;
+        chan->inNext = 0;
+        chan->outNext = 0;
+        chan->timeBaseNs = 0;
+        chan->timeBaseCount = 0;
+        chan->head = 0;
+        chan->tail = 0;
+        chan->bufferElems = 0;
+        chan->readOffset = 0;
+        _channels.push_back(std::move(chan));
+    }
+
+    const size_t threads = std::max<size_t>(1, std::min(numThreads, numChannels));
+    for (size_t i = 0; i < threads; i++)
+    {
+        std::unique_ptr<Worker> worker(new Worker());
+        worker->done = 0;
+        _workers.push_back(std::move(worker));
+    }
+    for (size_t i = 0; i < threads; i++)
+    {
+        _workers[i]->thread = std::thread(&SoapySDRPlayChannelizer::work, this, i);
+    }
+}
+
+SoapySDRPlayChannelizer::~SoapySDRPlayChannelizer(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _cond.notify_all();
+    for (auto &worker : _workers) worker->thread.join();
+}
+
+size_t SoapySDRPlayChannelizer::numChannels(void) const
+{
+    return _channels.size();
+}
+
+size_t SoapySDRPlayChannelizer::numThreads(void) const
+{
+    return _workers.size();
+}
+
+void SoapySDRPlayChannelizer::setSchedule(const SoapySDRPlaySchedule &schedule)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _schedule = schedule;
+        _scheduleSeq++;
+    }
+    _cond.notify_all();
+}
+
+/*******************************************************************
+ * Channel settings
+ ******************************************************************/
+
+void SoapySDRPlayChannelizer::setFrequency(const size_t ch, const double frequency)
+{
+    _channels.at(ch)->frequency = frequency;
+}
+
+double SoapySDRPlayChannelizer::getFrequency(const size_t ch, const double tunerFrequency) const
+{
+    const double frequency = _channels.at(ch)->frequency;
+    return std::isnan(frequency) ? tunerFrequency : frequency;
+}
+
+void SoapySDRPlayChannelizer::setRate(const size_t ch, const uint32_t rate)
+{
+    _channels.at(ch)->rate = rate;
+}
+
+uint32_t SoapySDRPlayChannelizer::getRate(const size_t ch) const
+{
+    return _channels.at(ch)->rate;
+}
+
+void SoapySDRPlayChannelizer::setup(const size_t ch, const Format format, const unsigned int bytesPerSample,
+                                    const size_t numBuffers, const size_t bufferElems,
+                                    const unsigned int cs8Shift, const bool round)
+{
+    Channel &chan = *_channels.at(ch);
+    if (chan.active) throw std::runtime_error("setupStream channel " + std::to_string(ch + 1) + " is streaming");
+
+    std::lock_guard<std::mutex> lock(chan.mutex);
+    chan.format = format;
+    chan.bytesPerSample = bytesPerSample;
+    chan.cs8Shift = cs8Shift;
+    chan.round = round;
+    chan.bufferElems = bufferElems;
+    chan.buffs.resize(numBuffers);
+    chan.buffTimeNs.assign(numBuffers, 0);
+    chan.buffRate.assign(numBuffers, 1.0);
+    chan.buffAfterLoss.assign(numBuffers, 0);
+    for (auto &buff : chan.buffs)
+    {
+        buff.reserve(bufferElems * bytesPerSample);
+        buff.clear();
+    }
+    chan.head = 0;
+    chan.tail = 0;
+    chan.readOffset = 0;
+}
+
+void SoapySDRPlayChannelizer::activate(const size_t ch, const bool active)
+{
+    Channel &chan = *_channels.at(ch);
+    if (active)
+    {
+        //the published buffers are dropped, the worker restarts the one it fills
+        std::lock_guard<std::mutex> lock(chan.mutex);
+        for (; chan.head != chan.tail; chan.head++)
+        {
+            chan.buffs[chan.head % chan.buffs.size()].clear();
+        }
+        chan.readOffset = 0;
+        chan.restart = true;
+    }
+    chan.active.store(active, std::memory_order_release);
+
+    //a worker may still be inside the last block
+    if (not active)
+    {
+        const unsigned long long seq = _published.load(std::memory_order_acquire);
+        for (const auto &worker : _workers)
+        {
+            while (worker->done.load(std::memory_order_acquire) < seq) std::this_thread::yield();
+        }
+    }
+}
+
+bool SoapySDRPlayChannelizer::anyActive(void) const
+{
+    for (const auto &chan : _channels)
+    {
+        if (chan->active.load(std::memory_order_relaxed)) return true;
+    }
+    return false;
+}
+
+size_t SoapySDRPlayChannelizer::getMTU(const size_t ch) const
+{
+    return _channels.at(ch)->bufferElems;
+}
+
+/*******************************************************************
+ * Wideband input, rx_callback
+ ******************************************************************/
+
+void SoapySDRPlayChannelizer::push(const SoapySDRPlayConverter *conv, const short *xi, const short *xq, const unsigned int numSamples,
+                                   const long long timeNs, const long long count, const bool restart,
+                                   const uint32_t rateNum, const uint32_t rateDen, const double tunerFrequency)
+{
+    //the slowest worker still needs the oldest block,
+    //the channels see the dropped block as a gap in the count
+    const unsigned long long seq = _published.load(std::memory_order_relaxed);
+    for (const auto &worker : _workers)
+    {
+        if (seq - worker->done.load(std::memory_order_acquire) >= DDC_NUM_BLOCKS) return;
+    }
+
+    //reserved by the constructor, only a larger callback grows them
+    Block &block = _blocks[seq % DDC_NUM_BLOCKS];
+    block.xi.assign(xi, xi + numSamples);
+    block.xq.assign(xq, xq + numSamples);
+    block.numSamples = numSamples;
+    block.timeNs = timeNs;
+    block.count = count;
+    block.restart = restart;
+    block.rateNum = rateNum;
+    block.rateDen = rateDen;
+    block.tunerFrequency = tunerFrequency;
+    block.conv = conv;
+    _published.store(seq + 1, std::memory_order_release);
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+    }
+    _cond.notify_all();
+}
+
+/*******************************************************************
+ * Channel workers
+ ******************************************************************/
+
+void SoapySDRPlayChannelizer::work(const size_t index)
+{
+    Worker &worker = *_workers[index];
+    unsigned long long seq = 0;
+    unsigned long long scheduleSeq = 0;
+    while (true)
+    {
+        SoapySDRPlaySchedule schedule;
+        bool reschedule = false;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _cond.wait(lock, [&]{ return _stop or _scheduleSeq != scheduleSeq or
+                                         _published.load(std::memory_order_acquire) != seq; });
+            if (_stop) return;
+            reschedule = (_scheduleSeq != scheduleSeq);
+            scheduleSeq = _scheduleSeq;
+            schedule = _schedule;
+        }
+        if (reschedule)
+        {
+            SoapySDRPlay_applySchedule(schedule, "DDC worker");
+        }
+
+        const unsigned long long end = _published.load(std::memory_order_acquire);
+        for (; seq != end; seq++)
+        {
+            //channel ch belongs to worker ch % number of workers
+            const Block &block = _blocks[seq % DDC_NUM_BLOCKS];
+            for (size_t ch = index; ch < _channels.size(); ch += _workers.size())
+            {
+                Channel &chan = *_channels[ch];
+                if (chan.active.load(std::memory_order_acquire)) this->process(chan, block);
+            }
+            worker.done.store(seq + 1, std::memory_order_release);
+        }
+    }
+}
+
+void SoapySDRPlayChannelizer::process(Channel &chan, const Block &block)
+{
+    //activate() dropped the queue, the buffer being filled goes as well
+    const bool restart = chan.restart.exchange(false);
+    if (restart and not chan.buffs.empty())
+    {
+        chan.buffs[chan.tail % chan.buffs.size()].clear();
+        chan.started = false;
+        chan.lost = false;
+    }
+
+    const uint32_t outRate = chan.rate.load(std::memory_order_relaxed);
+    const bool lost = chan.started and (block.count != chan.inNext);
+
+    //new settings, lost samples or a counter reset start the filters over
+    if (restart or block.restart or lost or
+        (block.rateNum != chan.rateNum) or (block.rateDen != chan.rateDen) or (outRate != chan.outRate))
+    {
+        if (not chan.started or (block.rateNum != chan.rateNum) or (block.rateDen != chan.rateDen) or (outRate != chan.outRate))
+        {
+            chan.resampler.configure(block.rateNum, block.rateDen, outRate);
+            chan.rateNum = block.rateNum;
+            chan.rateDen = block.rateDen;
+            chan.outRate = outRate;
+        }
+        chan.resampler.reset();
+
+        //across a gap the output count follows the wideband count
+        const double inRate = (double)block.rateNum / block.rateDen;
+        if (chan.started)
+        {
+            chan.outNext += std::max(0LL, std::llround((block.count - chan.inNext) * outRate / inRate));
+        }
+        chan.timeBaseNs = block.timeNs - chan.resampler.delayNs();
+        chan.timeBaseCount = chan.outNext;
+        chan.lost = chan.lost or lost;
+        chan.started = true;
+    }
+    chan.inNext = block.count + block.numSamples;
+
+    //mix the channel down to 0 Hz, the oscillator restarts from the
+    //exact phase every block so it never drifts
+    const double inRate = (double)block.rateNum / block.rateDen;
+    const double frequency = chan.frequency.load(std::memory_order_relaxed);
+    const double offset = std::isnan(frequency) ? 0.0 : frequency - block.tunerFrequency;
+    const double step = offset / inRate;
+    const size_t num = block.numSamples;
+    chan.mixI.resize(num);
+    chan.mixQ.resize(num);
+    double oscI = std::cos(2.0 * M_PI * chan.phase);
+    double oscQ = -std::sin(2.0 * M_PI * chan.phase);
+    const double rotI = std::cos(2.0 * M_PI * step);
+    const double rotQ = -std::sin(2.0 * M_PI * step);
+    for (size_t i = 0; i < num; i++)
+    {
+        const float x = block.xi[i], y = block.xq[i];
+        chan.mixI[i] = (float)(x * oscI - y * oscQ);
+        chan.mixQ[i] = (float)(x * oscQ + y * oscI);
+        const double nextI = oscI * rotI - oscQ * rotQ;
+        oscQ = oscI * rotQ + oscQ * rotI;
+        oscI = nextI;
+    }
+    chan.phase += step * num;
+    chan.phase -= std::floor(chan.phase);
+
+    const size_t maxOutput = chan.resampler.maxOutput(num);
+    if (chan.outI.size() < maxOutput)
+    {
+        chan.outI.resize(maxOutput);
+        chan.outQ.resize(maxOutput);
+    }
+    const size_t numOutput = chan.resampler.process(block.conv, chan.mixI.data(), chan.mixQ.data(), num, chan.outI.data(), chan.outQ.data());
+    if (numOutput == 0) return;
+
+    //a block can be longer than the channel buffers at high rates
+    for (size_t offset = 0; offset < numOutput;)
+    {
+        const size_t n = std::min(numOutput - offset, chan.bufferElems);
+        const long long timeNs = chan.timeBaseNs + std::llround((chan.outNext - chan.timeBaseCount) * 1e9 / outRate);
+        this->deliver(chan, block.conv, offset, (unsigned int)n, timeNs);
+        chan.outNext += n;
+        offset += n;
+    }
+}
+
+void SoapySDRPlayChannelizer::deliver(Channel &chan, const SoapySDRPlayConverter *conv, const size_t offset, const unsigned int numSamples, const long long timeNs)
+{
+    const size_t numBuffers = chan.buffs.size();
+    if (numBuffers == 0)
+    {
+        chan.lost = true;
+        return;
+    }
+
+    size_t head;
+    {
+        std::lock_guard<std::mutex> lock(chan.mutex);
+        head = chan.head;
+    }
+
+    //a restart from activate() drops the buffer being filled,
+    //with a full queue the tail slot is the reader's and stays as it is
+    auto *buff = &chan.buffs[chan.tail % numBuffers];
+    const size_t bytes = numSamples * chan.bytesPerSample;
+    if (chan.tail - head < numBuffers and not buff->empty() and
+        (chan.lost or buff->size() + bytes > chan.bufferElems * chan.bytesPerSample))
+    {
+        //publish the buffer to the reader
+        {
+            std::lock_guard<std::mutex> lock(chan.mutex);
+            chan.tail++;
+        }
+        chan.cond.notify_one();
+        buff = &chan.buffs[chan.tail % numBuffers];
+    }
+
+    //the reader fell behind, drop the new samples
+    if (chan.tail - head >= numBuffers)
+    {
+        chan.lost = true;
+        return;
+    }
+
+    if (buff->empty())
+    {
+        chan.buffTimeNs[chan.tail % numBuffers] = timeNs;
+        chan.buffRate[chan.tail % numBuffers] = chan.outRate;
+        chan.buffAfterLoss[chan.tail % numBuffers] = chan.lost;
+        chan.lost = false;
+    }
+    buff->resize(buff->size() + bytes);
+    char *out = buff->data() + buff->size() - bytes;
+
+    switch (chan.format)
+    {
+    case FORMAT_CS16:
+        conv->toCS16(chan.outI.data() + offset, chan.outQ.data() + offset, (short *)out, numSamples);
+        break;
+    case FORMAT_CF32:
+        conv->toCF32(chan.outI.data() + offset, chan.outQ.data() + offset, (float *)out, numSamples);
+        break;
+    case FORMAT_CS8:
+        conv->toCS8(chan.outI.data() + offset, chan.outQ.data() + offset, (signed char *)out, numSamples, chan.cs8Shift, chan.round);
+        break;
+    case FORMAT_CS12:
+        conv->toCS12(chan.outI.data() + offset, chan.outQ.data() + offset, (unsigned char *)out, numSamples, chan.round);
+        break;
+    }
+
+    //the reader wakes up once a buffer is full
+    if (chan.tail - head < numBuffers and buff->size() + bytes > chan.bufferElems * chan.bytesPerSample)
+    {
+        {
+            std::lock_guard<std::mutex> lock(chan.mutex);
+            chan.tail++;
+        }
+        chan.cond.notify_one();
+    }
+}
+
+/*******************************************************************
+ * Reader
+ ******************************************************************/
+
+int SoapySDRPlayChannelizer::read(const size_t ch, void *buff, const size_t numElems, int &flags, long long &timeNs, const long timeoutUs)
+{
+    Channel &chan = *_channels.at(ch);
+    const size_t numBuffers = chan.buffs.size();
+    if (numBuffers == 0) return SOAPY_SDR_STREAM_ERROR;
+
+    size_t slot;
+    {
+        std::unique_lock<std::mutex> lock(chan.mutex);
+        if (chan.head == chan.tail)
+        {
+            chan.cond.wait_for(lock, std::chrono::microseconds(timeoutUs), [&]{ return chan.head != chan.tail; });
+            if (chan.head == chan.tail) return SOAPY_SDR_TIMEOUT;
+        }
+        slot = chan.head % numBuffers;
+
+        //the buffer after lost samples is reported first
+        if (chan.readOffset == 0 and chan.buffAfterLoss[slot])
+        {
+            chan.buffAfterLoss[slot] = 0;
+            timeNs = chan.buffTimeNs[slot];
+            flags = SOAPY_SDR_HAS_TIME;
+            return SOAPY_SDR_OVERFLOW;
+        }
+    }
+
+    //buffers between head and tail are the reader's
+    const std::vector<char> &data = chan.buffs[slot];
+    const size_t available = data.size() / chan.bytesPerSample - chan.readOffset;
+    const size_t num = std::min(available, numElems);
+    std::memcpy(buff, data.data() + chan.readOffset * chan.bytesPerSample, num * chan.bytesPerSample);
+
+    flags = SOAPY_SDR_HAS_TIME;
+    timeNs = chan.buffTimeNs[slot] + std::llround(chan.readOffset * 1e9 / chan.buffRate[slot]);
+    chan.readOffset += num;
+
+    if (num < available)
+    {
+        flags |= SOAPY_SDR_MORE_FRAGMENTS;
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(chan.mutex);
+        chan.buffs[slot].clear();
+        chan.readOffset = 0;
+        chan.head++;
+    }
+    return (int)num;
+}
@@ -0,0 +1,182 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+#include "Convert.hpp"
+#include "Resampler.hpp"
+#include "Scheduling.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//wideband blocks queued between rx_callback and the channel workers
+#define DDC_NUM_BLOCKS            (64)
+
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE           (64)
+#endif
+
+/*******************************************************************
+ * Virtual channels cut out of the wideband stream
+ ******************************************************************/
+
+//Each channel mixes its frequency down to baseband and resamples to its
+//own rate. rx_callback copies every wideband block once into a shared
+//ring, the channels are spread over worker threads that all read it.
+class SoapySDRPlayChannelizer
+{
+public:
+    enum Format
+    {
+        FORMAT_CS16,
+        FORMAT_CF32,
+        FORMAT_CS8,
+        FORMAT_CS12
+    };
+
+    //the input blocks are sized for rx_callback blocks of up to maxSamples
+    SoapySDRPlayChannelizer(const size_t numChannels, const size_t numThreads, const size_t maxSamples);
+
+    ~SoapySDRPlayChannelizer(void);
+
+    size_t numChannels(void) const;
+
+    size_t numThreads(void) const;
+
+    //priority and CPUs of the workers, each one applies it when it next wakes up
+    void setSchedule(const SoapySDRPlaySchedule &schedule);
+
+    //absolute center frequency, follows the tuner until set
+    void setFrequency(const size_t ch, const double frequency);
+
+    double getFrequency(const size_t ch, const double tunerFrequency) const;
+
+    void setRate(const size_t ch, const uint32_t rate);
+
+    uint32_t getRate(const size_t ch) const;
+
+    //size the output queue and pick the format, the channel must be inactive
+    void setup(const size_t ch, const Format format, const unsigned int bytesPerSample,
+               const size_t numBuffers, const size_t bufferElems,
+               const unsigned int cs8Shift, const bool round);
+
+    //an active channel drops what was queued and starts over,
+    //deactivation returns once the workers are done with the channel
+    void activate(const size_t ch, const bool active);
+
+    bool anyActive(void) const;
+
+    size_t getMTU(const size_t ch) const;
+
+    //called by rx_callback with a wideband block at rateNum/rateDen Hz,
+    //restart is set when the hardware counter restarted
+    void push(const SoapySDRPlayConverter *conv, const short *xi, const short *xq, const unsigned int numSamples,
+              const long long timeNs, const long long count, const bool restart,
+              const uint32_t rateNum, const uint32_t rateDen, const double tunerFrequency);
+
+    //readStream() for a channel
+    int read(const size_t ch, void *buff, const size_t numElems, int &flags, long long &timeNs, const long timeoutUs);
+
+private:
+    struct Block
+    {
+        std::vector<short> xi, xq;
+        unsigned int numSamples;
+        long long timeNs;
+        long long count;
+        bool restart;
+        uint32_t rateNum, rateDen;
+        double tunerFrequency;
+        const SoapySDRPlayConverter *conv;
+    };
+
+    struct Channel
+    {
+        //settings, written by the API and picked up by the worker
+        std::atomic<double> frequency;
+        std::atomic_uint rate;
+        std::atomic_bool active;
+        std::atomic_bool restart;
+
+        //stream format, only changed while inactive
+        Format format;
+        unsigned int bytesPerSample;
+        unsigned int cs8Shift;
+        bool round;
+
+        //worker state
+        SoapySDRPlayResampler resampler;
+        uint32_t rateNum, rateDen, outRate;
+        double phase;                  // mixer phase in cycles
+        std::vector<float> mixI, mixQ;
+        std::vector<short> outI, outQ;
+        bool started;
+        bool lost;                     // samples went missing before the next buffer
+        long long inNext;
+        long long outNext;
+        long long timeBaseNs;          // time of output sample timeBaseCount
+        long long timeBaseCount;
+
+        //output queue, the worker fills buffs[tail % size], the reader
+        //drains buffs[head % size], head and tail change under the mutex
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::vector<std::vector<char> > buffs;
+        std::vector<long long> buffTimeNs;
+        std::vector<double> buffRate;
+        std::vector<char> buffAfterLoss;
+        size_t head, tail;
+        size_t bufferElems;
+        size_t readOffset;
+    };
+
+    //progress of a worker through the blocks, on its own cache line
+    struct Worker
+    {
+        std::thread thread;
+        std::atomic<unsigned long long> done;
+        char pad[CACHE_LINE_SIZE];
+    };
+
+    void work(const size_t index);
+
+    void process(Channel &chan, const Block &block);
+
+    void deliver(Channel &chan, const SoapySDRPlayConverter *conv, const size_t offset, const unsigned int numSamples, const long long timeNs);
+
+    std::vector<std::unique_ptr<Channel> > _channels;
+    std::vector<std::unique_ptr<Worker> > _workers;
+
+    std::vector<Block> _blocks;
+    std::atomic<unsigned long long> _published;
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    bool _stop;
+    SoapySDRPlaySchedule _schedule;
+    unsigned long long _scheduleSeq;
+};
@@ -0,0 +1,904 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "Convert.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SDRPLAY_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#define SDRPLAY_NEON
+#include <arm_neon.h>
+#endif
+
+//the SIMD kernels are compiled for their own target,
+//the build flags only need to cover the scalar fallback
+#if defined(__GNUC__)
+#define SDRPLAY_TARGET(t) __attribute__((target(t)))
+#else
+#define SDRPLAY_TARGET(t)
+#endif
+
+static const float CF32_SCALE = 1.0f / 32768.0f;
+
+/*******************************************************************
+ * Scalar kernels
+ ******************************************************************/
+
+static void convertCS16_scalar(const short *xi, const short *xq, short *out, size_t numSamples)
+{
+    for (size_t i = 0; i < numSamples; i++)
+    {
+        *out++ = xi[i];
+        *out++ = xq[i];
+    }
+}
+
+static void convertCF32_scalar(const short *xi, const short *xq, float *out, size_t numSamples)
+{
+    for (size_t i = 0; i < numSamples; i++)
+    {
+        *out++ = (float)xi[i] * CF32_SCALE;
+        *out++ = (float)xq[i] * CF32_SCALE;
+    }
+}
+
+static void convertCF32Corr_scalar(const short *xi, const short *xq, float *out, size_t numSamples, SoapySDRPlayCorrection &corr)
+{
+    float sI = 0, sQ = 0, sII = 0, sQQ = 0, sIQ = 0;
+    for (size_t i = 0; i < numSamples; i++)
+    {
+        const float vi = (float)xi[i] * CF32_SCALE - corr.dcI;
+        const float vq = (float)xq[i] * CF32_SCALE - corr.dcQ;
+        *out++ = vi;
+        *out++ = corr.gainQ * vq + corr.crossQ * vi;
+        sI += vi;
+        sQ += vq;
+        sII += vi * vi;
+        sQQ += vq * vq;
+        sIQ += vi * vq;
+    }
+    corr.sumI += sI;
+    corr.sumQ += sQ;
+    corr.sumII += sII;
+    corr.sumQQ += sQQ;
+    corr.sumIQ += sIQ;
+}
+
+static void convertCS8_scalar(const short *xi, const short *xq, signed char *out, size_t numSamples, unsigned int shift, bool round)
+{
+    //same saturating add as the SIMD kernels
+    const int bias = (round and shift != 0) ? (1 << (shift - 1)) : 0;
+    for (size_t i = 0; i < numSamples; i++)
+    {
+        const int vi = std::min(xi[i] + bias, 32767) >> shift;
+        const int vq = std::min(xq[i] + bias, 32767) >> shift;
+        *out++ = (signed char)std::max(-128, std::min(vi, 127));
+        *out++ = (signed char)std::max(-128, std::min(vq, 127));
+    }
+}
+
+static void convertCS12_scalar(const short *xi, const short *xq, unsigned char *out, size_t numSamples, bool round)
+{
+    const int bias = round ? 8 : 0;
+    for (size_t i = 0; i < numSamples; i++)
+    {
+        const int vi = std::min(xi[i] + bias, 32767) >> 4;
+        const int vq = std::min(xq[i] + bias, 32767) >> 4;
+        *out++ = (unsigned char)(vi & 0xff);
+        *out++ = (unsigned char)(((vi >> 8) & 0x0f) | ((vq & 0x0f) << 4));
+        *out++ = (unsigned char)((vq >> 4) & 0xff);
+    }
+}
+
+static void firCF32_scalar(const float *taps, const float *xi, const float *xq, size_t numTaps, float &outI, float &outQ)
+{
+    float accI = 0, accQ = 0;
+    for (size_t k = 0; k < numTaps; k++)
+    {
+        accI += taps[k] * xi[k];
+        accQ += taps[k] * xq[k];
+    }
+    outI = accI;
+    outQ = accQ;
+}
+
+static void butterflyCF32_scalar(const float *ar, const float *ai, const float *br, const float *bi,
+                                 float *cr, float *ci, float *dr, float *di, float wr, float wi, size_t n)
+{
+    for (size_t q = 0; q < n; q++)
+    {
+        const float tr = ar[q] - br[q], ti = ai[q] - bi[q];
+        cr[q] = ar[q] + br[q];
+        ci[q] = ai[q] + bi[q];
+        dr[q] = tr * wr - ti * wi;
+        di[q] = tr * wi + ti * wr;
+    }
+}
+
+/*******************************************************************
+ * x86 kernels
+ ******************************************************************/
+
+#ifdef SDRPLAY_X86
+
+SDRPLAY_TARGET("sse2")
+static void convertCS16_sse2(const short *xi, const short *xq, short *out, size_t numSamples)
+{
+    size_t i = 0;
+    for (; i + 8 <= numSamples; i += 8)
+    {
+        const __m128i vi = _mm_loadu_si128((const __m128i *)(xi + i));
+        const __m128i vq = _mm_loadu_si128((const __m128i *)(xq + i));
+        _mm_storeu_si128((__m128i *)(out + 0), _mm_unpacklo_epi16(vi, vq));
+        _mm_storeu_si128((__m128i *)(out + 8), _mm_unpackhi_epi16(vi, vq));
+        out += 16;
+    }
+    convertCS16_scalar(xi + i, xq + i, out, numSamples - i);
+}
+
+SDRPLAY_TARGET("sse2")
+static inline __m128 cvtLo_sse2(const __m128i iq)
+{
+    //sign extend the lower four int16 to int32
+    return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(iq, iq), 16));
+}
+
+SDRPLAY_TARGET("sse2")
+static inline __m128 cvtHi_sse2(const __m128i iq)
+{
+    return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(iq, iq), 16));
+}
+
+SDRPLAY_TARGET("sse2")
+static void convertCF32_sse2(const short *xi, const short *xq, float *out, size_t numSamples)
+{
+    const __m128 scale = _mm_set1_ps(CF32_SCALE);
+    size_t i = 0;
+    for (; i + 8 <= numSamples; i += 8)
+    {
+        const __m128i vi = _mm_loadu_si128((const __m128i *)(xi + i));
+        const __m128i vq = _mm_loadu_si128((const __m128i *)(xq + i));
+        const __m128i lo = _mm_unpacklo_epi16(vi, vq);
+        const __m128i hi = _mm_unpackhi_epi16(vi, vq);
+        _mm_storeu_ps(out + 0,  _mm_mul_ps(cvtLo_sse2(lo), scale));
+        _mm_storeu_ps(out + 4,  _mm_mul_ps(cvtHi_sse2(lo), scale));
+        _mm_storeu_ps(out + 8,  _mm_mul_ps(cvtLo_sse2(hi), scale));
+        _mm_storeu_ps(out + 12, _mm_mul_ps(cvtHi_sse2(hi), scale));
+        out += 16;
+    }
+    convertCF32_scalar(xi + i, xq + i, out, numSamples - i);
+}
+
+SDRPLAY_TARGET("sse2")
+static inline double sum_sse2(const __m128 v)
+{
+    float lanes[4];
+    _mm_storeu_ps(lanes, v);
+    return (double)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+SDRPLAY_TARGET("sse2")
+static void convertCF32Corr_sse2(const short *xi, const short *xq, float *out, size_t numSamples, SoapySDRPlayCorrection &corr)
+{
+    const __m128 scale = _mm_set1_ps(CF32_SCALE);
+    const __m128 dcI = _mm_set1_ps(corr.dcI);
+    const __m128 dcQ = _mm_set1_ps(corr.dcQ);
+    const __m128 gainQ = _mm_set1_ps(corr.gainQ);
+    const __m128 crossQ = _mm_set1_ps(corr.crossQ);
+    __m128 sI = _mm_setzero_ps(), sQ = _mm_setzero_ps();
+    __m128 sII = _mm_setzero_ps(), sQQ = _mm_setzero_ps(), sIQ = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= numSamples; i += 8)
+    {
+        const __m128i vi = _mm_loadu_si128((const __m128i *)(xi + i));
+        const __m128i vq = _mm_loadu_si128((const __m128i *)(xq + i));
+        const __m128 fi[2] = {_mm_sub_ps(_mm_mul_ps(cvtLo_sse2(vi), scale), dcI),
+                              _mm_sub_ps(_mm_mul_ps(cvtHi_sse2(vi), scale), dcI)};
+        const __m128 fq[2] = {_mm_sub_ps(_mm_mul_ps(cvtLo_sse2(vq), scale), dcQ),
+                              _mm_sub_ps(_mm_mul_ps(cvtHi_sse2(vq), scale), dcQ)};
+        for (int h = 0; h < 2; h++)
+        {
+            const __m128 oq = _mm_add_ps(_mm_mul_ps(gainQ, fq[h]), _mm_mul_ps(crossQ, fi[h]));
+            _mm_storeu_ps(out + 0, _mm_unpacklo_ps(fi[h], oq));
+            _mm_storeu_ps(out + 4, _mm_unpackhi_ps(fi[h], oq));
+            out += 8;
+            sI = _mm_add_ps(sI, fi[h]);
+            sQ = _mm_add_ps(sQ, fq[h]);
+            sII = _mm_add_ps(sII, _mm_mul_ps(fi[h], fi[h]));
+            sQQ = _mm_add_ps(sQQ, _mm_mul_ps(fq[h], fq[h]));
+            sIQ = _mm_add_ps(sIQ, _mm_mul_ps(fi[h], fq[h]));
+        }
+    }
+    corr.sumI += sum_sse2(sI);
+    corr.sumQ += sum_sse2(sQ);
+    corr.sumII += sum_sse2(sII);
+    corr.sumQQ += sum_sse2(sQQ);
+    corr.sumIQ += sum_sse2(sIQ);
+    convertCF32Corr_scalar(xi + i, xq + i, out, numSamples - i, corr);
+}
+
+SDRPLAY_TARGET("sse2")
+static void firCF32_sse2(const float *taps, const float *xi, const float *xq, size_t numTaps, float &outI, float &outQ)
+{
+    __m128 accI = _mm_setzero_ps(), accQ = _mm_setzero_ps();
+    size_t k = 0;
+    for (; k + 4 <= numTaps; k += 4)
+    {
+        const __m128 h = _mm_loadu_ps(taps + k);
+        accI = _mm_add_ps(accI, _mm_mul_ps(h, _mm_loadu_ps(xi + k)));
+        accQ = _mm_add_ps(accQ, _mm_mul_ps(h, _mm_loadu_ps(xq + k)));
+    }
+    float tailI, tailQ;
+    firCF32_scalar(taps + k, xi + k, xq + k, numTaps - k, tailI, tailQ);
+    outI = (float)sum_sse2(accI) + tailI;
+    outQ = (float)sum_sse2(accQ) + tailQ;
+}
+
+SDRPLAY_TARGET("sse2")
+static void butterflyCF32_sse2(const float *ar, const float *ai, const float *br, const float *bi,
+                               float *cr, float *ci, float *dr, float *di, float wr, float wi, size_t n)
+{
+    const __m128 vwr = _mm_set1_ps(wr), vwi = _mm_set1_ps(wi);
+    size_t q = 0;
+    for (; q + 4 <= n; q += 4)
+    {
+        const __m128 xar = _mm_loadu_ps(ar + q), xai = _mm_loadu_ps(ai + q);
+        const __m128 xbr = _mm_loadu_ps(br + q), xbi = _mm_loadu_ps(bi + q);
+        const __m128 tr = _mm_sub_ps(xar, xbr), ti = _mm_sub_ps(xai, xbi);
+        _mm_storeu_ps(cr + q, _mm_add_ps(xar, xbr));
+        _mm_storeu_ps(ci + q, _mm_add_ps(xai, xbi));
+        _mm_storeu_ps(dr + q, _mm_sub_ps(_mm_mul_ps(tr, vwr), _mm_mul_ps(ti, vwi)));
+        _mm_storeu_ps(di + q, _mm_add_ps(_mm_mul_ps(tr, vwi), _mm_mul_ps(ti, vwr)));
+    }
+    butterflyCF32_scalar(ar + q, ai + q, br + q, bi + q, cr + q, ci + q, dr + q, di + q, wr, wi, n - q);
+}
+
+SDRPLAY_TARGET("sse2")
+static void convertCS8_sse2(const short *xi, const short *xq, signed char *out, size_t numSamples, unsigned int shift, bool round)
+{
+    const __m128i bias = _mm_set1_epi16((round and shift != 0) ? (short)(1 << (shift - 1)) : 0);
+    const __m128i count = _mm_cvtsi32_si128((int)shift);
+    size_t i = 0;
+    for (; i + 8 <= numSamples; i += 8)
+    {
+        const __m128i vi = _mm_sra_epi16(_mm_adds_epi16(_mm_loadu_si128((const __m128i *)(xi + i)), bias), count);
+        const __m128i vq = _mm_sra_epi16(_mm_adds_epi16(_mm_loadu_si128((const __m128i *)(xq + i)), bias), count);
+        //interleave, then saturate to 8 bits
+        _mm_storeu_si128((__m128i *)out, _mm_packs_epi16(_mm_unpacklo_epi16(vi, vq), _mm_unpackhi_epi16(vi, vq)));
+        out += 16;
+    }
+    convertCS8_scalar(xi + i, xq + i, out, numSamples - i, shift, round);
+}
+
+SDRPLAY_TARGET("sse2")
+static inline __m128i pack12_sse2(const __m128i iq)
+{
+    //one 24 bit word per sample from I and Q in the 32 bit lanes
+    return _mm_or_si128(_mm_and_si128(iq, _mm_set1_epi32(0x00000fff)),
+                        _mm_and_si128(_mm_srli_epi32(iq, 4), _mm_set1_epi32(0x00fff000)));
+}
+
+SDRPLAY_TARGET("sse2")
+static void convertCS12_sse2(const short *xi, const short *xq, unsigned char *out, size_t numSamples, bool round)
+{
+    const __m128i bias = _mm_set1_epi16(round ? 8 : 0);
+    size_t i = 0;
+    //each 4 byte store spills one byte into the next sample
+    for (; i + 8 < numSamples; i += 8)
+    {
+        const __m128i vi = _mm_srai_epi16(_mm_adds_epi16(_mm_loadu_si128((const __m128i *)(xi + i)), bias), 4);
+        const __m128i vq = _mm_srai_epi16(_mm_adds_epi16(_mm_loadu_si128((const __m128i *)(xq + i)), bias), 4);
+        __m128i words[2] = {pack12_sse2(_mm_unpacklo_epi16(vi, vq)), pack12_sse2(_mm_unpackhi_epi16(vi, vq))};
+        for (const __m128i &w : words)
+        {
+            int lanes[4];
+            _mm_storeu_si128((__m128i *)lanes, w);
+            for (int lane : lanes)
+            {
+                std::memcpy(out, &lane, 4);
+                out += 3;
+            }
+        }
+    }
+    convertCS12_scalar(xi + i, xq + i, out, numSamples - i, round);
+}
+
+SDRPLAY_TARGET("avx2")
+static void convertCS16_avx2(const short *xi, const short *xq, short *out, size_t numSamples)
+{
+    size_t i = 0;
+    for (; i + 16 <= numSamples; i += 16)
+    {
+        const __m256i vi = _mm256_loadu_si256((const __m256i *)(xi + i));
+        const __m256i vq = _mm256_loadu_si256((const __m256i *)(xq + i));
+        //unpack works per 128 bit lane, put the lanes back in order
+        const __m256i lo = _mm256_unpacklo_epi16(vi, vq);
+        const __m256i hi = _mm256_unpackhi_epi16(vi, vq);
+        _mm256_storeu_si256((__m256i *)(out + 0),  _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i *)(out + 16), _mm256_permute2x128_si256(lo, hi, 0x31));
+        out += 32;
+    }
+    convertCS16_sse2(xi + i, xq + i, out, numSamples - i);
+}
+
+SDRPLAY_TARGET("avx2")
+static void convertCF32_avx2(const short *xi, const short *xq, float *out, size_t numSamples)
+{
+    const __m256 scale = _mm256_set1_ps(CF32_SCALE);
+    size_t i = 0;
+    for (; i + 8 <= numSamples; i += 8)
+    {
+        const __m128i vi = _mm_loadu_si128((const __m128i *)(xi + i));
+        const __m128i vq = _mm_loadu_si128((const __m128i *)(xq + i));
+        const __m256i lo = _mm256_cvtepi16_epi32(_mm_unpacklo_epi16(vi, vq));
+        const __m256i hi = _mm256_cvtepi16_epi32(_mm_unpackhi_epi16(vi, vq));
+        _mm256_storeu_ps(out + 0, _mm256_mul_ps(_mm256_cvtepi32_ps(lo), scale));
+        _mm256_storeu_ps(out + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(hi), scale));
+        out += 16;
+    }
+    convertCF32_scalar(xi + i, xq + i, out, numSamples - i);
+}
+
+SDRPLAY_TARGET("avx2")
+static inline double sum_avx2(const __m256 v)
+{
+    float lanes[8];
+    _mm256_storeu_ps(lanes, v);
+    double sum = 0;
+    for (float lane : lanes) sum += lane;
+    return sum;
+}
+
+SDRPLAY_TARGET("avx2")
+static void convertCF32Corr_avx2(const short *xi, const short *xq, float *out, size_t numSamples, SoapySDRPlayCorrection &corr)
+{
+    const __m256 scale = _mm256_set1_ps(CF32_SCALE);
+    const __m256 dcI = _mm256_set1_ps(corr.dcI);
+    const __m256 dcQ = _mm256_set1_ps(corr.dcQ);
+    const __m256 gainQ = _mm256_set1_ps(corr.gainQ);
+    const __m256 crossQ = _mm256_set1_ps(corr.crossQ);
+    __m256 sI = _mm256_setzero_ps(), sQ = _mm256_setzero_ps();
+    __m256 sII = _mm256_setzero_ps(), sQQ = _mm256_setzero_ps(), sIQ = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= numSamples; i += 8)
+    {
+        const __m256i vi = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(xi + i)));
+        const __m256i vq = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(xq + i)));
+        const __m256 fi = _mm256_sub_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(vi), scale), dcI);
+        const __m256 fq = _mm256_sub_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(vq), scale), dcQ);
+        const __m256 oq = _mm256_add_ps(_mm256_mul_ps(gainQ, fq), _mm256_mul_ps(crossQ, fi));
+        //unpack works per 128 bit lane, put the lanes back in order
+        const __m256 lo = _mm256_unpacklo_ps(fi, oq);
+        const __m256 hi = _mm256_unpackhi_ps(fi, oq);
+        _mm256_storeu_ps(out + 0, _mm256_permute2f128_ps(lo, hi, 0x20));
+        _mm256_storeu_ps(out + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+        out += 16;
+        sI = _mm256_add_ps(sI, fi);
+        sQ = _mm256_add_ps(sQ, fq);
+        sII = _mm256_add_ps(sII, _mm256_mul_ps(fi, fi));
+        sQQ = _mm256_add_ps(sQQ, _mm256_mul_ps(fq, fq));
+        sIQ = _mm256_add_ps(sIQ, _mm256_mul_ps(fi, fq));
+    }
+    corr.sumI += sum_avx2(sI);
+    corr.sumQ += sum_avx2(sQ);
+    corr.sumII += sum_avx2(sII);
+    corr.sumQQ += sum_avx2(sQQ);
+    corr.sumIQ += sum_avx2(sIQ);
+    convertCF32Corr_scalar(xi + i, xq + i, out, numSamples - i, corr);
+}
+
+SDRPLAY_TARGET("avx2")
+static void firCF32_avx2(const float *taps, const float *xi, const float *xq, size_t numTaps, float &outI, float &outQ)
+{
+    __m256 accI = _mm256_setzero_ps(), accQ = _mm256_setzero_ps();
+    size_t k = 0;
+    for (; k + 8 <= numTaps; k += 8)
+    {
+        const __m256 h = _mm256_loadu_ps(taps + k);
+        accI = _mm256_add_ps(accI, _mm256_mul_ps(h, _mm256_loadu_ps(xi + k)));
+        accQ = _mm256_add_ps(accQ, _mm256_mul_ps(h, _mm256_loadu_ps(xq + k)));
+    }
+    float tailI, tailQ;
+    firCF32_scalar(taps + k, xi + k, xq + k, numTaps - k, tailI, tailQ);
+    outI = (float)sum_avx2(accI) + tailI;
+    outQ = (float)sum_avx2(accQ) + tailQ;
+}
+
+SDRPLAY_TARGET("avx2")
+static void butterflyCF32_avx2(const float *ar, const float *ai, const float *br, const float *bi,
+                               float *cr, float *ci, float *dr, float *di, float wr, float wi, size_t n)
+{
+    const __m256 vwr = _mm256_set1_ps(wr), vwi = _mm256_set1_ps(wi);
+    size_t q = 0;
+    for (; q + 8 <= n; q += 8)
+    {
+        const __m256 xar = _mm256_loadu_ps(ar + q), xai = _mm256_loadu_ps(ai + q);
+        const __m256 xbr = _mm256_loadu_ps(br + q), xbi = _mm256_loadu_ps(bi + q);
+        const __m256 tr = _mm256_sub_ps(xar, xbr), ti = _mm256_sub_ps(xai, xbi);
+        _mm256_storeu_ps(cr + q, _mm256_add_ps(xar, xbr));
+        _mm256_storeu_ps(ci + q, _mm256_add_ps(xai, xbi));
+        _mm256_storeu_ps(dr + q, _mm256_sub_ps(_mm256_mul_ps(tr, vwr), _mm256_mul_ps(ti, vwi)));
+        _mm256_storeu_ps(di + q, _mm256_add_ps(_mm256_mul_ps(tr, vwi), _mm256_mul_ps(ti, vwr)));
+    }
+    //the tail runs legacy SSE code, leave the upper halves clean for it
+    _mm256_zeroupper();
+    butterflyCF32_sse2(ar + q, ai + q, br + q, bi + q, cr + q, ci + q, dr + q, di + q, wr, wi, n - q);
+}
+
+SDRPLAY_TARGET("avx2")
+static void convertCS8_avx2(const short *xi, const short *xq, signed char *out, size_t numSamples, unsigned int shift, bool round)
+{
+    const __m256i bias = _mm256_set1_epi16((round and shift != 0) ? (short)(1 << (shift - 1)) : 0);
+    const __m128i count = _mm_cvtsi32_si128((int)shift);
+    size_t i = 0;
+    for (; i + 16 <= numSamples; i += 16)
+    {
+        const __m256i vi = _mm256_sra_epi16(_mm256_adds_epi16(_mm256_loadu_si256((const __m256i *)(xi + i)), bias), count);
+        const __m256i vq = _mm256_sra_epi16(_mm256_adds_epi16(_mm256_loadu_si256((const __m256i *)(xq + i)), bias), count);
+        //unpack and pack both work per 128 bit lane, which restores the order
+        _mm256_storeu_si256((__m256i *)out, _mm256_packs_epi16(_mm256_unpacklo_epi16(vi, vq), _mm256_unpackhi_epi16(vi, vq)));
+        out += 32;
+    }
+    convertCS8_sse2(xi + i, xq + i, out, numSamples - i, shift, round);
+}
+
+SDRPLAY_TARGET("avx2")
+static inline __m256i pack12_avx2(const __m256i iq)
+{
+    //24 bit words, then the low 12 bytes of each 128 bit lane
+    const __m256i words = _mm256_or_si256(_mm256_and_si256(iq, _mm256_set1_epi32(0x00000fff)),
+                                          _mm256_and_si256(_mm256_srli_epi32(iq, 4), _mm256_set1_epi32(0x00fff000)));
+    const __m256i squeeze = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                             0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    return _mm256_shuffle_epi8(words, squeeze);
+}
+
+SDRPLAY_TARGET("avx2")
+static void convertCS12_avx2(const short *xi, const short *xq, unsigned char *out, size_t numSamples, bool round)
+{
+    const __m256i bias = _mm256_set1_epi16(round ? 8 : 0);
+    size_t i = 0;
+    //each 16 byte store spills 4 bytes, at least two more samples must follow
+    for (; i + 18 <= numSamples; i += 16)
+    {
+        const __m256i vi = _mm256_srai_epi16(_mm256_adds_epi16(_mm256_loadu_si256((const __m256i *)(xi + i)), bias), 4);
+        const __m256i vq = _mm256_srai_epi16(_mm256_adds_epi16(_mm256_loadu_si256((const __m256i *)(xq + i)), bias), 4);
+        //lo holds samples 0-3 and 8-11, hi holds 4-7 and 12-15
+        const __m256i lo = pack12_avx2(_mm256_unpacklo_epi16(vi, vq));
+        const __m256i hi = pack12_avx2(_mm256_unpackhi_epi16(vi, vq));
+        _mm_storeu_si128((__m128i *)(out + 0),  _mm256_castsi256_si128(lo));
+        _mm_storeu_si128((__m128i *)(out + 12), _mm256_castsi256_si128(hi));
+        _mm_storeu_si128((__m128i *)(out + 24), _mm256_extracti128_si256(lo, 1));
+        _mm_storeu_si128((__m128i *)(out + 36), _mm256_extracti128_si256(hi, 1));
+        out += 48;
+    }
+    convertCS12_sse2(xi + i, xq + i, out, numSamples - i, round);
+}
+
+SDRPLAY_TARGET("avx512f")
+static inline __m512i interleave_avx512(const short *xi, const short *xq)
+{
+    //one 32 bit word per sample, I in the low half, Q in the high half
+    const __m512i vi = _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i *)xi));
+    const __m512i vq = _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i *)xq));
+    return _mm512_or_si512(vi, _mm512_slli_epi32(vq, 16));
+}
+
+SDRPLAY_TARGET("avx512f")
+static void convertCS16_avx512(const short *xi, const short *xq, short *out, size_t numSamples)
+{
+    size_t i = 0;
+    for (; i + 16 <= numSamples; i += 16)
+    {
+        _mm512_storeu_si512((void *)out, interleave_avx512(xi + i, xq + i));
+        out += 32;
+    }
+    convertCS16_scalar(xi + i, xq + i, out, numSamples - i);
+}
+
+SDRPLAY_TARGET("avx512f")
+static void convertCF32_avx512(const short *xi, const short *xq, float *out, size_t numSamples)
+{
+    const __m512 scale = _mm512_set1_ps(CF32_SCALE);
+    size_t i = 0;
+    for (; i + 16 <= numSamples; i += 16)
+    {
+        const __m512i iq = interleave_avx512(xi + i, xq + i);
+        const __m512i lo = _mm512_cvtepi16_epi32(_mm512_castsi512_si256(iq));
+        const __m512i hi = _mm512_cvtepi16_epi32(_mm512_extracti64x4_epi64(iq, 1));
+        _mm512_storeu_ps(out + 0,  _mm512_mul_ps(_mm512_cvtepi32_ps(lo), scale));
+        _mm512_storeu_ps(out + 16, _mm512_mul_ps(_mm512_cvtepi32_ps(hi), scale));
+        out += 32;
+    }
+    convertCF32_scalar(xi + i, xq + i, out, numSamples - i);
+}
+
+SDRPLAY_TARGET("avx512f")
+static void convertCF32Corr_avx512(const short *xi, const short *xq, float *out, size_t numSamples, SoapySDRPlayCorrection &corr)
+{
+    const __m512 scale = _mm512_set1_ps(CF32_SCALE);
+    const __m512 dcI = _mm512_set1_ps(corr.dcI);
+    const __m512 dcQ = _mm512_set1_ps(corr.dcQ);
+    const __m512 gainQ = _mm512_set1_ps(corr.gainQ);
+    const __m512 crossQ = _mm512_set1_ps(corr.crossQ);
+    //unpack works per 128 bit lane, pick the lanes of lo (0-15) and hi (16-31) in order
+    const __m512i first = _mm512_setr_epi32(0, 1, 2, 3, 16, 17, 18, 19, 4, 5, 6, 7, 20, 21, 22, 23);
+    const __m512i second = _mm512_setr_epi32(8, 9, 10, 11, 24, 25, 26, 27, 12, 13, 14, 15, 28, 29, 30, 31);
+    __m512 sI = _mm512_setzero_ps(), sQ = _mm512_setzero_ps();
+    __m512 sII = _mm512_setzero_ps(), sQQ = _mm512_setzero_ps(), sIQ = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= numSamples; i += 16)
+    {
+        const __m512i vi = _mm512_cvtepi16_epi32(_mm256_loadu_si256((const __m256i *)(xi + i)));
+        const __m512i vq = _mm512_cvtepi16_epi32(_mm256_loadu_si256((const __m256i *)(xq + i)));
+        const __m512 fi = _mm512_fmsub_ps(_mm512_cvtepi32_ps(vi), scale, dcI);
+        const __m512 fq = _mm512_fmsub_ps(_mm512_cvtepi32_ps(vq), scale, dcQ);
+        const __m512 oq = _mm512_fmadd_ps(gainQ, fq, _mm512_mul_ps(crossQ, fi));
+        const __m512 lo = _mm512_unpacklo_ps(fi, oq);
+        const __m512 hi = _mm512_unpackhi_ps(fi, oq);
+        _mm512_storeu_ps(out + 0,  _mm512_permutex2var_ps(lo, first, hi));
+        _mm512_storeu_ps(out + 16, _mm512_permutex2var_ps(lo, second, hi));
+        out += 32;
+        sI = _mm512_add_ps(sI, fi);
+        sQ = _mm512_add_ps(sQ, fq);
+        sII = _mm512_fmadd_ps(fi, fi, sII);
+        sQQ = _mm512_fmadd_ps(fq, fq, sQQ);
+        sIQ = _mm512_fmadd_ps(fi, fq, sIQ);
+    }
+    corr.sumI += _mm512_reduce_add_ps(sI);
+    corr.sumQ += _mm512_reduce_add_ps(sQ);
+    corr.sumII += _mm512_reduce_add_ps(sII);
+    corr.sumQQ += _mm512_reduce_add_ps(sQQ);
+    corr.sumIQ += _mm512_reduce_add_ps(sIQ);
+    convertCF32Corr_scalar(xi + i, xq + i, out, numSamples - i, corr);
+}
+
+SDRPLAY_TARGET("avx512f")
+static void firCF32_avx512(const float *taps, const float *xi, const float *xq, size_t numTaps, float &outI, float &outQ)
+{
+    __m512 accI = _mm512_setzero_ps(), accQ = _mm512_setzero_ps();
+    size_t k = 0;
+    for (; k + 16 <= numTaps; k += 16)
+    {
+        const __m512 h = _mm512_loadu_ps(taps + k);
+        accI = _mm512_fmadd_ps(h, _mm512_loadu_ps(xi + k), accI);
+        accQ = _mm512_fmadd_ps(h, _mm512_loadu_ps(xq + k), accQ);
+    }
+    float tailI, tailQ;
+    firCF32_scalar(taps + k, xi + k, xq + k, numTaps - k, tailI, tailQ);
+    outI = _mm512_reduce_add_ps(accI) + tailI;
+    outQ = _mm512_reduce_add_ps(accQ) + tailQ;
+}
+
+SDRPLAY_TARGET("avx512f")
+static void butterflyCF32_avx512(const float *ar, const float *ai, const float *br, const float *bi,
+                                 float *cr, float *ci, float *dr, float *di, float wr, float wi, size_t n)
+{
+    const __m512 vwr = _mm512_set1_ps(wr), vwi = _mm512_set1_ps(wi);
+    size_t q = 0;
+    for (; q + 16 <= n; q += 16)
+    {
+        const __m512 xar = _mm512_loadu_ps(ar + q), xai = _mm512_loadu_ps(ai + q);
+        const __m512 xbr = _mm512_loadu_ps(br + q), xbi = _mm512_loadu_ps(bi + q);
+        const __m512 tr = _mm512_sub_ps(xar, xbr), ti = _mm512_sub_ps(xai, xbi);
+        _mm512_storeu_ps(cr + q, _mm512_add_ps(xar, xbr));
+        _mm512_storeu_ps(ci + q, _mm512_add_ps(xai, xbi));
+        _mm512_storeu_ps(dr + q, _mm512_fmsub_ps(tr, vwr, _mm512_mul_ps(ti, vwi)));
+        _mm512_storeu_ps(di + q, _mm512_fmadd_ps(tr, vwi, _mm512_mul_ps(ti, vwr)));
+    }
+    //the tail runs legacy SSE code, leave the upper halves clean for it
+    _mm256_zeroupper();
+    butterflyCF32_avx2(ar + q, ai + q, br + q, bi + q, cr + q, ci + q, dr + q, di + q, wr, wi, n - q);
+}
+
+#endif //SDRPLAY_X86
+
+/*******************************************************************
+ * ARM kernels
+ ******************************************************************/
+
+#ifdef SDRPLAY_NEON
+
+static void convertCS16_neon(const short *xi, const short *xq, short *out, size_t numSamples)
+{
+    size_t i = 0;
+    for (; i + 8 <= numSamples; i += 8)
+    {
+        int16x8x2_t iq;
+        iq.val[0] = vld1q_s16(xi + i);
+        iq.val[1] = vld1q_s16(xq + i);
+        vst2q_s16(out, iq);
+        out += 16;
+    }
+    convertCS16_scalar(xi + i, xq + i, out, numSamples - i);
+}
+
+static void convertCF32_neon(const short *xi, const short *xq, float *out, size_t numSamples)
+{
+    size_t i = 0;
+    for (; i + 8 <= numSamples; i += 8)
+    {
+        const int16x8_t vi = vld1q_s16(xi + i);
+        const int16x8_t vq = vld1q_s16(xq + i);
+        float32x4x2_t lo, hi;
+        lo.val[0] = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(vi))), CF32_SCALE);
+        lo.val[1] = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(vq))), CF32_SCALE);
+        hi.val[0] = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(vi))), CF32_SCALE);
+        hi.val[1] = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(vq))), CF32_SCALE);
+        vst2q_f32(out + 0, lo);
+        vst2q_f32(out + 8, hi);
+        out += 16;
+    }
+    convertCF32_scalar(xi + i, xq + i, out, numSamples - i);
+}
+
+static inline double sum_neon(const float32x4_t v)
+{
+    float lanes[4];
+    vst1q_f32(lanes, v);
+    return (double)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+static void convertCF32Corr_neon(const short *xi, const short *xq, float *out, size_t numSamples, SoapySDRPlayCorrection &corr)
+{
+    const float32x4_t dcI = vdupq_n_f32(corr.dcI);
+    const float32x4_t dcQ = vdupq_n_f32(corr.dcQ);
+    float32x4_t sI = vdupq_n_f32(0), sQ = vdupq_n_f32(0);
+    float32x4_t sII = vdupq_n_f32(0), sQQ = vdupq_n_f32(0), sIQ = vdupq_n_f32(0);
+    size_t i = 0;
+    for (; i + 4 <= numSamples; i += 4)
+    {
+        const float32x4_t fi = vsubq_f32(vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vld1_s16(xi + i))), CF32_SCALE), dcI);
+        const float32x4_t fq = vsubq_f32(vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vld1_s16(xq + i))), CF32_SCALE), dcQ);
+        float32x4x2_t iq;
+        iq.val[0] = fi;
+        iq.val[1] = vmlaq_n_f32(vmulq_n_f32(fq, corr.gainQ), fi, corr.crossQ);
+        vst2q_f32(out, iq);
+        out += 8;
+        sI = vaddq_f32(sI, fi);
+        sQ = vaddq_f32(sQ, fq);
+        sII = vmlaq_f32(sII, fi, fi);
+        sQQ = vmlaq_f32(sQQ, fq, fq);
+        sIQ = vmlaq_f32(sIQ, fi, fq);
+    }
+    corr.sumI += sum_neon(sI);
+    corr.sumQ += sum_neon(sQ);
+    corr.sumII += sum_neon(sII);
+    corr.sumQQ += sum_neon(sQQ);
+    corr.sumIQ += sum_neon(sIQ);
+    convertCF32Corr_scalar(xi + i, xq + i, out, numSamples - i, corr);
+}
+
+static void firCF32_neon(const float *taps, const float *xi, const float *xq, size_t numTaps, float &outI, float &outQ)
+{
+    float32x4_t accI = vdupq_n_f32(0), accQ = vdupq_n_f32(0);
+    size_t k = 0;
+    for (; k + 4 <= numTaps; k += 4)
+    {
+        const float32x4_t h = vld1q_f32(taps + k);
+        accI = vmlaq_f32(accI, h, vld1q_f32(xi + k));
+        accQ = vmlaq_f32(accQ, h, vld1q_f32(xq + k));
+    }
+    float tailI, tailQ;
+    firCF32_scalar(taps + k, xi + k, xq + k, numTaps - k, tailI, tailQ);
+    outI = (float)sum_neon(accI) + tailI;
+    outQ = (float)sum_neon(accQ) + tailQ;
+}
+
+static void butterflyCF32_neon(const float *ar, const float *ai, const float *br, const float *bi,
+                               float *cr, float *ci, float *dr, float *di, float wr, float wi, size_t n)
+{
+    const float32x4_t vwr = vdupq_n_f32(wr), vwi = vdupq_n_f32(wi);
+    size_t q = 0;
+    for (; q + 4 <= n; q += 4)
+    {
+        const float32x4_t xar = vld1q_f32(ar + q), xai = vld1q_f32(ai + q);
+        const float32x4_t xbr = vld1q_f32(br + q), xbi = vld1q_f32(bi + q);
+        const float32x4_t tr = vsubq_f32(xar, xbr), ti = vsubq_f32(xai, xbi);
+        vst1q_f32(cr + q, vaddq_f32(xar, xbr));
+        vst1q_f32(ci + q, vaddq_f32(xai, xbi));
+        vst1q_f32(dr + q, vmlsq_f32(vmulq_f32(tr, vwr), ti, vwi));
+        vst1q_f32(di + q, vmlaq_f32(vmulq_f32(tr, vwi), ti, vwr));
+    }
+    butterflyCF32_scalar(ar + q, ai + q, br + q, bi + q, cr + q, ci + q, dr + q, di + q, wr, wi, n - q);
+}
+
+static void convertCS8_neon(const short *xi, const short *xq, signed char *out, size_t numSamples, unsigned int shift, bool round)
+{
+    const int16x8_t bias = vdupq_n_s16((round and shift != 0) ? (short)(1 << (shift - 1)) : 0);
+    const int16x8_t count = vdupq_n_s16(-(short)shift);
+    size_t i = 0;
+    for (; i + 8 <= numSamples; i += 8)
+    {
+        //a negative shift count shifts right
+        int8x8x2_t iq;
+        iq.val[0] = vqmovn_s16(vshlq_s16(vqaddq_s16(vld1q_s16(xi + i), bias), count));
+        iq.val[1] = vqmovn_s16(vshlq_s16(vqaddq_s16(vld1q_s16(xq + i), bias), count));
+        vst2_s8(out, iq);
+        out += 16;
+    }
+    convertCS8_scalar(xi + i, xq + i, out, numSamples - i, shift, round);
+}
+
+static void convertCS12_neon(const short *xi, const short *xq, unsigned char *out, size_t numSamples, bool round)
+{
+    const int16x8_t bias = vdupq_n_s16(round ? 8 : 0);
+    size_t i = 0;
+    for (; i + 8 <= numSamples; i += 8)
+    {
+        const uint16x8_t vi = vreinterpretq_u16_s16(vshrq_n_s16(vqaddq_s16(vld1q_s16(xi + i), bias), 4));
+        const uint16x8_t vq = vreinterpretq_u16_s16(vshrq_n_s16(vqaddq_s16(vld1q_s16(xq + i), bias), 4));
+        uint8x8x3_t bytes;
+        bytes.val[0] = vmovn_u16(vi);
+        bytes.val[1] = vmovn_u16(vorrq_u16(vandq_u16(vshrq_n_u16(vi, 8), vdupq_n_u16(0x0f)), vshlq_n_u16(vq, 4)));
+        bytes.val[2] = vmovn_u16(vshrq_n_u16(vq, 4));
+        vst3_u8(out, bytes);
+        out += 24;
+    }
+    convertCS12_scalar(xi + i, xq + i, out, numSamples - i, round);
+}
+
+#endif //SDRPLAY_NEON
+
+/*******************************************************************
+ * Runtime dispatch
+ ******************************************************************/
+
+//ordered from the least to the most preferred kernel
+static const SoapySDRPlayConverter converters[] =
+{
+    {"scalar", convertCS16_scalar, convertCF32_scalar, convertCS8_scalar, convertCS12_scalar, convertCF32Corr_scalar, firCF32_scalar, butterflyCF32_scalar},
+#ifdef SDRPLAY_X86
+    {"sse2",   convertCS16_sse2,   convertCF32_sse2,   convertCS8_sse2,   convertCS12_sse2,   convertCF32Corr_sse2,   firCF32_sse2,   butterflyCF32_sse2},
+    {"avx2",   convertCS16_avx2,   convertCF32_avx2,   convertCS8_avx2,   convertCS12_avx2,   convertCF32Corr_avx2,   firCF32_avx2,   butterflyCF32_avx2},
+    //the byte packers need AVX-512BW, the AVX2 ones run on every AVX-512 CPU
+    {"avx512", convertCS16_avx512, convertCF32_avx512, convertCS8_avx2,   convertCS12_avx2,   convertCF32Corr_avx512, firCF32_avx512, butterflyCF32_avx512},
+#endif
+#ifdef SDRPLAY_NEON
+    {"neon",   convertCS16_neon,   convertCF32_neon,   convertCS8_neon,   convertCS12_neon,   convertCF32Corr_neon,   firCF32_neon,   butterflyCF32_neon},
+#endif
+};
+
+static bool cpuSupports(const std::string &name)
+{
+    if (name == "scalar" or name == "neon") return true;
+
+#if defined(SDRPLAY_X86) && defined(__GNUC__)
+    __builtin_cpu_init();
+    if (name == "sse2") return __builtin_cpu_supports("sse2");
+    if (name == "avx2") return __builtin_cpu_supports("avx2");
+    if (name == "avx512") return __builtin_cpu_supports("avx512f");
+#elif defined(SDRPLAY_X86) && defined(_MSC_VER)
+    int regs[4];
+    __cpuid(regs, 0);
+    const int maxLeaf = regs[0];
+    __cpuid(regs, 1);
+    const bool sse2 = (regs[3] & (1 << 26)) != 0;
+    const bool osxsave = (regs[2] & (1 << 27)) != 0;
+    //the OS must save the ymm/zmm state for avx2/avx512
+    const unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+    int ebx7 = 0;
+    if (maxLeaf >= 7)
+    {
+        __cpuidex(regs, 7, 0);
+        ebx7 = regs[1];
+    }
+    if (name == "sse2") return sse2;
+    if (name == "avx2") return (xcr0 & 0x6) == 0x6 and (ebx7 & (1 << 5)) != 0;
+    if (name == "avx512") return (xcr0 & 0xe6) == 0xe6 and (ebx7 & (1 << 16)) != 0;
+#endif
+
+    return false;
+}
+
+std::vector<std::string> SoapySDRPlay_listConverters(void)
+{
+    std::vector<std::string> names;
+    for (const auto &conv : converters)
+    {
+        if (cpuSupports(conv.name)) names.push_back(conv.name);
+    }
+    return names;
+}
+
+const SoapySDRPlayConverter *SoapySDRPlay_getConverter(const std::string &name)
+{
+    if (name == "auto")
+    {
+        //detect once, the last supported kernel is the preferred one
+        static const SoapySDRPlayConverter *best = SoapySDRPlay_getConverter(SoapySDRPlay_listConverters().back());
+        return best;
+    }
+
+    for (const auto &conv : converters)
+    {
+        if (name == conv.name and cpuSupports(name)) return &conv;
+    }
+    throw std::runtime_error("conversion kernel '" + name + "' is not supported on this CPU");
+}
+
+/*******************************************************************
+ * DC and IQ imbalance estimator
+ ******************************************************************/
+
+SoapySDRPlayCorrector::SoapySDRPlayCorrector(void)
+{
+    reset();
+}
+
+void SoapySDRPlayCorrector::reset(void)
+{
+    corr.dcI = corr.dcQ = 0.0f;
+    corr.gainQ = 1.0f;
+    corr.crossQ = 0.0f;
+    corr.sumI = corr.sumQ = corr.sumII = corr.sumQQ = corr.sumIQ = 0.0;
+    covII = covQQ = covIQ = 0.0;
+    fresh = true;
+}
+
+void SoapySDRPlayCorrector::update(const size_t numSamples, const double dcAlpha, const double iqAlpha, const bool iq)
+{
+    if (numSamples == 0) return;
+
+    //the first block after a reset is taken as it is
+    const double n = (double)numSamples;
+    const double aDC = fresh ? 1.0 : dcAlpha;
+    const double aIQ = fresh ? 1.0 : iqAlpha;
+    fresh = false;
+
+    //the block mean is what is left of the DC
+    const double meanI = corr.sumI / n;
+    const double meanQ = corr.sumQ / n;
+    corr.dcI += (float)(aDC * meanI);
+    corr.dcQ += (float)(aDC * meanQ);
+
+    covII += aIQ * ((corr.sumII / n - meanI * meanI) - covII);
+    covQQ += aIQ * ((corr.sumQQ / n - meanQ * meanQ) - covQQ);
+    covIQ += aIQ * ((corr.sumIQ / n - meanI * meanQ) - covIQ);
+    corr.sumI = corr.sumQ = corr.sumII = corr.sumQQ = corr.sumIQ = 0.0;
+
+    //remove the part of Q correlated with I, then match the powers
+    const double orthQQ = (covII > 0.0) ? covQQ - covIQ * covIQ / covII : 0.0;
+    if (iq and orthQQ > 1e-12)
+    {
+        const double gain = std::sqrt(covII / orthQQ);
+        corr.gainQ = (float)gain;
+        corr.crossQ = (float)(-gain * covIQ / covII);
+    }
+    else
+    {
+        corr.gainQ = 1.0f;
+        corr.crossQ = 0.0f;
+    }
+}
@@ -0,0 +1,105 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/*******************************************************************
+ * Sample conversion kernels used by rx_callback
+ ******************************************************************/
+
+//xi/xq -> interleaved CS16
+typedef void (*SoapySDRPlay_convertCS16T)(const short *xi, const short *xq, short *out, size_t numSamples);
+
+//xi/xq -> interleaved CF32 scaled by 1/32768
+typedef void (*SoapySDRPlay_convertCF32T)(const short *xi, const short *xq, float *out, size_t numSamples);
+
+//xi/xq -> interleaved CS8, (x + rounding) >> shift saturated to 8 bits,
+//rounding is half an output step when round is set
+typedef void (*SoapySDRPlay_convertCS8T)(const short *xi, const short *xq, signed char *out, size_t numSamples, unsigned int shift, bool round);
+
+//xi/xq -> packed CS12, 3 bytes per sample: I[7:0], Q[3:0]I[11:8], Q[11:4]
+typedef void (*SoapySDRPlay_convertCS12T)(const short *xi, const short *xq, unsigned char *out, size_t numSamples, bool round);
+
+//software DC and IQ imbalance correction fused into the CF32 conversion,
+//with s = 1/32768 the kernel computes
+//  I' = I*s - dcI,  Q0 = Q*s - dcQ,  Q' = gainQ*Q0 + crossQ*I'
+//and adds the sums of I', Q0 and their products for the estimator
+struct SoapySDRPlayCorrection
+{
+    float dcI, dcQ;
+    float gainQ, crossQ;
+    double sumI, sumQ, sumII, sumQQ, sumIQ;
+};
+
+typedef void (*SoapySDRPlay_convertCF32CorrT)(const short *xi, const short *xq, float *out, size_t numSamples, SoapySDRPlayCorrection &corr);
+
+//FIR dot product over planar float I/Q, xi/xq hold numTaps samples oldest first
+typedef void (*SoapySDRPlay_firCF32T)(const float *taps, const float *xi, const float *xq, size_t numTaps, float &outI, float &outQ);
+
+//radix 2 butterflies over n contiguous planar float I/Q values sharing one twiddle w:
+//  c = a + b,  d = (a - b) * w
+typedef void (*SoapySDRPlay_butterflyCF32T)(const float *ar, const float *ai, const float *br, const float *bi,
+                                            float *cr, float *ci, float *dr, float *di, float wr, float wi, size_t n);
+
+struct SoapySDRPlayConverter
+{
+    const char *name;
+    SoapySDRPlay_convertCS16T toCS16;
+    SoapySDRPlay_convertCF32T toCF32;
+    SoapySDRPlay_convertCS8T toCS8;
+    SoapySDRPlay_convertCS12T toCS12;
+    SoapySDRPlay_convertCF32CorrT toCF32Corr;
+    SoapySDRPlay_firCF32T firCF32;
+    SoapySDRPlay_butterflyCF32T butterflyCF32;
+};
+
+//block by block estimator behind SoapySDRPlayCorrection
+class SoapySDRPlayCorrector
+{
+public:
+    SoapySDRPlayCorrector(void);
+
+    //the next block starts the estimates from scratch
+    void reset(void);
+
+    //estimate from the sums of the last block, clears them,
+    //alphas are the smoothing factors per block, 0 < alpha <= 1
+    void update(const size_t numSamples, const double dcAlpha, const double iqAlpha, const bool iq);
+
+    SoapySDRPlayCorrection corr;
+
+private:
+    bool fresh;
+    double covII, covQQ, covIQ;
+};
+
+//names of the kernels this CPU can run, "scalar" first
+std::vector<std::string> SoapySDRPlay_listConverters(void);
+
+//"auto" picks the best kernel for this CPU (detected once),
+//any other name must be one of SoapySDRPlay_listConverters()
+const SoapySDRPlayConverter *SoapySDRPlay_getConverter(const std::string &name = "auto");
@@ -0,0 +1,344 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+/*******************************************************************
+ * Helper processes
+ *
+ * The mir_sdr API serves one device per process. With the device
+ * argument helper=true the module hosts the device in its own
+ * SoapySDRPlayHelper process instead, so one application can stream
+ * from several devices. Calls go over a unix socket, samples come
+ * back through a shared memory ring per stream that the helper fills
+ * with readStream() and the module reads without any syscall while
+ * samples are waiting.
+ ******************************************************************/
+
+#include <SoapySDR/Device.hpp>
+#include <SoapySDR/Types.hpp>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE           (64)
+#endif
+
+//installed helper, the helper_path device argument overrides it
+#ifndef SOAPY_SDRPLAY_HELPER_PATH
+#define SOAPY_SDRPLAY_HELPER_PATH "SoapySDRPlayHelper"
+#endif
+
+//the helper finds its end of the control socket here
+#define HELPER_CONTROL_FD         (3)
+
+#define HELPER_RING_MAGIC         (0x53445250)
+#define HELPER_RING_VERSION       (1)
+#define HELPER_NUM_SLOTS          (32)
+
+//one readStream() result of the helper
+struct SoapySDRPlayHelperSlot
+{
+    int ret;            // elements in the slot, or the readStream() error code
+    int flags;
+    long long timeNs;
+    double rate;        // times reads of part of the slot
+};
+
+//the shared memory of a stream starts with the ring, the slot payloads
+//follow at ringBytes(), head and tail count slots and only ever grow
+struct SoapySDRPlayHelperRing
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t numSlots;
+    uint32_t slotBytes;
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> head;     // published by the helper
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> tail;     // released by the module
+    alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> waiting;  // the module sleeps on the notify pipe
+    SoapySDRPlayHelperSlot slots[HELPER_NUM_SLOTS];
+
+    static size_t ringBytes(void)
+    {
+        return (sizeof(SoapySDRPlayHelperRing) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+    }
+
+    static size_t mapBytes(const size_t slotBytes)
+    {
+        return ringBytes() + HELPER_NUM_SLOTS * slotBytes;
+    }
+
+    char *slotData(const uint64_t slot)
+    {
+        return (char *)this + ringBytes() + (slot % numSlots) * slotBytes;
+    }
+};
+
+//a call or its reply on the control socket, a list of strings
+//with typed accessors, file descriptors can ride along
+class SoapySDRPlayHelperMessage
+{
+public:
+    SoapySDRPlayHelperMessage(void);
+
+    //calls always carry the direction and channel, 0 where unused
+    SoapySDRPlayHelperMessage(const std::string &method, const int direction = 0, const size_t channel = 0);
+
+    bool send(const int fd, const std::vector<int> &fds = std::vector<int>()) const;
+
+    bool recv(const int fd, std::vector<int> *fds = nullptr);
+
+    void putString(const std::string &value);
+    void putInt(const long long value);
+    void putDouble(const double value);
+    void putStrings(const std::vector<std::string> &values);
+    void putDoubles(const std::vector<double> &values);
+    void putKwargs(const SoapySDR::Kwargs &values);
+    void putRangeList(const SoapySDR::RangeList &values);
+    void putArgInfo(const SoapySDR::ArgInfo &value);
+    void putArgInfoList(const SoapySDR::ArgInfoList &values);
+
+    std::string getString(void);
+    long long getInt(void);
+    double getDouble(void);
+    std::vector<std::string> getStrings(void);
+    std::vector<double> getDoubles(void);
+    SoapySDR::Kwargs getKwargs(void);
+    SoapySDR::RangeList getRangeList(void);
+    SoapySDR::ArgInfo getArgInfo(void);
+    SoapySDR::ArgInfoList getArgInfoList(void);
+
+private:
+    std::vector<std::string> _fields;
+    size_t _pos;
+};
+
+#ifndef _WIN32
+
+//the module side of a device in a helper process
+class SoapySDRPlayHelperClient: public SoapySDR::Device
+{
+public:
+    SoapySDRPlayHelperClient(const SoapySDR::Kwargs &args);
+
+    ~SoapySDRPlayHelperClient(void);
+
+    /*******************************************************************
+     * Identification API
+     ******************************************************************/
+
+    std::string getDriverKey(void) const;
+
+    std::string getHardwareKey(void) const;
+
+    SoapySDR::Kwargs getHardwareInfo(void) const;
+
+    /*******************************************************************
+     * Channels API
+     ******************************************************************/
+
+    size_t getNumChannels(const int dir) const;
+
+    /*******************************************************************
+     * Stream API
+     ******************************************************************/
+
+    std::vector<std::string> getStreamFormats(const int direction, const size_t channel) const;
+
+    std::string getNativeStreamFormat(const int direction, const size_t channel, double &fullScale) const;
+
+    SoapySDR::ArgInfoList getStreamArgsInfo(const int direction, const size_t channel) const;
+
+    SoapySDR::Stream *setupStream(const int direction,
+                                  const std::string &format,
+                                  const std::vector<size_t> &channels = std::vector<size_t>(),
+                                  const SoapySDR::Kwargs &args = SoapySDR::Kwargs());
+
+    void closeStream(SoapySDR::Stream *stream);
+
+    size_t getStreamMTU(SoapySDR::Stream *stream) const;
+
+    int activateStream(SoapySDR::Stream *stream,
+                       const int flags = 0,
+                       const long long timeNs = 0,
+                       const size_t numElems = 0);
+
+    int deactivateStream(SoapySDR::Stream *stream, const int flags = 0, const long long timeNs = 0);
+
+    int readStream(SoapySDR::Stream *stream,
+                   void * const *buffs,
+                   const size_t numElems,
+                   int &flags,
+                   long long &timeNs,
+                   const long timeoutUs = 200000);
+
+    /*******************************************************************
+     * Direct buffer access API
+     ******************************************************************/
+
+    size_t getNumDirectAccessBuffers(SoapySDR::Stream *stream);
+
+    int getDirectAccessBufferAddrs(SoapySDR::Stream *stream, const size_t handle, void **buffs);
+
+    int acquireReadBuffer(SoapySDR::Stream *stream,
+                          size_t &handle,
+                          const void **buffs,
+                          int &flags,
+                          long long &timeNs,
+                          const long timeoutUs = 100000);
+
+    void releaseReadBuffer(SoapySDR::Stream *stream, const size_t handle);
+
+    /*******************************************************************
+     * Antenna API
+     ******************************************************************/
+
+    std::vector<std::string> listAntennas(const int direction, const size_t channel) const;
+
+    void setAntenna(const int direction, const size_t channel, const std::string &name);
+
+    std::string getAntenna(const int direction, const size_t channel) const;
+
+    /*******************************************************************
+     * Frontend corrections API
+     ******************************************************************/
+
+    bool hasDCOffsetMode(const int direction, const size_t channel) const;
+
+    void setDCOffsetMode(const int direction, const size_t channel, const bool automatic);
+
+    bool getDCOffsetMode(const int direction, const size_t channel) const;
+
+    bool hasDCOffset(const int direction, const size_t channel) const;
+
+    /*******************************************************************
+     * Gain API
+     ******************************************************************/
+
+    std::vector<std::string> listGains(const int direction, const size_t channel) const;
+
+    bool hasGainMode(const int direction, const size_t channel) const;
+
+    void setGainMode(const int direction, const size_t channel, const bool automatic);
+
+    bool getGainMode(const int direction, const size_t channel) const;
+
+    void setGain(const int direction, const size_t channel, const std::string &name, const double value);
+
+    double getGain(const int direction, const size_t channel, const std::string &name) const;
+
+    SoapySDR::Range getGainRange(const int direction, const size_t channel, const std::string &name) const;
+
+    /*******************************************************************
+     * Frequency API
+     ******************************************************************/
+
+    void setFrequency(const int direction,
+                      const size_t channel,
+                      const std::string &name,
+                      const double frequency,
+                      const SoapySDR::Kwargs &args = SoapySDR::Kwargs());
+
+    double getFrequency(const int direction, const size_t channel, const std::string &name) const;
+
+    std::vector<std::string> listFrequencies(const int direction, const size_t channel) const;
+
+    SoapySDR::RangeList getFrequencyRange(const int direction, const size_t channel, const std::string &name) const;
+
+    SoapySDR::ArgInfoList getFrequencyArgsInfo(const int direction, const size_t channel) const;
+
+    /*******************************************************************
+     * Sample Rate API
+     ******************************************************************/
+
+    void setSampleRate(const int direction, const size_t channel, const double rate);
+
+    double getSampleRate(const int direction, const size_t channel) const;
+
+    std::vector<double> listSampleRates(const int direction, const size_t channel) const;
+
+    SoapySDR::RangeList getSampleRateRange(const int direction, const size_t channel) const;
+
+    /*******************************************************************
+     * Bandwidth API
+     ******************************************************************/
+
+    void setBandwidth(const int direction, const size_t channel, const double bw);
+
+    double getBandwidth(const int direction, const size_t channel) const;
+
+    std::vector<double> listBandwidths(const int direction, const size_t channel) const;
+
+    SoapySDR::RangeList getBandwidthRange(const int direction, const size_t channel) const;
+
+    /*******************************************************************
+     * Sensor API
+     ******************************************************************/
+
+    std::vector<std::string> listSensors(void) const;
+
+    SoapySDR::ArgInfo getSensorInfo(const std::string &key) const;
+
+    std::string readSensor(const std::string &key) const;
+
+    /*******************************************************************
+     * Settings API
+     ******************************************************************/
+
+    SoapySDR::ArgInfoList getSettingInfo(void) const;
+
+    void writeSetting(const std::string &key, const std::string &value);
+
+    std::string readSetting(const std::string &key) const;
+
+private:
+
+    //a stream of the helper and its mapped ring,
+    //readOffset counts the elements already read from the tail slot
+    struct HelperStream
+    {
+        long long id;
+        SoapySDRPlayHelperRing *ring;
+        size_t mapBytes;
+        int notifyFd;
+        size_t mtu;
+        size_t bytesPerElem;
+        size_t readOffset;
+    };
+
+    SoapySDRPlayHelperMessage call(const SoapySDRPlayHelperMessage &request, std::vector<int> *fds = nullptr) const;
+
+    //0 once a slot is published, SOAPY_SDR_TIMEOUT, or
+    //SOAPY_SDR_STREAM_ERROR when the helper hung up on an empty ring
+    int waitSlot(HelperStream &stream, const long timeoutUs);
+
+    std::string serNo;
+    int _pid;
+    int _controlFd;
+    mutable std::mutex _controlMutex;
+};
+
+#endif //_WIN32
@@ -0,0 +1,634 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "Helper.hpp"
+#include "SoapySDRPlay.hpp"
+
+#ifndef _WIN32
+
+#include <SoapySDR/Logger.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+SoapySDRPlayHelperClient::SoapySDRPlayHelperClient(const SoapySDR::Kwargs &args)
+{
+    if (args.count("serial") == 0) throw std::runtime_error("no sdrplay device found");
+    serNo = args.at("serial");
+
+    std::string path = SOAPY_SDRPLAY_HELPER_PATH;
+    if (args.count("helper_path") != 0) path = args.at("helper_path");
+
+    //the helper gets its end of the socket as HELPER_CONTROL_FD,
+    //any other descriptor of ours is closed on exec
+    int sv[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0)
+    {
+        throw std::runtime_error("SoapySDRPlayHelper socketpair failed: " + std::string(std::strerror(errno)));
+    }
+    ::fcntl(sv[0], F_SETFD, FD_CLOEXEC);
+    const int childFd = ::fcntl(sv[1], F_DUPFD, HELPER_CONTROL_FD + 1);
+    ::close(sv[1]);
+    ::fcntl(childFd, F_SETFD, FD_CLOEXEC);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, childFd, HELPER_CONTROL_FD);
+    char *argv[] = {&path[0], nullptr};
+    pid_t pid = 0;
+    const int err = posix_spawnp(&pid, path.c_str(), &actions, nullptr, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    ::close(childFd);
+    if (err != 0)
+    {
+        ::close(sv[0]);
+        throw std::runtime_error("SoapySDRPlayHelper " + path + " failed to start: " + std::strerror(err));
+    }
+    _pid = pid;
+    _controlFd = sv[0];
+
+    //the helper opens the device with the remaining arguments
+    SoapySDR::Kwargs deviceArgs(args);
+    deviceArgs.erase("helper");
+    deviceArgs.erase("helper_path");
+    SoapySDRPlayHelperMessage request("open");
+    request.putKwargs(deviceArgs);
+    try
+    {
+        this->call(request);
+    }
+    catch (const std::exception &)
+    {
+        ::close(_controlFd);
+        ::waitpid(_pid, nullptr, 0);
+        throw;
+    }
+
+    SoapySDR_logf(SOAPY_SDR_INFO, "Device %s in helper process %d", serNo.c_str(), _pid);
+    SoapySDRPlay_claimSerial(serNo);
+}
+
+SoapySDRPlayHelperClient::~SoapySDRPlayHelperClient(void)
+{
+    //the helper closes the device when the socket goes
+    ::close(_controlFd);
+    ::waitpid(_pid, nullptr, 0);
+    SoapySDRPlay_releaseSerial(serNo);
+}
+
+SoapySDRPlayHelperMessage SoapySDRPlayHelperClient::call(const SoapySDRPlayHelperMessage &request, std::vector<int> *fds) const
+{
+    std::lock_guard <std::mutex> lock(_controlMutex);
+
+    SoapySDRPlayHelperMessage reply;
+    if (not request.send(_controlFd) or not reply.recv(_controlFd, fds))
+    {
+        throw std::runtime_error("SoapySDRPlayHelper process " + std::to_string(_pid) + " is gone");
+    }
+    const std::string status = reply.getString();
+    if (status != "ok")
+    {
+        if (fds != nullptr) for (const int fd : *fds) ::close(fd);
+        throw std::runtime_error(reply.getString());
+    }
+    return reply;
+}
+
+/*******************************************************************
+ * Identification API
+ ******************************************************************/
+
+std::string SoapySDRPlayHelperClient::getDriverKey(void) const
+{
+    return "SDRplay";
+}
+
+std::string SoapySDRPlayHelperClient::getHardwareKey(void) const
+{
+    return this->call(SoapySDRPlayHelperMessage("getHardwareKey")).getString();
+}
+
+SoapySDR::Kwargs SoapySDRPlayHelperClient::getHardwareInfo(void) const
+{
+    SoapySDR::Kwargs hwArgs = this->call(SoapySDRPlayHelperMessage("getHardwareInfo")).getKwargs();
+    hwArgs["helper_pid"] = std::to_string(_pid);
+    return hwArgs;
+}
+
+/*******************************************************************
+ * Channels API
+ ******************************************************************/
+
+size_t SoapySDRPlayHelperClient::getNumChannels(const int dir) const
+{
+    return this->call(SoapySDRPlayHelperMessage("getNumChannels", dir)).getInt();
+}
+
+/*******************************************************************
+ * Stream API
+ ******************************************************************/
+
+std::vector<std::string> SoapySDRPlayHelperClient::getStreamFormats(const int direction, const size_t channel) const
+{
+    return this->call(SoapySDRPlayHelperMessage("getStreamFormats", direction, channel)).getStrings();
+}
+
+std::string SoapySDRPlayHelperClient::getNativeStreamFormat(const int direction, const size_t channel, double &fullScale) const
+{
+    SoapySDRPlayHelperMessage reply = this->call(SoapySDRPlayHelperMessage("getNativeStreamFormat", direction, channel));
+    const std::string format = reply.getString();
+    fullScale = reply.getDouble();
+    return format;
+}
+
+SoapySDR::ArgInfoList SoapySDRPlayHelperClient::getStreamArgsInfo(const int direction, const size_t channel) const
+{
+    return this->call(SoapySDRPlayHelperMessage("getStreamArgsInfo", direction, channel)).getArgInfoList();
+}
+
+SoapySDR::Stream *SoapySDRPlayHelperClient::setupStream(const int direction,
+                                                         const std::string &format,
+                                                         const std::vector<size_t> &channels,
+                                                         const SoapySDR::Kwargs &args)
+{
+    SoapySDRPlayHelperMessage request("setupStream", direction);
+    request.putString(format);
+    request.putInt(channels.size());
+    for (const size_t channel : channels) request.putInt(channel);
+    request.putKwargs(args);
+
+    //the reply brings the shared memory and the read end of the notify pipe
+    std::vector<int> fds;
+    SoapySDRPlayHelperMessage reply = this->call(request, &fds);
+    std::unique_ptr<HelperStream> stream(new HelperStream());
+    stream->id = reply.getInt();
+    stream->mtu = reply.getInt();
+    stream->bytesPerElem = reply.getInt();
+    stream->mapBytes = reply.getInt();
+    stream->readOffset = 0;
+    if (fds.size() != 2)
+    {
+        for (const int fd : fds) ::close(fd);
+        throw std::runtime_error("SoapySDRPlayHelper setupStream: no stream memory");
+    }
+    void *mem = ::mmap(nullptr, stream->mapBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+    ::close(fds[0]);
+    stream->notifyFd = fds[1];
+    ::fcntl(stream->notifyFd, F_SETFD, FD_CLOEXEC);
+    stream->ring = (SoapySDRPlayHelperRing *)mem;
+    if (mem == MAP_FAILED or stream->ring->magic != HELPER_RING_MAGIC or stream->ring->version != HELPER_RING_VERSION)
+    {
+        if (mem != MAP_FAILED) ::munmap(mem, stream->mapBytes);
+        ::close(stream->notifyFd);
+        SoapySDRPlayHelperMessage close("closeStream");
+        close.putInt(stream->id);
+        this->call(close);
+        throw std::runtime_error("SoapySDRPlayHelper setupStream: stream memory mismatch");
+    }
+
+    return (SoapySDR::Stream *)stream.release();
+}
+
+void SoapySDRPlayHelperClient::closeStream(SoapySDR::Stream *stream)
+{
+    HelperStream *helperStream = (HelperStream *)stream;
+    SoapySDRPlayHelperMessage request("closeStream");
+    request.putInt(helperStream->id);
+    try
+    {
+        this->call(request);
+    }
+    catch (const std::exception &ex)
+    {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "closeStream: %s", ex.what());
+    }
+    ::munmap(helperStream->ring, helperStream->mapBytes);
+    ::close(helperStream->notifyFd);
+    delete helperStream;
+}
+
+size_t SoapySDRPlayHelperClient::getStreamMTU(SoapySDR::Stream *stream) const
+{
+    return ((HelperStream *)stream)->mtu;
+}
+
+int SoapySDRPlayHelperClient::activateStream(SoapySDR::Stream *stream,
+                                             const int flags,
+                                             const long long timeNs,
+                                             const size_t numElems)
+{
+    //the helper drops the slots of an earlier activation
+    HelperStream *helperStream = (HelperStream *)stream;
+    helperStream->readOffset = 0;
+    SoapySDRPlayHelperMessage request("activateStream");
+    request.putInt(helperStream->id);
+    request.putInt(flags);
+    request.putInt(timeNs);
+    request.putInt(numElems);
+    return this->call(request).getInt();
+}
+
+int SoapySDRPlayHelperClient::deactivateStream(SoapySDR::Stream *stream, const int flags, const long long timeNs)
+{
+    SoapySDRPlayHelperMessage request("deactivateStream");
+    request.putInt(((HelperStream *)stream)->id);
+    request.putInt(flags);
+    request.putInt(timeNs);
+    return this->call(request).getInt();
+}
+
+int SoapySDRPlayHelperClient::waitSlot(HelperStream &stream, const long timeoutUs)
+{
+    SoapySDRPlayHelperRing &ring = *stream.ring;
+    const uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+    if (ring.head.load(std::memory_order_acquire) != tail) return 0;
+
+    //the helper writes to the pipe when it publishes and sees waiting set,
+    //both sides store then load so one of them sees the other
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(timeoutUs);
+    while (true)
+    {
+        ring.waiting.store(1);
+        if (ring.head.load() != tail) return 0;
+
+        const long long remainUs = std::chrono::duration_cast<std::chrono::microseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+        if (remainUs <= 0) return SOAPY_SDR_TIMEOUT;
+        struct pollfd pfd;
+        pfd.fd = stream.notifyFd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        const int ret = ::poll(&pfd, 1, (int)((remainUs + 999) / 1000));
+        if (ret > 0)
+        {
+            char drain[64];
+            while (::read(stream.notifyFd, drain, sizeof(drain)) > 0);
+            //nothing more comes from a helper that is gone
+            if ((pfd.revents & POLLHUP) != 0 and ring.head.load() == tail) return SOAPY_SDR_STREAM_ERROR;
+        }
+    }
+}
+
+int SoapySDRPlayHelperClient::readStream(SoapySDR::Stream *stream,
+                                         void * const *buffs,
+                                         const size_t numElems,
+                                         int &flags,
+                                         long long &timeNs,
+                                         const long timeoutUs)
+{
+    HelperStream &helperStream = *(HelperStream *)stream;
+    SoapySDRPlayHelperRing &ring = *helperStream.ring;
+    const int waitRet = this->waitSlot(helperStream, timeoutUs);
+    if (waitRet != 0) return waitRet;
+
+    //errors from the helper take a slot of their own
+    const uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+    const SoapySDRPlayHelperSlot &slot = ring.slots[tail % ring.numSlots];
+    flags = slot.flags;
+    timeNs = slot.timeNs;
+    if (slot.ret <= 0)
+    {
+        helperStream.readOffset = 0;
+        ring.tail.store(tail + 1, std::memory_order_release);
+        return slot.ret;
+    }
+
+    const size_t offset = helperStream.readOffset;
+    const size_t numRead = std::min(numElems, (size_t)slot.ret - offset);
+    std::memcpy(buffs[0], ring.slotData(tail) + offset * helperStream.bytesPerElem, numRead * helperStream.bytesPerElem);
+    if (offset > 0 and slot.rate > 0.0)
+    {
+        timeNs += std::llround(offset * 1e9 / slot.rate);
+    }
+
+    if (offset + numRead < (size_t)slot.ret)
+    {
+        helperStream.readOffset = offset + numRead;
+        flags |= SOAPY_SDR_MORE_FRAGMENTS;
+    }
+    else
+    {
+        helperStream.readOffset = 0;
+        ring.tail.store(tail + 1, std::memory_order_release);
+    }
+    return numRead;
+}
+
+/*******************************************************************
+ * Direct buffer access API
+ ******************************************************************/
+
+// the slots of the ring, released in order
+size_t SoapySDRPlayHelperClient::getNumDirectAccessBuffers(SoapySDR::Stream *stream)
+{
+    return ((HelperStream *)stream)->ring->numSlots;
+}
+
+int SoapySDRPlayHelperClient::getDirectAccessBufferAddrs(SoapySDR::Stream *stream, const size_t handle, void **buffs)
+{
+    buffs[0] = ((HelperStream *)stream)->ring->slotData(handle);
+    return 0;
+}
+
+int SoapySDRPlayHelperClient::acquireReadBuffer(SoapySDR::Stream *stream,
+                                                size_t &handle,
+                                                const void **buffs,
+                                                int &flags,
+                                                long long &timeNs,
+                                                const long timeoutUs)
+{
+    HelperStream &helperStream = *(HelperStream *)stream;
+    SoapySDRPlayHelperRing &ring = *helperStream.ring;
+    const int waitRet = this->waitSlot(helperStream, timeoutUs);
+    if (waitRet != 0) return waitRet;
+
+    const uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+    const SoapySDRPlayHelperSlot &slot = ring.slots[tail % ring.numSlots];
+    flags = slot.flags;
+    timeNs = slot.timeNs;
+    helperStream.readOffset = 0;
+    if (slot.ret <= 0)
+    {
+        ring.tail.store(tail + 1, std::memory_order_release);
+        return slot.ret;
+    }
+    handle = tail % ring.numSlots;
+    buffs[0] = ring.slotData(tail);
+    return slot.ret;
+}
+
+void SoapySDRPlayHelperClient::releaseReadBuffer(SoapySDR::Stream *stream, const size_t handle)
+{
+    SoapySDRPlayHelperRing &ring = *((HelperStream *)stream)->ring;
+    ring.tail.fetch_add(1, std::memory_order_release);
+}
+
+/*******************************************************************
+ * Antenna API
+ ******************************************************************/
+
+std::vector<std::string> SoapySDRPlayHelperClient::listAntennas(const int direction, const size_t channel) const
+{
+    return this->call(SoapySDRPlayHelperMessage("listAntennas", direction, channel)).getStrings();
+}
+
+void SoapySDRPlayHelperClient::setAntenna(const int direction, const size_t channel, const std::string &name)
+{
+    SoapySDRPlayHelperMessage request("setAntenna", direction, channel);
+    request.putString(name);
+    this->call(request);
+}
+
+std::string SoapySDRPlayHelperClient::getAntenna(const int direction, const size_t channel) const
+{
+    return this->call(SoapySDRPlayHelperMessage("getAntenna", direction, channel)).getString();
+}
+
+/*******************************************************************
+ * Frontend corrections API
+ ******************************************************************/
+
+bool SoapySDRPlayHelperClient::hasDCOffsetMode(const int direction, const size_t channel) const
+{
+    return this->call(SoapySDRPlayHelperMessage("hasDCOffsetMode", direction, channel)).getInt() != 0;
+}
+
+void SoapySDRPlayHelperClient::setDCOffsetMode(const int direction, const size_t channel, const bool automatic)
+{
+    SoapySDRPlayHelperMessage request("setDCOffsetMode", direction, channel);
+    request.putInt(automatic);
+    this->call(request);
+}
+
+bool SoapySDRPlayHelperClient::getDCOffsetMode(const int direction, const size_t channel) const
+{
+    return this->call(SoapySDRPlayHelperMessage("getDCOffsetMode", direction, channel)).getInt() != 0;
+}
+
+bool SoapySDRPlayHelperClient::hasDCOffset(const int direction, const size_t channel) const
+{
+    return this->call(SoapySDRPlayHelperMessage("hasDCOffset", direction, channel)).getInt() != 0;
+}
+
+/*******************************************************************
+ * Gain API
+ ******************************************************************/
+
+std::vector<std::string> SoapySDRPlayHelperClient::listGains(const int direction, const size_t channel) const
+{
+    return this->call(SoapySDRPlayHelperMessage("listGains", direction, channel)).getStrings();
+}
+
+bool SoapySDRPlayHelperClient::hasGainMode(const int direction, const size_t channel) const
+{
+    return this->call(SoapySDRPlayHelperMessage("hasGainMode", direction, channel)).getInt() != 0;
+}
+
+void SoapySDRPlayHelperClient::setGainMode(const int direction, const size_t channel, const bool automatic)
+{
+    SoapySDRPlayHelperMessage request("setGainMode", direction, channel);
+    request.putInt(automatic);
+    this->call(request);
+}
+
+bool SoapySDRPlayHelperClient::getGainMode(const int direction, const size_t channel) const
+{
+    return this->call(SoapySDRPlayHelperMessage("getGainMode", direction, channel)).getInt() != 0;
+}
+
+void SoapySDRPlayHelperClient::setGain(const int direction, const size_t channel, const std::string &name, const double value)
+{
+    SoapySDRPlayHelperMessage request("setGain", direction, channel);
+    request.putString(name);
+    request.putDouble(value);
+    this->call(request);
+}
+
+double SoapySDRPlayHelperClient::getGain(const int direction, const size_t channel, const std::string &name) const
+{
+    SoapySDRPlayHelperMessage request("getGain", direction, channel);
+    request.putString(name);
+    return this->call(request).getDouble();
+}
+
+SoapySDR::Range SoapySDRPlayHelperClient::getGainRange(const int direction, const size_t channel, const std::string &name) const
+{
+    SoapySDRPlayHelperMessage request("getGainRange", direction, channel);
+    request.putString(name);
+    const SoapySDR::RangeList range = this->call(request).getRangeList();
+    return range.empty() ? SoapySDR::Range() : range.front();
+}
+
+/*******************************************************************
+ * Frequency API
+ ******************************************************************/
+
+void SoapySDRPlayHelperClient::setFrequency(const int direction,
+                                            const size_t channel,
+                                            const std::string &name,
+                                            const double frequency,
+                                            const SoapySDR::Kwargs &args)
+{
+    SoapySDRPlayHelperMessage request("setFrequency", direction, channel);
+    request.putString(name);
+    request.putDouble(frequency);
+    request.putKwargs(args);
+    this->call(request);
+}
+
+double SoapySDRPlayHelperClient::getFrequency(const int direction, const size_t channel, const std::string &name) const
+{
+    SoapySDRPlayHelperMessage request("getFrequency", direction, channel);
+    request.putString(name);
+    return this->call(request).getDouble();
+}
+
+std::vector<std::string> SoapySDRPlayHelperClient::listFrequencies(const int direction, const size_t channel) const
+{
+    return this->call(SoapySDRPlayHelperMessage("listFrequencies", direction, channel)).getStrings();
+}
+
+SoapySDR::RangeList SoapySDRPlayHelperClient::getFrequencyRange(const int direction, const size_t channel, const std::string &name) const
+{
+    SoapySDRPlayHelperMessage request("getFrequencyRange", direction, channel);
+    request.putString(name);
+    return this->call(request).getRangeList();
+}
+
+SoapySDR::ArgInfoList SoapySDRPlayHelperClient::getFrequencyArgsInfo(const int direction, const size_t channel) const
+{
+    return this->call(SoapySDRPlayHelperMessage("getFrequencyArgsInfo", direction, channel)).getArgInfoList();
+}
+
+/*******************************************************************
+ * Sample Rate API
+ ******************************************************************/
+
+void SoapySDRPlayHelperClient::setSampleRate(const int direction, const size_t channel, const double rate)
+{
+    SoapySDRPlayHelperMessage request("setSampleRate", direction, channel);
+    request.putDouble(rate);
+    this->call(request);
+}
+
+double SoapySDRPlayHelperClient::getSampleRate(const int direction, const size_t channel) const
+{
+    return this->call(SoapySDRPlayHelperMessage("getSampleRate", direction, channel)).getDouble();
+}
+
+std::vector<double> SoapySDRPlayHelperClient::listSampleRates(const int direction, const size_t channel) const
+{
+    return this->call(SoapySDRPlayHelperMessage("listSampleRates", direction, channel)).getDoubles();
+}
+
+SoapySDR::RangeList SoapySDRPlayHelperClient::getSampleRateRange(const int direction, const size_t channel) const
+{
+    return this->call(SoapySDRPlayHelperMessage("getSampleRateRange", direction, channel)).getRangeList();
+}
+
+/*******************************************************************
+ * Bandwidth API
+ ******************************************************************/
+
+void SoapySDRPlayHelperClient::setBandwidth(const int direction, const size_t channel, const double bw)
+{
+    SoapySDRPlayHelperMessage request("setBandwidth", direction, channel);
+    request.putDouble(bw);
+    this->call(request);
+}
+
+double SoapySDRPlayHelperClient::getBandwidth(const int direction, const size_t channel) const
+{
+    return this->call(SoapySDRPlayHelperMessage("getBandwidth", direction, channel)).getDouble();
+}
+
+std::vector<double> SoapySDRPlayHelperClient::listBandwidths(const int direction, const size_t channel) const
+{
+    return this->call(SoapySDRPlayHelperMessage("listBandwidths", direction, channel)).getDoubles();
+}
+
+SoapySDR::RangeList SoapySDRPlayHelperClient::getBandwidthRange(const int direction, const size_t channel) const
+{
+    return this->call(SoapySDRPlayHelperMessage("getBandwidthRange", direction, channel)).getRangeList();
+}
+
+/*******************************************************************
+ * Sensor API
+ ******************************************************************/
+
+std::vector<std::string> SoapySDRPlayHelperClient::listSensors(void) const
+{
+    return this->call(SoapySDRPlayHelperMessage("listSensors")).getStrings();
+}
+
+SoapySDR::ArgInfo SoapySDRPlayHelperClient::getSensorInfo(const std::string &key) const
+{
+    SoapySDRPlayHelperMessage request("getSensorInfo");
+    request.putString(key);
+    return this->call(request).getArgInfo();
+}
+
+std::string SoapySDRPlayHelperClient::readSensor(const std::string &key) const
+{
+    SoapySDRPlayHelperMessage request("readSensor");
+    request.putString(key);
+    return this->call(request).getString();
+}
+
+/*******************************************************************
+ * Settings API
+ ******************************************************************/
+
+SoapySDR::ArgInfoList SoapySDRPlayHelperClient::getSettingInfo(void) const
+{
+    return this->call(SoapySDRPlayHelperMessage("getSettingInfo")).getArgInfoList();
+}
+
+void SoapySDRPlayHelperClient::writeSetting(const std::string &key, const std::string &value)
+{
+    SoapySDRPlayHelperMessage request("writeSetting");
+    request.putString(key);
+    request.putString(value);
+    this->call(request);
+}
+
+std::string SoapySDRPlayHelperClient::readSetting(const std::string &key) const
+{
+    SoapySDRPlayHelperMessage request("readSetting");
+    request.putString(key);
+    return this->call(request).getString();
+}
+
+#endif //_WIN32
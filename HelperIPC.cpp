@@ -0,0 +1,332 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "Helper.hpp"
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+//a dropped helper must not take the application down with SIGPIPE
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+//more descriptors than a stream needs are an error
+#define HELPER_MAX_FDS (4)
+
+/*******************************************************************
+ * Framing, a field count then each field as length and bytes
+ ******************************************************************/
+
+#ifndef _WIN32
+
+static bool writeAll(const int fd, const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        const ssize_t ret = ::send(fd, data, size, MSG_NOSIGNAL);
+        if (ret < 0 and errno == EINTR) continue;
+        if (ret <= 0) return false;
+        data += ret;
+        size -= ret;
+    }
+    return true;
+}
+
+static bool readAll(const int fd, char *data, size_t size)
+{
+    while (size > 0)
+    {
+        const ssize_t ret = ::recv(fd, data, size, 0);
+        if (ret < 0 and errno == EINTR) continue;
+        if (ret <= 0) return false;
+        data += ret;
+        size -= ret;
+    }
+    return true;
+}
+
+#endif
+
+SoapySDRPlayHelperMessage::SoapySDRPlayHelperMessage(void):
+    _pos(0)
+{
+    return;
+}
+
+SoapySDRPlayHelperMessage::SoapySDRPlayHelperMessage(const std::string &method, const int direction, const size_t channel):
+    _pos(0)
+{
+    this->putString(method);
+    this->putInt(direction);
+    this->putInt(channel);
+}
+
+bool SoapySDRPlayHelperMessage::send(const int fd, const std::vector<int> &fds) const
+{
+#ifdef _WIN32
+    return false;
+#else
+    std::string data(sizeof(uint32_t), '\0');
+    const uint32_t numFields = _fields.size();
+    std::memcpy(&data[0], &numFields, sizeof(numFields));
+    for (const auto &field : _fields)
+    {
+        const uint32_t size = field.size();
+        data.append((const char *)&size, sizeof(size));
+        data.append(field);
+    }
+
+    //descriptors go with the first byte
+    size_t sent = 0;
+    if (not fds.empty())
+    {
+        char control[CMSG_SPACE(HELPER_MAX_FDS * sizeof(int))];
+        std::memset(control, 0, sizeof(control));
+        struct iovec iov;
+        iov.iov_base = &data[0];
+        iov.iov_len = 1;
+        struct msghdr msg;
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(fds.size() * sizeof(int));
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(fds.size() * sizeof(int));
+        std::memcpy(CMSG_DATA(cmsg), fds.data(), fds.size() * sizeof(int));
+        ssize_t ret;
+        do ret = ::sendmsg(fd, &msg, MSG_NOSIGNAL); while (ret < 0 and errno == EINTR);
+        if (ret != 1) return false;
+        sent = 1;
+    }
+    return writeAll(fd, data.data() + sent, data.size() - sent);
+#endif
+}
+
+bool SoapySDRPlayHelperMessage::recv(const int fd, std::vector<int> *fds)
+{
+#ifdef _WIN32
+    return false;
+#else
+    _fields.clear();
+    _pos = 0;
+
+    //the first byte may carry descriptors
+    uint32_t numFields = 0;
+    char control[CMSG_SPACE(HELPER_MAX_FDS * sizeof(int))];
+    struct iovec iov;
+    iov.iov_base = &numFields;
+    iov.iov_len = 1;
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t ret;
+    do ret = ::recvmsg(fd, &msg, 0); while (ret < 0 and errno == EINTR);
+    if (ret != 1) return false;
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if (cmsg->cmsg_level != SOL_SOCKET or cmsg->cmsg_type != SCM_RIGHTS) continue;
+        const size_t num = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < num; i++)
+        {
+            int received;
+            std::memcpy(&received, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+            if (fds != nullptr) fds->push_back(received);
+            else ::close(received);
+        }
+    }
+    if (not readAll(fd, (char *)&numFields + 1, sizeof(numFields) - 1)) return false;
+
+    _fields.resize(numFields);
+    for (auto &field : _fields)
+    {
+        uint32_t size = 0;
+        if (not readAll(fd, (char *)&size, sizeof(size))) return false;
+        field.resize(size);
+        if (size > 0 and not readAll(fd, &field[0], size)) return false;
+    }
+    return true;
+#endif
+}
+
+/*******************************************************************
+ * Typed fields
+ ******************************************************************/
+
+void SoapySDRPlayHelperMessage::putString(const std::string &value)
+{
+    _fields.push_back(value);
+}
+
+void SoapySDRPlayHelperMessage::putInt(const long long value)
+{
+    _fields.push_back(std::to_string(value));
+}
+
+void SoapySDRPlayHelperMessage::putDouble(const double value)
+{
+    //round trips exactly
+    char buff[32];
+    std::snprintf(buff, sizeof(buff), "%.17g", value);
+    _fields.push_back(buff);
+}
+
+void SoapySDRPlayHelperMessage::putStrings(const std::vector<std::string> &values)
+{
+    this->putInt(values.size());
+    for (const auto &value : values) this->putString(value);
+}
+
+void SoapySDRPlayHelperMessage::putDoubles(const std::vector<double> &values)
+{
+    this->putInt(values.size());
+    for (const auto &value : values) this->putDouble(value);
+}
+
+void SoapySDRPlayHelperMessage::putKwargs(const SoapySDR::Kwargs &values)
+{
+    this->putInt(values.size());
+    for (const auto &value : values)
+    {
+        this->putString(value.first);
+        this->putString(value.second);
+    }
+}
+
+void SoapySDRPlayHelperMessage::putRangeList(const SoapySDR::RangeList &values)
+{
+    this->putInt(values.size());
+    for (const auto &value : values)
+    {
+        this->putDouble(value.minimum());
+        this->putDouble(value.maximum());
+    }
+}
+
+void SoapySDRPlayHelperMessage::putArgInfo(const SoapySDR::ArgInfo &value)
+{
+    this->putString(value.key);
+    this->putString(value.value);
+    this->putString(value.name);
+    this->putString(value.description);
+    this->putString(value.units);
+    this->putInt(value.type);
+    this->putRangeList(SoapySDR::RangeList(1, value.range));
+    this->putStrings(value.options);
+    this->putStrings(value.optionNames);
+}
+
+void SoapySDRPlayHelperMessage::putArgInfoList(const SoapySDR::ArgInfoList &values)
+{
+    this->putInt(values.size());
+    for (const auto &value : values) this->putArgInfo(value);
+}
+
+std::string SoapySDRPlayHelperMessage::getString(void)
+{
+    if (_pos >= _fields.size()) throw std::runtime_error("SoapySDRPlayHelper: truncated message");
+    return _fields[_pos++];
+}
+
+long long SoapySDRPlayHelperMessage::getInt(void)
+{
+    return std::stoll(this->getString());
+}
+
+double SoapySDRPlayHelperMessage::getDouble(void)
+{
+    return std::stod(this->getString());
+}
+
+std::vector<std::string> SoapySDRPlayHelperMessage::getStrings(void)
+{
+    std::vector<std::string> values(this->getInt());
+    for (auto &value : values) value = this->getString();
+    return values;
+}
+
+std::vector<double> SoapySDRPlayHelperMessage::getDoubles(void)
+{
+    std::vector<double> values(this->getInt());
+    for (auto &value : values) value = this->getDouble();
+    return values;
+}
+
+SoapySDR::Kwargs SoapySDRPlayHelperMessage::getKwargs(void)
+{
+    SoapySDR::Kwargs values;
+    for (long long i = this->getInt(); i > 0; i--)
+    {
+        const std::string key = this->getString();
+        values[key] = this->getString();
+    }
+    return values;
+}
+
+SoapySDR::RangeList SoapySDRPlayHelperMessage::getRangeList(void)
+{
+    SoapySDR::RangeList values;
+    for (long long i = this->getInt(); i > 0; i--)
+    {
+        const double minimum = this->getDouble();
+        values.push_back(SoapySDR::Range(minimum, this->getDouble()));
+    }
+    return values;
+}
+
+SoapySDR::ArgInfo SoapySDRPlayHelperMessage::getArgInfo(void)
+{
+    SoapySDR::ArgInfo value;
+    value.key = this->getString();
+    value.value = this->getString();
+    value.name = this->getString();
+    value.description = this->getString();
+    value.units = this->getString();
+    value.type = (SoapySDR::ArgInfo::Type)this->getInt();
+    const SoapySDR::RangeList range = this->getRangeList();
+    if (not range.empty()) value.range = range.front();
+    value.options = this->getStrings();
+    value.optionNames = this->getStrings();
+    return value;
+}
+
+SoapySDR::ArgInfoList SoapySDRPlayHelperMessage::getArgInfoList(void)
+{
+    SoapySDR::ArgInfoList values(this->getInt());
+    for (auto &value : values) value = this->getArgInfo();
+    return values;
+}
@@ -0,0 +1,535 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "Recorder.hpp"
+#include <SoapySDR/Logger.h>
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+//bytes of one ci16_le sample
+#define RECORD_SAMPLE_BYTES       (2 * sizeof(short))
+
+/*******************************************************************
+ * File helpers
+ ******************************************************************/
+
+static int openData(const std::string &path, bool &direct)
+{
+#ifdef _WIN32
+    direct = false;
+    return _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    //bypass the page cache where the file system supports it, tmpfs does not
+#ifdef O_DIRECT
+    const int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+    if (fd >= 0 or errno != EINVAL)
+    {
+        direct = (fd >= 0);
+        return fd;
+    }
+#endif
+    direct = false;
+    return open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+}
+
+static long writeData(const int fd, const char *data, const size_t bytes)
+{
+#ifdef _WIN32
+    return _write(fd, data, (unsigned int)bytes);
+#else
+    return (long)write(fd, data, bytes);
+#endif
+}
+
+static void closeData(const int fd)
+{
+#ifdef _WIN32
+    _close(fd);
+#else
+    close(fd);
+#endif
+}
+
+//back to buffered writes, for the unaligned end of the file
+static void clearDirect(const int fd)
+{
+#if defined(O_DIRECT) && !defined(_WIN32)
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+#endif
+}
+
+//ISO 8601 UTC for core:datetime
+static std::string isoTime(const long long timeNs)
+{
+    const time_t secs = (time_t)(timeNs / 1000000000LL);
+    struct tm utc;
+#ifdef _WIN32
+    gmtime_s(&utc, &secs);
+#else
+    gmtime_r(&secs, &utc);
+#endif
+    char buff[64];
+    std::snprintf(buff, sizeof(buff), "%04d-%02d-%02dT%02d:%02d:%02d.%09lldZ",
+                  utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday, utc.tm_hour, utc.tm_min, utc.tm_sec,
+                  timeNs % 1000000000LL);
+    return buff;
+}
+
+static std::string jsonString(const std::string &value)
+{
+    std::string out = "\"";
+    for (const char c : value)
+    {
+        if (c == '"' or c == '\\') out += '\\';
+        out += c;
+    }
+    return out + "\"";
+}
+
+/*******************************************************************
+ * Recording control
+ ******************************************************************/
+
+SoapySDRPlayRecorder::SoapySDRPlayRecorder(void):
+    _fd(-1),
+    _direct(false),
+    _published(0),
+    _done(0),
+    _active(false),
+    _pushing(false),
+    _stop(false),
+    _finalBytes(0),
+    _fill(0),
+    _started(false),
+    _samples(0),
+    _countNext(0),
+    _rate(0.0),
+    _frequency(0.0),
+    _gRdB(0),
+    _dropRun(0),
+    _eventsPublished(0),
+    _eventsDone(0),
+    _bytesWritten(0),
+    _droppedSamples(0),
+    _droppedWrites(0),
+    _droppedEvents(0)
+{
+    return;
+}
+
+SoapySDRPlayRecorder::~SoapySDRPlayRecorder(void)
+{
+    this->stop();
+}
+
+void SoapySDRPlayRecorder::start(const std::string &path, const std::string &hw)
+{
+    this->stop();
+
+    std::string base = path;
+    for (const std::string suffix : {".sigmf-data", ".sigmf-meta"})
+    {
+        if (base.size() > suffix.size() and base.compare(base.size() - suffix.size(), suffix.size(), suffix) == 0)
+        {
+            base.erase(base.size() - suffix.size());
+        }
+    }
+    const std::string dataPath = base + ".sigmf-data";
+    _fd = openData(dataPath, _direct);
+    if (_fd < 0)
+    {
+        throw std::runtime_error("record: can't create " + dataPath + ": " + std::strerror(errno));
+    }
+
+    //the ring is kept for the next recording, page aligned for O_DIRECT
+    if (_arena.numSlots() == 0)
+    {
+        _arena.allocate(RECORD_NUM_BLOCKS, RECORD_BLOCK_BYTES, false, false);
+        _events.resize(RECORD_NUM_EVENTS);
+    }
+
+    _base = base;
+    _hw = hw;
+    _published = 0;
+    _done = 0;
+    _stop = false;
+    _finalBytes = 0;
+    _fill = 0;
+    _started = false;
+    _samples = 0;
+    _dropRun = 0;
+    _eventsPublished = 0;
+    _eventsDone = 0;
+    _log.clear();
+    _bytesWritten = 0;
+    _droppedSamples = 0;
+    _droppedWrites = 0;
+    _droppedEvents = 0;
+    _thread = std::thread(&SoapySDRPlayRecorder::work, this);
+    _active = true;
+
+    SoapySDR_logf(SOAPY_SDR_INFO, "Recording to %s%s.", dataPath.c_str(), _direct ? " with O_DIRECT" : "");
+}
+
+void SoapySDRPlayRecorder::stop(void)
+{
+    if (not _thread.joinable()) return;
+
+    //rx_callback is out of record() once it saw the flag cleared
+    _active = false;
+    while (_pushing) std::this_thread::yield();
+    if (_dropRun != 0)
+    {
+        this->event(EVENT_DROPPED, 0, (double)_dropRun);
+        _dropRun = 0;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _finalBytes = _fill;
+        _stop = true;
+    }
+    _cond.notify_all();
+    _thread.join();
+
+    closeData(_fd);
+    _fd = -1;
+    if (_droppedSamples != 0 or _droppedWrites != 0 or _droppedEvents != 0)
+    {
+        SoapySDR_logf(SOAPY_SDR_WARNING, "Recording %s.sigmf-data: %llu samples dropped, %llu failed writes, %llu events dropped",
+                      _base.c_str(), _droppedSamples.load(), _droppedWrites.load(), _droppedEvents.load());
+    }
+    _base.clear();
+}
+
+std::string SoapySDRPlayRecorder::path(void) const
+{
+    return _base.empty() ? "" : _base + ".sigmf-data";
+}
+
+void SoapySDRPlayRecorder::setSchedule(const SoapySDRPlaySchedule &schedule)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _schedule = schedule;
+}
+
+unsigned long long SoapySDRPlayRecorder::bytesWritten(void) const
+{
+    return _bytesWritten.load(std::memory_order_relaxed);
+}
+
+unsigned long long SoapySDRPlayRecorder::droppedSamples(void) const
+{
+    return _droppedSamples.load(std::memory_order_relaxed);
+}
+
+unsigned long long SoapySDRPlayRecorder::droppedWrites(void) const
+{
+    return _droppedWrites.load(std::memory_order_relaxed);
+}
+
+/*******************************************************************
+ * Sample input, rx_callback
+ ******************************************************************/
+
+void SoapySDRPlayRecorder::record(const SoapySDRPlayConverter *conv, const short *xi, const short *xq, const unsigned int numSamples,
+                                  const long long timeNs, const long long count, const double rate, const double frequency, const int gRdB)
+{
+    _pushing = true;
+    if (not _active)
+    {
+        _pushing = false;
+        return;
+    }
+
+    //changes apply from the first sample of this callback
+    if (not _started)
+    {
+        _started = true;
+        _rate = rate;
+        _frequency = frequency;
+        _gRdB = gRdB;
+        this->event(EVENT_RATE, timeNs, rate);
+        this->event(EVENT_FREQUENCY, timeNs, frequency);
+        this->event(EVENT_GAIN, timeNs, gRdB);
+    }
+    else
+    {
+        if (count != _countNext) this->event(EVENT_LOST, timeNs, (double)(count - _countNext));
+        if (rate != _rate) this->event(EVENT_RATE, timeNs, rate);
+        if (frequency != _frequency) this->event(EVENT_FREQUENCY, timeNs, frequency);
+        if (gRdB != _gRdB) this->event(EVENT_GAIN, timeNs, gRdB);
+        _rate = rate;
+        _frequency = frequency;
+        _gRdB = gRdB;
+    }
+    _countNext = count + numSamples;
+
+    for (unsigned int offset = 0; offset < numSamples;)
+    {
+        //the writer fell behind, the samples are lost until a block is free
+        const unsigned long long seq = _published.load(std::memory_order_relaxed);
+        if (_fill == 0 and seq - _done.load(std::memory_order_acquire) >= RECORD_NUM_BLOCKS)
+        {
+            _dropRun += numSamples - offset;
+            _droppedSamples.fetch_add(numSamples - offset, std::memory_order_relaxed);
+            break;
+        }
+        if (_dropRun != 0)
+        {
+            this->event(EVENT_DROPPED, timeNs + std::llround(offset * 1e9 / rate), (double)_dropRun);
+            _dropRun = 0;
+        }
+
+        const unsigned int n = std::min<unsigned int>(numSamples - offset, (RECORD_BLOCK_BYTES - _fill) / RECORD_SAMPLE_BYTES);
+        conv->toCS16(xi + offset, xq + offset, (short *)(_arena.slot(seq % RECORD_NUM_BLOCKS) + _fill), n);
+        _fill += n * RECORD_SAMPLE_BYTES;
+        _samples += n;
+        offset += n;
+
+        if (_fill == RECORD_BLOCK_BYTES)
+        {
+            _published.store(seq + 1, std::memory_order_release);
+            _fill = 0;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+            }
+            _cond.notify_one();
+        }
+    }
+
+    _pushing = false;
+}
+
+void SoapySDRPlayRecorder::event(const EventKind kind, const long long timeNs, const double value)
+{
+    //the metadata misses it rather than stalling rx_callback
+    const unsigned long long seq = _eventsPublished.load(std::memory_order_relaxed);
+    if (seq - _eventsDone.load(std::memory_order_acquire) >= RECORD_NUM_EVENTS)
+    {
+        _droppedEvents.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    Event &event = _events[seq % RECORD_NUM_EVENTS];
+    event.kind = kind;
+    event.sample = _samples;
+    event.timeNs = timeNs;
+    event.value = value;
+    _eventsPublished.store(seq + 1, std::memory_order_release);
+}
+
+/*******************************************************************
+ * Writer
+ ******************************************************************/
+
+void SoapySDRPlayRecorder::work(void)
+{
+    SoapySDRPlaySchedule schedule;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        schedule = _schedule;
+    }
+    if (not schedule.empty()) SoapySDRPlay_applySchedule(schedule, "record writer");
+
+    unsigned long long seq = 0;
+    while (true)
+    {
+        bool stop;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _cond.wait(lock, [&]{ return _stop or _published.load(std::memory_order_acquire) != seq; });
+            stop = _stop;
+        }
+
+        const unsigned long long end = _published.load(std::memory_order_acquire);
+        for (; seq != end; seq++)
+        {
+            this->writeBlock(_arena.slot(seq % RECORD_NUM_BLOCKS), RECORD_BLOCK_BYTES);
+            _done.store(seq + 1, std::memory_order_release);
+        }
+        this->drainEvents();
+        if (stop) break;
+    }
+
+    //stop() waited for rx_callback, the partial block follows the full ones
+    this->writeBlock(_arena.slot(seq % RECORD_NUM_BLOCKS), _finalBytes);
+    this->drainEvents();
+    this->writeMeta();
+}
+
+void SoapySDRPlayRecorder::writeBlock(const char *data, const size_t bytes)
+{
+    size_t done = 0;
+    while (done < bytes)
+    {
+        //O_DIRECT takes whole 4 KiB pages only
+        if (_direct and (bytes - done) % 4096 != 0)
+        {
+            clearDirect(_fd);
+            _direct = false;
+        }
+
+        const long ret = (_fd < 0) ? -1 : writeData(_fd, data + done, bytes - done);
+        if (ret < 0 and errno == EINTR) continue;
+        if (ret < 0 and errno == EINVAL and _direct)
+        {
+            //the file system refused direct I/O after all
+            clearDirect(_fd);
+            _direct = false;
+            continue;
+        }
+        if (ret <= 0)
+        {
+            //a full disk does not recover, the rest of the recording is dropped
+            if (_fd >= 0)
+            {
+                SoapySDR_logf(SOAPY_SDR_ERROR, "Recording %s.sigmf-data: write failed: %s", _base.c_str(), std::strerror(errno));
+                closeData(_fd);
+                _fd = -1;
+            }
+            _droppedWrites.fetch_add(1, std::memory_order_relaxed);
+            _droppedSamples.fetch_add((bytes - done) / RECORD_SAMPLE_BYTES, std::memory_order_relaxed);
+            return;
+        }
+        done += ret;
+        _bytesWritten.fetch_add(ret, std::memory_order_relaxed);
+    }
+}
+
+void SoapySDRPlayRecorder::drainEvents(void)
+{
+    const unsigned long long end = _eventsPublished.load(std::memory_order_acquire);
+    for (unsigned long long seq = _eventsDone.load(std::memory_order_relaxed); seq != end; seq++)
+    {
+        _log.push_back(_events[seq % RECORD_NUM_EVENTS]);
+        _eventsDone.store(seq + 1, std::memory_order_release);
+    }
+}
+
+void SoapySDRPlayRecorder::writeMeta(void)
+{
+    const std::string metaPath = _base + ".sigmf-meta";
+    std::FILE *meta = std::fopen(metaPath.c_str(), "w");
+    if (meta == nullptr)
+    {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "Recording: can't create %s: %s", metaPath.c_str(), std::strerror(errno));
+        return;
+    }
+
+    //the rate at the first sample is the one of the recording
+    std::stable_sort(_log.begin(), _log.end(), [](const Event &a, const Event &b){ return a.sample < b.sample; });
+    double rate = 0.0;
+    for (const Event &event : _log)
+    {
+        if (event.kind == EVENT_RATE)
+        {
+            rate = event.value;
+            break;
+        }
+    }
+
+    std::fprintf(meta, "{\n  \"global\": {\n");
+    std::fprintf(meta, "    \"core:datatype\": \"ci16_le\",\n");
+    std::fprintf(meta, "    \"core:sample_rate\": %.17g,\n", rate);
+    std::fprintf(meta, "    \"core:version\": \"1.0.0\",\n");
+    std::fprintf(meta, "    \"core:hw\": %s,\n", jsonString(_hw).c_str());
+    std::fprintf(meta, "    \"core:recorder\": \"SoapySDRPlay\",\n");
+    std::fprintf(meta, "    \"core:extensions\": [{\"name\": \"sdrplay\", \"version\": \"1.0.0\", \"optional\": true}]\n");
+    std::fprintf(meta, "  },\n  \"captures\": [");
+
+    const char *sep = "\n";
+    for (const Event &event : _log)
+    {
+        if (event.kind != EVENT_FREQUENCY) continue;
+        std::fprintf(meta, "%s    {\"core:sample_start\": %lld, \"core:frequency\": %.17g, \"core:datetime\": \"%s\"}",
+                     sep, event.sample, event.value, isoTime(event.timeNs).c_str());
+        sep = ",\n";
+    }
+    std::fprintf(meta, "\n  ],\n  \"annotations\": [");
+
+    sep = "\n";
+    bool globalRate = true;
+    for (const Event &event : _log)
+    {
+        //the sdrplay fields carry the values for a replay
+        char comment[128], value[64];
+        const char *label;
+        switch (event.kind)
+        {
+        case EVENT_RATE:
+            //the first one is the global sample rate
+            if (globalRate)
+            {
+                globalRate = false;
+                continue;
+            }
+            label = "rate";
+            std::snprintf(comment, sizeof(comment), "sample rate %.17g Hz from here", event.value);
+            std::snprintf(value, sizeof(value), "\"sdrplay:sample_rate\": %.17g", event.value);
+            break;
+        case EVENT_GAIN:
+            label = "gain";
+            std::snprintf(comment, sizeof(comment), "gain reduction %d dB from here", (int)event.value);
+            std::snprintf(value, sizeof(value), "\"sdrplay:gr\": %d", (int)event.value);
+            break;
+        case EVENT_LOST:
+            label = "lost";
+            if (event.value > 0.0) std::snprintf(comment, sizeof(comment), "%.0f samples lost by the hardware before here", event.value);
+            else std::snprintf(comment, sizeof(comment), "sample counter restarted here");
+            std::snprintf(value, sizeof(value), "\"sdrplay:lost\": %.0f", event.value);
+            break;
+        case EVENT_DROPPED:
+            label = "dropped";
+            std::snprintf(comment, sizeof(comment), "%.0f samples not recorded before here, the writer fell behind", event.value);
+            std::snprintf(value, sizeof(value), "\"sdrplay:dropped\": %.0f", event.value);
+            break;
+        default:
+            continue;
+        }
+        std::fprintf(meta, "%s    {\"core:sample_start\": %lld, \"core:label\": \"%s\", \"core:comment\": \"%s\", %s}",
+                     sep, event.sample, label, comment, value);
+        sep = ",\n";
+    }
+    std::fprintf(meta, "\n  ]\n}\n");
+
+    if (std::fclose(meta) != 0)
+    {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "Recording: can't write %s: %s", metaPath.c_str(), std::strerror(errno));
+    }
+}
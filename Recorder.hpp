@@ -0,0 +1,166 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "Convert.hpp"
+#include "BufferArena.hpp"
+#include "Scheduling.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//CS16 blocks queued between rx_callback and the writer, each block is one
+//write, a multiple of the 4 KiB that O_DIRECT asks for on every file system
+#define RECORD_BLOCK_BYTES        (1024 * 1024)
+#define RECORD_NUM_BLOCKS         (64)
+
+//frequency, rate, gain and lost sample events queued for the metadata
+#define RECORD_NUM_EVENTS         (4096)
+
+/*******************************************************************
+ * SigMF recording of the raw stream
+ ******************************************************************/
+
+//rx_callback interleaves the hardware samples into preallocated blocks
+//of a lock-free ring, a writer thread drains the full blocks into
+//<base>.sigmf-data with O_DIRECT where the file system allows it. Tuner,
+//rate and gain changes and lost samples are queued as events next to
+//the samples, <base>.sigmf-meta is written from them when the recording
+//stops. Samples that find the ring full are dropped and counted.
+class SoapySDRPlayRecorder
+{
+public:
+    SoapySDRPlayRecorder(void);
+
+    ~SoapySDRPlayRecorder(void);
+
+    //open <base>.sigmf-data, a .sigmf-data or .sigmf-meta suffix on path
+    //is dropped, hw describes the device in the metadata, throws when the
+    //file can't be created, a running recording is stopped first
+    void start(const std::string &path, const std::string &hw);
+
+    //write what is queued and the metadata, returns once the writer is done
+    void stop(void);
+
+    //data file of the running recording, empty when stopped
+    std::string path(void) const;
+
+    //priority and CPUs of the writer, applied when it starts
+    void setSchedule(const SoapySDRPlaySchedule &schedule);
+
+    //called by rx_callback with the hardware samples at rate Hz,
+    //tuned to frequency with gRdB of gain reduction
+    void push(const SoapySDRPlayConverter *conv, const short *xi, const short *xq, const unsigned int numSamples,
+              const long long timeNs, const long long count, const double rate, const double frequency, const int gRdB)
+    {
+        //nothing to do unless recording, checked before any other work
+        if (not _active.load(std::memory_order_relaxed)) return;
+        this->record(conv, xi, xq, numSamples, timeNs, count, rate, frequency, gRdB);
+    }
+
+    //counters since the recording started
+    unsigned long long bytesWritten(void) const;
+    unsigned long long droppedSamples(void) const;
+    unsigned long long droppedWrites(void) const;
+
+private:
+    SoapySDRPlayRecorder(const SoapySDRPlayRecorder &);
+    SoapySDRPlayRecorder &operator=(const SoapySDRPlayRecorder &);
+
+    enum EventKind
+    {
+        EVENT_FREQUENCY,   // new capture segment
+        EVENT_RATE,
+        EVENT_GAIN,
+        EVENT_LOST,        // the hardware count jumped, value is the jump
+        EVENT_DROPPED      // samples that found the ring full, value is their number
+    };
+
+    struct Event
+    {
+        EventKind kind;
+        long long sample;  // index in the data file
+        long long timeNs;
+        double value;
+    };
+
+    void record(const SoapySDRPlayConverter *conv, const short *xi, const short *xq, const unsigned int numSamples,
+                const long long timeNs, const long long count, const double rate, const double frequency, const int gRdB);
+
+    void event(const EventKind kind, const long long timeNs, const double value);
+
+    void work(void);
+
+    void writeBlock(const char *data, const size_t bytes);
+
+    void drainEvents(void);
+
+    void writeMeta(void);
+
+    //recording files and the writer schedule, only changed while stopped
+    std::string _base;
+    std::string _hw;
+    SoapySDRPlaySchedule _schedule;
+    int _fd;
+    bool _direct;                  // _fd was opened with O_DIRECT
+
+    //block ring, rx_callback fills slot(_published % RECORD_NUM_BLOCKS),
+    //the writer releases a block by counting it done
+    SoapySDRPlayBufferArena _arena;
+    std::atomic<unsigned long long> _published;
+    std::atomic<unsigned long long> _done;
+    std::atomic_bool _active;
+    std::atomic_bool _pushing;
+    std::thread _thread;
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    bool _stop;
+    size_t _finalBytes;            // of the partial block written at stop
+
+    //rx_callback state
+    size_t _fill;                  // bytes in the block being filled
+    bool _started;
+    long long _samples;            // written to the ring so far
+    long long _countNext;
+    double _rate;
+    double _frequency;
+    int _gRdB;
+    long long _dropRun;            // dropped since the last queued sample
+
+    //event ring, rx_callback publishes, the writer copies them to _log
+    std::vector<Event> _events;
+    std::atomic<unsigned long long> _eventsPublished;
+    std::atomic<unsigned long long> _eventsDone;
+    std::vector<Event> _log;
+
+    std::atomic<unsigned long long> _bytesWritten;    // writer
+    std::atomic<unsigned long long> _droppedSamples;  // rx_callback and the writer
+    std::atomic<unsigned long long> _droppedWrites;   // writer, blocks that failed to write
+    std::atomic<unsigned long long> _droppedEvents;   // rx_callback
+};
@@ -23,69 +23,88 @@
  */
 
 #include "SoapySDRPlay.hpp"
+#include "Helper.hpp"
 #include <SoapySDR/Registry.hpp>
 
 #if !defined(_M_X64) && !defined(_M_IX86)
 #define sprintf_s(buffer, buffer_size, stringbuffer, ...) (sprintf(buffer, stringbuffer, __VA_ARGS__))
 #endif
 
-static std::map<std::string, SoapySDR::Kwargs> _cachedResults;
+/*******************************************************************
+ * Find available devices
+ ******************************************************************/
 
 static std::vector<SoapySDR::Kwargs> findSDRPlay(const SoapySDR::Kwargs &args)
 {
    std::vector<SoapySDR::Kwargs> results;
-   unsigned int nDevs = 0;
    char lblstr[128];
 
-   //Enable (= 1) API calls tracing,
-   //but only for debug purposes due to its performance impact. 
-   mir_sdr_DebugEnable(0);
+   // a recording replayed in place of the hardware, the file is opened by makeSDRPlay
+   if (args.count("replay") != 0)
+   {
+      SoapySDR::Kwargs dev;
+      dev["replay"] = args.at("replay");
+      dev["serial"] = "replay";
+      dev["label"] = "SDRplay replay " + args.at("replay");
+      results.push_back(dev);
+      return results;
+   }
 
-   std::string baseLabel = "SDRplay Dev";
+   double ttlMs = DEFAULT_ENUM_CACHE_TTL_MS;
+   if (args.count("cache_ttl_ms") != 0)
+   {
+      // a bad value must not fail the enumeration of every module
+      try
+      {
+         ttlMs = std::stod(args.at("cache_ttl_ms"));
+      }
+      catch (const std::logic_error &)
+      {
+         SoapySDR_logf(SOAPY_SDR_WARNING, "cache_ttl_ms '%s' ignored, not a number", args.at("cache_ttl_ms").c_str());
+      }
+   }
 
-   // list devices by API
-   mir_sdr_DeviceT rspDevs[MAX_RSP_DEVICES];
-   mir_sdr_GetDevices(&rspDevs[0], &nDevs, MAX_RSP_DEVICES);
+   // enumeration can yield the devices already opened by this process
+   const std::set<std::string> claimed = SoapySDRPlay_getClaimedSerials();
 
-  for (unsigned int i = 0; i < nDevs; i++)
-  {
-     if (rspDevs[i].devAvail)
-     {
-        SoapySDR::Kwargs dev;
-        dev["serial"] = rspDevs[i].SerNo;
-        const bool serialMatch = args.count("serial") == 0 or args.at("serial") == dev["serial"];
-        if (not serialMatch) continue;
-        if (rspDevs[i].hwVer > 253)
-        {
-           sprintf_s(lblstr, sizeof(lblstr), "SDRplay Dev%d RSP1A %s", i, rspDevs[i].SerNo);
-        }
-        else if (rspDevs[i].hwVer == 3)
-        {
-           sprintf_s(lblstr, sizeof(lblstr), "SDRplay Dev%d RSPduo %s", i, rspDevs[i].SerNo);
-        }
-        else
-        {
-           sprintf_s(lblstr, sizeof(lblstr), "SDRplay Dev%d RSP%d %s", i, rspDevs[i].hwVer, rspDevs[i].SerNo);
-        }
-        dev["label"] = lblstr;
-        results.push_back(dev);
-        _cachedResults[rspDevs[i].SerNo] = dev;
-     }
-  }
+   for (const auto &rspDev : SoapySDRPlay_getDevices(ttlMs))
+   {
+      if (not rspDev.available and claimed.count(rspDev.serial) == 0) continue;
 
-    //fill in the cached results for claimed handles
-    for (const auto &serial : SoapySDRPlay_getClaimedSerials())
-    {
-        if (_cachedResults.count(serial) == 0) continue;
-        if (args.count("serial") != 0 and args.at("serial") != serial) continue;
-        results.push_back(_cachedResults.at(serial));
-    }
+      SoapySDR::Kwargs dev;
+      dev["serial"] = rspDev.serial;
+      const bool serialMatch = args.count("serial") == 0 or args.at("serial") == dev["serial"];
+      if (not serialMatch) continue;
+      if (rspDev.hwVer > 253)
+      {
+         sprintf_s(lblstr, sizeof(lblstr), "SDRplay Dev%d RSP1A %s", rspDev.index, rspDev.serial.c_str());
+      }
+      else if (rspDev.hwVer == 3)
+      {
+         sprintf_s(lblstr, sizeof(lblstr), "SDRplay Dev%d RSPduo %s", rspDev.index, rspDev.serial.c_str());
+      }
+      else
+      {
+         sprintf_s(lblstr, sizeof(lblstr), "SDRplay Dev%d RSP%d %s", rspDev.index, rspDev.hwVer, rspDev.serial.c_str());
+      }
+      dev["label"] = lblstr;
+      results.push_back(dev);
+   }
 
    return results;
 }
 
 static SoapySDR::Device *makeSDRPlay(const SoapySDR::Kwargs &args)
 {
+    //host the device in a helper process, one process serves one device
+    if (args.count("helper") != 0 and args.at("helper") == "true")
+    {
+#ifdef _WIN32
+        throw std::runtime_error("helper processes are not supported on this platform");
+#else
+        return new SoapySDRPlayHelperClient(args);
+#endif
+    }
     return new SoapySDRPlay(args);
 }
 
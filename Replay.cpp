@@ -0,0 +1,727 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "Replay.hpp"
+#include <SoapySDR/Logger.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+
+//stdio buffer of the data file, a few callbacks per read
+#define REPLAY_READ_BYTES         (1024 * 1024)
+
+//how often a replay without pacing looks for room in the stream
+#define REPLAY_WAIT_US            (50)
+
+/*******************************************************************
+ * File helpers
+ ******************************************************************/
+
+static bool endsWith(const std::string &value, const std::string &suffix)
+{
+    return value.size() >= suffix.size() and value.compare(value.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+static int seekFile(std::FILE *file, const long long offset, const int whence)
+{
+#ifdef _WIN32
+    return _fseeki64(file, offset, whence);
+#else
+    return fseeko(file, (off_t)offset, whence);
+#endif
+}
+
+static long long fileSize(std::FILE *file)
+{
+    if (seekFile(file, 0, SEEK_END) != 0) return -1;
+#ifdef _WIN32
+    const long long size = _ftelli64(file);
+#else
+    const long long size = (long long)ftello(file);
+#endif
+    seekFile(file, 0, SEEK_SET);
+    return size;
+}
+
+static std::FILE *openFile(const std::string &path)
+{
+    std::FILE *file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr)
+    {
+        throw std::runtime_error("replay: can't open " + path + ": " + std::strerror(errno));
+    }
+    return file;
+}
+
+static std::string readBytes(std::FILE *file, const std::string &path, const long long bytes)
+{
+    std::string text((size_t)bytes, '\0');
+    if (bytes > 0 and std::fread(&text[0], 1, text.size(), file) != text.size())
+    {
+        std::fclose(file);
+        throw std::runtime_error("replay: can't read " + path);
+    }
+    return text;
+}
+
+/*******************************************************************
+ * SigMF metadata
+ ******************************************************************/
+
+//just enough JSON for the metadata, objects keep their keys in order
+struct JsonValue
+{
+    enum Type
+    {
+        JSON_NULL,
+        JSON_BOOL,
+        JSON_NUMBER,
+        JSON_STRING,
+        JSON_ARRAY,
+        JSON_OBJECT
+    };
+
+    Type type = JSON_NULL;
+    double number = 0.0;
+    std::string string;
+    std::vector<std::string> keys;   // of an object
+    std::vector<JsonValue> items;    // of an array, or the values of an object
+
+    const JsonValue *get(const std::string &key) const
+    {
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            if (keys[i] == key) return &items[i];
+        }
+        return nullptr;
+    }
+
+    double getNumber(const std::string &key, const double fallback) const
+    {
+        const JsonValue *value = this->get(key);
+        return (value != nullptr and value->type == JSON_NUMBER) ? value->number : fallback;
+    }
+};
+
+class JsonParser
+{
+public:
+    JsonParser(const std::string &text):
+        _text(text),
+        _pos(0)
+    {
+        return;
+    }
+
+    JsonValue parse(void)
+    {
+        JsonValue value = this->value();
+        this->space();
+        if (_pos != _text.size()) this->fail("trailing characters");
+        return value;
+    }
+
+private:
+    void fail(const char *what) const
+    {
+        throw std::runtime_error(std::string("replay: bad SigMF metadata, ") + what + " at offset " + std::to_string(_pos));
+    }
+
+    void space(void)
+    {
+        while (_pos < _text.size() and std::isspace((unsigned char)_text[_pos])) _pos++;
+    }
+
+    bool take(const char c)
+    {
+        this->space();
+        if (_pos < _text.size() and _text[_pos] == c)
+        {
+            _pos++;
+            return true;
+        }
+        return false;
+    }
+
+    void expect(const char c)
+    {
+        if (not this->take(c)) this->fail("unexpected character");
+    }
+
+    bool literal(const char *word)
+    {
+        const size_t len = std::strlen(word);
+        if (_text.compare(_pos, len, word) != 0) return false;
+        _pos += len;
+        return true;
+    }
+
+    JsonValue value(void)
+    {
+        JsonValue value;
+        this->space();
+        if (_pos >= _text.size()) this->fail("unexpected end");
+
+        if (this->take('{'))
+        {
+            value.type = JsonValue::JSON_OBJECT;
+            if (this->take('}')) return value;
+            do
+            {
+                this->space();
+                value.keys.push_back(this->string());
+                this->expect(':');
+                value.items.push_back(this->value());
+            } while (this->take(','));
+            this->expect('}');
+        }
+        else if (this->take('['))
+        {
+            value.type = JsonValue::JSON_ARRAY;
+            if (this->take(']')) return value;
+            do
+            {
+                value.items.push_back(this->value());
+            } while (this->take(','));
+            this->expect(']');
+        }
+        else if (_text[_pos] == '"')
+        {
+            value.type = JsonValue::JSON_STRING;
+            value.string = this->string();
+        }
+        else if (this->literal("true"))
+        {
+            value.type = JsonValue::JSON_BOOL;
+            value.number = 1.0;
+        }
+        else if (this->literal("false"))
+        {
+            value.type = JsonValue::JSON_BOOL;
+        }
+        else if (this->literal("null"))
+        {
+            value.type = JsonValue::JSON_NULL;
+        }
+        else
+        {
+            const char *begin = _text.c_str() + _pos;
+            char *end = nullptr;
+            value.type = JsonValue::JSON_NUMBER;
+            value.number = std::strtod(begin, &end);
+            if (end == begin) this->fail("unexpected character");
+            _pos += end - begin;
+        }
+        return value;
+    }
+
+    std::string string(void)
+    {
+        if (_pos >= _text.size() or _text[_pos] != '"') this->fail("expected a string");
+        _pos++;
+
+        std::string out;
+        while (true)
+        {
+            if (_pos >= _text.size()) this->fail("unterminated string");
+            char c = _text[_pos++];
+            if (c == '"') break;
+            if (c == '\\' and _pos < _text.size())
+            {
+                c = _text[_pos++];
+                if (c == 'n') c = '\n';
+                else if (c == 't') c = '\t';
+                else if (c == 'r') c = '\r';
+                else if (c == 'b') c = '\b';
+                else if (c == 'f') c = '\f';
+                else if (c == 'u')
+                {
+                    //labels and comments only, anything outside ASCII becomes '?'
+                    const unsigned long code = (_pos + 4 <= _text.size()) ? std::strtoul(_text.substr(_pos, 4).c_str(), nullptr, 16) : 0;
+                    _pos = std::min(_pos + 4, _text.size());
+                    c = (code > 0 and code < 0x80) ? (char)code : '?';
+                }
+            }
+            out += c;
+        }
+        return out;
+    }
+
+    const std::string &_text;
+    size_t _pos;
+};
+
+/*******************************************************************
+ * Opening the recording
+ ******************************************************************/
+
+//the first recording of a SigMF archive, a tar of <name>.sigmf-meta and <name>.sigmf-data
+static std::string readArchive(const std::string &path, std::string &dataName, long long &dataOffset, long long &dataBytes)
+{
+    std::FILE *file = openFile(path);
+    std::string metaName, metaText;
+    std::map<std::string, std::pair<long long, long long>> members;
+
+    long long offset = 0;
+    char header[512];
+    while (seekFile(file, offset, SEEK_SET) == 0 and std::fread(header, 1, sizeof(header), file) == sizeof(header))
+    {
+        //two zero blocks end the archive
+        if (header[0] == '\0') break;
+
+        //ustar keeps a directory prefix apart from the name
+        std::string name(header, strnlen(header, 100));
+        if (std::memcmp(header + 257, "ustar", 5) == 0 and header[345] != '\0')
+        {
+            name = std::string(header + 345, strnlen(header + 345, 155)) + "/" + name;
+        }
+        const long long size = std::strtoll(std::string(header + 124, strnlen(header + 124, 12)).c_str(), nullptr, 8);
+        const char type = header[156];
+
+        if (type == '0' or type == '\0')
+        {
+            if (metaName.empty() and endsWith(name, ".sigmf-meta"))
+            {
+                metaName = name;
+                metaText = readBytes(file, path, size);
+            }
+            members[name] = std::make_pair(offset + 512, size);
+        }
+        offset += 512 + (size + 511) / 512 * 512;
+    }
+    std::fclose(file);
+
+    if (metaName.empty())
+    {
+        throw std::runtime_error("replay: no .sigmf-meta in " + path);
+    }
+    dataName = metaName.substr(0, metaName.size() - 4) + "data";
+    if (members.count(dataName) == 0)
+    {
+        throw std::runtime_error("replay: no " + dataName + " in " + path);
+    }
+    dataOffset = members.at(dataName).first;
+    dataBytes = members.at(dataName).second;
+    return metaText;
+}
+
+SoapySDRPlayReplay::SoapySDRPlayReplay(const std::string &path):
+    _path(path),
+    _dataOffset(0),
+    _numSamples(0),
+    _format(FORMAT_CI16),
+    _sampleBytes(2 * sizeof(short)),
+    _rate(0.0),
+    _frequency(0.0),
+    _gRdB(-1),
+    _speed(1.0),
+    _loop(false),
+    _chunk(DEFAULT_REPLAY_CHUNK),
+    _stop(false),
+    _done(false),
+    _replayed(0)
+{
+    std::string metaText;
+    long long dataBytes = 0;
+    if (endsWith(path, ".sigmf"))
+    {
+        std::string dataName;
+        metaText = readArchive(path, dataName, _dataOffset, dataBytes);
+        _dataPath = path;
+    }
+    else
+    {
+        std::string base = path;
+        if (endsWith(base, ".sigmf-data") or endsWith(base, ".sigmf-meta")) base.erase(base.size() - 11);
+
+        std::FILE *meta = openFile(base + ".sigmf-meta");
+        metaText = readBytes(meta, base + ".sigmf-meta", fileSize(meta));
+        std::fclose(meta);
+
+        _dataPath = base + ".sigmf-data";
+        std::FILE *data = openFile(_dataPath);
+        dataBytes = fileSize(data);
+        std::fclose(data);
+    }
+
+    this->parseMeta(metaText);
+    _numSamples = dataBytes / (long long)_sampleBytes;
+    if (_numSamples == 0)
+    {
+        throw std::runtime_error("replay: no samples in " + _dataPath);
+    }
+
+    SoapySDR_logf(SOAPY_SDR_INFO, "Replaying %s: %lld samples at %.0f Hz, %d changes",
+                  path.c_str(), _numSamples, _rate, (int)_changes.size());
+}
+
+void SoapySDRPlayReplay::parseMeta(const std::string &text)
+{
+    const JsonValue root = JsonParser(text).parse();
+    const JsonValue *global = root.get("global");
+    if (global == nullptr or global->type != JsonValue::JSON_OBJECT)
+    {
+        throw std::runtime_error("replay: no global object in the SigMF metadata of " + _path);
+    }
+
+    const JsonValue *datatype = global->get("core:datatype");
+    const std::string type = (datatype != nullptr) ? datatype->string : "";
+    if (type == "ci16_le")      { _format = FORMAT_CI16; _sampleBytes = 2 * sizeof(short); }
+    else if (type == "cf32_le") { _format = FORMAT_CF32; _sampleBytes = 2 * sizeof(float); }
+    else if (type == "ci8")     { _format = FORMAT_CI8;  _sampleBytes = 2; }
+    else throw std::runtime_error("replay: unsupported core:datatype '" + type + "', ci16_le, cf32_le or ci8 can be replayed");
+
+    _rate = global->getNumber("core:sample_rate", 0.0);
+    if (_rate <= 0.0)
+    {
+        throw std::runtime_error("replay: no core:sample_rate in the SigMF metadata of " + _path);
+    }
+    const JsonValue *hw = global->get("core:hw");
+    if (hw != nullptr) _hw = hw->string;
+
+    //each capture segment retunes
+    const JsonValue *captures = root.get("captures");
+    if (captures != nullptr)
+    {
+        for (const JsonValue &capture : captures->items)
+        {
+            const JsonValue *frequency = capture.get("core:frequency");
+            if (frequency == nullptr) continue;
+            Change change;
+            change.sample = (long long)capture.getNumber("core:sample_start", 0.0);
+            change.kind = CHANGE_FREQUENCY;
+            change.value = frequency->number;
+            _changes.push_back(change);
+        }
+    }
+
+    //annotations of other tools have none of the sdrplay fields
+    const JsonValue *annotations = root.get("annotations");
+    if (annotations != nullptr)
+    {
+        for (const JsonValue &annotation : annotations->items)
+        {
+            Change change;
+            change.sample = (long long)annotation.getNumber("core:sample_start", 0.0);
+            if (annotation.get("sdrplay:gr") != nullptr)
+            {
+                change.kind = CHANGE_GAIN;
+                change.value = annotation.getNumber("sdrplay:gr", 0.0);
+            }
+            else if (annotation.get("sdrplay:sample_rate") != nullptr)
+            {
+                change.kind = CHANGE_RATE;
+                change.value = annotation.getNumber("sdrplay:sample_rate", _rate);
+                if (change.value <= 0.0) continue;
+            }
+            else if (annotation.get("sdrplay:lost") != nullptr or annotation.get("sdrplay:dropped") != nullptr)
+            {
+                change.value = annotation.getNumber("sdrplay:lost", annotation.getNumber("sdrplay:dropped", 0.0));
+                change.kind = (change.value > 0.0) ? CHANGE_LOST : CHANGE_RESET;
+            }
+            else continue;
+            _changes.push_back(change);
+        }
+    }
+    std::stable_sort(_changes.begin(), _changes.end(), [](const Change &a, const Change &b){ return a.sample < b.sample; });
+
+    //the replay starts out with what applies to the first sample
+    for (const Change &change : _changes)
+    {
+        if (change.sample > 0) break;
+        if (change.kind == CHANGE_FREQUENCY) _frequency = change.value;
+        if (change.kind == CHANGE_RATE)      _rate = change.value;
+        if (change.kind == CHANGE_GAIN)      _gRdB = (int)change.value;
+    }
+    if (_frequency == 0.0)
+    {
+        for (const Change &change : _changes)
+        {
+            if (change.kind != CHANGE_FREQUENCY) continue;
+            _frequency = change.value;
+            break;
+        }
+    }
+}
+
+SoapySDRPlayReplay::~SoapySDRPlayReplay(void)
+{
+    this->stop();
+}
+
+const std::string &SoapySDRPlayReplay::path(void) const
+{
+    return _path;
+}
+
+const std::string &SoapySDRPlayReplay::hw(void) const
+{
+    return _hw;
+}
+
+double SoapySDRPlayReplay::sampleRate(void) const
+{
+    return _rate;
+}
+
+double SoapySDRPlayReplay::frequency(void) const
+{
+    return _frequency;
+}
+
+int SoapySDRPlayReplay::gRdB(void) const
+{
+    return _gRdB;
+}
+
+long long SoapySDRPlayReplay::numSamples(void) const
+{
+    return _numSamples;
+}
+
+void SoapySDRPlayReplay::setSpeed(const double speed)
+{
+    if (not std::isfinite(speed) or speed < 0.0)
+    {
+        throw std::runtime_error("replay_speed must be finite and not negative: " + std::to_string(speed));
+    }
+    _speed = speed;
+}
+
+double SoapySDRPlayReplay::speed(void) const
+{
+    return _speed;
+}
+
+void SoapySDRPlayReplay::setLoop(const bool loop)
+{
+    _loop = loop;
+}
+
+bool SoapySDRPlayReplay::loop(void) const
+{
+    return _loop;
+}
+
+void SoapySDRPlayReplay::setChunk(const unsigned int samples)
+{
+    if (samples == 0 or samples > MAX_REPLAY_CHUNK)
+    {
+        throw std::runtime_error("replay_chunk out of range: " + std::to_string(samples));
+    }
+    _chunk = samples;
+}
+
+unsigned int SoapySDRPlayReplay::chunk(void) const
+{
+    return _chunk;
+}
+
+/*******************************************************************
+ * Replay control
+ ******************************************************************/
+
+void SoapySDRPlayReplay::start(const SoapySDRPlayReplayCallbacks &callbacks)
+{
+    this->stop();
+
+    _callbacks = callbacks;
+    _stop = false;
+    _done = false;
+    _replayed = 0;
+    _thread = std::thread(&SoapySDRPlayReplay::work, this, _speed, _loop, _chunk);
+}
+
+void SoapySDRPlayReplay::stop(void)
+{
+    if (not _thread.joinable()) return;
+
+    _stop = true;
+    _thread.join();
+}
+
+unsigned long long SoapySDRPlayReplay::samplesReplayed(void) const
+{
+    return _replayed.load(std::memory_order_relaxed);
+}
+
+bool SoapySDRPlayReplay::done(void) const
+{
+    return _done.load(std::memory_order_relaxed);
+}
+
+/*******************************************************************
+ * Replay thread
+ ******************************************************************/
+
+void SoapySDRPlayReplay::convert(const char *raw, short *xi, short *xq, const unsigned int numSamples) const
+{
+    if (_format == FORMAT_CI16)
+    {
+        const short *in = (const short *)raw;
+        for (unsigned int i = 0; i < numSamples; i++)
+        {
+            xi[i] = in[2 * i];
+            xq[i] = in[2 * i + 1];
+        }
+    }
+    else if (_format == FORMAT_CF32)
+    {
+        //full scale 1.0 is full scale of the 16 bit samples
+        const float *in = (const float *)raw;
+        for (unsigned int i = 0; i < numSamples; i++)
+        {
+            xi[i] = (short)std::max(-32768.0f, std::min(32767.0f, std::nearbyint(in[2 * i] * 32767.0f)));
+            xq[i] = (short)std::max(-32768.0f, std::min(32767.0f, std::nearbyint(in[2 * i + 1] * 32767.0f)));
+        }
+    }
+    else
+    {
+        const signed char *in = (const signed char *)raw;
+        for (unsigned int i = 0; i < numSamples; i++)
+        {
+            xi[i] = (short)(in[2 * i] * 256);
+            xq[i] = (short)(in[2 * i + 1] * 256);
+        }
+    }
+}
+
+void SoapySDRPlayReplay::work(const double speed, const bool loop, const unsigned int chunk)
+{
+    std::FILE *file = std::fopen(_dataPath.c_str(), "rb");
+    if (file == nullptr or seekFile(file, _dataOffset, SEEK_SET) != 0)
+    {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "Replay: can't open %s: %s", _dataPath.c_str(), std::strerror(errno));
+        if (file != nullptr) std::fclose(file);
+        _done = true;
+        return;
+    }
+    std::vector<char> readBuff(REPLAY_READ_BYTES);
+    std::setvbuf(file, readBuff.data(), _IOFBF, readBuff.size());
+
+    std::vector<char> raw(chunk * _sampleBytes);
+    std::vector<short> xi(chunk), xq(chunk);
+
+    //what the device was set up with
+    double frequency = _frequency;
+    double rate = _rate;
+    int gRdB = _gRdB;
+
+    unsigned int hwCount = 0;     // the hardware sample counter
+    long long pos = 0;            // next sample of the file
+    size_t next = 0;              // next change
+    const auto startTime = std::chrono::steady_clock::now();
+    double dueSecs = 0.0;         // stream time of pos, lost samples included
+
+    while (not _stop.load(std::memory_order_relaxed))
+    {
+        if (pos == _numSamples)
+        {
+            if (not loop) break;
+            pos = 0;
+            next = 0;
+            seekFile(file, _dataOffset, SEEK_SET);
+        }
+
+        //changes at pos apply from the first sample of this callback
+        int grChanged = 0, rfChanged = 0, fsChanged = 0;
+        unsigned int reset = 0;
+        for (; next < _changes.size() and _changes[next].sample <= pos; next++)
+        {
+            const Change &change = _changes[next];
+            switch (change.kind)
+            {
+            case CHANGE_FREQUENCY:
+                rfChanged |= (change.value != frequency);
+                frequency = change.value;
+                break;
+            case CHANGE_RATE:
+                fsChanged |= (change.value != rate);
+                rate = change.value;
+                break;
+            case CHANGE_GAIN:
+                grChanged |= ((int)change.value != gRdB);
+                gRdB = (int)change.value;
+                break;
+            case CHANGE_LOST:
+                //the samples were lost in the original stream, their time passed all the same
+                hwCount += (unsigned int)change.value;
+                dueSecs += change.value / rate;
+                break;
+            case CHANGE_RESET:
+                hwCount = 0;
+                reset = 1;
+                break;
+            }
+        }
+
+        //up to the next change
+        const long long end = (next < _changes.size()) ? std::min(_changes[next].sample, _numSamples) : _numSamples;
+        const unsigned int numSamples = (unsigned int)std::min<long long>(chunk, end - pos);
+        if (std::fread(raw.data(), _sampleBytes, numSamples, file) != numSamples)
+        {
+            SoapySDR_logf(SOAPY_SDR_ERROR, "Replay: can't read %s at sample %lld", _dataPath.c_str(), pos);
+            break;
+        }
+        this->convert(raw.data(), xi.data(), xq.data(), numSamples);
+
+        if (speed > 0.0)
+        {
+            //the callback comes once the hardware would have sampled the chunk
+            dueSecs += numSamples / rate;
+            std::this_thread::sleep_until(startTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(dueSecs / speed)));
+        }
+        else
+        {
+            //as fast as the stream takes the samples, none are lost to a full queue
+            while (not _callbacks.ready(_callbacks.cbContext) and not _stop.load(std::memory_order_relaxed))
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(REPLAY_WAIT_US));
+            }
+        }
+
+        if (rfChanged or fsChanged) _callbacks.tune(frequency, rate, _callbacks.cbContext);
+        if (grChanged) _callbacks.gain((unsigned int)gRdB, 0, _callbacks.cbContext);
+        _callbacks.stream(xi.data(), xq.data(), hwCount, grChanged, rfChanged, fsChanged, numSamples, reset, 0, _callbacks.cbContext);
+
+        hwCount += numSamples;
+        pos += numSamples;
+        _replayed.fetch_add(numSamples, std::memory_order_relaxed);
+    }
+
+    std::fclose(file);
+    if (not _stop.load(std::memory_order_relaxed))
+    {
+        _done = true;
+        _callbacks.end(_callbacks.cbContext);
+    }
+}
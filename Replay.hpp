@@ -0,0 +1,167 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <mir_sdr.h>
+#else
+#include <mirsdrapi-rsp.h>
+#endif
+
+//samples per stream callback, what the RSPs deliver in zero IF mode
+#define DEFAULT_REPLAY_CHUNK      (1008)
+
+//largest replay_chunk, the rx path reserves its buffers for a whole chunk
+#define MAX_REPLAY_CHUNK          (1 << 20)
+
+//where the replay thread delivers the recording, the stream and gain
+//callbacks are the ones given to mir_sdr_StreamInit()
+struct SoapySDRPlayReplayCallbacks
+{
+    mir_sdr_StreamCallback_t stream;
+    mir_sdr_GainChangeCallback_t gain;
+
+    //the tuner frequency and sample rate of the samples that follow,
+    //before the stream callback flagged with rfChanged or fsChanged
+    void (*tune)(double frequency, double rate, void *cbContext);
+
+    //a replay without pacing waits while this returns false
+    bool (*ready)(void *cbContext);
+
+    //after the last sample of a replay that does not loop
+    void (*end)(void *cbContext);
+
+    void *cbContext;
+};
+
+/*******************************************************************
+ * SigMF recording in place of the hardware
+ ******************************************************************/
+
+//plays a SigMF recording through the callbacks of the SDRplay API from
+//a thread of its own, chunk samples at a time. Captures retune, the
+//gain and rate annotations of the sdrplay extension written by
+//SoapySDRPlayRecorder change the gain and rate, its lost and dropped
+//annotations skip the hardware sample counter so that the gaps of the
+//original stream come back as overflows. The callbacks arrive when the
+//hardware would have delivered them, speed times faster, or as fast as
+//the stream takes them with a speed of 0.
+class SoapySDRPlayReplay
+{
+public:
+    //path.sigmf-meta and path.sigmf-data, either suffix on path, or a .sigmf
+    //archive, throws when the recording can't be read or has no usable format
+    SoapySDRPlayReplay(const std::string &path);
+
+    ~SoapySDRPlayReplay(void);
+
+    //what the recording starts with, before start()
+    const std::string &path(void) const;
+    const std::string &hw(void) const;           // core:hw, may be empty
+    double sampleRate(void) const;
+    double frequency(void) const;                // 0 without captures
+    int gRdB(void) const;                        // -1 without gain annotations
+    long long numSamples(void) const;
+
+    //replay options, applied by the next start()
+    void setSpeed(const double speed);
+    double speed(void) const;
+    void setLoop(const bool loop);
+    bool loop(void) const;
+    void setChunk(const unsigned int samples);
+    unsigned int chunk(void) const;
+
+    //replay from the first sample, a running replay is stopped first
+    void start(const SoapySDRPlayReplayCallbacks &callbacks);
+
+    //returns once the callbacks are done
+    void stop(void);
+
+    //samples delivered since start(), and whether the recording ended
+    unsigned long long samplesReplayed(void) const;
+    bool done(void) const;
+
+private:
+    SoapySDRPlayReplay(const SoapySDRPlayReplay &);
+    SoapySDRPlayReplay &operator=(const SoapySDRPlayReplay &);
+
+    enum Format
+    {
+        FORMAT_CI16,
+        FORMAT_CF32,
+        FORMAT_CI8
+    };
+
+    enum ChangeKind
+    {
+        CHANGE_FREQUENCY,
+        CHANGE_RATE,
+        CHANGE_GAIN,
+        CHANGE_LOST,     // the hardware count skips value samples
+        CHANGE_RESET     // the hardware count restarts
+    };
+
+    struct Change
+    {
+        long long sample;   // index in the data file
+        ChangeKind kind;
+        double value;
+    };
+
+    void parseMeta(const std::string &text);
+
+    void work(const double speed, const bool loop, const unsigned int chunk);
+
+    void convert(const char *raw, short *xi, short *xq, const unsigned int numSamples) const;
+
+    //recording, fixed after construction
+    std::string _path;
+    std::string _dataPath;
+    long long _dataOffset;         // of the samples in _dataPath
+    long long _numSamples;
+    Format _format;
+    size_t _sampleBytes;
+    std::string _hw;
+    double _rate;
+    double _frequency;
+    int _gRdB;
+    std::vector<Change> _changes;  // by sample
+
+    //options, the replay thread gets a copy
+    double _speed;
+    bool _loop;
+    unsigned int _chunk;
+
+    SoapySDRPlayReplayCallbacks _callbacks;
+    std::thread _thread;
+    std::atomic_bool _stop;
+    std::atomic_bool _done;
+    std::atomic<unsigned long long> _replayed;
+};
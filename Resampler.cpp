@@ -0,0 +1,343 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "Resampler.hpp"
+#include <algorithm>
+#include <cmath>
+
+//80 dB stopband for the halfband and polyphase filters
+static const double KAISER_BETA = 7.857;
+
+//4k+3 taps put the zeros of the halfband at even offsets from the center
+static const size_t HALFBAND_TAPS = 51;
+
+//ratios with more phases interpolate between neighbouring ones
+static const uint64_t MAX_PHASES = 512;
+
+static uint64_t gcd(uint64_t a, uint64_t b)
+{
+    while (b != 0)
+    {
+        const uint64_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+//zeroth order modified Bessel function of the first kind
+static double besselI0(const double x)
+{
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 50; k++)
+    {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+        if (term < sum * 1e-12) break;
+    }
+    return sum;
+}
+
+//Kaiser windowed sinc, cutoff in cycles per sample, t in samples from the center
+static double windowedSinc(const double cutoff, const double t, const double halfLength)
+{
+    const double x = t / halfLength;
+    if (x <= -1.0 or x >= 1.0) return 0.0;
+    const double arg = 2.0 * M_PI * cutoff * t;
+    const double sinc = (t == 0.0) ? 1.0 : std::sin(arg) / arg;
+    return 2.0 * cutoff * sinc * besselI0(KAISER_BETA * std::sqrt(1.0 - x * x)) / besselI0(KAISER_BETA);
+}
+
+SoapySDRPlayResampler::SoapySDRPlayResampler(void):
+    _hbCenter(0.5f),
+    _interp(1),
+    _step(1),
+    _numPhases(0),
+    _numTaps(0),
+    _polyPos(0),
+    _polyFrac(0),
+    _polyRate(0.0)
+{
+    //the halfband passes 0.2 and stops from 0.3 of the input rate
+    const size_t center = (HALFBAND_TAPS - 1) / 2;
+    double sum = 0.0;
+    for (size_t j = 0; j < HALFBAND_TAPS; j += 2)
+    {
+        _hbTaps.push_back((float)windowedSinc(0.25, (double)j - center, center + 1.0));
+        sum += _hbTaps.back();
+    }
+    //unity gain at DC
+    for (auto &tap : _hbTaps) tap = (float)(tap * 0.5 / sum);
+}
+
+void SoapySDRPlayResampler::configure(const uint64_t inNum, const uint64_t inDen, const uint64_t outRate)
+{
+    //halve the rate as long as it stays at or above the output rate
+    uint64_t den = inDen;
+    double rate = (double)inNum / inDen;
+    _stages.clear();
+    while (inNum >= 2 * outRate * den)
+    {
+        Halfband stage;
+        stage.inRate = rate;
+        _stages.push_back(stage);
+        den *= 2;
+        rate /= 2;
+    }
+
+    //the remaining ratio outRate / (inNum / den) as interp / step
+    const uint64_t g = gcd(outRate * den, inNum);
+    _interp = outRate * den / g;
+    _step = inNum / g;
+    _polyRate = rate;
+    _phaseTaps.clear();
+    _numTaps = 0;
+    _numPhases = 0;
+
+    if (_interp != _step)
+    {
+        //passband 0.4 and stopband from 0.6 of the lower rate,
+        //aliases only land in the transition band
+        const double ratio = std::min(1.0, (double)_interp / _step);
+        const double cutoff = 0.5 * ratio;
+        _numTaps = (size_t)std::ceil(25.1 / ratio);
+        _numTaps = (_numTaps + 3) & ~size_t(3);
+        _numPhases = (size_t)std::min(_interp, MAX_PHASES);
+
+        //prototype at numPhases times the input rate,
+        //one extra phase to interpolate beyond the last one
+        const size_t length = _numTaps * _numPhases;
+        std::vector<double> proto(length + 1);
+        double sum = 0.0;
+        for (size_t i = 0; i <= length; i++)
+        {
+            proto[i] = windowedSinc(cutoff, (double)i / _numPhases - _numTaps / 2.0, _numTaps / 2.0);
+            if (i < length) sum += proto[i];
+        }
+
+        //phase p holds the taps for the window ending at the newest sample,
+        //oldest sample first
+        _phaseTaps.resize((_numPhases + 1) * _numTaps);
+        for (size_t p = 0; p <= _numPhases; p++)
+        {
+            for (size_t k = 0; k < _numTaps; k++)
+            {
+                _phaseTaps[p * _numTaps + k] = (float)(proto[(_numTaps - 1 - k) * _numPhases + p] * _numPhases / sum);
+            }
+        }
+    }
+
+    this->reset();
+}
+
+void SoapySDRPlayResampler::reset(void)
+{
+    const size_t history = _hbTaps.size() - 1;
+    for (auto &stage : _stages)
+    {
+        stage.evenI.assign(history, 0.0f);
+        stage.evenQ.assign(history, 0.0f);
+        stage.oddI.assign(history, 0.0f);
+        stage.oddQ.assign(history, 0.0f);
+        stage.evenPending = false;
+    }
+
+    _polyI.assign(_numTaps > 0 ? _numTaps - 1 : 0, 0.0f);
+    _polyQ.assign(_polyI.size(), 0.0f);
+    _polyPos = _polyI.size();
+    _polyFrac = 0;
+}
+
+void SoapySDRPlayResampler::reserve(const size_t maxSamples)
+{
+    //each stage holds its history, a pending even sample
+    //and the even/odd half of a block
+    const size_t history = _hbTaps.size() - 1;
+    size_t num = maxSamples;
+    for (auto &stage : _stages)
+    {
+        stage.evenI.reserve(history + num / 2 + 2);
+        stage.evenQ.reserve(history + num / 2 + 2);
+        stage.oddI.reserve(history + num / 2 + 2);
+        stage.oddQ.reserve(history + num / 2 + 2);
+        num = num / 2 + 1;
+    }
+    _polyI.reserve(_polyI.size() + num);
+    _polyQ.reserve(_polyQ.size() + num);
+    for (int i = 0; i < 2; i++)
+    {
+        _workI[i].reserve(maxSamples);
+        _workQ[i].reserve(maxSamples);
+    }
+}
+
+size_t SoapySDRPlayResampler::maxOutput(const size_t numSamples) const
+{
+    size_t num = numSamples;
+    for (size_t s = 0; s < _stages.size(); s++) num = num / 2 + 1;
+    if (_numTaps == 0) return num;
+    return (size_t)(num * _interp / _step) + 2;
+}
+
+long long SoapySDRPlayResampler::delayNs(void) const
+{
+    //the halfband output lines up with the odd input sample,
+    //polyphase outputs are centered on the window
+    const double center = (HALFBAND_TAPS - 1) / 2;
+    double delay = 0.0;
+    for (const auto &stage : _stages) delay += (center - 1.0) / stage.inRate;
+    if (_numTaps != 0) delay += (_numTaps / 2.0) / _polyRate;
+    return std::llround(delay * 1e9);
+}
+
+static inline short toShort(const float x)
+{
+    return (short)std::max(-32768L, std::min(std::lrint(x), 32767L));
+}
+
+size_t SoapySDRPlayResampler::process(const SoapySDRPlayConverter *conv, const short *xi, const short *xq, const size_t numSamples, short *outI, short *outQ)
+{
+    //the filters run on floats in the units of the input samples
+    _workI[0].resize(numSamples);
+    _workQ[0].resize(numSamples);
+    for (size_t i = 0; i < numSamples; i++)
+    {
+        _workI[0][i] = xi[i];
+        _workQ[0][i] = xq[i];
+    }
+    return this->run(conv, numSamples, outI, outQ);
+}
+
+size_t SoapySDRPlayResampler::process(const SoapySDRPlayConverter *conv, const float *xi, const float *xq, const size_t numSamples, short *outI, short *outQ)
+{
+    _workI[0].assign(xi, xi + numSamples);
+    _workQ[0].assign(xq, xq + numSamples);
+    return this->run(conv, numSamples, outI, outQ);
+}
+
+size_t SoapySDRPlayResampler::run(const SoapySDRPlayConverter *conv, const size_t numSamples, short *outI, short *outQ)
+{
+    int cur = 0;
+    size_t num = numSamples;
+    for (auto &stage : _stages)
+    {
+        const int next = cur ^ 1;
+        _workI[next].resize(num / 2 + 1);
+        _workQ[next].resize(num / 2 + 1);
+        num = this->halfband(conv, stage, _workI[cur].data(), _workQ[cur].data(), num, _workI[next].data(), _workQ[next].data());
+        cur = next;
+    }
+
+    if (_numTaps != 0)
+    {
+        return this->polyphase(conv, _workI[cur].data(), _workQ[cur].data(), num, outI, outQ);
+    }
+
+    for (size_t i = 0; i < num; i++)
+    {
+        outI[i] = toShort(_workI[cur][i]);
+        outQ[i] = toShort(_workQ[cur][i]);
+    }
+    return num;
+}
+
+size_t SoapySDRPlayResampler::halfband(const SoapySDRPlayConverter *conv, Halfband &stage, const float *inI, const float *inQ, const size_t numSamples, float *outI, float *outQ)
+{
+    //split the input into even and odd samples,
+    //the nonzero taps only ever see the odd ones
+    for (size_t i = 0; i < numSamples; i++)
+    {
+        if (stage.evenPending)
+        {
+            stage.oddI.push_back(inI[i]);
+            stage.oddQ.push_back(inQ[i]);
+        }
+        else
+        {
+            stage.evenI.push_back(inI[i]);
+            stage.evenQ.push_back(inQ[i]);
+        }
+        stage.evenPending = not stage.evenPending;
+    }
+
+    //one output per even/odd pair, the center tap hits the even sample
+    const size_t history = _hbTaps.size() - 1;
+    const size_t centerPair = (HALFBAND_TAPS - 3) / 4;
+    const size_t numPairs = stage.oddI.size();
+    size_t num = 0;
+    for (size_t m = history; m < numPairs; m++, num++)
+    {
+        conv->firCF32(_hbTaps.data(), &stage.oddI[m - history], &stage.oddQ[m - history], _hbTaps.size(), outI[num], outQ[num]);
+        outI[num] += _hbCenter * stage.evenI[m - centerPair];
+        outQ[num] += _hbCenter * stage.evenQ[m - centerPair];
+    }
+
+    stage.evenI.erase(stage.evenI.begin(), stage.evenI.begin() + num);
+    stage.evenQ.erase(stage.evenQ.begin(), stage.evenQ.begin() + num);
+    stage.oddI.erase(stage.oddI.begin(), stage.oddI.begin() + num);
+    stage.oddQ.erase(stage.oddQ.begin(), stage.oddQ.begin() + num);
+    return num;
+}
+
+size_t SoapySDRPlayResampler::polyphase(const SoapySDRPlayConverter *conv, const float *inI, const float *inQ, const size_t numSamples, short *outI, short *outQ)
+{
+    _polyI.insert(_polyI.end(), inI, inI + numSamples);
+    _polyQ.insert(_polyQ.end(), inQ, inQ + numSamples);
+
+    size_t num = 0;
+    while (_polyPos < _polyI.size())
+    {
+        //exact position in 1/_interp input samples, split into a phase
+        //and the fraction towards the next phase
+        const uint64_t scaled = _polyFrac * _numPhases;
+        const size_t phase = (size_t)(scaled / _interp);
+        const uint64_t rem = scaled % _interp;
+
+        const size_t first = _polyPos + 1 - _numTaps;
+        float yI, yQ;
+        conv->firCF32(&_phaseTaps[phase * _numTaps], &_polyI[first], &_polyQ[first], _numTaps, yI, yQ);
+        if (rem != 0)
+        {
+            float nextI, nextQ;
+            conv->firCF32(&_phaseTaps[(phase + 1) * _numTaps], &_polyI[first], &_polyQ[first], _numTaps, nextI, nextQ);
+            const float frac = (float)((double)rem / _interp);
+            yI += (nextI - yI) * frac;
+            yQ += (nextQ - yQ) * frac;
+        }
+        outI[num] = toShort(yI);
+        outQ[num] = toShort(yQ);
+        num++;
+
+        _polyFrac += _step;
+        _polyPos += (size_t)(_polyFrac / _interp);
+        _polyFrac %= _interp;
+    }
+
+    //keep the window history for the next block
+    const size_t consumed = _polyPos - (_numTaps - 1);
+    _polyI.erase(_polyI.begin(), _polyI.begin() + consumed);
+    _polyQ.erase(_polyQ.begin(), _polyQ.begin() + consumed);
+    _polyPos -= consumed;
+    return num;
+}
@@ -0,0 +1,95 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+#include "Convert.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*******************************************************************
+ * Rate conversion from the hardware output rate to the requested rate
+ ******************************************************************/
+
+//Halfband decimate by 2 stages bring the rate down to less than twice
+//the requested one, a polyphase stage does the remaining ratio exactly.
+//Ratios with too many phases interpolate between neighbouring phases.
+//The passband is 80% of the output Nyquist rate.
+class SoapySDRPlayResampler
+{
+public:
+    SoapySDRPlayResampler(void);
+
+    //input rate inNum/inDen Hz to outRate Hz, outRate <= input rate
+    void configure(const uint64_t inNum, const uint64_t inDen, const uint64_t outRate);
+
+    //clear the filter history, the next block starts a new signal
+    void reset(void);
+
+    //size the buffers for blocks of up to maxSamples after configure(),
+    //process() and reset() then never allocate for such blocks
+    void reserve(const size_t maxSamples);
+
+    //resample a block, returns the number of samples written to outI/outQ,
+    //at most maxOutput(numSamples)
+    size_t process(const SoapySDRPlayConverter *conv, const short *xi, const short *xq, const size_t numSamples, short *outI, short *outQ);
+
+    //same for float input in the units of the short samples
+    size_t process(const SoapySDRPlayConverter *conv, const float *xi, const float *xq, const size_t numSamples, short *outI, short *outQ);
+
+    size_t maxOutput(const size_t numSamples) const;
+
+    //delay of the filters, the output sample at n / outRate
+    //since reset() holds the input from n / outRate - delayNs()
+    long long delayNs(void) const;
+
+private:
+    struct Halfband
+    {
+        double inRate;
+        std::vector<float> evenI, evenQ, oddI, oddQ;
+        bool evenPending;
+    };
+
+    size_t run(const SoapySDRPlayConverter *conv, const size_t numSamples, short *outI, short *outQ);
+    size_t halfband(const SoapySDRPlayConverter *conv, Halfband &stage, const float *inI, const float *inQ, const size_t numSamples, float *outI, float *outQ);
+    size_t polyphase(const SoapySDRPlayConverter *conv, const float *inI, const float *inQ, const size_t numSamples, short *outI, short *outQ);
+
+    //halfband taps at odd offsets from the center, and the center tap
+    std::vector<float> _hbTaps;
+    float _hbCenter;
+    std::vector<Halfband> _stages;
+
+    //polyphase stage, output k is at input position k * _step / _interp
+    uint64_t _interp, _step;
+    size_t _numPhases, _numTaps;
+    std::vector<float> _phaseTaps;
+    std::vector<float> _polyI, _polyQ;
+    size_t _polyPos;
+    uint64_t _polyFrac;
+    double _polyRate;
+
+    //scratch space between the stages
+    std::vector<float> _workI[2], _workQ[2];
+};
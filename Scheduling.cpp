@@ -0,0 +1,165 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "Scheduling.hpp"
+#include <SoapySDR/Logger.h>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+SoapySDRPlaySchedule SoapySDRPlay_parseSchedule(const std::string &priority, const std::string &cpus)
+{
+    SoapySDRPlaySchedule schedule;
+    try
+    {
+        if (not priority.empty()) schedule.priority = std::stoi(priority);
+
+        // comma separated CPUs or ranges
+        size_t pos = 0;
+        while (pos < cpus.size())
+        {
+            size_t end = cpus.find(',', pos);
+            if (end == std::string::npos) end = cpus.size();
+            const std::string item = cpus.substr(pos, end - pos);
+            pos = end + 1;
+            if (item.empty()) continue;
+
+            const size_t dash = item.find('-');
+            const int first = std::stoi(item.substr(0, dash));
+            const int last = (dash == std::string::npos) ? first : std::stoi(item.substr(dash + 1));
+            if (first < 0 or last < first) throw std::invalid_argument(item);
+            for (int cpu = first; cpu <= last; cpu++) schedule.cpus.push_back(cpu);
+        }
+    }
+    catch (const std::logic_error &)
+    {
+        throw std::runtime_error("setupStream invalid priority '" + priority + "' or cpu list '" + cpus + "'");
+    }
+
+    if (schedule.priority > 99 or schedule.priority < -20)
+    {
+        throw std::runtime_error("setupStream priority " + priority + " out of range, 1..99 real time or -20..-1 nice");
+    }
+    return schedule;
+}
+
+bool SoapySDRPlay_applySchedule(const SoapySDRPlaySchedule &schedule, const char *name)
+{
+    bool ok = true;
+
+#ifdef _WIN32
+    if (schedule.priority != 0)
+    {
+        const int winPriority = (schedule.priority > 0) ? THREAD_PRIORITY_TIME_CRITICAL : THREAD_PRIORITY_HIGHEST;
+        if (not SetThreadPriority(GetCurrentThread(), winPriority))
+        {
+            SoapySDR_logf(SOAPY_SDR_WARNING, "%s thread priority %d refused, error %lu", name, schedule.priority, GetLastError());
+            ok = false;
+        }
+    }
+    if (not schedule.cpus.empty())
+    {
+        DWORD_PTR mask = 0;
+        for (const int cpu : schedule.cpus)
+        {
+            if (cpu < (int)(8 * sizeof(mask))) mask |= ((DWORD_PTR)1) << cpu;
+        }
+        if (SetThreadAffinityMask(GetCurrentThread(), mask) == 0)
+        {
+            SoapySDR_logf(SOAPY_SDR_WARNING, "%s thread CPU affinity refused, error %lu", name, GetLastError());
+            ok = false;
+        }
+    }
+#else
+    if (schedule.priority > 0)
+    {
+        // real time, needs CAP_SYS_NICE or an rtprio limit
+        sched_param param;
+        std::memset(&param, 0, sizeof(param));
+        param.sched_priority = schedule.priority;
+        const int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (err != 0)
+        {
+            SoapySDR_logf(SOAPY_SDR_WARNING, "%s thread SCHED_FIFO priority %d refused: %s%s", name, schedule.priority,
+                          std::strerror(err), (err == EPERM) ? " (needs CAP_SYS_NICE or an rtprio limit)" : "");
+            ok = false;
+        }
+    }
+    else if (schedule.priority < 0)
+    {
+#ifdef __linux__
+        // the nice value is per thread on Linux
+        const id_t who = (id_t)syscall(SYS_gettid);
+#else
+        const id_t who = 0;
+#endif
+        if (setpriority(PRIO_PROCESS, who, schedule.priority) != 0)
+        {
+            const int err = errno;
+            SoapySDR_logf(SOAPY_SDR_WARNING, "%s thread nice %d refused: %s%s", name, schedule.priority,
+                          std::strerror(err), (err == EACCES or err == EPERM) ? " (needs CAP_SYS_NICE or a nice limit)" : "");
+            ok = false;
+        }
+    }
+
+    if (not schedule.cpus.empty())
+    {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (const int cpu : schedule.cpus)
+        {
+            if (cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+        }
+        const int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (err != 0)
+        {
+            SoapySDR_logf(SOAPY_SDR_WARNING, "%s thread CPU affinity refused: %s", name, std::strerror(err));
+            ok = false;
+        }
+#else
+        SoapySDR_logf(SOAPY_SDR_WARNING, "%s thread CPU affinity is not supported on this platform", name);
+        ok = false;
+#endif
+    }
+#endif
+
+    if (ok and not schedule.empty())
+    {
+        SoapySDR_logf(SOAPY_SDR_DEBUG, "%s thread priority %d on %d CPUs", name, schedule.priority, (int)schedule.cpus.size());
+    }
+    return ok;
+}
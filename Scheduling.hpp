@@ -0,0 +1,65 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+
+/*******************************************************************
+ * Scheduling of the streaming threads
+ *
+ * The stream args rx_priority/rx_cpu, reader_priority/reader_cpu and
+ * worker_priority/worker_cpu pick a policy for the vendor callback
+ * thread, the thread calling readStream() and the virtual channel
+ * workers. Each thread applies its own schedule, the vendor thread
+ * from inside its first callback after activateStream().
+ ******************************************************************/
+
+struct SoapySDRPlaySchedule
+{
+    SoapySDRPlaySchedule(void):
+        priority(0)
+    {
+        return;
+    }
+
+    //> 0 real time priority (SCHED_FIFO 1..99), < 0 nice value, 0 unchanged
+    int priority;
+
+    //CPUs the thread may run on, empty leaves the affinity unchanged
+    std::vector<int> cpus;
+
+    bool empty(void) const
+    {
+        return priority == 0 and cpus.empty();
+    }
+};
+
+//schedule from the <prefix>_priority and <prefix>_cpu stream args,
+//the CPU list is like "2", "2,3" or "0-3", throws std::runtime_error
+SoapySDRPlaySchedule SoapySDRPlay_parseSchedule(const std::string &priority, const std::string &cpus);
+
+//apply to the calling thread, anything refused is logged with the
+//name of the thread and false is returned
+bool SoapySDRPlay_applySchedule(const SoapySDRPlaySchedule &schedule, const char *name);
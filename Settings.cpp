@@ -23,41 +23,155 @@
  */
 
 #include "SoapySDRPlay.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstdint>
 
-std::set<std::string> &SoapySDRPlay_getClaimedSerials(void)
+/*******************************************************************
+ * Device cache, one bus scan serves enumeration and open
+ ******************************************************************/
+
+struct DeviceCache
+{
+    std::mutex mutex;
+    bool valid = false;
+    std::chrono::steady_clock::time_point scanned;
+    std::vector<SoapySDRPlayDeviceInfo> devices;
+    std::map<std::string, SoapySDRPlayDeviceInfo> known;   // every device seen, by serial
+    std::set<std::string> claimed;
+};
+
+static DeviceCache &deviceCache(void)
 {
-	static std::set<std::string> serials;
-	return serials;
+    static DeviceCache cache;
+    return cache;
 }
 
-SoapySDRPlay::SoapySDRPlay(const SoapySDR::Kwargs &args)
+std::set<std::string> SoapySDRPlay_getClaimedSerials(void)
 {
-    if (args.count("serial") == 0) throw std::runtime_error("no sdrplay device found");
+    DeviceCache &cache = deviceCache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    return cache.claimed;
+}
 
-    serNo = args.at("serial");
+void SoapySDRPlay_claimSerial(const std::string &serial)
+{
+    DeviceCache &cache = deviceCache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    cache.claimed.insert(serial);
+    cache.valid = false;
+}
 
-    // retreive hwVer and device index by API
-    unsigned int nDevs = 0;
+void SoapySDRPlay_releaseSerial(const std::string &serial)
+{
+    DeviceCache &cache = deviceCache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    cache.claimed.erase(serial);
+    cache.valid = false;
+}
 
-    mir_sdr_DeviceT rspDevs[MAX_RSP_DEVICES];
-    mir_sdr_GetDevices(&rspDevs[0], &nDevs, MAX_RSP_DEVICES);
+void SoapySDRPlay_invalidateDevices(void)
+{
+    DeviceCache &cache = deviceCache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    cache.valid = false;
+}
 
-    unsigned devIdx = MAX_RSP_DEVICES;
-    for (unsigned int i = 0; i < nDevs; i++)
+std::vector<SoapySDRPlayDeviceInfo> SoapySDRPlay_getDevices(const double ttlMs)
+{
+    DeviceCache &cache = deviceCache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+
+    // concurrent callers wait for the one scan instead of starting their own
+    const auto now = std::chrono::steady_clock::now();
+    if (not cache.valid or now - cache.scanned > std::chrono::duration<double, std::milli>(ttlMs))
+    {
+        //Enable (= 1) API calls tracing,
+        //but only for debug purposes due to its performance impact.
+        mir_sdr_DebugEnable(0);
+
+        // list devices by API, the indices are only valid for the latest scan
+        unsigned int nDevs = 0;
+        mir_sdr_DeviceT rspDevs[MAX_RSP_DEVICES];
+        if (mir_sdr_GetDevices(&rspDevs[0], &nDevs, MAX_RSP_DEVICES) != mir_sdr_Success)
+        {
+            nDevs = 0;
+        }
+
+        cache.devices.clear();
+        for (unsigned int i = 0; i < nDevs; i++)
+        {
+            SoapySDRPlayDeviceInfo dev;
+            dev.serial = rspDevs[i].SerNo;
+            dev.hwVer = rspDevs[i].hwVer;
+            dev.index = i;
+            dev.available = rspDevs[i].devAvail != 0;
+            cache.devices.push_back(dev);
+            cache.known[dev.serial] = dev;
+        }
+        cache.valid = true;
+        cache.scanned = now;
+    }
+
+    // the devices this process holds open may have left the list
+    std::vector<SoapySDRPlayDeviceInfo> devices = cache.devices;
+    for (const auto &serial : cache.claimed)
     {
-        if (rspDevs[i].devAvail and rspDevs[i].SerNo == serNo) devIdx = i;
+        const bool listed = std::any_of(devices.begin(), devices.end(),
+            [&serial](const SoapySDRPlayDeviceInfo &dev){ return dev.serial == serial; });
+        if (listed or cache.known.count(serial) == 0) continue;
+        devices.push_back(cache.known.at(serial));
+        devices.back().available = false;
     }
-    if (devIdx == MAX_RSP_DEVICES) throw std::runtime_error("no sdrplay device matches");
+    return devices;
+}
 
-    hwVer = rspDevs[devIdx].hwVer;
+/*******************************************************************
+ * Device construction
+ ******************************************************************/
 
-    mir_sdr_ApiVersion(&ver);
-    if (ver != MIR_SDR_API_VERSION)
+SoapySDRPlay::SoapySDRPlay(const SoapySDR::Kwargs &args)
+{
+    if (args.count("replay") != 0)
     {
-        SoapySDR_logf(SOAPY_SDR_WARNING, "mir_sdr version: '%.3f' does not equal build version: '%.3f'", ver, MIR_SDR_API_VERSION);
+        // a recording stands in for an RSP1, no device is claimed
+        _replay.reset(new SoapySDRPlayReplay(args.at("replay")));
+        serNo = "replay";
+        hwVer = 1;
+        ver = MIR_SDR_API_VERSION;
     }
+    else
+    {
+        if (args.count("serial") == 0) throw std::runtime_error("no sdrplay device found");
+
+        serNo = args.at("serial");
+
+        // hwVer and device index from the enumeration cache,
+        // the bus is only scanned again when the cached entry is stale
+        unsigned devIdx = MAX_RSP_DEVICES;
+        for (int scan = 0; scan < 2 and devIdx == MAX_RSP_DEVICES; scan++)
+        {
+            for (const auto &dev : SoapySDRPlay_getDevices(scan == 0 ? DEFAULT_ENUM_CACHE_TTL_MS : 0.0))
+            {
+                if (dev.available and dev.serial == serNo)
+                {
+                    devIdx = dev.index;
+                    hwVer = dev.hwVer;
+                }
+            }
+            if (devIdx != MAX_RSP_DEVICES and mir_sdr_SetDeviceIdx(devIdx) != mir_sdr_Success)
+            {
+                devIdx = MAX_RSP_DEVICES;
+            }
+        }
+        if (devIdx == MAX_RSP_DEVICES) throw std::runtime_error("no sdrplay device matches");
 
-    mir_sdr_SetDeviceIdx(devIdx);
+        mir_sdr_ApiVersion(&ver);
+        if (ver != MIR_SDR_API_VERSION)
+        {
+            SoapySDR_logf(SOAPY_SDR_WARNING, "mir_sdr version: '%.3f' does not equal build version: '%.3f'", ver, MIR_SDR_API_VERSION);
+        }
+    }
 
     sampleRate = 2000000;
     reqSampleRate = sampleRate;
@@ -68,11 +182,54 @@ SoapySDRPlay::SoapySDRPlay(const SoapySDR::Kwargs &args)
     ifMode = mir_sdr_IF_Zero;
     bwMode = mir_sdr_BW_1_536;
     gRdB = 40;
+    current_gRdB = gRdB;
+    _gainSeq = 0;
+    _gainIF = gRdB;
+    _gainLNA = 0;
+    _gainCount = 0;
+    _gainTimeNs = 0;
+    _rxCountNext = 0;
+    _rxTimeNext = 0;
+    _systemGainSeq = 1;  // odd, no snapshot has been queried
+    _systemGain = 0.0;
     lnaState = (hwVer == 2 || hwVer == 3 || hwVer > 253)? 4: 1;
 
-    //this may change later according to format
-    shortsPerWord = 1;
-    bufferLength = bufferElems * elementsPerSample * shortsPerWord;
+    // the recording sets the hardware rate, frequency and gain it starts with
+    if (_replay)
+    {
+        sampleRate = (uint32_t)std::llround(_replay->sampleRate());
+        reqSampleRate = sampleRate;
+        if (_replay->frequency() > 0.0) centerFrequency = (uint32_t)_replay->frequency();
+        if (_replay->gRdB() >= 0) gRdB = _replay->gRdB();
+        current_gRdB = gRdB;
+        _gainIF = gRdB;
+    }
+
+    //this may change later according to format and stream args
+    numBuffers = DEFAULT_NUM_BUFFERS;
+    bufferElems = DEFAULT_BUFFER_LENGTH;
+    latencyMs = 0.0;
+    streamFormat = FORMAT_CS16;
+    bytesPerSample = 2 * sizeof(short);
+    bufferLength = bufferElems * bytesPerSample;
+    cs8Shift = 8;
+    packRounding = true;
+    swCorrection = SW_CORR_OFF;
+    _corrReset = true;
+    _resampleConfigure = true;
+    _resampling = false;
+    _resampleRestart = false;
+    _resampleInBase = 0;
+    _resampleOutBase = 0;
+    _resampleInNext = 0;
+    _resampleOutNext = 0;
+    _resampleTimeNs = 0;
+    _resampleTimeCount = 0;
+    _blockElems = bufferElems;
+
+    //fastest conversion kernel for this CPU
+    converter = SoapySDRPlay_getConverter("auto");
+    converterName = "auto";
 
     agcMode = mir_sdr_AGC_100HZ;
     dcOffsetMode = true;
@@ -88,37 +245,374 @@ SoapySDRPlay::SoapySDRPlay(const SoapySDR::Kwargs &args)
     notchEn = 0;
     dabNotchEn = 0;
 
-    // process additional device string arguments
-    for (std::pair<std::string, std::string> arg : args) {
-        // ignore 'driver', 'label', 'mode', 'serial', and 'soapy'
-        if (arg.first == "driver" || arg.first == "label" ||
-            arg.first == "mode" || arg.first == "serial" ||
-            arg.first == "soapy") {
-            continue;
+    // virtual channels, one worker thread per core by default
+    _wideActive = false;
+    if (args.count("ddc_channels") != 0)
+    {
+        int numChannels = 0;
+        long numThreads = std::max(1u, std::thread::hardware_concurrency());
+        try
+        {
+            numChannels = std::stoi(args.at("ddc_channels"));
+            if (args.count("ddc_threads") != 0) numThreads = std::stol(args.at("ddc_threads"));
+        }
+        catch (const std::logic_error &)
+        {
+            throw std::runtime_error("invalid ddc_channels or ddc_threads device argument");
+        }
+        if (numChannels < 0 or numChannels > MAX_DDC_CHANNELS)
+        {
+            throw std::runtime_error("ddc_channels out of range: " + args.at("ddc_channels"));
+        }
+        if (numThreads < 1) throw std::runtime_error("ddc_threads must be positive: " + args.at("ddc_threads"));
+        if (numChannels > 0)
+        {
+            _channelizer.reset(new SoapySDRPlayChannelizer(numChannels, numThreads, rxReserveSamples()));
+            _channelStreams.resize(numChannels);
+            for (int ch = 0; ch < numChannels; ch++) _channelStreams[ch].channel = ch + 1;
+            SoapySDR_logf(SOAPY_SDR_INFO, "%d virtual channels on %d threads", numChannels, (int)_channelizer->numThreads());
         }
-        writeSetting(arg.first, arg.second);
     }
+    _spectrumStream.channel = 1 + _channelStreams.size();
+    _rxScheduleDue = false;
+    _readerSchedules.resize(2 + _channelStreams.size());
+    _readerScheduleDue.reset(new std::atomic_bool[_readerSchedules.size()]);
+    for (size_t ch = 0; ch < _readerSchedules.size(); ch++) _readerScheduleDue[ch] = false;
 
     bufferedElems = 0;
+    _buf_head = 0;
+    _buf_tail = 0;
+    _buf_acquired = 0;
+    _buf_waiting = false;
+    _buf_drain = false;
+    _overflowEvent = false;
+    overflowPolicy = OVERFLOW_DROP_NEWEST;
+    _gapPending = false;
+    _fillAfterGap = false;
+    _expectCount = 0;
+    _expectValid = false;
+    _overflowPending = false;
+    _overflowHandle = 0;
+    _overflowSamples = 0;
+    _statCallbacks = 0;
+    _statSamplesIn = 0;
+    _statSamplesOut = 0;
+    _statFillSum = 0;
+    _statFillMin = SIZE_MAX;
+    _statFillMax = 0;
+    _statConvertNs = 0;
+    _statConvertMaxNs = 0;
+    _statOverflows = 0;
+    _statDropped = 0;
+    _statBursts = 0;
+    _statAdcOverloads = 0;
+    _direct_count = 0;
+    _direct_state = DIRECT_IDLE;
+    _direct_buff = nullptr;
+    _direct_capacity = 0;
+    _direct_elems = 0;
+    _direct_timeNs = 0;
+    _callbackSamples = 0;
+    _counterValid = false;
+    _timeAnchorNs = 0;
     _currentBuff = 0;
+    _currentTimeNs = 0;
     resetBuffer = false;
-    useShort = true;
     
     streamActive = false;
-    SoapySDRPlay_getClaimedSerials().insert(serNo);
+
+    _reinitPending = 0;
+    _reinitTransaction = 0;
+    _reinitStop = false;
+    _reinitWake = false;
+    _replayTuneDue = false;
+    _replayTuneFrequency = 0.0;
+    _replayTuneRate = 0.0;
+    _hwTuning = {sampleRate, decM, reqSampleRate, centerFrequency};
+    _rxTuningNext = _hwTuning;
+    _rxTuningDue = 0;
+    _rxTuning = _hwTuning;
+    _rxTuningWait = 0;
+
+    _scanListValue = "off";
+    _scanDwellMs = DEFAULT_SCAN_DWELL_MS;
+    _scanIndex = 0;
+    _scanActive = false;
+    _hopDue = false;
+    _hopSeq = 0;
+    _hopFrequency = 0.0;
+    _hopDwell = 0;
+    _hopSettle = false;
+    _scanState = SCAN_OFF;
+    _scanSeqSeen = 0;
+    _scanRemain = 0;
+    _scanSettled = 0;
+    _rxFrequency = centerFrequency;
+    _segmentStart = false;
+    _direct_frequency = centerFrequency;
+    _currentEndBurst = false;
+    _readFrequency = centerFrequency;
+    _readRate = reqSampleRate;
+    _rxEvents = 0;
+    _eventSplit = true;
+    _direct_events = 0;
+    _direct_gRdB = 0;
+    _direct_rate = 0.0;
+    _readEvent = StreamEvent();
+    _burstMode = false;
+    _burstThresholdDb = 0.0;
+    _burstPreMs = DEFAULT_BURST_PRE_MS;
+    _burstPostMs = DEFAULT_BURST_POST_MS;
+    _burstTauMs = DEFAULT_BURST_TAU_MS;
+    _burstRate = 0.0;
+    _burstThreshold = 0.0f;
+    _burstAlpha = 0.0f;
+    _burstPower = 0.0f;
+    _burstPost = 0;
+    _burstHang = 0;
+    _burstNext = 0;
+    _burstFrequency = 0.0;
+    _burstOn = false;
+    _burstRingPos = 0;
+    _burstRingFill = 0;
+    _readBurst = StreamBurst();
+
+    // process additional device string arguments, once the state they change is set up
+    for (std::pair<std::string, std::string> arg : args) {
+        // ignore 'driver', 'label', 'mode', 'serial', 'soapy', the virtual channel, helper and replay setup
+        if (arg.first == "driver" || arg.first == "label" ||
+            arg.first == "mode" || arg.first == "serial" ||
+            arg.first == "soapy" || arg.first == "ddc_channels" ||
+            arg.first == "ddc_threads" || arg.first == "helper" ||
+            arg.first == "helper_path" || arg.first == "replay") {
+            continue;
+        }
+        writeSetting(arg.first, arg.second);
+    }
+
+    _reinitThread = std::thread(&SoapySDRPlay::reinitLoop, this);
+
+    if (not _replay) SoapySDRPlay_claimSerial(serNo);
 }
 
 SoapySDRPlay::~SoapySDRPlay(void)
 {
-    SoapySDRPlay_getClaimedSerials().erase(serNo);
+    {
+        std::lock_guard <std::mutex> lock(_general_state_mutex);
+        _reinitStop = true;
+        wakeReinit(false);
+    }
+    _reinitThread.join();
+
     std::lock_guard <std::mutex> lock(_general_state_mutex);
 
     if (streamActive)
     {
-        mir_sdr_StreamUninit();
+        if (_replay) _replay->stop();
+        else
+        {
+            std::lock_guard <std::mutex> api(_api_mutex);
+            mir_sdr_StreamUninit();
+        }
     }
     streamActive = false;
+
+    // the callbacks are done, the recording gets its metadata
+    _recorder.stop();
+    if (_replay) return;
     mir_sdr_ReleaseDeviceIdx();
+    SoapySDRPlay_releaseSerial(serNo);
+}
+
+/*******************************************************************
+ * Control thread
+ ******************************************************************/
+
+// called with _general_state_mutex held, the setter returns right away
+// and the change reaches the hardware with the next reinit
+void SoapySDRPlay::requestReinit(const int reason)
+{
+    // nothing to reinit, the rx path takes the settings as they are
+    if (not streamActive)
+    {
+        _hwTuning = {sampleRate, decM, reqSampleRate, centerFrequency};
+        int due = 0;
+        if (reason & (mir_sdr_CHANGE_FS_FREQ | mir_sdr_CHANGE_IF_TYPE)) due |= RX_TUNING_RATE;
+        if (reason & mir_sdr_CHANGE_RF_FREQ) due |= RX_TUNING_FREQ;
+        if (due != 0) publishRxTuning(due | RX_TUNING_NOW);
+        return;
+    }
+
+    _reinitPending |= reason;
+    if (_reinitTransaction == 0) wakeReinit(false);
+}
+
+// safe without _general_state_mutex, rx_callback raises the hop from here
+void SoapySDRPlay::wakeReinit(const bool hop)
+{
+    {
+        std::lock_guard <std::mutex> lock(_wakeMutex);
+        if (hop) _hopDue = true;
+        _reinitWake = true;
+    }
+    _wakeCond.notify_one();
+}
+
+// called with _general_state_mutex held once _hwTuning has the values for the
+// hardware, rx_callback takes them with the callback the hardware reports them in
+void SoapySDRPlay::publishRxTuning(const int due)
+{
+    RxTuning next = _hwTuning;
+    next.outputRate = reqSampleRate;
+
+    // new rates come with their filters, a retune alone keeps the waiting ones
+    SoapySDRPlayResampler resampler;
+    std::vector<short> ringI, ringQ;
+    const bool rates = (due & (RX_TUNING_RATE | RX_TUNING_OUTPUT)) != 0;
+    if (rates) prepareRx(next.sampleRate, next.decM, next.outputRate, resampler, ringI, ringQ);
+
+    // the lock goes first, whatever was waiting is freed after it
+    std::lock_guard <std::mutex> lock(_rxTuningMutex);
+    _rxTuningNext = next;
+    if (rates)
+    {
+        std::swap(_resamplerNext, resampler);
+        _burstRingNextI.swap(ringI);
+        _burstRingNextQ.swap(ringQ);
+    }
+    _rxTuningDue.store(_rxTuningDue.load(std::memory_order_relaxed) | due, std::memory_order_relaxed);
+}
+
+// merges everything queued since the last pass into one mir_sdr_Reinit
+void SoapySDRPlay::reinitLoop(void)
+{
+    std::unique_lock <std::mutex> lock(_general_state_mutex);
+    while (true)
+    {
+        // the wake lock is taken before the state lock is dropped,
+        // so a change made in between still finds the thread waiting
+        if (not (_reinitStop or (_reinitPending != 0 and _reinitTransaction == 0)))
+        {
+            std::unique_lock <std::mutex> wake(_wakeMutex);
+            lock.unlock();
+            _wakeCond.wait(wake, [this]{ return _reinitWake or _hopDue; });
+            _reinitWake = false;
+            wake.unlock();
+            lock.lock();
+        }
+        if (_reinitStop) return;
+
+        // the settings follow a replay retune as they would a reinit
+        if (_replay)
+        {
+            std::lock_guard <std::mutex> wake(_wakeMutex);
+            if (_replayTuneDue)
+            {
+                _replayTuneDue = false;
+                centerFrequency = (uint32_t)_replayTuneFrequency;
+                sampleRate = (uint32_t)std::llround(_replayTuneRate);
+                _hwTuning.frequency = centerFrequency;
+                _hwTuning.sampleRate = sampleRate;
+                updateBlockSize();
+            }
+        }
+
+        int reason = 0;
+        if (_reinitTransaction == 0)
+        {
+            reason = _reinitPending;
+            _reinitPending = 0;
+        }
+        if (not streamActive)
+        {
+            _hopDue = false;
+            continue;
+        }
+
+        // next scan entry, published before the retune so that
+        // rx_callback waits for the rfChanged that comes with it
+        if (_hopDue.exchange(false) and not _scanList.empty())
+        {
+            _scanIndex = (_scanIndex + 1) % _scanList.size();
+            const ScanEntry &entry = _scanList[_scanIndex];
+            const bool retune = (entry.frequency != centerFrequency) or (reason & mir_sdr_CHANGE_RF_FREQ);
+            centerFrequency = entry.frequency;
+            _hopFrequency = entry.frequency;
+            const double dwellMs = (entry.dwellMs > 0.0) ? entry.dwellMs : _scanDwellMs;
+            _hopDwell = std::max(1LL, std::llround(dwellMs * getHardwareRate() / 1000.0));
+            _hopSettle = retune;
+            _hopSeq.fetch_add(1, std::memory_order_release);
+            if (retune) reason |= mir_sdr_CHANGE_RF_FREQ;
+        }
+        if (reason == 0) continue;
+
+        // a replay has no hardware to reinit, the recording sets rate and frequency
+        if (_replay) continue;
+
+        const bool rateChange = (reason & (mir_sdr_CHANGE_FS_FREQ | mir_sdr_CHANGE_IF_TYPE)) != 0;
+
+        // the first callback after mir_sdr_Reinit may already report the change,
+        // so the rx path gets the new values before the hardware does
+        const RxTuning applied = _hwTuning;
+        int due = 0;
+        if (rateChange)
+        {
+            _hwTuning.sampleRate = sampleRate;
+            _hwTuning.decM = decM;
+            due |= RX_TUNING_RATE;
+        }
+        if (reason & mir_sdr_CHANGE_RF_FREQ)
+        {
+            _hwTuning.frequency = centerFrequency;
+            due |= RX_TUNING_FREQ;
+        }
+        if (due != 0) publishRxTuning(due);
+
+        // the setters go on while the hardware reinits with this snapshot
+        const int gRdBSent = gRdB;
+        int gRdBOut = gRdB, gRdBsystemOut = gRdBsystem, spsOut = sps;
+        const double fsMHz = (reason & mir_sdr_CHANGE_FS_FREQ) ? sampleRate / 1e6 : 0.0;
+        const double rfMHz = (reason & mir_sdr_CHANGE_RF_FREQ) ? centerFrequency / 1e6 : 0.0;
+        const mir_sdr_Bw_MHzT bwType = (reason & mir_sdr_CHANGE_BW_TYPE) ? bwMode : mir_sdr_BW_Undefined;
+        const mir_sdr_If_kHzT ifType = (reason & mir_sdr_CHANGE_IF_TYPE) ? ifMode : mir_sdr_IF_Undefined;
+        const bool decimate = rateChange and ifMode == mir_sdr_IF_Zero;
+        const unsigned int decEnableSent = decEnable, decMSent = decM;
+        const int lnaStateSent = lnaState;
+        lock.unlock();
+
+        mir_sdr_ErrT err;
+        {
+            std::lock_guard <std::mutex> api(_api_mutex);
+            if (reason & mir_sdr_CHANGE_IF_TYPE)
+            {
+                mir_sdr_DecimateControl(0, 1, 1);
+            }
+            err = mir_sdr_Reinit(&gRdBOut, fsMHz, rfMHz, bwType, ifType, mir_sdr_LO_Undefined, lnaStateSent,
+                                 &gRdBsystemOut, mir_sdr_USE_RSP_SET_GR, &spsOut, (mir_sdr_ReasonForReinitT)reason);
+            if (decimate)
+            {
+                mir_sdr_DecimateControl(decEnableSent, decMSent, 1);
+            }
+        }
+        if (err != mir_sdr_Success)
+        {
+            SoapySDR_logf(SOAPY_SDR_ERROR, "mir_sdr_Reinit(0x%x) Error %d", reason, err);
+        }
+        SoapySDR_logf(SOAPY_SDR_DEBUG, "mir_sdr_Reinit reasons 0x%x", reason);
+
+        lock.lock();
+        gRdBsystem = gRdBsystemOut;
+        sps = spsOut;
+        // a gain set meanwhile has its own reinit queued
+        if (gRdB == gRdBSent) gRdB = gRdBOut;
+
+        // nothing changes, the rx path settles back on the old values
+        if (err != mir_sdr_Success and due != 0)
+        {
+            _hwTuning = applied;
+            publishRxTuning(due);
+        }
+    }
 }
 
 /*******************************************************************
@@ -132,6 +626,7 @@ std::string SoapySDRPlay::getDriverKey(void) const
 
 std::string SoapySDRPlay::getHardwareKey(void) const
 {
+    if (_replay) return "Replay";
     if (hwVer > 253) return "RSP1A";
     if (hwVer == 3) return "RSPduo";
     return "RSP" + std::to_string(hwVer);
@@ -146,6 +641,11 @@ SoapySDR::Kwargs SoapySDRPlay::getHardwareInfo(void) const
     hwArgs["mir_sdr_api_version"] = std::to_string(ver);
     hwArgs["mir_sdr_hw_version"] = std::to_string(hwVer);
     hwArgs["serial"] = serNo;
+    if (_replay)
+    {
+        hwArgs["replay"] = _replay->path();
+        hwArgs["replay_hw"] = _replay->hw();
+    }
     return hwArgs;
 }
 
@@ -155,7 +655,8 @@ SoapySDR::Kwargs SoapySDRPlay::getHardwareInfo(void) const
 
 size_t SoapySDRPlay::getNumChannels(const int dir) const
 {
-    return (dir == SOAPY_SDR_RX) ? 1 : 0;
+    // the wideband channel 0 and the virtual channels
+    return (dir == SOAPY_SDR_RX) ? 1 + _channelStreams.size() : 0;
 }
 
 /*******************************************************************
@@ -194,6 +695,7 @@ void SoapySDRPlay::setAntenna(const int direction, const size_t channel, const s
     }
 
     std::lock_guard <std::mutex> lock(_general_state_mutex);
+    std::lock_guard <std::mutex> api(_api_mutex);
 
     if (hwVer == 2)
     {
@@ -214,10 +716,7 @@ void SoapySDRPlay::setAntenna(const int direction, const size_t channel, const s
             amPort = 1;
             mir_sdr_AmPortSelect(amPort);
 
-            if (streamActive)
-            {
-                mir_sdr_Reinit(&gRdB, 0.0, 0.0, mir_sdr_BW_Undefined, mir_sdr_IF_Undefined, mir_sdr_LO_Undefined, lnaState, &gRdBsystem, mir_sdr_USE_RSP_SET_GR, &sps, mir_sdr_CHANGE_AM_PORT);
-            }
+            requestReinit(mir_sdr_CHANGE_AM_PORT);
         }
 
         if (changeToAntennaA_B)
@@ -231,10 +730,7 @@ void SoapySDRPlay::setAntenna(const int direction, const size_t channel, const s
             
                 mir_sdr_RSPII_AntennaControl(antSel);
 
-                if (streamActive)
-                {
-                    mir_sdr_Reinit(&gRdB, 0.0, 0.0, mir_sdr_BW_Undefined, mir_sdr_IF_Undefined, mir_sdr_LO_Undefined, lnaState, &gRdBsystem, mir_sdr_USE_RSP_SET_GR, &sps, mir_sdr_CHANGE_AM_PORT);
-                }
+                requestReinit(mir_sdr_CHANGE_AM_PORT);
             }
             else
             {
@@ -281,10 +777,7 @@ void SoapySDRPlay::setAntenna(const int direction, const size_t channel, const s
 
         mir_sdr_AmPortSelect(amPort);
 
-        if (streamActive)
-        {
-            mir_sdr_Reinit(&gRdB, 0.0, 0.0, mir_sdr_BW_Undefined, mir_sdr_IF_Undefined, mir_sdr_LO_Undefined, lnaState, &gRdBsystem, mir_sdr_USE_RSP_SET_GR, &sps, mir_sdr_CHANGE_AM_PORT);
-        }
+        requestReinit(mir_sdr_CHANGE_AM_PORT);
     }
 }
 
@@ -342,6 +835,8 @@ void SoapySDRPlay::setDCOffsetMode(const int direction, const size_t channel, co
 
     //enable/disable automatic DC removal
     dcOffsetMode = automatic;
+    if (_replay) return;
+    std::lock_guard <std::mutex> api(_api_mutex);
     mir_sdr_DCoffsetIQimbalanceControl((unsigned int)automatic, (unsigned int)automatic);
 }
 
@@ -385,11 +880,14 @@ void SoapySDRPlay::setGainMode(const int direction, const size_t channel, const
 
     agcMode = mir_sdr_AGC_DISABLE;
 
+    // a replay follows the recorded gain
     if (automatic == true) {
         agcMode = mir_sdr_AGC_100HZ;
         //align known agc values with current value before starting AGC.
-        current_gRdB = gRdB;
+        if (not _replay) current_gRdB = gRdB;
     }
+    if (_replay) return;
+    std::lock_guard <std::mutex> api(_api_mutex);
     mir_sdr_AgcControl(agcMode, setPoint, 0, 0, 0, 0, lnaState);
 }
 
@@ -404,6 +902,9 @@ void SoapySDRPlay::setGain(const int direction, const size_t channel, const std:
 {
     std::lock_guard <std::mutex> lock(_general_state_mutex);
 
+   // a replay follows the recorded gain
+   if (_replay) return;
+
    bool doUpdate = false;
 
    if (name == "IFGR")
@@ -426,21 +927,23 @@ void SoapySDRPlay::setGain(const int direction, const size_t channel, const std:
           doUpdate = true;
       }
    }
-   if ((doUpdate == true) && (streamActive))
+   if (doUpdate == true)
    {
-      mir_sdr_Reinit(&gRdB, 0.0, 0.0, mir_sdr_BW_Undefined, mir_sdr_IF_Undefined, mir_sdr_LO_Undefined, lnaState, &gRdBsystem, mir_sdr_USE_RSP_SET_GR, &sps, mir_sdr_CHANGE_GR);
+      requestReinit(mir_sdr_CHANGE_GR);
    }
 }
 
 double SoapySDRPlay::getGain(const int direction, const size_t channel, const std::string &name) const
 {
-    std::lock_guard <std::mutex> lock(_general_state_mutex);
-
+   // follows gr_callback without taking the lock
    if (name == "IFGR")
    {
-       return current_gRdB;
+       return current_gRdB.load(std::memory_order_relaxed);
    }
-   else if (name == "RFGR")
+
+    std::lock_guard <std::mutex> lock(_general_state_mutex);
+
+   if (name == "RFGR")
    {
       return lnaState;
    }
@@ -485,20 +988,36 @@ void SoapySDRPlay::setFrequency(const int direction,
 {
     std::lock_guard <std::mutex> lock(_general_state_mutex);
 
-   if (direction == SOAPY_SDR_RX)
+   if ((direction == SOAPY_SDR_RX) && (channel > 0) && (name == "RF"))
+   {
+      // a virtual channel mixes its frequency down from the tuned band
+      if (channel > _channelStreams.size()) throw std::runtime_error("setFrequency invalid channel " + std::to_string(channel));
+      if (std::abs(frequency - centerFrequency) > getHardwareRate() / 2)
+      {
+         throw std::runtime_error("setFrequency " + std::to_string(frequency) + " outside the tuned band for channel " + std::to_string(channel));
+      }
+      _channelizer->setFrequency(channel - 1, frequency);
+   }
+   else if (direction == SOAPY_SDR_RX)
    {
-      if ((name == "RF") && (centerFrequency != (uint32_t)frequency))
+      if ((name == "RF") && _replay)
+      {
+         // the captures of the recording tune a replay
+         SoapySDR_logf(SOAPY_SDR_DEBUG, "Replay: setFrequency(%f) ignored", frequency);
+      }
+      else if ((name == "RF") && (centerFrequency != (uint32_t)frequency))
       {
          centerFrequency = (uint32_t)frequency;
-         if (streamActive)
-         {
-            mir_sdr_Reinit(&gRdB, 0.0, frequency / 1e6, mir_sdr_BW_Undefined, mir_sdr_IF_Undefined, mir_sdr_LO_Undefined, lnaState, &gRdBsystem, mir_sdr_USE_RSP_SET_GR, &sps, mir_sdr_CHANGE_RF_FREQ);
-         }
+         requestReinit(mir_sdr_CHANGE_RF_FREQ);
       }
       else if ((name == "CORR") && (ppm != frequency))
       {
          ppm = frequency;
-         mir_sdr_SetPpm(ppm);
+         if (not _replay)
+         {
+            std::lock_guard <std::mutex> api(_api_mutex);
+            mir_sdr_SetPpm(ppm);
+         }
       }
    }
 }
@@ -507,7 +1026,11 @@ double SoapySDRPlay::getFrequency(const int direction, const size_t channel, con
 {
     std::lock_guard <std::mutex> lock(_general_state_mutex);
 
-    if (name == "RF")
+    if ((name == "RF") && (channel > 0) && (channel <= _channelStreams.size()))
+    {
+        return _channelizer->getFrequency(channel - 1, centerFrequency);
+    }
+    else if (name == "RF")
     {
         return (double)centerFrequency;
     }
@@ -530,7 +1053,13 @@ std::vector<std::string> SoapySDRPlay::listFrequencies(const int direction, cons
 SoapySDR::RangeList SoapySDRPlay::getFrequencyRange(const int direction, const size_t channel,  const std::string &name) const
 {
     SoapySDR::RangeList results;
-    if (name == "RF")
+    if ((name == "RF") && (channel > 0))
+    {
+       // anywhere inside the tuned band
+       const double halfRate = getHardwareRate() / 2;
+       results.push_back(SoapySDR::Range(centerFrequency - halfRate, centerFrequency + halfRate));
+    }
+    else if (name == "RF")
     {
        results.push_back(SoapySDR::Range(10000, 2000000000));
     }
@@ -554,32 +1083,67 @@ void SoapySDRPlay::setSampleRate(const int direction, const size_t channel, cons
 
     SoapySDR_logf(SOAPY_SDR_DEBUG, "Setting sample rate: %d", sampleRate);
 
-    if (direction == SOAPY_SDR_RX)
+    if ((direction == SOAPY_SDR_RX) && (channel > 0))
+    {
+       // virtual channels resample from the hardware rate
+       if (channel > _channelStreams.size()) throw std::runtime_error("setSampleRate invalid channel " + std::to_string(channel));
+       if ((rate < MIN_SAMPLE_RATE) || (rate > getHardwareRate()))
+       {
+          throw std::runtime_error("setSampleRate " + std::to_string(rate) + " out of range for channel " + std::to_string(channel));
+       }
+       _channelizer->setRate(channel - 1, (uint32_t)rate);
+    }
+    else if ((direction == SOAPY_SDR_RX) && _replay)
+    {
+       // the recording fixes the hardware rate, the resampler delivers lower ones
+       if ((rate < MIN_SAMPLE_RATE) || (rate > getHardwareRate()))
+       {
+          throw std::runtime_error("setSampleRate " + std::to_string(rate) + " out of range for the replay");
+       }
+       if (reqSampleRate != (uint32_t)rate)
+       {
+          reqSampleRate = (uint32_t)rate;
+          updateBlockSize();
+          resetBuffer = true;
+          publishRxTuning(RX_TUNING_OUTPUT);
+       }
+    }
+    else if (direction == SOAPY_SDR_RX)
     {
        unsigned int decMp = decM;
+       mir_sdr_Bw_MHzT bwModep = bwMode;
+       uint32_t currReqSampleRate = reqSampleRate;
        reqSampleRate = (uint32_t)rate;
        uint32_t currSampleRate = sampleRate;
 
        sampleRate = getInputSampleRateAndDecimation(reqSampleRate, &decM, &decEnable, ifMode);
        bwMode = getBwEnumForRate(rate, ifMode);
 
-       if ((sampleRate != currSampleRate) || (decM != decMp) || (reqSampleRate != sampleRate))
+       if ((sampleRate != currSampleRate) || (decM != decMp) || (reqSampleRate != currReqSampleRate))
        {
+          updateBlockSize();
           resetBuffer = true;
-          if (streamActive)
-          {
-             mir_sdr_Reinit(&gRdB, sampleRate / 1e6, 0.0, bwMode, mir_sdr_IF_Undefined, mir_sdr_LO_Undefined, lnaState, &gRdBsystem, mir_sdr_USE_RSP_SET_GR, &sps, (mir_sdr_ReasonForReinitT)(mir_sdr_CHANGE_FS_FREQ | mir_sdr_CHANGE_BW_TYPE));
-             if (ifMode == mir_sdr_IF_Zero)
-             {
-                mir_sdr_DecimateControl(decEnable, decM, 1);
-             }
-          }
+       }
+       // a new output rate goes with the reinit when the hardware rate changes too
+       if ((sampleRate != currSampleRate) || (decM != decMp))
+       {
+          requestReinit(mir_sdr_CHANGE_FS_FREQ | mir_sdr_CHANGE_BW_TYPE);
+       }
+       else
+       {
+          // the same hardware rate may still want another IF filter
+          if (bwMode != bwModep) requestReinit(mir_sdr_CHANGE_BW_TYPE);
+          if (reqSampleRate != currReqSampleRate) publishRxTuning(RX_TUNING_OUTPUT);
        }
     }
 }
 
 double SoapySDRPlay::getSampleRate(const int direction, const size_t channel) const
 {
+   if ((channel > 0) && (channel <= _channelStreams.size()))
+   {
+      return _channelizer->getRate(channel - 1);
+   }
    return reqSampleRate;
 }
 
@@ -587,6 +1151,9 @@ std::vector<double> SoapySDRPlay::listSampleRates(const int direction, const siz
 {
     std::vector<double> rates;
 
+    rates.push_back(48000);
+    rates.push_back(96000);
+    rates.push_back(192000);
     rates.push_back(250000);
     rates.push_back(500000);
     rates.push_back(1000000);
@@ -600,28 +1167,51 @@ std::vector<double> SoapySDRPlay::listSampleRates(const int direction, const siz
     rates.push_back(8000000);
     rates.push_back(9000000);
     rates.push_back(10000000);
-    
+
+    // virtual channels and replays stay below the hardware rate
+    if ((channel > 0) || _replay)
+    {
+        const double maxRate = getHardwareRate();
+        rates.erase(std::remove_if(rates.begin(), rates.end(), [maxRate](double rate){ return rate > maxRate; }), rates.end());
+    }
+
     return rates;
 }
 
+SoapySDR::RangeList SoapySDRPlay::getSampleRateRange(const int direction, const size_t channel) const
+{
+    SoapySDR::RangeList results;
+
+    // any rate below the hardware output rate is resampled in software
+    if ((channel > 0) || _replay)        results.push_back(SoapySDR::Range(MIN_SAMPLE_RATE, getHardwareRate()));
+    else if (ifMode == mir_sdr_IF_2_048)      results.push_back(SoapySDR::Range(MIN_SAMPLE_RATE, 2048000));
+    else if (ifMode == mir_sdr_IF_0_450) results.push_back(SoapySDR::Range(MIN_SAMPLE_RATE, 1000000));
+    else                                 results.push_back(SoapySDR::Range(MIN_SAMPLE_RATE, 10000000));
+
+    return results;
+}
+
+// the hardware runs at the lowest output rate at or above the requested one,
+// getOutputRate() != getHardwareRate() enables the software resampler
 uint32_t SoapySDRPlay::getInputSampleRateAndDecimation(uint32_t rate, unsigned int *decM, unsigned int *decEnable, mir_sdr_If_kHzT ifMode)
 {
    if (ifMode == mir_sdr_IF_2_048)
    {
-      if      (rate == 2048000) { *decM = 4; *decEnable = 1; return 8192000; }
+      *decM = 4; *decEnable = 1; return 8192000;
    }
    else if (ifMode == mir_sdr_IF_0_450)
    {
-      if      (rate == 1000000) { *decM = 2; *decEnable = 1; return 2000000; }
-      else if (rate == 500000)  { *decM = 4; *decEnable = 1; return 2000000; }
+      if (rate <= 500000) { *decM = 4; *decEnable = 1; return 2000000; }
+      else                { *decM = 2; *decEnable = 1; return 2000000; }
    }
    else if (ifMode == mir_sdr_IF_Zero)
    {
+      if (rate >= 2000000) { *decM = 1; *decEnable = 0; return rate; }
 
-      if      ((rate >= 200000)  && (rate < 500000))  { *decM = 8; *decEnable = 1; return 2000000; }
-      else if ((rate >= 500000)  && (rate < 1000000)) { *decM = 4; *decEnable = 1; return 2000000; }
-      else if ((rate >= 1000000) && (rate < 2000000)) { *decM = 2; *decEnable = 1; return 2000000; }
-      else                                            { *decM = 1; *decEnable = 0; return rate; }
+      *decM = 1;
+      while ((*decM < MAX_HW_DECIMATION) && (2000000 / (*decM * 2) >= rate)) *decM *= 2;
+      *decEnable = (*decM > 1) ? 1 : 0;
+      return 2000000;
    }
 
    // this is invalid, but return something
@@ -641,10 +1231,7 @@ void SoapySDRPlay::setBandwidth(const int direction, const size_t channel, const
       if (getBwValueFromEnum(bwMode) != bw_in)
       {
          bwMode = mirGetBwMhzEnum(bw_in);
-         if (streamActive)
-         {
-            mir_sdr_Reinit(&gRdB, 0.0, 0.0, bwMode, mir_sdr_IF_Undefined, mir_sdr_LO_Undefined, lnaState, &gRdBsystem, mir_sdr_USE_RSP_SET_GR, &sps, mir_sdr_CHANGE_BW_TYPE);
-         }
+         requestReinit(mir_sdr_CHANGE_BW_TYPE);
       }
    }
 }
@@ -701,9 +1288,11 @@ double SoapySDRPlay::getRateForBwEnum(mir_sdr_Bw_MHzT bwEnum)
 
 mir_sdr_Bw_MHzT SoapySDRPlay::getBwEnumForRate(double rate, mir_sdr_If_kHzT ifMode)
 {
+   // lower rates decimate from 2 MHz, the narrowest filter keeps
+   // the rest of the band from aliasing into the decimator
    if (ifMode == mir_sdr_IF_Zero)
    {
-      if      ((rate >= 200000)  && (rate < 300000))  return mir_sdr_BW_0_200;
+      if      (rate < 300000)                         return mir_sdr_BW_0_200;
       else if ((rate >= 300000)  && (rate < 600000))  return mir_sdr_BW_0_300;
       else if ((rate >= 600000)  && (rate < 1536000)) return mir_sdr_BW_0_600;
       else if ((rate >= 1536000) && (rate < 5000000)) return mir_sdr_BW_1_536;
@@ -714,13 +1303,13 @@ mir_sdr_Bw_MHzT SoapySDRPlay::getBwEnumForRate(double rate, mir_sdr_If_kHzT ifMo
    }
    else if ((ifMode == mir_sdr_IF_0_450) || (ifMode == mir_sdr_IF_1_620))
    {
-      if      ((rate >= 200000)  && (rate < 500000))  return mir_sdr_BW_0_200;
+      if      (rate < 500000)                         return mir_sdr_BW_0_200;
       else if ((rate >= 500000)  && (rate < 1000000)) return mir_sdr_BW_0_300;
       else                                            return mir_sdr_BW_0_600;
    }
    else
    {
-      if      ((rate >= 200000)  && (rate < 500000))  return mir_sdr_BW_0_200;
+      if      (rate < 500000)                         return mir_sdr_BW_0_200;
       else if ((rate >= 500000)  && (rate < 1000000)) return mir_sdr_BW_0_300;
       else if ((rate >= 1000000) && (rate < 1536000)) return mir_sdr_BW_0_600;
       else                                            return mir_sdr_BW_1_536;
@@ -912,6 +1501,111 @@ SoapySDR::ArgInfoList SoapySDRPlay::getSettingInfo(void) const
     SetPointArg.range = SoapySDR::Range(-60, 0);
     setArgs.push_back(SetPointArg);
 
+    SoapySDR::ArgInfo ConvArg;
+    ConvArg.key = "convert_kernel";
+    ConvArg.value = "auto";
+    ConvArg.name = "Conversion Kernel";
+    ConvArg.description = "Sample conversion kernel used by the rx callback";
+    ConvArg.type = SoapySDR::ArgInfo::STRING;
+    ConvArg.options.push_back("auto");
+    for (const auto &name : SoapySDRPlay_listConverters())
+    {
+       ConvArg.options.push_back(name);
+    }
+    setArgs.push_back(ConvArg);
+
+    SoapySDR::ArgInfo Cs8ShiftArg;
+    Cs8ShiftArg.key = "cs8_shift";
+    Cs8ShiftArg.value = "8";
+    Cs8ShiftArg.name = "CS8 Shift";
+    Cs8ShiftArg.description = "Right shift of the 16 bit samples for the CS8 format, smaller values add gain and saturate";
+    Cs8ShiftArg.type = SoapySDR::ArgInfo::INT;
+    Cs8ShiftArg.range = SoapySDR::Range(0, 8);
+    setArgs.push_back(Cs8ShiftArg);
+
+    SoapySDR::ArgInfo RoundingArg;
+    RoundingArg.key = "pack_rounding";
+    RoundingArg.value = "true";
+    RoundingArg.name = "Round Packed Samples";
+    RoundingArg.description = "Round to nearest instead of truncating for the CS8 and CS12 formats";
+    RoundingArg.type = SoapySDR::ArgInfo::BOOL;
+    setArgs.push_back(RoundingArg);
+
+    SoapySDR::ArgInfo SwCorrArg;
+    SwCorrArg.key = "sw_correction";
+    SwCorrArg.value = "off";
+    SwCorrArg.name = "Software Correction";
+    SwCorrArg.description = "DC offset (dc) and IQ imbalance (dc_iq) correction in the CF32 conversion";
+    SwCorrArg.type = SoapySDR::ArgInfo::STRING;
+    SwCorrArg.options.push_back("off");
+    SwCorrArg.options.push_back("dc");
+    SwCorrArg.options.push_back("dc_iq");
+    setArgs.push_back(SwCorrArg);
+
+    SoapySDR::ArgInfo ReinitArg;
+    ReinitArg.key = "reinit";
+    ReinitArg.value = "commit";
+    ReinitArg.name = "Reinit Transaction";
+    ReinitArg.description = "Hold back hardware changes from begin and apply them with one reinit at commit";
+    ReinitArg.type = SoapySDR::ArgInfo::STRING;
+    ReinitArg.options.push_back("begin");
+    ReinitArg.options.push_back("commit");
+    setArgs.push_back(ReinitArg);
+
+    SoapySDR::ArgInfo ScanListArg;
+    ScanListArg.key = "scan_list";
+    ScanListArg.value = "off";
+    ScanListArg.name = "Scan List";
+    ScanListArg.description = "Hop over freq[:dwell_ms],... while streaming, each dwell ends with END_BURST";
+    ScanListArg.type = SoapySDR::ArgInfo::STRING;
+    setArgs.push_back(ScanListArg);
+
+    SoapySDR::ArgInfo ScanDwellArg;
+    ScanDwellArg.key = "scan_dwell_ms";
+    ScanDwellArg.value = std::to_string(DEFAULT_SCAN_DWELL_MS);
+    ScanDwellArg.name = "Scan Dwell";
+    ScanDwellArg.description = "Dwell for scan list entries without their own, in milliseconds";
+    ScanDwellArg.units = "ms";
+    ScanDwellArg.type = SoapySDR::ArgInfo::FLOAT;
+    setArgs.push_back(ScanDwellArg);
+
+    SoapySDR::ArgInfo RecordArg;
+    RecordArg.key = "record";
+    RecordArg.value = "";
+    RecordArg.name = "Record";
+    RecordArg.description = "Record the CS16 hardware samples to path.sigmf-data with SigMF metadata, empty stops";
+    RecordArg.type = SoapySDR::ArgInfo::STRING;
+    setArgs.push_back(RecordArg);
+
+    if (_replay)
+    {
+       SoapySDR::ArgInfo ReplaySpeedArg;
+       ReplaySpeedArg.key = "replay_speed";
+       ReplaySpeedArg.value = "1";
+       ReplaySpeedArg.name = "Replay Speed";
+       ReplaySpeedArg.description = "Multiple of real time the recording is replayed at, 0 as fast as the channel 0 stream takes it, from the next activateStream";
+       ReplaySpeedArg.type = SoapySDR::ArgInfo::FLOAT;
+       setArgs.push_back(ReplaySpeedArg);
+
+       SoapySDR::ArgInfo ReplayLoopArg;
+       ReplayLoopArg.key = "replay_loop";
+       ReplayLoopArg.value = "false";
+       ReplayLoopArg.name = "Replay Loop";
+       ReplayLoopArg.description = "Start over at the end of the recording instead of ending the stream";
+       ReplayLoopArg.type = SoapySDR::ArgInfo::BOOL;
+       setArgs.push_back(ReplayLoopArg);
+
+       SoapySDR::ArgInfo ReplayChunkArg;
+       ReplayChunkArg.key = "replay_chunk";
+       ReplayChunkArg.value = std::to_string(DEFAULT_REPLAY_CHUNK);
+       ReplayChunkArg.name = "Replay Chunk";
+       ReplayChunkArg.description = "Samples per stream callback of the replay";
+       ReplayChunkArg.units = "samples";
+       ReplayChunkArg.range = SoapySDR::Range(1, MAX_REPLAY_CHUNK);
+       ReplayChunkArg.type = SoapySDR::ArgInfo::INT;
+       setArgs.push_back(ReplayChunkArg);
+    }
+
     if (hwVer == 2) // RSP2/RSP2pro
     {
        SoapySDR::ArgInfo ExtRefArg;
@@ -1019,47 +1713,190 @@ void SoapySDRPlay::writeSetting(const std::string &key, const std::string &value
       else if (value == "7") lnaState = 7;
       else if (value == "8") lnaState = 8;
       else                   lnaState = 9;
-      if (agcMode != mir_sdr_AGC_DISABLE)
+      if ((agcMode != mir_sdr_AGC_DISABLE) && !_replay)
       {
+         std::lock_guard <std::mutex> api(_api_mutex);
          mir_sdr_AgcControl(agcMode, setPoint, 0, 0, 0, 0, lnaState);
       }
       else
       {
-         mir_sdr_Reinit(&gRdB, 0.0, 0.0, mir_sdr_BW_Undefined, mir_sdr_IF_Undefined, mir_sdr_LO_Undefined, lnaState, &gRdBsystem, mir_sdr_USE_RSP_SET_GR, &sps, mir_sdr_CHANGE_GR);
+         requestReinit(mir_sdr_CHANGE_GR);
       }
    }
    else
 #endif
    if (key == "if_mode")
    {
-      if (ifMode != stringToIF(value))
+      // a replay keeps the rate of the recording
+      if ((ifMode != stringToIF(value)) && !_replay)
       {
          ifMode = stringToIF(value);
          sampleRate = getInputSampleRateAndDecimation(reqSampleRate, &decM, &decEnable, ifMode);
          bwMode = getBwEnumForRate(reqSampleRate, ifMode);
-         if (streamActive)
-         {
-            mir_sdr_DecimateControl(0, 1, 1);
-            mir_sdr_Reinit(&gRdB, sampleRate / 1e6, 0.0, bwMode, ifMode, mir_sdr_LO_Undefined, lnaState, &gRdBsystem, mir_sdr_USE_RSP_SET_GR, &sps, (mir_sdr_ReasonForReinitT)(mir_sdr_CHANGE_FS_FREQ | mir_sdr_CHANGE_BW_TYPE | mir_sdr_CHANGE_IF_TYPE));
-         }
+         updateBlockSize();
+         requestReinit(mir_sdr_CHANGE_FS_FREQ | mir_sdr_CHANGE_BW_TYPE | mir_sdr_CHANGE_IF_TYPE);
       }
    }
    else if (key == "iqcorr_ctrl")
    {
       if (value == "false") IQcorr = 0;
       else                  IQcorr = 1;
-      mir_sdr_DCoffsetIQimbalanceControl(1, IQcorr);
+      if (!_replay)
+      {
+         std::lock_guard <std::mutex> api(_api_mutex);
+         mir_sdr_DCoffsetIQimbalanceControl(1, IQcorr);
+      }
       //mir_sdr_DCoffsetIQimbalanceControl(IQcorr, IQcorr);
    }
+   else if (key == "convert_kernel")
+   {
+      converter = SoapySDRPlay_getConverter(value);
+      converterName = value;
+      SoapySDR_logf(SOAPY_SDR_INFO, "Using conversion kernel '%s'", converter.load()->name);
+   }
+   else if (key == "cs8_shift")
+   {
+      const int shift = stoi(value);
+      if (shift < 0 or shift > 8) throw std::runtime_error("cs8_shift out of range: " + value);
+      cs8Shift = shift;
+   }
+   else if (key == "pack_rounding")
+   {
+      if (value == "false") packRounding = false;
+      else                  packRounding = true;
+   }
+   else if (key == "sw_correction")
+   {
+      if (value == "off")        swCorrection = SW_CORR_OFF;
+      else if (value == "dc")    swCorrection = SW_CORR_DC;
+      else if (value == "dc_iq") swCorrection = SW_CORR_DC_IQ;
+      else throw std::runtime_error("sw_correction unknown mode: " + value);
+      _corrReset = true;
+   }
+   else if (key == "reinit")
+   {
+      // transactions nest, the outermost commit hands the changes to the control thread
+      if (value == "begin") _reinitTransaction++;
+      else if (value == "commit")
+      {
+         if (_reinitTransaction > 0) _reinitTransaction--;
+         if (_reinitTransaction == 0 && _reinitPending != 0) wakeReinit(false);
+      }
+      else throw std::runtime_error("reinit unknown value: " + value);
+   }
+   else if (key == "scan_list")
+   {
+      // freq[:dwell_ms],... hops in order, empty or off stops at the last frequency
+      if (_replay && !value.empty() && value != "off")
+      {
+         throw std::runtime_error("scan_list can't retune a replay");
+      }
+      std::vector<ScanEntry> scanList;
+      size_t pos = 0;
+      while (value != "off" && pos < value.size())
+      {
+         size_t end = value.find(',', pos);
+         if (end == std::string::npos) end = value.size();
+         const std::string item = value.substr(pos, end - pos);
+         pos = end + 1;
+         if (item.empty()) continue;
+
+         const size_t colon = item.find(':');
+         ScanEntry entry;
+         entry.dwellMs = 0.0;
+         try
+         {
+            entry.frequency = std::stod(item.substr(0, colon));
+            if (colon != std::string::npos) entry.dwellMs = std::stod(item.substr(colon + 1));
+         }
+         catch (const std::logic_error &)
+         {
+            throw std::runtime_error("scan_list invalid entry: " + item);
+         }
+         if (colon != std::string::npos && entry.dwellMs <= 0.0)
+         {
+            throw std::runtime_error("scan_list dwell must be positive: " + item);
+         }
+         scanList.push_back(entry);
+      }
+      _scanList = scanList;
+      _scanListValue = scanList.empty() ? "off" : value;
+      _scanActive = not scanList.empty();
+      if (not scanList.empty())
+      {
+         _scanIndex = scanList.size() - 1;
+         wakeReinit(true);
+      }
+   }
+   else if (key == "record")
+   {
+      // a new path closes the running recording first
+      if (value.empty() or value == "off") _recorder.stop();
+      else _recorder.start(value, "SDRplay " + getHardwareKey() + " " + serNo);
+   }
+   else if (key == "replay_speed" && _replay)
+   {
+      double speed = 0.0;
+      try
+      {
+         speed = std::stod(value);
+      }
+      catch (const std::logic_error &)
+      {
+         throw std::runtime_error("replay_speed invalid value: " + value);
+      }
+      _replay->setSpeed(speed);
+   }
+   else if (key == "replay_loop" && _replay)
+   {
+      _replay->setLoop(value == "true");
+   }
+   else if (key == "replay_chunk" && _replay)
+   {
+      // parsed signed, stoul would wrap a negative value
+      long long chunk = 0;
+      try
+      {
+         chunk = std::stoll(value);
+      }
+      catch (const std::logic_error &)
+      {
+         throw std::runtime_error("replay_chunk invalid value: " + value);
+      }
+      if (chunk < 1 or chunk > MAX_REPLAY_CHUNK)
+      {
+         throw std::runtime_error("replay_chunk must be from 1 to " + std::to_string(MAX_REPLAY_CHUNK) + ": " + value);
+      }
+      _replay->setChunk((unsigned int)chunk);
+   }
+   else if (key == "scan_dwell_ms")
+   {
+      double dwellMs = 0.0;
+      try
+      {
+         dwellMs = std::stod(value);
+      }
+      catch (const std::logic_error &)
+      {
+         throw std::runtime_error("scan_dwell_ms invalid value: " + value);
+      }
+      if (dwellMs <= 0.0) throw std::runtime_error("scan_dwell_ms must be positive: " + value);
+      _scanDwellMs = dwellMs;
+   }
    else if (key == "agc_setpoint")
    {
       setPoint = stoi(value);
-      mir_sdr_AgcControl(agcMode, setPoint, 0, 0, 0, 0, lnaState);
+      if (!_replay)
+      {
+         std::lock_guard <std::mutex> api(_api_mutex);
+         mir_sdr_AgcControl(agcMode, setPoint, 0, 0, 0, 0, lnaState);
+      }
    }
    else if (key == "extref_ctrl")
    {
       if (value == "false") extRef = 0;
       else                  extRef = 1;
+      std::lock_guard <std::mutex> api(_api_mutex);
       if (hwVer == 2) mir_sdr_RSPII_ExternalReferenceControl(extRef);
       if (hwVer == 3) mir_sdr_rspDuo_ExtRef(extRef);
    }
@@ -1067,6 +1904,7 @@ void SoapySDRPlay::writeSetting(const std::string &key, const std::string &value
    {
       if (value == "false") biasTen = 0;
       else                  biasTen = 1;
+      std::lock_guard <std::mutex> api(_api_mutex);
       if (hwVer == 2) mir_sdr_RSPII_BiasTControl(biasTen);
       if (hwVer == 3) mir_sdr_rspDuo_BiasT(biasTen);
       if (hwVer > 253) mir_sdr_rsp1a_BiasT(biasTen);
@@ -1075,6 +1913,7 @@ void SoapySDRPlay::writeSetting(const std::string &key, const std::string &value
    {
       if (value == "false") notchEn = 0;
       else                  notchEn = 1;
+      std::lock_guard <std::mutex> api(_api_mutex);
       if (hwVer == 2) mir_sdr_RSPII_RfNotchEnable(notchEn);
       if (hwVer == 3)
       {
@@ -1087,6 +1926,7 @@ void SoapySDRPlay::writeSetting(const std::string &key, const std::string &value
    {
       if (value == "false") dabNotchEn = 0;
       else                  dabNotchEn = 1;
+      std::lock_guard <std::mutex> api(_api_mutex);
       if (hwVer == 3) mir_sdr_rspDuo_DabNotch(dabNotchEn);
       if (hwVer > 253) mir_sdr_rsp1a_DabNotch(dabNotchEn);
    }
@@ -1121,6 +1961,104 @@ std::string SoapySDRPlay::readSetting(const std::string &key) const
        if (IQcorr == 0) return "false";
        else             return "true";
     }
+    else if (key == "convert_kernel")
+    {
+       return converterName;
+    }
+    else if (key == "cs8_shift")
+    {
+       return std::to_string(cs8Shift.load());
+    }
+    else if (key == "pack_rounding")
+    {
+       if (packRounding) return "true";
+       else              return "false";
+    }
+    else if (key == "sw_correction")
+    {
+       if (swCorrection == SW_CORR_DC)    return "dc";
+       if (swCorrection == SW_CORR_DC_IQ) return "dc_iq";
+       return "off";
+    }
+    else if (key == "reinit")
+    {
+       // pending until the control thread has applied the queued changes
+       if (_reinitTransaction > 0) return "begin";
+       if (_reinitPending != 0)    return "pending";
+       return "commit";
+    }
+    else if (key == "scan_list")
+    {
+       return _scanListValue;
+    }
+    else if (key == "scan_dwell_ms")
+    {
+       return std::to_string(_scanDwellMs);
+    }
+    else if (key == "stream_event")
+    {
+       // the last change flagged by readStream, it applies from the sample at count
+       std::lock_guard <std::mutex> eventLock(_event_mutex);
+       std::string events;
+       if (_readEvent.events & SOAPY_SDRPLAY_GAIN_CHANGED)  events += "|gain";
+       if (_readEvent.events & SOAPY_SDRPLAY_FREQ_CHANGED)  events += "|frequency";
+       if (_readEvent.events & SOAPY_SDRPLAY_RATE_CHANGED)  events += "|rate";
+       if (_readEvent.events & SOAPY_SDRPLAY_COUNTER_RESET) events += "|reset";
+       if (events.empty()) return "";
+       return "events=" + events.substr(1) +
+              ", time_ns=" + std::to_string(_readEvent.timeNs) +
+              ", count=" + std::to_string(_readEvent.count) +
+              ", gr=" + std::to_string(_readEvent.gRdB) +
+              ", frequency=" + std::to_string(_readEvent.frequency) +
+              ", rate=" + std::to_string(_readEvent.rate);
+    }
+    else if (key == "record")
+    {
+       return _recorder.path();
+    }
+    else if (key == "replay_speed" && _replay)
+    {
+       return std::to_string(_replay->speed());
+    }
+    else if (key == "replay_loop" && _replay)
+    {
+       return _replay->loop() ? "true" : "false";
+    }
+    else if (key == "replay_chunk" && _replay)
+    {
+       return std::to_string(_replay->chunk());
+    }
+    else if (key == "stream_burst")
+    {
+       // the burst of the samples last returned by readStream, from its first pre-roll sample
+       std::lock_guard <std::mutex> eventLock(_event_mutex);
+       if (_readBurst.samples == 0) return "";
+       return "time_ns=" + std::to_string(_readBurst.timeNs) +
+              ", count=" + std::to_string(_readBurst.count) +
+              ", samples=" + std::to_string(_readBurst.samples) +
+              ", complete=" + (_readBurst.complete ? "true" : "false");
+    }
+    else if (key == "spectrum_frame")
+    {
+       // the frame last returned by readStream on the F32 spectrum stream
+       const SoapySDRPlaySpectrum::FrameInfo frame = _spectrum.lastRead();
+       if (frame.averages == 0) return "";
+       return "time_ns=" + std::to_string(frame.timeNs) +
+              ", frequency=" + std::to_string(frame.frequency) +
+              ", rate=" + std::to_string(frame.rate) +
+              ", bin_width=" + std::to_string(frame.rate / _spectrum.getMTU()) +
+              ", averages=" + std::to_string(frame.averages);
+    }
+    else if (key == "scan_frequency")
+    {
+       // capture frequency of the samples last returned by readStream
+       return std::to_string(_readFrequency.load());
+    }
+    else if (key == "overflow_samples")
+    {
+       // samples lost in the last reported overflow
+       return std::to_string(_overflowSamples.load());
+    }
     else if (key == "agc_setpoint")
     {
        return std::to_string(setPoint);
@@ -1149,3 +2087,282 @@ std::string SoapySDRPlay::readSetting(const std::string &key) const
     // SoapySDR_logf(SOAPY_SDR_WARNING, "Unknown setting '%s'", key.c_str());
     return "";
 }
+
+/*******************************************************************
+ * Sensor API
+ ******************************************************************/
+
+std::vector<std::string> SoapySDRPlay::listSensors(void) const
+{
+    std::vector<std::string> sensors;
+    sensors.push_back("callback_rate");
+    sensors.push_back("samples_in_rate");
+    sensors.push_back("samples_out_rate");
+    sensors.push_back("overflows");
+    sensors.push_back("dropped_samples");
+    sensors.push_back("bursts");
+    sensors.push_back("record_bytes");
+    sensors.push_back("record_dropped");
+    sensors.push_back("record_failed_writes");
+    if (_replay)
+    {
+        sensors.push_back("replay_samples");
+        sensors.push_back("replay_done");
+    }
+    sensors.push_back("queue_fill_min");
+    sensors.push_back("queue_fill_avg");
+    sensors.push_back("queue_fill_max");
+    sensors.push_back("convert_time_avg");
+    sensors.push_back("convert_time_max");
+    sensors.push_back("adc_overloads");
+    sensors.push_back("ifgr");
+    sensors.push_back("lna_gr");
+    sensors.push_back("gain_sample");
+    sensors.push_back("system_gain");
+    return sensors;
+}
+
+SoapySDR::ArgInfo SoapySDRPlay::getSensorInfo(const std::string &key) const
+{
+    SoapySDR::ArgInfo info;
+    info.key = key;
+    info.value = "0";
+    info.type = SoapySDR::ArgInfo::FLOAT;
+
+    if (key == "callback_rate")
+    {
+        info.name = "Callback Rate";
+        info.description = "Stream callbacks per second since the last read.";
+        info.units = "1/s";
+    }
+    else if (key == "samples_in_rate")
+    {
+        info.name = "Input Sample Rate";
+        info.description = "Samples per second received from the device since the last read.";
+        info.units = "Sps";
+    }
+    else if (key == "samples_out_rate")
+    {
+        info.name = "Output Sample Rate";
+        info.description = "Samples per second handed to the reader since the last read.";
+        info.units = "Sps";
+    }
+    else if (key == "overflows")
+    {
+        info.name = "Overflows";
+        info.description = "Overflows reported to the reader since setupStream().";
+        info.type = SoapySDR::ArgInfo::INT;
+    }
+    else if (key == "dropped_samples")
+    {
+        info.name = "Dropped Samples";
+        info.description = "Samples lost to overflows since setupStream().";
+        info.units = "samples";
+        info.type = SoapySDR::ArgInfo::INT;
+    }
+    else if (key == "bursts")
+    {
+        info.name = "Bursts";
+        info.description = "Bursts detected by the burst_threshold stream mode since setupStream().";
+        info.type = SoapySDR::ArgInfo::INT;
+    }
+    else if (key == "record_bytes")
+    {
+        info.name = "Recorded Bytes";
+        info.description = "Bytes written by the running or last recording.";
+        info.units = "bytes";
+        info.type = SoapySDR::ArgInfo::INT;
+    }
+    else if (key == "record_dropped")
+    {
+        info.name = "Recording Dropped Samples";
+        info.description = "Samples of the running or last recording dropped because the writer fell behind or failed.";
+        info.units = "samples";
+        info.type = SoapySDR::ArgInfo::INT;
+    }
+    else if (key == "record_failed_writes")
+    {
+        info.name = "Recording Failed Writes";
+        info.description = "Blocks of the running or last recording that could not be written.";
+        info.type = SoapySDR::ArgInfo::INT;
+    }
+    else if (key == "replay_samples")
+    {
+        info.name = "Replayed Samples";
+        info.description = "Samples of the recording delivered since activateStream().";
+        info.units = "samples";
+        info.type = SoapySDR::ArgInfo::INT;
+    }
+    else if (key == "replay_done")
+    {
+        info.name = "Replay Done";
+        info.description = "The replay reached the end of the recording, readStream() times out once the last samples are read.";
+        info.value = "false";
+        info.type = SoapySDR::ArgInfo::BOOL;
+    }
+    else if (key == "queue_fill_min" || key == "queue_fill_avg" || key == "queue_fill_max")
+    {
+        info.name = "Queue Fill";
+        info.description = "Minimum, average or maximum buffer queue fill seen by the stream callbacks since the last read.";
+        info.units = "%";
+    }
+    else if (key == "convert_time_avg" || key == "convert_time_max")
+    {
+        info.name = "Convert Time";
+        info.description = "Average or maximum time a stream callback spent converting and queueing samples since the last read.";
+        info.units = "us";
+    }
+    else if (key == "adc_overloads")
+    {
+        info.name = "ADC Overloads";
+        info.description = "ADC overloads detected since the device was opened.";
+        info.type = SoapySDR::ArgInfo::INT;
+    }
+    else if (key == "ifgr" || key == "lna_gr")
+    {
+        info.name = (key == "ifgr") ? "IF Gain Reduction" : "LNA Gain Reduction";
+        info.description = "Gain reduction last reported by the gain callback.";
+        info.units = "dB";
+        info.type = SoapySDR::ArgInfo::INT;
+    }
+    else if (key == "gain_sample")
+    {
+        info.name = "Gain Sample";
+        info.description = "Hardware sample index from which the last reported gain applies.";
+        info.type = SoapySDR::ArgInfo::INT;
+    }
+    else if (key == "system_gain")
+    {
+        info.name = "System Gain";
+        info.description = "Calibrated system gain at the last reported gain reduction.";
+        info.units = "dB";
+    }
+    else
+    {
+        throw std::runtime_error("getSensorInfo(" + key + ") unknown sensor");
+    }
+    return info;
+}
+
+bool SoapySDRPlay::statWindow(const std::string &key, const unsigned long long value, const unsigned long long count, double &dValue, double &dCount) const
+{
+    // change since the last read of the same sensor, _stat_mutex held,
+    // the first read covers everything since setupStream()
+    auto it = _statLast.find(key);
+    const bool found = (it != _statLast.end());
+    dValue = (double)value - (found ? it->second.value : 0.0);
+    dCount = (double)count - (found ? it->second.count : 0.0);
+    _statLast[key] = {(double)value, (double)count};
+    return found;
+}
+
+std::string SoapySDRPlay::readSensor(const std::string &key) const
+{
+    std::lock_guard <std::mutex> lock(_stat_mutex);
+
+    double dValue, dCount;
+    const unsigned long long nowNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+
+    if (key == "callback_rate" || key == "samples_in_rate" || key == "samples_out_rate")
+    {
+        const unsigned long long value = (key == "callback_rate") ? _statCallbacks.load() :
+                                         (key == "samples_in_rate") ? _statSamplesIn.load() : _statSamplesOut.load();
+        // the first read only starts the clock
+        if (not statWindow(key, value, nowNs, dValue, dCount) || dCount <= 0) return "0";
+        return std::to_string(dValue * 1e9 / dCount);
+    }
+    else if (key == "overflows")
+    {
+        return std::to_string(_statOverflows.load());
+    }
+    else if (key == "dropped_samples")
+    {
+        return std::to_string(_statDropped.load());
+    }
+    else if (key == "bursts")
+    {
+        return std::to_string(_statBursts.load());
+    }
+    else if (key == "record_bytes")
+    {
+        return std::to_string(_recorder.bytesWritten());
+    }
+    else if (key == "record_dropped")
+    {
+        return std::to_string(_recorder.droppedSamples());
+    }
+    else if (key == "record_failed_writes")
+    {
+        return std::to_string(_recorder.droppedWrites());
+    }
+    else if (key == "replay_samples" and _replay)
+    {
+        return std::to_string(_replay->samplesReplayed());
+    }
+    else if (key == "replay_done" and _replay)
+    {
+        return _replay->done() ? "true" : "false";
+    }
+    else if (key == "queue_fill_min" || key == "queue_fill_max")
+    {
+        // restart the window, no callback in it reads as 0
+        size_t fill;
+        if (key == "queue_fill_min")
+        {
+            fill = _statFillMin.exchange(SIZE_MAX);
+            if (fill == SIZE_MAX) fill = 0;
+        }
+        else
+        {
+            fill = _statFillMax.exchange(0);
+        }
+        return std::to_string(numBuffers ? 100.0 * fill / numBuffers : 0.0);
+    }
+    else if (key == "queue_fill_avg")
+    {
+        statWindow(key, _statFillSum.load(), _statCallbacks.load(), dValue, dCount);
+        if (dCount <= 0 || numBuffers == 0) return "0";
+        return std::to_string(100.0 * dValue / dCount / numBuffers);
+    }
+    else if (key == "convert_time_avg")
+    {
+        statWindow(key, _statConvertNs.load(), _statCallbacks.load(), dValue, dCount);
+        if (dCount <= 0) return "0";
+        return std::to_string(dValue / dCount / 1e3);
+    }
+    else if (key == "convert_time_max")
+    {
+        return std::to_string(_statConvertMaxNs.exchange(0) / 1e3);
+    }
+    else if (key == "adc_overloads")
+    {
+        return std::to_string(_statAdcOverloads.load());
+    }
+    else if (key == "ifgr" || key == "lna_gr" || key == "gain_sample")
+    {
+        const GainSnapshot snap = readGainSnapshot();
+        if (key == "ifgr")   return std::to_string(snap.ifGRdB);
+        if (key == "lna_gr") return std::to_string(snap.lnaGRdB);
+        return std::to_string(snap.count);
+    }
+    else if (key == "system_gain")
+    {
+        // the API query only runs when the gain changed since the last read
+        const GainSnapshot snap = readGainSnapshot();
+        if (snap.seq != _systemGainSeq and not _replay)
+        {
+            // serialized with the control thread, which may be in mir_sdr_Reinit
+            std::lock_guard <std::mutex> api(_api_mutex);
+            mir_sdr_GainValuesT gainVals;
+            if (mir_sdr_GetCurrentGain(&gainVals) == mir_sdr_Success)
+            {
+                _systemGain = gainVals.curr;
+                _systemGainSeq = snap.seq;
+            }
+        }
+        return std::to_string(_systemGain);
+    }
+
+    throw std::runtime_error("readSensor(" + key + ") unknown sensor");
+}
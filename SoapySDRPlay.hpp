@@ -35,6 +35,17 @@
 #include <cstring>
 #include <algorithm>
 #include <set>
+#include <map>
+#include <memory>
+
+#include "Convert.hpp"
+#include "Resampler.hpp"
+#include "Channelizer.hpp"
+#include "Scheduling.hpp"
+#include "BufferArena.hpp"
+#include "Spectrum.hpp"
+#include "Recorder.hpp"
+#include "Replay.hpp"
 
 #ifdef _WIN32
 #include <mir_sdr.h>
@@ -44,11 +55,77 @@
 
 #define DEFAULT_BUFFER_LENGTH     (65536)
 #define DEFAULT_NUM_BUFFERS       (8)
-#define DEFAULT_ELEMS_PER_SAMPLE  (2)
+#define DEFAULT_QUEUE_MS          (200)
+#define MIN_BUFFER_LENGTH         (4096)
+#define MAX_NUM_BUFFERS           (1024)
+
+#define CACHE_LINE_SIZE           (64)
+
+//lowest software resampled rate, and the largest zero IF hardware decimation
+#define MIN_SAMPLE_RATE           (8000)
+#define MAX_HW_DECIMATION         (32)
+
+//virtual channels, their buffers default to DDC_LATENCY_MS of samples
+#define MAX_DDC_CHANNELS          (64)
+#define DDC_LATENCY_MS            (20)
+
+//spectrum stream defaults
+#define DEFAULT_FFT_SIZE          (1024)
+#define DEFAULT_FRAME_RATE        (25)
+
+//scan dwell default, and how long a hop may wait for the tuner
+#define DEFAULT_SCAN_DWELL_MS     (100)
+#define SCAN_SETTLE_MAX_MS        (50)
+
+//how long the rx path waits for the fsChanged/rfChanged of a reinit
+#define REINIT_SETTLE_MAX_MS      (50)
+
+//rx_callback buffers are sized off the rx thread for callbacks of up
+//to this many samples, only a larger callback grows them there
+#define RX_RESERVE_SAMPLES        (8192)
+
+//burst extraction defaults, pre/post-roll and power smoothing
+#define DEFAULT_BURST_PRE_MS      (10)
+#define DEFAULT_BURST_POST_MS     (50)
+#define DEFAULT_BURST_TAU_MS      (1)
+
+//readStream() flags for hardware changes that take effect with the
+//first sample of the returned block, readSetting("stream_event") has the details
+#ifndef SOAPY_SDR_USER_FLAG0
+#define SOAPY_SDR_USER_FLAG0      (1 << 16)
+#define SOAPY_SDR_USER_FLAG1      (1 << 17)
+#define SOAPY_SDR_USER_FLAG2      (1 << 18)
+#define SOAPY_SDR_USER_FLAG3      (1 << 19)
+#endif
+#define SOAPY_SDRPLAY_GAIN_CHANGED   SOAPY_SDR_USER_FLAG0
+#define SOAPY_SDRPLAY_FREQ_CHANGED   SOAPY_SDR_USER_FLAG1
+#define SOAPY_SDRPLAY_RATE_CHANGED   SOAPY_SDR_USER_FLAG2
+#define SOAPY_SDRPLAY_COUNTER_RESET  SOAPY_SDR_USER_FLAG3
+#define SOAPY_SDRPLAY_EVENT_FLAGS    (SOAPY_SDRPLAY_GAIN_CHANGED | SOAPY_SDRPLAY_FREQ_CHANGED | \
+                                      SOAPY_SDRPLAY_RATE_CHANGED | SOAPY_SDRPLAY_COUNTER_RESET)
 
 #define MAX_RSP_DEVICES  (4)
 
-std::set<std::string> &SoapySDRPlay_getClaimedSerials(void);
+//enumeration results are reused for this long, cache_ttl_ms overrides it
+#define DEFAULT_ENUM_CACHE_TTL_MS (2000)
+
+//serials opened by this process, each change invalidates the device cache
+std::set<std::string> SoapySDRPlay_getClaimedSerials(void);
+void SoapySDRPlay_claimSerial(const std::string &serial);
+void SoapySDRPlay_releaseSerial(const std::string &serial);
+
+//mir_sdr_GetDevices() results shared by enumeration and the constructor,
+//the bus is scanned again once they are older than ttlMs or invalidated,
+//claimed devices the scan no longer offers keep their last entry
+struct SoapySDRPlayDeviceInfo
+{
+    std::string serial;
+    unsigned char hwVer;
+    unsigned int index;    // for mir_sdr_SetDeviceIdx()
+    bool available;
+};
+std::vector<SoapySDRPlayDeviceInfo> SoapySDRPlay_getDevices(const double ttlMs = DEFAULT_ENUM_CACHE_TTL_MS);
+void SoapySDRPlay_invalidateDevices(void);
 
 class SoapySDRPlay: public SoapySDR::Device
 {
@@ -187,6 +264,8 @@ public:
 
     std::vector<double> listSampleRates(const int direction, const size_t channel) const;
 
+    SoapySDR::RangeList getSampleRateRange(const int direction, const size_t channel) const;
+
     /*******************************************************************
     * Bandwidth API
     ******************************************************************/
@@ -203,6 +282,16 @@ public:
     
     bool hasDCOffset(const int direction, const size_t channel) const;
 
+    /*******************************************************************
+     * Sensor API
+     ******************************************************************/
+
+    std::vector<std::string> listSensors(void) const;
+
+    SoapySDR::ArgInfo getSensorInfo(const std::string &key) const;
+
+    std::string readSensor(const std::string &key) const;
+
     /*******************************************************************
      * Settings API
      ******************************************************************/
@@ -217,10 +306,18 @@ public:
      * Async API
      ******************************************************************/
 
-    void rx_callback(short *xi, short *xq, unsigned int numSamples);
+    void rx_callback(short *xi, short *xq, unsigned int firstSampleNum, unsigned int numSamples, unsigned int reset,
+                     int grChanged = 0, int rfChanged = 0, int fsChanged = 0);
 
     void gr_callback(unsigned int gRdB, unsigned int lnaGRdB);
 
+    //the replay thread in place of the hardware, see SoapySDRPlayReplayCallbacks
+    void replay_tune(const double frequency, const double rate);
+
+    bool replay_ready(void) const;
+
+    void replay_end(void);
+
 private:
 
     /*******************************************************************
@@ -241,6 +338,71 @@ private:
 
     static std::string IFtoString(mir_sdr_If_kHzT ifkHzT);
 
+    double getOutputRate(void) const;
+
+    double getHardwareRate(void) const;
+
+    void updateBlockSize(void);
+
+    void requestReinit(const int reason);
+
+    void wakeReinit(const bool hop);
+
+    void reinitLoop(void);
+
+    void publishRxTuning(const int due);
+
+    void rx_tuning(unsigned int numSamples, int rfChanged, int fsChanged);
+
+    void rx_swapResampler(void);
+
+    double rxHardwareRate(void) const;
+
+    double rxOutputRate(void) const;
+
+    size_t rxReserveSamples(void) const;
+
+    void prepareRx(const uint32_t rate, const unsigned int decimation, const uint32_t outputRate,
+                   SoapySDRPlayResampler &resampler, std::vector<short> &ringI, std::vector<short> &ringQ) const;
+
+    long long rx_timeNs(unsigned int firstSampleNum, unsigned int numSamples, unsigned int reset, long long &count);
+
+    void notifyReader(void);
+
+    void drainBuffers(void);
+
+    size_t streamChannel(SoapySDR::Stream *stream) const;
+
+    SoapySDR::Stream *setupChannelStream(const size_t channel, const std::string &format, const SoapySDR::Kwargs &args);
+
+    SoapySDR::Stream *setupSpectrumStream(const SoapySDR::Kwargs &args);
+
+    void rx_resample(short *xi, short *xq, unsigned int numSamples, const long long timeNs, const long long count, unsigned int reset);
+
+    void rx_deliver(short *xi, short *xq, unsigned int numSamples, const long long timeNs, const long long count);
+
+    void rx_burst(short *xi, short *xq, unsigned int numSamples, const long long timeNs, const long long count);
+
+    void rx_burstKeep(const short *xi, const short *xq, size_t numSamples);
+
+    void rx_burstStart(const long long timeNs, const long long count);
+
+    unsigned int rx_scan(unsigned int numSamples, int rfChanged);
+
+    void rx_flush(const bool endBurst);
+
+    void rx_event(const int events);
+
+    bool rx_reclaim(const size_t tail);
+
+    void rx_convert(const SoapySDRPlayConverter *conv, short *xi, short *xq, char *out, unsigned int numSamples);
+
+    bool rx_direct(short *xi, short *xq, unsigned int numSamples, const long long timeNs, const long long count, const SoapySDRPlayConverter *conv, const unsigned int sampleBytes);
+
+    int readDirect(void *buff0, const size_t numElems, const long timeoutUs);
+
+    bool statWindow(const std::string &key, const unsigned long long value, const unsigned long long count, double &dValue, double &dCount) const;
+
     /*******************************************************************
      * Private variables
      ******************************************************************/
@@ -251,6 +413,31 @@ private:
 
     int gRdB;
     std::atomic_int current_gRdB;
+
+    //gain state published by gr_callback, a seqlock so neither
+    //gr_callback nor the getters ever wait, _gainSeq is odd mid update
+    struct GainSnapshot
+    {
+        int ifGRdB;
+        int lnaGRdB;
+        long long count;   // hardware index of the first sample at this gain
+        long long timeNs;
+        unsigned int seq;
+    };
+    GainSnapshot readGainSnapshot(void) const;
+    std::atomic_uint _gainSeq;
+    std::atomic_int _gainIF;
+    std::atomic_int _gainLNA;
+    std::atomic<long long> _gainCount;
+    std::atomic<long long> _gainTimeNs;
+
+    //next hardware sample index and its time, published by rx_callback for gr_callback
+    std::atomic<long long> _rxCountNext;
+    std::atomic<long long> _rxTimeNext;
+
+    //calibrated system gain, queried from the API when a sensor read finds a newer snapshot
+    mutable unsigned int _systemGainSeq;
+    mutable double _systemGain;
     int gRdBsystem;
     int sps;
     int lnaState;
@@ -265,19 +452,212 @@ private:
     double ppm;
     std::atomic_int bufferLength;
 
-    //numBuffers, bufferElems, elementsPerSample
-    //are indeed constants
-    const size_t numBuffers = DEFAULT_NUM_BUFFERS;
-    const unsigned int bufferElems = DEFAULT_BUFFER_LENGTH;
-    const int elementsPerSample = DEFAULT_ELEMS_PER_SAMPLE;
-
-    std::atomic_uint shortsPerWord;
+    //numBuffers and bufferElems (buffer capacity) are sized
+    //by setupStream() and fixed while the stream exists
+    size_t numBuffers;
+    unsigned int bufferElems;
+
+    //target latency from the stream args, 0 when unused
+    double latencyMs;
+
+    //elements per delivered buffer, follows the output rate
+    std::atomic_size_t _blockElems;
+
+    //what rx_callback drops when the reader falls behind
+    enum OverflowPolicy
+    {
+        OVERFLOW_DROP_NEWEST,
+        OVERFLOW_DROP_OLDEST,
+        OVERFLOW_DROP_QUEUE
+    };
+    OverflowPolicy overflowPolicy;
+
+    //stream format and the size of one complex sample in the queue
+    enum StreamFormat
+    {
+        FORMAT_CS16,
+        FORMAT_CF32,
+        FORMAT_CS8,
+        FORMAT_CS12
+    };
+    std::atomic_int streamFormat;
+    std::atomic_uint bytesPerSample;
+
+    //CS8 scaling, and rounding instead of truncation for CS8 and CS12
+    std::atomic_uint cs8Shift;
+    std::atomic_bool packRounding;
+
+    //software DC and IQ imbalance correction for CF32,
+    //the corrector is only touched by the rx thread, _corrReset restarts it
+    enum SwCorrection
+    {
+        SW_CORR_OFF,
+        SW_CORR_DC,
+        SW_CORR_DC_IQ
+    };
+    std::atomic_int swCorrection;
+    std::atomic_bool _corrReset;
+    SoapySDRPlayCorrector _corrector;
+
+    //software rate conversion from the hardware rate to reqSampleRate,
+    //owned by the rx thread, _resampleConfigure picks up rate and IF
+    //changes, _resampleRestart only clears the filter history
+    std::atomic_bool _resampleConfigure;
+    bool _resampling;
+    bool _resampleRestart;
+    SoapySDRPlayResampler _resampler;
+    std::vector<short> _resampleI, _resampleQ;
+    long long _resampleInBase;     // hardware count and output count at the
+    long long _resampleOutBase;    // last rate change, to follow gaps
+    long long _resampleInNext;
+    long long _resampleOutNext;
+    long long _resampleTimeNs;     // time of output sample _resampleTimeCount
+    long long _resampleTimeCount;
+
+    //virtual channels 1..N cut out of the wideband channel 0,
+    //the hardware streams while any of them is active
+    struct ChannelStream
+    {
+        size_t channel;
+    };
+    std::unique_ptr<SoapySDRPlayChannelizer> _channelizer;
+    std::vector<ChannelStream> _channelStreams;
+
+    //F32 power spectrum frames of the wideband channel, a stream of its
+    //own numbered after the virtual channels
+    SoapySDRPlaySpectrum _spectrum;
+    ChannelStream _spectrumStream;
+
+    //SigMF recording of the hardware samples, the record setting starts and stops it
+    SoapySDRPlayRecorder _recorder;
+
+    //a recording in place of the hardware with the replay device argument,
+    //it owns the tuner frequency and hardware rate while streaming, the
+    //control thread applies its retunes to the settings under _wakeMutex
+    std::unique_ptr<SoapySDRPlayReplay> _replay;
+    bool _replayTuneDue;
+    double _replayTuneFrequency;
+    double _replayTuneRate;
+
+    //thread schedules from the stream args, the vendor thread and each
+    //stream's reader apply theirs once after activateStream()
+    void setupSchedules(const size_t channel, const SoapySDR::Kwargs &args);
+    SoapySDRPlaySchedule _rxSchedule;
+    std::atomic_bool _rxScheduleDue;
+    std::vector<SoapySDRPlaySchedule> _readerSchedules;
+    std::unique_ptr<std::atomic_bool[]> _readerScheduleDue;
+
+    //hardware changes queued for the control thread as OR'ed
+    //mir_sdr_ReasonForReinitT flags, held back while a reinit
+    //transaction is open, all under _general_state_mutex
+    int _reinitPending;
+    int _reinitTransaction;
+    bool _reinitStop;
+    std::thread _reinitThread;
+
+    //the control thread sleeps on its own small lock, rx_callback takes
+    //it for nothing more than raising _hopDue, the settings side marks
+    //_reinitWake after changing the state under _general_state_mutex
+    std::mutex _wakeMutex;
+    std::condition_variable _wakeCond;
+    bool _reinitWake;
+
+    //the rates and frequency the rx path works with, the setters only
+    //stage sampleRate, decM, reqSampleRate and centerFrequency, the
+    //control thread hands them over with the mir_sdr_Reinit that applies
+    //them and rx_callback takes them with the fsChanged/rfChanged that
+    //reports the change
+    struct RxTuning
+    {
+        uint32_t sampleRate;
+        unsigned int decM;
+        uint32_t outputRate;    // as requested, rxOutputRate() clamps it
+        uint32_t frequency;
+    };
+    enum
+    {
+        RX_TUNING_RATE = 1,     // waits for fsChanged
+        RX_TUNING_FREQ = 2,     // waits for rfChanged
+        RX_TUNING_OUTPUT = 4,   // resampler only, taken by the next callback
+        RX_TUNING_NOW = 8       // not streaming, taken by the next callback
+    };
+    RxTuning _hwTuning;         // as sent to the hardware, under _general_state_mutex
+    std::mutex _rxTuningMutex;  // guards the next values and _rxTuningDue
+    RxTuning _rxTuningNext;
+
+    //designed and sized with the next rates by the publishing thread,
+    //rx_callback swaps them in and the old ones are freed with the next
+    SoapySDRPlayResampler _resamplerNext;
+    std::vector<short> _burstRingNextI, _burstRingNextQ;
+    std::atomic_int _rxTuningDue;
+    RxTuning _rxTuning;         // owned by rx_callback
+    long long _rxTuningWait;    // samples since the oldest due change
+
+    //scan list hopping, the control thread retunes and publishes each hop
+    //with _hopSeq, rx_callback drops the samples until rfChanged and
+    //raises _hopDue once the dwell is complete
+    struct ScanEntry
+    {
+        double frequency;
+        double dwellMs;
+    };
+    std::vector<ScanEntry> _scanList;
+    std::string _scanListValue;
+    double _scanDwellMs;
+    size_t _scanIndex;
+    std::atomic_bool _scanActive;
+    std::atomic_bool _hopDue;
+    std::atomic_uint _hopSeq;
+    std::atomic<double> _hopFrequency;
+    std::atomic<long long> _hopDwell;
+    std::atomic_bool _hopSettle;
+
+    //scan state owned by rx_callback
+    enum ScanState
+    {
+        SCAN_OFF,       // not scanning
+        SCAN_WAIT,      // waiting for the next hop
+        SCAN_SETTLING,  // retuned, waiting for rfChanged
+        SCAN_DWELL      // delivering the dwell
+    };
+    int _scanState;
+    unsigned int _scanSeqSeen;
+    long long _scanRemain;
+    long long _scanSettled;
+    double _rxFrequency;
+    bool _segmentStart;
+    int _rxEvents;      // hardware changes waiting for the next block
+    std::atomic_bool _eventSplit;
+
+    //energy detect burst extraction on channel 0, only the samples around
+    //a running power above the threshold are queued, the detector and the
+    //pre-roll ring are owned by rx_callback, setupStream() configures them
+    std::atomic_bool _burstMode;
+    double _burstThresholdDb;
+    double _burstPreMs;
+    double _burstPostMs;
+    double _burstTauMs;
+    double _burstRate;         // output rate the values below are for, 0 to redo them
+    float _burstThreshold;     // on I*I+Q*Q
+    float _burstAlpha;
+    float _burstPower;
+    long long _burstPost;      // post-roll in samples
+    long long _burstHang;      // post-roll samples left
+    long long _burstNext;      // next output count, a jump restarts the detector
+    double _burstFrequency;
+    bool _burstOn;
+    std::vector<short> _burstRingI, _burstRingQ;
+    size_t _burstRingPos;
+    size_t _burstRingFill;
+
+    //sample conversion kernels used by rx_callback
+    std::atomic<const SoapySDRPlayConverter *> converter;
+    std::string converterName;
  
     mir_sdr_AgcControlT agcMode;
     std::atomic_bool streamActive;
   
     bool dcOffsetMode;
-    std::atomic_bool useShort;
 
     unsigned int IQcorr;
     int setPoint;
@@ -299,15 +679,147 @@ public:
     
     mutable std::mutex _general_state_mutex;
 
+    //serializes the mir_sdr calls, the control thread reinits without
+    //_general_state_mutex, taken after it where a thread holds both
+    mutable std::mutex _api_mutex;
+
+    //rx_callback only queues channel 0 samples while its stream is active
+    std::atomic_bool _wideActive;
+
+    //single producer (rx_callback) / single consumer (reader) ring,
+    //the mutex and condition variable are only used by a blocked reader
     std::mutex _buf_mutex;
     std::condition_variable _buf_cond;
-
-    std::vector<std::vector<short> > _buffs;
-    size_t	_buf_head;
-    size_t	_buf_tail;
-    size_t	_buf_count;
-    short *_currentBuff;
-    bool _overflowEvent;
+    std::atomic_bool _buf_waiting;
+
+    //numBuffers slots of bufferLength bytes, allocated by setupStream()
+    SoapySDRPlayBufferArena _arena;
+
+    //per buffer metadata, written by rx_callback before publishing
+    struct BufferMeta
+    {
+        size_t bytes;      // filled so far
+        long long timeNs;  // time of the first sample
+        long long count;   // hardware index of the first sample
+        double frequency;  // tuner frequency the samples were taken at
+        bool segment;      // first buffer after a hop, the count jumps
+        bool endBurst;     // last buffer of a scan dwell
+        int events;        // SOAPY_SDRPLAY_* changes at the first sample
+        int gRdB;          // gain reduction at the first sample
+        double rate;       // sample rate at the first sample
+    };
+    std::vector<BufferMeta> _buffMeta;
+
+    //monotonic ring indices, slot = index % numBuffers,
+    //each one on its own cache line to avoid false sharing
+    char _buf_pad0[CACHE_LINE_SIZE];
+    std::atomic_size_t _buf_head;      // written by the reader on release
+    char _buf_pad1[CACHE_LINE_SIZE - sizeof(std::atomic_size_t)];
+    std::atomic_size_t _buf_tail;      // written by rx_callback on publish
+    char _buf_pad2[CACHE_LINE_SIZE - sizeof(std::atomic_size_t)];
+    std::atomic_size_t _buf_acquired;  // reader, or rx_callback recycling the oldest buffer
+    char _buf_pad3[CACHE_LINE_SIZE - sizeof(std::atomic_size_t)];
+    std::atomic_bool _buf_drain;       // reader asks rx_callback to drop its partial buffer
+    bool _gapPending;                  // rx_callback lost samples since the last buffer
+    bool _fillAfterGap;                // the buffer being filled follows lost samples
+
+    //zero-copy handoff of a reader buffer to rx_callback,
+    //the request fields are owned by whoever holds _direct_state
+    enum DirectState
+    {
+        DIRECT_IDLE,     // no request
+        DIRECT_WAITING,  // posted by readStream, untouched
+        DIRECT_FILLING,  // rx_callback is converting into it
+        DIRECT_PARTIAL,  // holds samples, more may follow
+        DIRECT_DONE      // handed back to readStream
+    };
+    std::atomic_int _direct_state;
+    void *_direct_buff;
+    size_t _direct_capacity;
+    size_t _direct_elems;
+    long long _direct_timeNs;
+    long long _direct_count;
+    double _direct_frequency;
+    int _direct_events;
+    int _direct_gRdB;
+    double _direct_rate;
+    std::atomic_uint _callbackSamples;
+
+    //hardware sample counter extended to 64 bits by rx_callback,
+    //timestamps are anchored to the host clock at activateStream()
+    bool _counterValid;
+    unsigned int _counterNext;     // expected firstSampleNum of the next callback
+    long long _counterExtNext;
+    long long _timeBaseCount;
+    long long _timeBaseNs;
+    double _timeBaseRate;
+    long long _timeAnchorNs;
+
+    //next hardware sample index the reader expects, a jump is an overflow
+    long long _expectCount;
+    bool _expectValid;
+    bool _overflowPending;             // buffer after the reported gap, returned next
+    size_t _overflowHandle;
+    std::atomic<long long> _overflowSamples;
+
+    //streaming health counters behind the sensors API, relaxed atomics
+    //written by rx_callback, the reader or gr_callback as noted
+    std::atomic<unsigned long long> _statCallbacks;              // rx_callback
+    std::atomic<unsigned long long> _statSamplesIn;              // rx_callback
+    std::atomic<unsigned long long> _statFillSum;                // rx_callback, queued buffers per callback
+    mutable std::atomic_size_t _statFillMin;                     // rx_callback, reset by readSensor()
+    mutable std::atomic_size_t _statFillMax;                     // rx_callback, reset by readSensor()
+    std::atomic<unsigned long long> _statConvertNs;              // rx_callback
+    std::atomic<unsigned long long> _statBursts;                 // rx_callback
+    mutable std::atomic<unsigned long long> _statConvertMaxNs;   // rx_callback, reset by readSensor()
+    char _stat_pad[CACHE_LINE_SIZE];
+    std::atomic<unsigned long long> _statSamplesOut;             // reader
+    std::atomic<unsigned long long> _statOverflows;              // reader
+    std::atomic<unsigned long long> _statDropped;                // reader
+    std::atomic<unsigned long long> _statAdcOverloads;           // gr_callback
+
+    //value and count of windowed sensors at their last read
+    struct StatSnapshot
+    {
+        double value;
+        double count;
+    };
+    mutable std::mutex _stat_mutex;
+    mutable std::map<std::string, StatSnapshot> _statLast;
+
+    char *_currentBuff;
+    long long _currentTimeNs;
+    bool _currentEndBurst;
+    std::atomic<double> _readFrequency;    // of the samples last returned to the reader
+    double _readRate;
+
+    //the last hardware change returned by readStream(), for readSetting()
+    struct StreamEvent
+    {
+        int events;
+        long long timeNs;
+        long long count;
+        int gRdB;
+        double frequency;
+        double rate;
+    };
+    void setReadEvent(const int events, const long long timeNs, const long long count,
+                      const int gRdB, const double frequency, const double rate);
+    mutable std::mutex _event_mutex;
+    StreamEvent _readEvent;
+
+    //the burst the last buffer returned by readStream() belongs to, for readSetting()
+    struct StreamBurst
+    {
+        long long timeNs;   // of the first pre-roll sample
+        long long count;
+        long long samples;  // returned so far
+        bool complete;      // its END_BURST was returned
+    };
+    void setReadBurst(const bool start, const long long timeNs, const long long count,
+                      const long long samples, const bool complete);
+    StreamBurst _readBurst;
+    std::atomic_bool _overflowEvent;
     std::atomic_size_t bufferedElems;
     size_t _currentHandle;
     std::atomic_bool resetBuffer;
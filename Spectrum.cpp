@@ -0,0 +1,546 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "Spectrum.hpp"
+#include <SoapySDR/Constants.h>
+#include <SoapySDR/Errors.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+/*******************************************************************
+ * Complex FFT
+ ******************************************************************/
+
+SoapySDRPlayFFT::SoapySDRPlayFFT(void):
+    _size(0)
+{
+    return;
+}
+
+void SoapySDRPlayFFT::configure(const size_t size)
+{
+    _size = size;
+    _cos.resize(size / 2);
+    _sin.resize(size / 2);
+    for (size_t k = 0; k < size / 2; k++)
+    {
+        _cos[k] = (float)std::cos(2.0 * M_PI * k / size);
+        _sin[k] = (float)-std::sin(2.0 * M_PI * k / size);
+    }
+    _workRe.assign(size, 0.0f);
+    _workIm.assign(size, 0.0f);
+}
+
+size_t SoapySDRPlayFFT::size(void) const
+{
+    return _size;
+}
+
+void SoapySDRPlayFFT::transform(const SoapySDRPlayConverter *conv, float *re, float *im)
+{
+    //stage with stride s splits each of the s interleaved sequences
+    //of length n in two, the results alternate between the buffers
+    float *xr = re, *xi = im;
+    float *yr = _workRe.data(), *yi = _workIm.data();
+    for (size_t s = 1, n = _size; n > 1; s *= 2, n /= 2)
+    {
+        const size_t m = n / 2;
+        if (s >= 4)
+        {
+            //s butterflies in a row share their twiddle
+            for (size_t p = 0; p < m; p++)
+            {
+                conv->butterflyCF32(xr + s * p, xi + s * p, xr + s * (p + m), xi + s * (p + m),
+                                    yr + s * 2 * p, yi + s * 2 * p, yr + s * (2 * p + 1), yi + s * (2 * p + 1),
+                                    _cos[p * s], _sin[p * s], s);
+            }
+        }
+        else
+        {
+            //the first two stages run over the twiddles instead
+            for (size_t q = 0; q < s; q++)
+            {
+                for (size_t p = 0; p < m; p++)
+                {
+                    const float ar = xr[q + s * p], ai = xi[q + s * p];
+                    const float br = xr[q + s * (p + m)], bi = xi[q + s * (p + m)];
+                    const float wr = _cos[p * s], wi = _sin[p * s];
+                    const float tr = ar - br, ti = ai - bi;
+                    yr[q + s * 2 * p] = ar + br;
+                    yi[q + s * 2 * p] = ai + bi;
+                    yr[q + s * (2 * p + 1)] = tr * wr - ti * wi;
+                    yi[q + s * (2 * p + 1)] = tr * wi + ti * wr;
+                }
+            }
+        }
+        std::swap(xr, yr);
+        std::swap(xi, yi);
+    }
+
+    if (xr != re)
+    {
+        std::memcpy(re, xr, _size * sizeof(float));
+        std::memcpy(im, xi, _size * sizeof(float));
+    }
+}
+
+/*******************************************************************
+ * Spectrum settings
+ ******************************************************************/
+
+SoapySDRPlaySpectrum::SoapySDRPlaySpectrum(void):
+    _fftSize(0),
+    _window(WINDOW_HANN),
+    _overlap(0.0),
+    _average(0),
+    _frameRate(1.0),
+    _published(0),
+    _done(0),
+    _active(false),
+    _pushing(false),
+    _stop(false),
+    _windowPower(1.0),
+    _stageFill(0),
+    _skip(0),
+    _stageCount(0),
+    _hop(1),
+    _perFrame(1),
+    _frameHop(1),
+    _numAveraged(0),
+    _frameTimeNs(0),
+    _started(false),
+    _lost(false),
+    _inNext(0),
+    _rate(1.0),
+    _frequency(0.0),
+    _timeBaseNs(0),
+    _timeBaseCount(0),
+    _numFrames(0),
+    _head(0),
+    _tail(0),
+    _readOffset(0)
+{
+    _lastRead.timeNs = 0;
+    _lastRead.frequency = 0.0;
+    _lastRead.rate = 0.0;
+    _lastRead.averages = 0;
+}
+
+SoapySDRPlaySpectrum::~SoapySDRPlaySpectrum(void)
+{
+    this->activate(false);
+}
+
+SoapySDRPlaySpectrum::Window SoapySDRPlaySpectrum::parseWindow(const std::string &name)
+{
+    if (name == "rect")            return WINDOW_RECT;
+    if (name == "hann")            return WINDOW_HANN;
+    if (name == "hamming")         return WINDOW_HAMMING;
+    if (name == "blackman_harris") return WINDOW_BLACKMAN_HARRIS;
+    throw std::runtime_error("setupStream invalid fft_window '" + name + "'");
+}
+
+void SoapySDRPlaySpectrum::setup(const size_t fftSize, const Window window, const double overlap,
+                                 const size_t average, const double frameRate, const size_t numFrames)
+{
+    if (_active) throw std::runtime_error("setupStream the spectrum stream is streaming");
+    if (fftSize < SPECTRUM_MIN_FFT_SIZE or fftSize > SPECTRUM_MAX_FFT_SIZE or (fftSize & (fftSize - 1)) != 0)
+    {
+        throw std::runtime_error("setupStream invalid fft_size " + std::to_string(fftSize) + ", a power of two from " +
+                                 std::to_string(SPECTRUM_MIN_FFT_SIZE) + " to " + std::to_string(SPECTRUM_MAX_FFT_SIZE));
+    }
+    if (not (overlap >= 0.0 and overlap < 1.0)) throw std::runtime_error("setupStream invalid fft_overlap, 0 to below 1");
+    if (not (frameRate > 0.0)) throw std::runtime_error("setupStream invalid frame_rate");
+
+    _fftSize = fftSize;
+    _window = window;
+    _overlap = overlap;
+    _average = average;
+    _frameRate = frameRate;
+    _hop = std::max<size_t>(1, (size_t)std::llround(fftSize * (1.0 - overlap)));
+
+    //periodic windows, the power is scaled by their coherent gain
+    _fft.configure(fftSize);
+    _windowTaps.resize(fftSize);
+    double sum = 0.0;
+    for (size_t i = 0; i < fftSize; i++)
+    {
+        const double x = 2.0 * M_PI * i / fftSize;
+        double w = 1.0;
+        switch (window)
+        {
+        case WINDOW_RECT: break;
+        case WINDOW_HANN: w = 0.5 - 0.5 * std::cos(x); break;
+        case WINDOW_HAMMING: w = 0.54 - 0.46 * std::cos(x); break;
+        case WINDOW_BLACKMAN_HARRIS: w = 0.35875 - 0.48829 * std::cos(x) + 0.14128 * std::cos(2 * x) - 0.01168 * std::cos(3 * x); break;
+        }
+        _windowTaps[i] = (float)w;
+        sum += w;
+    }
+    _windowPower = sum * sum;
+
+    _stageI.assign(fftSize, 0.0f);
+    _stageQ.assign(fftSize, 0.0f);
+    _fftI.assign(fftSize, 0.0f);
+    _fftQ.assign(fftSize, 0.0f);
+    _power.assign(fftSize, 0.0f);
+
+    //the blocks never grow, push() splits long callbacks
+    if (_blocks.empty())
+    {
+        _blocks.resize(SPECTRUM_NUM_BLOCKS);
+        for (auto &block : _blocks)
+        {
+            block.xi.reserve(SPECTRUM_BLOCK_SAMPLES);
+            block.xq.reserve(SPECTRUM_BLOCK_SAMPLES);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(_frameMutex);
+    _numFrames = std::max<size_t>(2, numFrames);
+    _frames.assign(_numFrames * fftSize, 0.0f);
+    _frameInfo.assign(_numFrames, _lastRead);
+    _frameAfterLoss.assign(_numFrames, 0);
+    _head = 0;
+    _tail = 0;
+    _readOffset = 0;
+}
+
+void SoapySDRPlaySpectrum::setSchedule(const SoapySDRPlaySchedule &schedule)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _schedule = schedule;
+}
+
+void SoapySDRPlaySpectrum::activate(const bool active)
+{
+    //rx_callback is out of push() once it saw the flag cleared
+    if (_thread.joinable())
+    {
+        _active = false;
+        while (_pushing) std::this_thread::yield();
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _cond.notify_all();
+        _thread.join();
+    }
+    if (not active or _fftSize == 0) return;
+
+    //the queued frames and the partial one are dropped
+    {
+        std::lock_guard<std::mutex> lock(_frameMutex);
+        _head = 0;
+        _tail = 0;
+        _readOffset = 0;
+    }
+    _published = 0;
+    _done = 0;
+    _stop = false;
+    _started = false;
+    _lost = false;
+    _thread = std::thread(&SoapySDRPlaySpectrum::work, this);
+    _active = true;
+}
+
+bool SoapySDRPlaySpectrum::active(void) const
+{
+    return _active.load(std::memory_order_relaxed);
+}
+
+size_t SoapySDRPlaySpectrum::getMTU(void) const
+{
+    return _fftSize;
+}
+
+/*******************************************************************
+ * Wideband input, rx_callback
+ ******************************************************************/
+
+void SoapySDRPlaySpectrum::push(const SoapySDRPlayConverter *conv, const short *xi, const short *xq, const unsigned int numSamples,
+                                const long long timeNs, const long long count, const bool restart,
+                                const double rate, const double frequency)
+{
+    _pushing = true;
+    if (not _active)
+    {
+        _pushing = false;
+        return;
+    }
+
+    for (unsigned int offset = 0; offset < numSamples;)
+    {
+        //the worker fell behind, it sees the dropped samples as a gap in the count
+        const unsigned long long seq = _published.load(std::memory_order_relaxed);
+        if (seq - _done.load(std::memory_order_acquire) >= SPECTRUM_NUM_BLOCKS) break;
+
+        const unsigned int n = std::min<unsigned int>(numSamples - offset, SPECTRUM_BLOCK_SAMPLES);
+        Block &block = _blocks[seq % SPECTRUM_NUM_BLOCKS];
+        block.xi.assign(xi + offset, xi + offset + n);
+        block.xq.assign(xq + offset, xq + offset + n);
+        block.numSamples = n;
+        block.timeNs = timeNs + std::llround(offset * 1e9 / rate);
+        block.count = count + offset;
+        block.restart = restart and offset == 0;
+        block.rate = rate;
+        block.frequency = frequency;
+        block.conv = conv;
+        _published.store(seq + 1, std::memory_order_release);
+        offset += n;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+    }
+    _cond.notify_one();
+    _pushing = false;
+}
+
+/*******************************************************************
+ * Spectrum worker
+ ******************************************************************/
+
+void SoapySDRPlaySpectrum::work(void)
+{
+    SoapySDRPlaySchedule schedule;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        schedule = _schedule;
+    }
+    if (not schedule.empty()) SoapySDRPlay_applySchedule(schedule, "spectrum worker");
+
+    unsigned long long seq = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _cond.wait(lock, [&]{ return _stop or _published.load(std::memory_order_acquire) != seq; });
+            if (_stop) return;
+        }
+
+        const unsigned long long end = _published.load(std::memory_order_acquire);
+        for (; seq != end; seq++)
+        {
+            this->process(_blocks[seq % SPECTRUM_NUM_BLOCKS]);
+            _done.store(seq + 1, std::memory_order_release);
+        }
+    }
+}
+
+void SoapySDRPlaySpectrum::process(const Block &block)
+{
+    //lost samples, a counter reset or a retune start a new frame,
+    //the samples skipped while the tuner settles are no loss
+    const bool retune = (block.rate != _rate) or (block.frequency != _frequency);
+    const bool lost = _started and not retune and (block.count != _inNext);
+    if (not _started or lost or retune or block.restart)
+    {
+        _rate = block.rate;
+        _frequency = block.frequency;
+        _timeBaseNs = block.timeNs;
+        _timeBaseCount = block.count;
+        _stageFill = 0;
+        _skip = 0;
+        _stageCount = block.count;
+        _numAveraged = 0;
+        std::fill(_power.begin(), _power.end(), 0.0f);
+
+        //frames start every frame interval, or further apart
+        //when the averaged transforms do not fit in one
+        const size_t frameSamples = std::max<size_t>(1, (size_t)std::llround(_rate / _frameRate));
+        if (_average > 0) _perFrame = _average;
+        else if (frameSamples > _fftSize) _perFrame = (frameSamples - _fftSize) / _hop + 1;
+        else _perFrame = 1;
+        _frameHop = std::max(frameSamples, _perFrame * _hop) - (_perFrame - 1) * _hop;
+
+        _lost = _lost or lost;
+        _started = true;
+    }
+    _inNext = block.count + block.numSamples;
+
+    const float scale = 1.0f / 32768;
+    for (size_t offset = 0; offset < block.numSamples;)
+    {
+        if (_skip > 0)
+        {
+            const size_t n = std::min<size_t>(_skip, block.numSamples - offset);
+            _skip -= n;
+            offset += n;
+            continue;
+        }
+        const size_t n = std::min<size_t>(_fftSize - _stageFill, block.numSamples - offset);
+        for (size_t i = 0; i < n; i++)
+        {
+            _stageI[_stageFill + i] = block.xi[offset + i] * scale;
+            _stageQ[_stageFill + i] = block.xq[offset + i] * scale;
+        }
+        _stageFill += n;
+        offset += n;
+        if (_stageFill == _fftSize) this->transform(block.conv);
+    }
+}
+
+void SoapySDRPlaySpectrum::transform(const SoapySDRPlayConverter *conv)
+{
+    const size_t size = _fftSize;
+    for (size_t i = 0; i < size; i++)
+    {
+        _fftI[i] = _stageI[i] * _windowTaps[i];
+        _fftQ[i] = _stageQ[i] * _windowTaps[i];
+    }
+    _fft.transform(conv, _fftI.data(), _fftQ.data());
+    for (size_t i = 0; i < size; i++)
+    {
+        _power[i] += _fftI[i] * _fftI[i] + _fftQ[i] * _fftQ[i];
+    }
+
+    if (_numAveraged == 0)
+    {
+        _frameTimeNs = _timeBaseNs + std::llround((_stageCount - _timeBaseCount) * 1e9 / _rate);
+    }
+    size_t advance = _hop;
+    if (++_numAveraged == _perFrame)
+    {
+        this->deliver();
+        _numAveraged = 0;
+        std::fill(_power.begin(), _power.end(), 0.0f);
+        advance = _frameHop;
+    }
+
+    //keep the overlap, or skip ahead to the next transform
+    if (advance < size)
+    {
+        std::memmove(_stageI.data(), _stageI.data() + advance, (size - advance) * sizeof(float));
+        std::memmove(_stageQ.data(), _stageQ.data() + advance, (size - advance) * sizeof(float));
+        _stageFill = size - advance;
+    }
+    else
+    {
+        _stageFill = 0;
+        _skip = advance - size;
+    }
+    _stageCount += advance;
+}
+
+void SoapySDRPlaySpectrum::deliver(void)
+{
+    size_t head;
+    {
+        std::lock_guard<std::mutex> lock(_frameMutex);
+        head = _head;
+    }
+
+    //the reader fell behind, drop the new frame
+    if (_tail - head == _numFrames)
+    {
+        _lost = true;
+        return;
+    }
+
+    //DC moves to the middle bin
+    const size_t slot = _tail % _numFrames;
+    const size_t half = _fftSize / 2;
+    const float scale = (float)(1.0 / (_numAveraged * _windowPower));
+    float *out = _frames.data() + slot * _fftSize;
+    for (size_t k = 0; k < half; k++)
+    {
+        out[k] = 10.0f * std::log10(std::max(_power[k + half] * scale, 1e-20f));
+        out[k + half] = 10.0f * std::log10(std::max(_power[k] * scale, 1e-20f));
+    }
+
+    FrameInfo &info = _frameInfo[slot];
+    info.timeNs = _frameTimeNs;
+    info.frequency = _frequency;
+    info.rate = _rate;
+    info.averages = _numAveraged;
+    _frameAfterLoss[slot] = _lost;
+    _lost = false;
+
+    {
+        std::lock_guard<std::mutex> lock(_frameMutex);
+        _tail++;
+    }
+    _frameCond.notify_one();
+}
+
+/*******************************************************************
+ * Reader
+ ******************************************************************/
+
+int SoapySDRPlaySpectrum::read(void *buff, const size_t numElems, int &flags, long long &timeNs, const long timeoutUs)
+{
+    if (_numFrames == 0) return SOAPY_SDR_STREAM_ERROR;
+
+    size_t slot;
+    {
+        std::unique_lock<std::mutex> lock(_frameMutex);
+        if (_head == _tail)
+        {
+            _frameCond.wait_for(lock, std::chrono::microseconds(timeoutUs), [&]{ return _head != _tail; });
+            if (_head == _tail) return SOAPY_SDR_TIMEOUT;
+        }
+        slot = _head % _numFrames;
+
+        //the frame after lost samples or frames is reported first
+        if (_readOffset == 0 and _frameAfterLoss[slot])
+        {
+            _frameAfterLoss[slot] = 0;
+            timeNs = _frameInfo[slot].timeNs;
+            flags = SOAPY_SDR_HAS_TIME;
+            return SOAPY_SDR_OVERFLOW;
+        }
+        if (_readOffset == 0) _lastRead = _frameInfo[slot];
+    }
+
+    //frames between head and tail are the reader's
+    const size_t available = _fftSize - _readOffset;
+    const size_t num = std::min(available, numElems);
+    std::memcpy(buff, _frames.data() + slot * _fftSize + _readOffset, num * sizeof(float));
+
+    flags = SOAPY_SDR_HAS_TIME;
+    timeNs = _frameInfo[slot].timeNs;
+    _readOffset += num;
+
+    if (num < available)
+    {
+        flags |= SOAPY_SDR_MORE_FRAGMENTS;
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(_frameMutex);
+        _readOffset = 0;
+        _head++;
+    }
+    return (int)num;
+}
+
+SoapySDRPlaySpectrum::FrameInfo SoapySDRPlaySpectrum::lastRead(void) const
+{
+    std::lock_guard<std::mutex> lock(_frameMutex);
+    return _lastRead;
+}
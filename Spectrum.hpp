@@ -0,0 +1,209 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "Convert.hpp"
+#include "Scheduling.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//wideband blocks queued between rx_callback and the spectrum worker,
+//longer callbacks take several blocks
+#define SPECTRUM_NUM_BLOCKS       (1024)
+#define SPECTRUM_BLOCK_SAMPLES    (1024)
+
+#define SPECTRUM_MIN_FFT_SIZE     (16)
+#define SPECTRUM_MAX_FFT_SIZE     (65536)
+
+/*******************************************************************
+ * Complex FFT
+ ******************************************************************/
+
+//Radix 2 Stockham FFT on split real and imaginary arrays, the output
+//comes out in natural order without a bit reversal pass. From the third
+//stage on the butterflies sharing a twiddle are contiguous and run
+//through the SIMD butterfly kernel of the converter.
+class SoapySDRPlayFFT
+{
+public:
+    SoapySDRPlayFFT(void);
+
+    //size is a power of two
+    void configure(const size_t size);
+
+    size_t size(void) const;
+
+    //forward transform in place, X[k] = sum x[n] exp(-2 pi i k n / size)
+    void transform(const SoapySDRPlayConverter *conv, float *re, float *im);
+
+private:
+    size_t _size;
+    std::vector<float> _cos, _sin;
+    std::vector<float> _workRe, _workIm;
+};
+
+/*******************************************************************
+ * Power spectrum of the wideband stream
+ ******************************************************************/
+
+//rx_callback copies the wideband samples into a block ring, a worker
+//thread windows and transforms them and averages the power of the
+//transforms within each frame interval. Frames of fftSize float bins
+//in dBFS, DC in the middle, queue up for read(). A full scale tone
+//reads 0 dB in its bin.
+class SoapySDRPlaySpectrum
+{
+public:
+    enum Window
+    {
+        WINDOW_RECT,
+        WINDOW_HANN,
+        WINDOW_HAMMING,
+        WINDOW_BLACKMAN_HARRIS
+    };
+
+    //what read() last returned a frame of
+    struct FrameInfo
+    {
+        long long timeNs;      // first sample of the first transform
+        double frequency;      // tuner frequency, the center bin
+        double rate;           // sample rate, the span of the bins
+        size_t averages;       // transforms averaged
+    };
+
+    SoapySDRPlaySpectrum(void);
+
+    ~SoapySDRPlaySpectrum(void);
+
+    //transform size and window, overlap of consecutive transforms as a
+    //fraction, average transforms per frame or 0 for all that fit in the
+    //frame interval, and frames queued for the reader, only while inactive
+    void setup(const size_t fftSize, const Window window, const double overlap,
+               const size_t average, const double frameRate, const size_t numFrames);
+
+    //priority and CPUs of the worker, applied when it starts
+    void setSchedule(const SoapySDRPlaySchedule &schedule);
+
+    //activation starts the worker with an empty queue,
+    //deactivation returns once rx_callback and the worker let go
+    void activate(const bool active);
+
+    bool active(void) const;
+
+    size_t getMTU(void) const;
+
+    //called by rx_callback with wideband samples at rate Hz,
+    //restart is set when the hardware counter restarted
+    void push(const SoapySDRPlayConverter *conv, const short *xi, const short *xq, const unsigned int numSamples,
+              const long long timeNs, const long long count, const bool restart,
+              const double rate, const double frequency);
+
+    //readStream() for the spectrum stream, one frame per call unless numElems is smaller
+    int read(void *buff, const size_t numElems, int &flags, long long &timeNs, const long timeoutUs);
+
+    FrameInfo lastRead(void) const;
+
+    static Window parseWindow(const std::string &name);
+
+private:
+    struct Block
+    {
+        std::vector<short> xi, xq;
+        unsigned int numSamples;
+        long long timeNs;
+        long long count;
+        bool restart;
+        double rate;
+        double frequency;
+        const SoapySDRPlayConverter *conv;
+    };
+
+    void work(void);
+
+    void process(const Block &block);
+
+    void transform(const SoapySDRPlayConverter *conv);
+
+    void deliver(void);
+
+    //settings, only changed while inactive
+    size_t _fftSize;
+    Window _window;
+    double _overlap;
+    size_t _average;
+    double _frameRate;
+    SoapySDRPlaySchedule _schedule;
+
+    //input from rx_callback, the worker releases a block by counting it done
+    std::vector<Block> _blocks;
+    std::atomic<unsigned long long> _published;
+    std::atomic<unsigned long long> _done;
+    std::atomic_bool _active;
+    std::atomic_bool _pushing;
+    std::thread _thread;
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    bool _stop;
+
+    //worker state
+    SoapySDRPlayFFT _fft;
+    std::vector<float> _windowTaps;
+    double _windowPower;           // (sum of the taps)^2, scales the power to dBFS
+    std::vector<float> _stageI, _stageQ;
+    std::vector<float> _fftI, _fftQ;
+    std::vector<float> _power;
+    size_t _stageFill;
+    size_t _skip;                  // samples to drop before the stage fills again
+    long long _stageCount;         // count of the first staged sample
+    size_t _hop;
+    size_t _perFrame;              // transforms averaged per frame
+    size_t _frameHop;              // from the last transform of a frame to the first of the next
+    size_t _numAveraged;
+    long long _frameTimeNs;
+    bool _started;
+    bool _lost;                    // frames or samples went missing before the next frame
+    long long _inNext;
+    double _rate;
+    double _frequency;
+    long long _timeBaseNs;
+    long long _timeBaseCount;
+
+    //output queue, the worker fills frames[tail % size], the reader
+    //drains frames[head % size], head and tail change under _frameMutex
+    mutable std::mutex _frameMutex;
+    std::condition_variable _frameCond;
+    std::vector<float> _frames;
+    std::vector<FrameInfo> _frameInfo;
+    std::vector<char> _frameAfterLoss;
+    size_t _numFrames;
+    size_t _head, _tail;
+    size_t _readOffset;
+    FrameInfo _lastRead;
+};
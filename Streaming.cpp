@@ -23,6 +23,9 @@
  */
 
 #include "SoapySDRPlay.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstdint>
 
 std::vector<std::string> SoapySDRPlay::getStreamFormats(const int direction, const size_t channel) const 
 {
@@ -30,6 +33,11 @@ std::vector<std::string> SoapySDRPlay::getStreamFormats(const int direction, con
 
     formats.push_back("CS16");
     formats.push_back("CF32");
+    formats.push_back("CS8");
+    formats.push_back("CS12");
+
+    // power spectrum frames of the wideband channel
+    if (channel == 0) formats.push_back("F32");
 
     return formats;
 }
@@ -44,6 +52,189 @@ SoapySDR::ArgInfoList SoapySDRPlay::getStreamArgsInfo(const int direction, const
 {
     SoapySDR::ArgInfoList streamArgs;
 
+    SoapySDR::ArgInfo BuffersArg;
+    BuffersArg.key = "buffers";
+    BuffersArg.value = std::to_string(DEFAULT_NUM_BUFFERS);
+    BuffersArg.name = "Buffer Count";
+    BuffersArg.description = "Number of queued buffers, by default sized for " + std::to_string(DEFAULT_QUEUE_MS) + " ms of samples.";
+    BuffersArg.units = "buffers";
+    BuffersArg.type = SoapySDR::ArgInfo::INT;
+    BuffersArg.range = SoapySDR::Range(2, MAX_NUM_BUFFERS);
+    streamArgs.push_back(BuffersArg);
+
+    SoapySDR::ArgInfo BufflenArg;
+    BufflenArg.key = "bufflen";
+    BufflenArg.value = std::to_string(DEFAULT_BUFFER_LENGTH);
+    BufflenArg.name = "Buffer Size";
+    BufflenArg.description = "Buffer capacity in samples, overrides latency_ms.";
+    BufflenArg.units = "samples";
+    BufflenArg.type = SoapySDR::ArgInfo::INT;
+    BufflenArg.range = SoapySDR::Range(MIN_BUFFER_LENGTH, 16 * DEFAULT_BUFFER_LENGTH);
+    streamArgs.push_back(BufflenArg);
+
+    SoapySDR::ArgInfo LatencyArg;
+    LatencyArg.key = "latency_ms";
+    LatencyArg.value = "0";
+    LatencyArg.name = "Target Latency";
+    LatencyArg.description = "Size the buffers to wake the reader every latency_ms at the output rate, 0 to disable.";
+    LatencyArg.units = "ms";
+    LatencyArg.type = SoapySDR::ArgInfo::FLOAT;
+    LatencyArg.range = SoapySDR::Range(0, 1000);
+    streamArgs.push_back(LatencyArg);
+
+    SoapySDR::ArgInfo OverflowArg;
+    OverflowArg.key = "overflow";
+    OverflowArg.value = "drop_newest";
+    OverflowArg.name = "Overflow Policy";
+    OverflowArg.description = "Samples dropped when the reader falls behind: the incoming ones, the oldest queued buffer or the whole queue.";
+    OverflowArg.type = SoapySDR::ArgInfo::STRING;
+    OverflowArg.options.push_back("drop_newest");
+    OverflowArg.options.push_back("drop_oldest");
+    OverflowArg.options.push_back("drop_queue");
+    streamArgs.push_back(OverflowArg);
+
+    SoapySDR::ArgInfo EventsArg;
+    EventsArg.key = "events";
+    EventsArg.value = "true";
+    EventsArg.name = "Change Events";
+    EventsArg.description = "Split blocks at gain, frequency, rate and counter reset changes and flag them.";
+    EventsArg.type = SoapySDR::ArgInfo::BOOL;
+    streamArgs.push_back(EventsArg);
+
+    SoapySDR::ArgInfo HugePagesArg;
+    HugePagesArg.key = "huge_pages";
+    HugePagesArg.value = "false";
+    HugePagesArg.name = "Huge Pages";
+    HugePagesArg.description = "Back the buffer arena with huge pages when the system has them.";
+    HugePagesArg.type = SoapySDR::ArgInfo::BOOL;
+    streamArgs.push_back(HugePagesArg);
+
+    SoapySDR::ArgInfo LockArg;
+    LockArg.key = "mlock";
+    LockArg.value = "false";
+    LockArg.name = "Lock Buffers";
+    LockArg.description = "Lock the buffer arena in memory, needs a large enough RLIMIT_MEMLOCK.";
+    LockArg.type = SoapySDR::ArgInfo::BOOL;
+    streamArgs.push_back(LockArg);
+
+    if (channel == 0)
+    {
+        SoapySDR::ArgInfo FftSizeArg;
+        FftSizeArg.key = "fft_size";
+        FftSizeArg.value = std::to_string(DEFAULT_FFT_SIZE);
+        FftSizeArg.name = "FFT Size";
+        FftSizeArg.description = "Bins per frame of the F32 spectrum stream, a power of two.";
+        FftSizeArg.units = "bins";
+        FftSizeArg.type = SoapySDR::ArgInfo::INT;
+        FftSizeArg.range = SoapySDR::Range(SPECTRUM_MIN_FFT_SIZE, SPECTRUM_MAX_FFT_SIZE);
+        streamArgs.push_back(FftSizeArg);
+
+        SoapySDR::ArgInfo WindowArg;
+        WindowArg.key = "fft_window";
+        WindowArg.value = "hann";
+        WindowArg.name = "FFT Window";
+        WindowArg.description = "Window applied before each transform of the F32 spectrum stream.";
+        WindowArg.type = SoapySDR::ArgInfo::STRING;
+        WindowArg.options.push_back("rect");
+        WindowArg.options.push_back("hann");
+        WindowArg.options.push_back("hamming");
+        WindowArg.options.push_back("blackman_harris");
+        streamArgs.push_back(WindowArg);
+
+        SoapySDR::ArgInfo OverlapArg;
+        OverlapArg.key = "fft_overlap";
+        OverlapArg.value = "0.5";
+        OverlapArg.name = "FFT Overlap";
+        OverlapArg.description = "Overlap of consecutive transforms averaged into one frame.";
+        OverlapArg.type = SoapySDR::ArgInfo::FLOAT;
+        OverlapArg.range = SoapySDR::Range(0, 0.95);
+        streamArgs.push_back(OverlapArg);
+
+        SoapySDR::ArgInfo AverageArg;
+        AverageArg.key = "fft_average";
+        AverageArg.value = "0";
+        AverageArg.name = "FFT Averages";
+        AverageArg.description = "Transforms averaged per frame, 0 for all that fit in the frame interval.";
+        AverageArg.type = SoapySDR::ArgInfo::INT;
+        AverageArg.range = SoapySDR::Range(0, 100000);
+        streamArgs.push_back(AverageArg);
+
+        SoapySDR::ArgInfo FrameRateArg;
+        FrameRateArg.key = "frame_rate";
+        FrameRateArg.value = std::to_string(DEFAULT_FRAME_RATE);
+        FrameRateArg.name = "Frame Rate";
+        FrameRateArg.description = "Spectrum frames per second, lower when the averages do not fit in the interval.";
+        FrameRateArg.units = "Hz";
+        FrameRateArg.type = SoapySDR::ArgInfo::FLOAT;
+        FrameRateArg.range = SoapySDR::Range(0.1, 1000);
+        streamArgs.push_back(FrameRateArg);
+
+        SoapySDR::ArgInfo BurstThresholdArg;
+        BurstThresholdArg.key = "burst_threshold";
+        BurstThresholdArg.value = "";
+        BurstThresholdArg.name = "Burst Threshold";
+        BurstThresholdArg.description = "Only queue bursts with a running power above this level, empty for the continuous stream.";
+        BurstThresholdArg.units = "dBFS";
+        BurstThresholdArg.type = SoapySDR::ArgInfo::FLOAT;
+        BurstThresholdArg.range = SoapySDR::Range(-140, 0);
+        streamArgs.push_back(BurstThresholdArg);
+
+        SoapySDR::ArgInfo BurstPreArg;
+        BurstPreArg.key = "burst_pre_ms";
+        BurstPreArg.value = std::to_string(DEFAULT_BURST_PRE_MS);
+        BurstPreArg.name = "Burst Pre-roll";
+        BurstPreArg.description = "Samples kept ahead of the detection, they start the burst.";
+        BurstPreArg.units = "ms";
+        BurstPreArg.type = SoapySDR::ArgInfo::FLOAT;
+        BurstPreArg.range = SoapySDR::Range(0, 1000);
+        streamArgs.push_back(BurstPreArg);
+
+        SoapySDR::ArgInfo BurstPostArg;
+        BurstPostArg.key = "burst_post_ms";
+        BurstPostArg.value = std::to_string(DEFAULT_BURST_POST_MS);
+        BurstPostArg.name = "Burst Post-roll";
+        BurstPostArg.description = "The burst ends this long after the power fell below the threshold.";
+        BurstPostArg.units = "ms";
+        BurstPostArg.type = SoapySDR::ArgInfo::FLOAT;
+        BurstPostArg.range = SoapySDR::Range(0, 10000);
+        streamArgs.push_back(BurstPostArg);
+
+        SoapySDR::ArgInfo BurstTauArg;
+        BurstTauArg.key = "burst_tau_ms";
+        BurstTauArg.value = std::to_string(DEFAULT_BURST_TAU_MS);
+        BurstTauArg.name = "Burst Power Smoothing";
+        BurstTauArg.description = "Time constant of the running power estimate.";
+        BurstTauArg.units = "ms";
+        BurstTauArg.type = SoapySDR::ArgInfo::FLOAT;
+        BurstTauArg.range = SoapySDR::Range(0.001, 1000);
+        streamArgs.push_back(BurstTauArg);
+    }
+
+    // the same pair of args for each of the streaming threads
+    const char *threadNames[][2] = {
+        {"rx", "vendor callback thread"},
+        {"reader", "thread calling readStream()"},
+        {"worker", "virtual channel, spectrum and recording worker threads"}};
+    for (const auto &thread : threadNames)
+    {
+        SoapySDR::ArgInfo PriorityArg;
+        PriorityArg.key = std::string(thread[0]) + "_priority";
+        PriorityArg.value = "0";
+        PriorityArg.name = "Thread Priority";
+        PriorityArg.description = std::string("Priority of the ") + thread[1] + ", 1..99 SCHED_FIFO, -20..-1 nice, 0 unchanged.";
+        PriorityArg.type = SoapySDR::ArgInfo::INT;
+        PriorityArg.range = SoapySDR::Range(-20, 99);
+        streamArgs.push_back(PriorityArg);
+
+        SoapySDR::ArgInfo CpuArg;
+        CpuArg.key = std::string(thread[0]) + "_cpu";
+        CpuArg.value = "";
+        CpuArg.name = "Thread CPUs";
+        CpuArg.description = std::string("CPUs for the ") + thread[1] + ", like 2 or 2,3 or 0-3, empty unchanged.";
+        CpuArg.type = SoapySDR::ArgInfo::STRING;
+        streamArgs.push_back(CpuArg);
+    }
+
     return streamArgs;
 }
 
@@ -55,7 +246,12 @@ static void _rx_callback(short *xi, short *xq, unsigned int firstSampleNum, int
                          int fsChanged, unsigned int numSamples, unsigned int reset, unsigned int hwRemoved, void *cbContext)
 {
     SoapySDRPlay *self = (SoapySDRPlay *)cbContext;
-    return self->rx_callback(xi, xq, numSamples);
+    if (hwRemoved)
+    {
+        // the next enumeration scans the bus again
+        SoapySDRPlay_invalidateDevices();
+    }
+    return self->rx_callback(xi, xq, firstSampleNum, numSamples, reset, grChanged, rfChanged, fsChanged);
 }
 
 static void _gr_callback(unsigned int gRdB, unsigned int lnaGRdB, void *cbContext)
@@ -64,78 +260,879 @@ static void _gr_callback(unsigned int gRdB, unsigned int lnaGRdB, void *cbContex
     return self->gr_callback(gRdB, lnaGRdB);
 }
 
-void SoapySDRPlay::rx_callback(short *xi, short *xq, unsigned int numSamples)
+static void _replay_tune(double frequency, double rate, void *cbContext)
+{
+    SoapySDRPlay *self = (SoapySDRPlay *)cbContext;
+    return self->replay_tune(frequency, rate);
+}
+
+static bool _replay_ready(void *cbContext)
+{
+    SoapySDRPlay *self = (SoapySDRPlay *)cbContext;
+    return self->replay_ready();
+}
+
+static void _replay_end(void *cbContext)
+{
+    SoapySDRPlay *self = (SoapySDRPlay *)cbContext;
+    return self->replay_end();
+}
+
+static long long hostTimeNs(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static long long ticksToTimeNs(const long long ticks, const double rate)
+{
+    // split off whole seconds to keep the precision of large counts
+    const long long fullSecs = (long long)(ticks / rate);
+    const double remTicks = ticks - fullSecs * rate;
+    return fullSecs * 1000000000LL + std::llround(remTicks * 1e9 / rate);
+}
+
+double SoapySDRPlay::getOutputRate(void) const
+{
+    // the resampler makes up the difference to the hardware rate,
+    // a replay capture at a lower rate than requested passes through
+    return std::min((double)reqSampleRate, getHardwareRate());
+}
+
+double SoapySDRPlay::getHardwareRate(void) const
+{
+    return (double)sampleRate / decM;
+}
+
+// the rates the rx thread is working with, see rx_tuning()
+double SoapySDRPlay::rxOutputRate(void) const
+{
+    return std::min((double)_rxTuning.outputRate, rxHardwareRate());
+}
+
+double SoapySDRPlay::rxHardwareRate(void) const
+{
+    return (double)_rxTuning.sampleRate / _rxTuning.decM;
+}
+
+// callback sizes the rx buffers are made for, a replay delivers whole chunks
+size_t SoapySDRPlay::rxReserveSamples(void) const
+{
+    return std::max<size_t>(RX_RESERVE_SAMPLES, _replay ? _replay->chunk() : 0);
+}
+
+// designs the resampler and sizes the pre-roll ring for a set of rates,
+// the caller hands them to the rx path so that it never allocates for them
+void SoapySDRPlay::prepareRx(const uint32_t rate, const unsigned int decimation, const uint32_t outputRate,
+                             SoapySDRPlayResampler &resampler, std::vector<short> &ringI, std::vector<short> &ringQ) const
+{
+    const uint32_t outRate = std::min<uint32_t>(outputRate, rate / decimation);
+    resampler.configure(rate, decimation, outRate);
+    resampler.reserve(rxReserveSamples());
+    if (_burstMode)
+    {
+        const size_t preElems = (size_t)std::ceil(_burstPreMs * outRate / 1000.0);
+        ringI.assign(preElems, 0);
+        ringQ.assign(preElems, 0);
+    }
+}
+
+long long SoapySDRPlay::rx_timeNs(unsigned int firstSampleNum, unsigned int numSamples, unsigned int reset, long long &count)
 {
-    std::lock_guard<std::mutex> lock(_buf_mutex);
+    const double rate = rxHardwareRate();
 
-    if (_buf_count == numBuffers)
+    if (not _counterValid)
     {
+        // first callback after activateStream()
+        _counterValid = true;
+        count = firstSampleNum;
+        _timeBaseCount = count;
+        _timeBaseNs = _timeAnchorNs;
+        _timeBaseRate = rate;
+    }
+    else if (reset)
+    {
+        // the counter restarted, continue from the host clock
+        count = _counterExtNext;
+        _timeBaseCount = count;
+        _timeBaseNs = hostTimeNs();
+        _timeBaseRate = rate;
+    }
+    else
+    {
+        // signed 32 bit difference handles the counter wraparound
+        count = _counterExtNext + (int)(firstSampleNum - _counterNext);
+        if (count > _counterExtNext)
+        {
+            // samples lost before they reached us
+            _gapPending = true;
+        }
+        if (rate != _timeBaseRate)
+        {
+            _timeBaseNs += ticksToTimeNs(count - _timeBaseCount, _timeBaseRate);
+            _timeBaseCount = count;
+            _timeBaseRate = rate;
+        }
+    }
+
+    _counterNext = firstSampleNum + numSamples;
+    _counterExtNext = count + numSamples;
+
+    return _timeBaseNs + ticksToTimeNs(count - _timeBaseCount, _timeBaseRate);
+}
+
+void SoapySDRPlay::rx_tuning(unsigned int numSamples, int rfChanged, int fsChanged)
+{
+    if (_rxTuningDue.load(std::memory_order_relaxed) == 0)
+    {
+        return;
+    }
+
+    // only the reinit and the output rate setters contend for this lock
+    std::lock_guard<std::mutex> lock(_rxTuningMutex);
+    int due = _rxTuningDue.load(std::memory_order_relaxed);
+    _rxTuningWait += numSamples;
+    const bool now = (due & RX_TUNING_NOW) != 0;
+    const bool late = not now and _rxTuningWait > (long long)(REINIT_SETTLE_MAX_MS * rxHardwareRate() / 1000.0);
+    if (late and (due & (RX_TUNING_RATE | RX_TUNING_FREQ)))
+    {
+        SoapySDR_logf(SOAPY_SDR_WARNING, "No fsChanged/rfChanged within %d ms of mir_sdr_Reinit", REINIT_SETTLE_MAX_MS);
+    }
+
+    if ((due & RX_TUNING_FREQ) and (rfChanged or late or now))
+    {
+        _rxTuning.frequency = _rxTuningNext.frequency;
+        _corrReset = true;
+        due &= ~RX_TUNING_FREQ;
+    }
+    if ((due & RX_TUNING_RATE) and (fsChanged or late or now))
+    {
+        _rxTuning.sampleRate = _rxTuningNext.sampleRate;
+        _rxTuning.decM = _rxTuningNext.decM;
+        _rxTuning.outputRate = _rxTuningNext.outputRate;
+        _corrReset = true;
+        rx_swapResampler();
+        due &= ~(RX_TUNING_RATE | RX_TUNING_OUTPUT);
+    }
+
+    // a new output rate waits for the hardware rate it was chosen for
+    if ((due & RX_TUNING_OUTPUT) and not (due & RX_TUNING_RATE))
+    {
+        _rxTuning.outputRate = _rxTuningNext.outputRate;
+        rx_swapResampler();
+        due &= ~RX_TUNING_OUTPUT;
+    }
+
+    if ((due & ~RX_TUNING_NOW) == 0) due = 0;
+    if (due == 0) _rxTuningWait = 0;
+    _rxTuningDue.store(due, std::memory_order_relaxed);
+}
+
+// called from rx_tuning() with _rxTuningMutex held, the publishing
+// thread designed the next filters and frees the ones swapped out
+void SoapySDRPlay::rx_swapResampler(void)
+{
+    std::swap(_resampler, _resamplerNext);
+
+    // rx_burst() keeps using the ring it has as long as it is large enough
+    if (_burstRingNextI.size() > _burstRingI.size())
+    {
+        _burstRingI.swap(_burstRingNextI);
+        _burstRingQ.swap(_burstRingNextQ);
+    }
+    _resampleConfigure = true;
+}
+
+// reader side, once the caller holds no buffers
+void SoapySDRPlay::drainBuffers(void)
+{
+    // drain all published buffers from the fifo,
+    // the rx callback drops the one it is filling
+    _buf_drain = true;
+    size_t acquired = _buf_acquired.load();
+    while (acquired != _buf_tail.load(std::memory_order_acquire))
+    {
+        if (_buf_acquired.compare_exchange_weak(acquired, acquired + 1))
+        {
+            _buffMeta[acquired % numBuffers].bytes = 0;
+            _buf_head.fetch_add(1, std::memory_order_release);
+            acquired++;
+        }
+    }
+
+    if (resetBuffer)
+    {
+       // samples after a reset do not follow the previous ones
+       resetBuffer = false;
+       _expectValid = false;
+    }
+}
+
+void SoapySDRPlay::updateBlockSize(void)
+{
+    size_t elems;
+    if (latencyMs > 0.0)
+    {
+        elems = (size_t)(latencyMs * getOutputRate() / 1000.0);
+    }
+    else
+    {
+        // smaller buffers for decimated rates
+        elems = (size_t)(bufferElems * getOutputRate() / sampleRate);
+    }
+    _blockElems = std::max<size_t>(1, std::min<size_t>(elems, bufferElems));
+}
+
+void SoapySDRPlay::notifyReader(void)
+{
+    // the lock is only taken when a reader is blocked
+    if (_buf_waiting)
+    {
+        std::lock_guard<std::mutex> lock(_buf_mutex);
+        _buf_cond.notify_one();
+    }
+}
+
+void SoapySDRPlay::rx_convert(const SoapySDRPlayConverter *conv, short *xi, short *xq, char *out, unsigned int numSamples)
+{
+    switch (streamFormat.load(std::memory_order_relaxed))
+    {
+    case FORMAT_CS16:
+        conv->toCS16(xi, xq, (short *)out, numSamples);
+        break;
+    case FORMAT_CF32:
+    {
+        const int mode = swCorrection.load(std::memory_order_relaxed);
+        if (mode == SW_CORR_OFF)
+        {
+            conv->toCF32(xi, xq, (float *)out, numSamples);
+            break;
+        }
+        if (_corrReset.exchange(false, std::memory_order_relaxed)) _corrector.reset();
+
+        // corrects with the estimates up to the last block, then updates them,
+        // DC tracks within ~100ms, the IQ balance within ~1s
+        conv->toCF32Corr(xi, xq, (float *)out, numSamples, _corrector.corr);
+        const double blockSecs = numSamples / rxOutputRate();
+        const double dcAlpha = 1.0 - std::exp(-blockSecs / 0.1);
+        const double iqAlpha = 1.0 - std::exp(-blockSecs / 1.0);
+        _corrector.update(numSamples, dcAlpha, iqAlpha, mode == SW_CORR_DC_IQ);
+        break;
+    }
+    case FORMAT_CS8:
+        conv->toCS8(xi, xq, (signed char *)out, numSamples, cs8Shift.load(std::memory_order_relaxed), packRounding.load(std::memory_order_relaxed));
+        break;
+    case FORMAT_CS12:
+        conv->toCS12(xi, xq, (unsigned char *)out, numSamples, packRounding.load(std::memory_order_relaxed));
+        break;
+    }
+}
+
+bool SoapySDRPlay::rx_direct(short *xi, short *xq, unsigned int numSamples, const long long timeNs, const long long count, const SoapySDRPlayConverter *conv, const unsigned int sampleBytes)
+{
+    int state = _direct_state.load(std::memory_order_acquire);
+    if (state != DIRECT_WAITING and state != DIRECT_PARTIAL)
+    {
+        return false;
+    }
+
+    // a fresh request can only start when no published buffer is pending,
+    // samples after a loss go through the queue so the reader reports it
+    const size_t tail = _buf_tail.load(std::memory_order_relaxed);
+    if (state == DIRECT_WAITING and
+        (tail != _buf_head.load(std::memory_order_acquire) or _gapPending or _segmentStart or
+         (_rxEvents != 0 and _buffMeta[tail % numBuffers].bytes != 0) or
+         (_fillAfterGap and _buffMeta[tail % numBuffers].bytes != 0)))
+    {
+        return false;
+    }
+
+    // readStream() may take the request back at any time
+    if (not _direct_state.compare_exchange_strong(state, DIRECT_FILLING))
+    {
+        return false;
+    }
+
+    if (state == DIRECT_WAITING)
+    {
+        // samples of the partially filled buffer go first
+        BufferMeta &partial = _buffMeta[tail % numBuffers];
+        const bool empty = (partial.bytes == 0);
+        const size_t partialElems = partial.bytes / sampleBytes;
+        if (partialElems + numSamples > _direct_capacity)
+        {
+            _direct_state.store(DIRECT_WAITING);
+            return false;
+        }
+        std::memcpy(_direct_buff, _arena.slot(tail % numBuffers), partial.bytes);
+        _direct_elems = partialElems;
+        _direct_timeNs = empty ? timeNs : partial.timeNs;
+        _direct_count = empty ? count : partial.count;
+        _direct_frequency = _rxFrequency;
+        _direct_events = empty ? _rxEvents : partial.events;
+        _direct_gRdB = empty ? current_gRdB.load() : partial.gRdB;
+        _direct_rate = empty ? rxOutputRate() : partial.rate;
+        if (empty) _rxEvents = 0;
+        partial.bytes = 0;
+    }
+    else if ((_direct_elems + numSamples > _direct_capacity) or _gapPending or _segmentStart or (_rxEvents != 0))
+    {
+        // no room left, hand back what is there and use the queue
+        _direct_state.store(DIRECT_DONE);
+        notifyReader();
+        return false;
+    }
+
+    rx_convert(conv, xi, xq, (char *)_direct_buff + _direct_elems * sampleBytes, numSamples);
+    _direct_elems += numSamples;
+
+    // same wake up cadence as a queued buffer
+    const size_t blockElems = _blockElems.load(std::memory_order_relaxed);
+    if ((_direct_elems + numSamples > _direct_capacity) or (_direct_elems + numSamples > blockElems))
+    {
+        _direct_state.store(DIRECT_DONE);
+        notifyReader();
+    }
+    else
+    {
+        _direct_state.store(DIRECT_PARTIAL);
+    }
+    return true;
+}
+
+bool SoapySDRPlay::rx_reclaim(const size_t tail)
+{
+    if (tail - _buf_head.load(std::memory_order_acquire) != numBuffers)
+    {
+        return true;
+    }
+
+    // the queue is full, the buffer at tail is the oldest one
+    if (overflowPolicy == OVERFLOW_DROP_OLDEST)
+    {
+        // take it back unless the reader got hold of it meanwhile
+        size_t oldest = tail - numBuffers;
+        if (_buf_acquired.compare_exchange_strong(oldest, oldest + 1))
+        {
+            _buffMeta[tail % numBuffers].bytes = 0;
+            _buf_head.fetch_add(1);
+            return true;
+        }
+    }
+    else if (overflowPolicy == OVERFLOW_DROP_QUEUE)
+    {
+        // the reader drains the queue
         _overflowEvent = true;
+    }
+
+    // drop the new samples
+    _gapPending = true;
+    return false;
+}
+
+void SoapySDRPlay::rx_callback(short *xi, short *xq, unsigned int firstSampleNum, unsigned int numSamples, unsigned int reset,
+                               int grChanged, int rfChanged, int fsChanged)
+{
+    // the vendor thread only exists while streaming, it schedules itself
+    if (_rxScheduleDue.load(std::memory_order_relaxed) and _rxScheduleDue.exchange(false))
+    {
+        SoapySDRPlay_applySchedule(_rxSchedule, "rx_callback");
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+
+    // queue fill as seen by this callback
+    const size_t fill = _buf_tail.load(std::memory_order_relaxed) - _buf_head.load(std::memory_order_relaxed);
+    _statFillSum.fetch_add(fill, std::memory_order_relaxed);
+    if (fill < _statFillMin.load(std::memory_order_relaxed))
+    {
+        _statFillMin.store(fill, std::memory_order_relaxed);
+    }
+    if (fill > _statFillMax.load(std::memory_order_relaxed))
+    {
+        _statFillMax.store(fill, std::memory_order_relaxed);
+    }
+
+    // a reinit applies from the callback that reports it
+    rx_tuning(numSamples, rfChanged, fsChanged);
+
+    long long count;
+    const long long timeNs = rx_timeNs(firstSampleNum, numSamples, reset, count);
+
+    // where a gain change reported after this callback takes effect
+    _rxCountNext.store(count + numSamples, std::memory_order_relaxed);
+    _rxTimeNext.store(timeNs + ticksToTimeNs(numSamples, rxHardwareRate()), std::memory_order_relaxed);
+
+    // hardware changes apply from the first sample of this callback
+    int events = 0;
+    if (grChanged) events |= SOAPY_SDRPLAY_GAIN_CHANGED;
+    if (rfChanged) events |= SOAPY_SDRPLAY_FREQ_CHANGED;
+    if (fsChanged) events |= SOAPY_SDRPLAY_RATE_CHANGED;
+    if (reset)     events |= SOAPY_SDRPLAY_COUNTER_RESET;
+    if (events != 0 and _eventSplit.load(std::memory_order_relaxed))
+    {
+        rx_event(events);
+    }
+
+    // while scanning only the dwell samples go on, from the start of the callback
+    const unsigned int numDeliver = rx_scan(numSamples, rfChanged);
+
+    // a recording gets every hardware sample, settling ones included
+    _recorder.push(converter.load(std::memory_order_relaxed), xi, xq, numSamples, timeNs, count,
+                   rxHardwareRate(), _rxFrequency, current_gRdB.load(std::memory_order_relaxed));
+
+    // the virtual channels get the wideband samples as they are
+    if (numDeliver > 0 and _channelizer and _channelizer->anyActive())
+    {
+        _channelizer->push(converter.load(std::memory_order_relaxed), xi, xq, numDeliver, timeNs, count, reset != 0,
+                           _rxTuning.sampleRate, _rxTuning.decM, _rxTuning.frequency);
+    }
+
+    if (numDeliver > 0 and _spectrum.active())
+    {
+        _spectrum.push(converter.load(std::memory_order_relaxed), xi, xq, numDeliver, timeNs, count, reset != 0,
+                       rxHardwareRate(), _rxFrequency);
+    }
+
+    if (numDeliver > 0 and _wideActive.load(std::memory_order_relaxed))
+    {
+        rx_resample(xi, xq, numDeliver, timeNs, count, reset);
+    }
+
+    // the dwell is complete, hand its last buffer to the reader now
+    if (_scanState == SCAN_WAIT and numDeliver > 0)
+    {
+        rx_flush(true);
+    }
+
+    // time spent converting and queueing this callback
+    const unsigned long long elapsedNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    _statConvertNs.fetch_add(elapsedNs, std::memory_order_relaxed);
+    if (elapsedNs > _statConvertMaxNs.load(std::memory_order_relaxed))
+    {
+        _statConvertMaxNs.store(elapsedNs, std::memory_order_relaxed);
+    }
+    _statSamplesIn.fetch_add(numSamples, std::memory_order_relaxed);
+    _statCallbacks.fetch_add(1, std::memory_order_relaxed);
+}
+
+unsigned int SoapySDRPlay::rx_scan(unsigned int numSamples, int rfChanged)
+{
+    if (not _scanActive.load(std::memory_order_relaxed))
+    {
+        if (_scanState != SCAN_OFF)
+        {
+            // back to the plain stream in a buffer of its own
+            _scanState = SCAN_OFF;
+            rx_flush(false);
+            _segmentStart = true;
+        }
+        _rxFrequency = _rxTuning.frequency;
+        return numSamples;
+    }
+
+    // a new hop, the tuner changes with the callback flagged by rfChanged
+    const unsigned int seq = _hopSeq.load(std::memory_order_acquire);
+    if (seq != _scanSeqSeen)
+    {
+        _scanSeqSeen = seq;
+        _scanSettled = 0;
+        _scanState = _hopSettle.load(std::memory_order_relaxed) ? SCAN_SETTLING : SCAN_DWELL;
+        if (_scanState == SCAN_DWELL)
+        {
+            _scanRemain = _hopDwell.load(std::memory_order_relaxed);
+            _rxFrequency = _hopFrequency.load(std::memory_order_relaxed);
+            rx_flush(false);
+            _segmentStart = true;
+            _resampleRestart = true;
+        }
+    }
+    else if (_scanState == SCAN_OFF)
+    {
+        // nothing to deliver before the first hop
+        _scanState = SCAN_WAIT;
+    }
+
+    if (_scanState == SCAN_SETTLING)
+    {
+        _scanSettled += numSamples;
+        const bool late = _scanSettled > (long long)(SCAN_SETTLE_MAX_MS * rxHardwareRate() / 1000.0);
+        if (not rfChanged and not late)
+        {
+            return 0;
+        }
+        if (late)
+        {
+            SoapySDR_logf(SOAPY_SDR_WARNING, "Scan: no rfChanged within %d ms of the hop to %.0f Hz", SCAN_SETTLE_MAX_MS, _hopFrequency.load());
+        }
+        _scanState = SCAN_DWELL;
+        _scanRemain = _hopDwell.load(std::memory_order_relaxed);
+        _rxFrequency = _hopFrequency.load(std::memory_order_relaxed);
+        rx_flush(false);
+        _segmentStart = true;
+        _resampleRestart = true;
+    }
+
+    if (_scanState != SCAN_DWELL)
+    {
+        return 0;
+    }
+
+    // exactly the dwell, then ask the control thread for the next hop
+    const unsigned int numDeliver = (unsigned int)std::min<long long>(numSamples, _scanRemain);
+    _scanRemain -= numDeliver;
+    if (_scanRemain == 0)
+    {
+        _scanState = SCAN_WAIT;
+        wakeReinit(true);
+    }
+    return numDeliver;
+}
+
+void SoapySDRPlay::rx_flush(const bool endBurst)
+{
+    // only a streaming wideband channel has a queue, and with a full
+    // queue the buffer at tail belongs to the reader
+    size_t tail = _buf_tail.load(std::memory_order_relaxed);
+    if (not _wideActive.load(std::memory_order_relaxed) or numBuffers == 0 or tail - _buf_head.load(std::memory_order_acquire) == numBuffers)
+    {
         return;
     }
-    
-    int spaceReqd = numSamples * elementsPerSample * shortsPerWord;
-    if ((_buffs[_buf_tail].size() + spaceReqd) >= (bufferLength / decM))
+    if (_buffMeta[tail % numBuffers].bytes == 0)
+    {
+        return;
+    }
+    _buffMeta[tail % numBuffers].endBurst = endBurst;
+    _buf_tail.store(++tail);
+    notifyReader();
+}
+
+void SoapySDRPlay::rx_event(const int events)
+{
+    // the samples before the change go out in a block of their own,
+    // the next block starts with the change and carries it
+    rx_flush(false);
+    _rxEvents |= events;
+}
+
+void SoapySDRPlay::rx_resample(short *xi, short *xq, unsigned int numSamples, const long long timeNs, const long long count, unsigned int reset)
+{
+    // pick up a new rate, the output count carries on from here
+    if (_resampleConfigure.exchange(false, std::memory_order_acquire))
+    {
+        _resampling = (rxHardwareRate() != rxOutputRate());
+        _resampleInBase = count;
+        _resampleOutBase = _resampleOutNext;
+        _resampleRestart = true;
+    }
+
+    if (not _resampling)
+    {
+        rx_burst(xi, xq, numSamples, timeNs, count);
+        return;
+    }
+
+    // lost samples, a counter reset or a new scan dwell break the filter history
+    if (_resampleRestart or reset or count != _resampleInNext)
+    {
+        // across a gap the output count follows the hardware count
+        const long long outCount = _resampleOutBase + std::llround((count - _resampleInBase) * rxOutputRate() / rxHardwareRate());
+        _resampleOutNext = std::max(_resampleOutNext, outCount);
+        _resampleTimeNs = timeNs - _resampler.delayNs();
+        _resampleTimeCount = _resampleOutNext;
+        _resampler.reset();
+        _resampleRestart = false;
+    }
+    _resampleInNext = count + numSamples;
+
+    // sized by setupStream(), only a larger callback grows it
+    const size_t maxOutput = _resampler.maxOutput(numSamples);
+    if (_resampleI.size() < maxOutput)
+    {
+        _resampleI.resize(maxOutput);
+        _resampleQ.resize(maxOutput);
+    }
+
+    const SoapySDRPlayConverter *conv = converter.load(std::memory_order_relaxed);
+    const size_t numOutput = _resampler.process(conv, xi, xq, numSamples, _resampleI.data(), _resampleQ.data());
+    if (numOutput == 0)
+    {
+        return;
+    }
+
+    const long long outTimeNs = _resampleTimeNs + ticksToTimeNs(_resampleOutNext - _resampleTimeCount, rxOutputRate());
+    rx_burst(_resampleI.data(), _resampleQ.data(), (unsigned int)numOutput, outTimeNs, _resampleOutNext);
+    _resampleOutNext += numOutput;
+}
+
+void SoapySDRPlay::rx_burst(short *xi, short *xq, unsigned int numSamples, const long long timeNs, const long long count)
+{
+    if (not _burstMode.load(std::memory_order_relaxed))
+    {
+        rx_deliver(xi, xq, numSamples, timeNs, count);
+        return;
+    }
+
+    // sample counts follow the output rate
+    const double rate = rxOutputRate();
+    if (rate != _burstRate)
+    {
+        _burstRate = rate;
+        _burstThreshold = (float)(32767.0 * 32767.0 * std::pow(10.0, _burstThresholdDb / 10.0));
+        _burstAlpha = (float)(1.0 - std::exp(-1000.0 / (_burstTauMs * rate)));
+        _burstPost = (long long)std::ceil(_burstPostMs * rate / 1000.0);
+        const size_t preElems = (size_t)std::ceil(_burstPreMs * rate / 1000.0);
+        if (_burstRingI.size() < preElems)
+        {
+            _burstRingI.resize(preElems);
+            _burstRingQ.resize(preElems);
+        }
+        _burstRingPos = 0;
+        _burstRingFill = 0;
+    }
+
+    // lost samples or a retune end the burst, the pre-roll would not fit either
+    if (count != _burstNext or _rxFrequency != _burstFrequency)
+    {
+        if (_burstOn) rx_flush(true);
+        _burstOn = false;
+        _burstPower = 0.0f;
+        _burstRingFill = 0;
+        _burstFrequency = _rxFrequency;
+    }
+    _burstNext = count + numSamples;
+
+    const float alpha = _burstAlpha;
+    const float threshold = _burstThreshold;
+    float power = _burstPower;
+    unsigned int first = 0;    // of the samples not yet queued or kept
+    for (unsigned int i = 0; i < numSamples; i++)
+    {
+        const float re = xi[i], im = xq[i];
+        power += alpha * (re * re + im * im - power);
+
+        if (not _burstOn)
+        {
+            if (power <= threshold) continue;
+
+            // the pre-roll goes first, up to the sample before the detection
+            rx_burstKeep(xi + first, xq + first, i - first);
+            rx_burstStart(timeNs + ticksToTimeNs(i, rate), count + i);
+            _burstOn = true;
+            _burstHang = _burstPost;
+            first = i;
+        }
+        else if (power > threshold)
+        {
+            _burstHang = _burstPost;
+        }
+        else if (--_burstHang < 0)
+        {
+            // the post-roll is complete, hand the burst to the reader now
+            rx_deliver(xi + first, xq + first, i - first, timeNs + ticksToTimeNs(first, rate), count + first);
+            rx_flush(true);
+            _burstOn = false;
+            first = i;
+        }
+    }
+    _burstPower = power;
+
+    if (_burstOn)
+    {
+        rx_deliver(xi + first, xq + first, numSamples - first, timeNs + ticksToTimeNs(first, rate), count + first);
+    }
+    else
+    {
+        rx_burstKeep(xi + first, xq + first, numSamples - first);
+    }
+}
+
+void SoapySDRPlay::rx_burstKeep(const short *xi, const short *xq, size_t numSamples)
+{
+    // the pre-roll ring holds the last samples before a burst
+    const size_t size = (size_t)std::ceil(_burstPreMs * _burstRate / 1000.0);
+    if (size == 0)
+    {
+        return;
+    }
+    if (numSamples >= size)
+    {
+        xi += numSamples - size;
+        xq += numSamples - size;
+        numSamples = size;
+        _burstRingPos = 0;
+    }
+    while (numSamples > 0)
+    {
+        const size_t n = std::min(numSamples, size - _burstRingPos);
+        std::copy(xi, xi + n, _burstRingI.begin() + _burstRingPos);
+        std::copy(xq, xq + n, _burstRingQ.begin() + _burstRingPos);
+        _burstRingPos = (_burstRingPos + n) % size;
+        _burstRingFill = std::min(_burstRingFill + n, size);
+        xi += n;
+        xq += n;
+        numSamples -= n;
+    }
+}
+
+void SoapySDRPlay::rx_burstStart(const long long timeNs, const long long count)
+{
+    // a burst starts a buffer of its own, its count does not follow the last one
+    rx_flush(false);
+    _segmentStart = true;
+    _statBursts.fetch_add(1, std::memory_order_relaxed);
+
+    // queue the pre-roll oldest first, a block at a time
+    const size_t size = (size_t)std::ceil(_burstPreMs * _burstRate / 1000.0);
+    const size_t fill = _burstRingFill;
+    const size_t blockElems = std::max<size_t>(_blockElems.load(std::memory_order_relaxed), 1);
+    size_t pos = (size == 0) ? 0 : (_burstRingPos + size - fill) % size;
+    for (size_t done = 0; done < fill;)
+    {
+        const size_t n = std::min(std::min(fill - done, size - pos), blockElems);
+        const long long ahead = (long long)(fill - done);
+        rx_deliver(_burstRingI.data() + pos, _burstRingQ.data() + pos, (unsigned int)n,
+                   timeNs - ticksToTimeNs(ahead, _burstRate), count - ahead);
+        pos = (pos + n) % size;
+        done += n;
+    }
+    _burstRingFill = 0;
+}
+
+void SoapySDRPlay::rx_deliver(short *xi, short *xq, unsigned int numSamples, const long long timeNs, const long long count)
+{
+    // the reader dropped the queue, forget about the partially filled buffer
+    if (_buf_drain.exchange(false))
+    {
+        // with a full queue the buffer at tail is a published one
+        const size_t tail = _buf_tail.load(std::memory_order_relaxed);
+        if (tail - _buf_head.load(std::memory_order_acquire) != numBuffers)
+        {
+            _buffMeta[tail % numBuffers].bytes = 0;
+        }
+        _gapPending = true;
+    }
+
+    if (_callbackSamples.load(std::memory_order_relaxed) != numSamples)
+    {
+        _callbackSamples.store(numSamples, std::memory_order_relaxed);
+    }
+
+    // load the stream format once per callback
+    const SoapySDRPlayConverter *conv = converter.load(std::memory_order_relaxed);
+    const unsigned int sampleBytes = bytesPerSample;
+
+    // a reader is blocked in readStream(), convert straight into its buffer
+    if (rx_direct(xi, xq, numSamples, timeNs, count, conv, sampleBytes))
+    {
+        return;
+    }
+
+    // a single callback must fit into an empty buffer
+    if (numSamples > bufferElems)
+    {
+        _gapPending = true;
+        return;
+    }
+
+    size_t tail = _buf_tail.load(std::memory_order_relaxed);
+
+    // the buffer at tail still belongs to the reader when the queue is full
+    if (not rx_reclaim(tail))
+    {
+        return;
+    }
+
+    // start a new buffer when this one would overshoot or after lost samples
+    const size_t blockBytes = _blockElems.load(std::memory_order_relaxed) * sampleBytes;
+    const size_t spaceReqd = numSamples * sampleBytes;
+    const size_t fill = _buffMeta[tail % numBuffers].bytes;
+    if ((fill != 0) and (_gapPending or (fill + spaceReqd > blockBytes)))
     {
-       // increment the tail pointer and buffer count
-       _buf_tail = (_buf_tail + 1) % numBuffers;
-       _buf_count++;
+       // publish the buffer to the reader
+       _buf_tail.store(++tail);
 
        // notify readStream()
-       _buf_cond.notify_one();
+       notifyReader();
+
+       if (not rx_reclaim(tail))
+       {
+           return;
+       }
     }
 
     // get current fill buffer
-    auto &buff = _buffs[_buf_tail];
-    buff.resize(buff.size() + spaceReqd);
+    BufferMeta &meta = _buffMeta[tail % numBuffers];
+    if (meta.bytes == 0)
+    {
+        _buffMeta[tail % numBuffers].timeNs = timeNs;
+        _buffMeta[tail % numBuffers].count = count;
+        _buffMeta[tail % numBuffers].frequency = _rxFrequency;
+        _buffMeta[tail % numBuffers].segment = _segmentStart;
+        _buffMeta[tail % numBuffers].endBurst = false;
+        _buffMeta[tail % numBuffers].events = _rxEvents;
+        _buffMeta[tail % numBuffers].gRdB = current_gRdB.load(std::memory_order_relaxed);
+        _buffMeta[tail % numBuffers].rate = rxOutputRate();
+        _rxEvents = 0;
+        _fillAfterGap = _gapPending;
+        _gapPending = false;
+        _segmentStart = false;
+    }
 
-    // copy into the buffer queue
-    unsigned int i = 0;
+    // convert into the buffer queue
+    rx_convert(conv, xi, xq, _arena.slot(tail % numBuffers) + meta.bytes, numSamples);
+    meta.bytes += spaceReqd;
+
+    return;
+}
 
-    if (useShort)
+SoapySDRPlay::GainSnapshot SoapySDRPlay::readGainSnapshot(void) const
+{
+    GainSnapshot snap;
+    while (true)
     {
-       short *dptr = buff.data();
-       dptr += (buff.size() - spaceReqd);
-       for (i = 0; i < numSamples; i++)
-       {
-           *dptr++ = xi[i];
-           *dptr++ = xq[i];
+        snap.seq = _gainSeq.load(std::memory_order_acquire);
+        if (snap.seq & 1)
+        {
+            // gr_callback is halfway through, it never blocks
+            std::this_thread::yield();
+            continue;
         }
+        snap.ifGRdB = _gainIF.load(std::memory_order_relaxed);
+        snap.lnaGRdB = _gainLNA.load(std::memory_order_relaxed);
+        snap.count = _gainCount.load(std::memory_order_relaxed);
+        snap.timeNs = _gainTimeNs.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (_gainSeq.load(std::memory_order_relaxed) == snap.seq) return snap;
     }
-    else
-    {
-       float *dptr = (float *)buff.data();
-       dptr += ((buff.size() - spaceReqd) / shortsPerWord);
-       for (i = 0; i < numSamples; i++)
-       {
-          *dptr++ = (float)xi[i] / 32768.0f;
-          *dptr++ = (float)xq[i] / 32768.0f;
-       }
-    }
-
-    return;
 }
 
 void SoapySDRPlay::gr_callback(unsigned int gRdB, unsigned int lnaGRdB)
 {
     //Beware, lnaGRdB is really the LNA GR, NOT the LNA state !
- 
-    mir_sdr_GainValuesT gainVals;
-
-    mir_sdr_GetCurrentGain(&gainVals);
 
     if (gRdB < 200)
     {
-        current_gRdB = gRdB;
+        current_gRdB.store(gRdB, std::memory_order_relaxed);
     }
 
     if (gRdB < mir_sdr_GAIN_MESSAGE_START_ID)
     {
-        // gainVals.curr is a calibrated gain value
+        // publish the new gain, the calibrated value is only queried on demand
+        const unsigned int seq = _gainSeq.load(std::memory_order_relaxed);
+        _gainSeq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        _gainIF.store(gRdB, std::memory_order_relaxed);
+        _gainLNA.store(lnaGRdB, std::memory_order_relaxed);
+        _gainCount.store(_rxCountNext.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        _gainTimeNs.store(_rxTimeNext.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        _gainSeq.store(seq + 2, std::memory_order_release);
     }
     else if (gRdB == mir_sdr_ADC_OVERLOAD_DETECTED)
     {
         mir_sdr_GainChangeCallbackMessageReceived();
+        _statAdcOverloads.fetch_add(1, std::memory_order_relaxed);
         // OVERLOAD DECTECTED
     }
     else
@@ -145,6 +1142,51 @@ void SoapySDRPlay::gr_callback(unsigned int gRdB, unsigned int lnaGRdB)
     }
 }
 
+// the replay thread retunes where the hardware would report a reinit,
+// the rx path follows from the flagged callback that comes next and
+// the control thread brings the settings along
+void SoapySDRPlay::replay_tune(const double frequency, const double rate)
+{
+    _rxTuning.frequency = (uint32_t)frequency;
+    if ((uint32_t)std::llround(rate) != _rxTuning.sampleRate)
+    {
+        // this is the thread rx_callback runs on, it may design in place
+        _rxTuning.sampleRate = (uint32_t)std::llround(rate);
+        prepareRx(_rxTuning.sampleRate, _rxTuning.decM, _rxTuning.outputRate, _resampler, _burstRingI, _burstRingQ);
+        _burstRate = 0.0;
+        _corrReset = true;
+        _resampleConfigure = true;
+    }
+
+    {
+        std::lock_guard <std::mutex> lock(_wakeMutex);
+        _replayTuneFrequency = frequency;
+        _replayTuneRate = rate;
+        _replayTuneDue = true;
+        _reinitWake = true;
+    }
+    _wakeCond.notify_one();
+}
+
+bool SoapySDRPlay::replay_ready(void) const
+{
+    // room for the buffer being filled once the one before is published
+    if (not _wideActive.load(std::memory_order_relaxed)) return true;
+    const size_t queued = _buf_tail.load(std::memory_order_relaxed) - _buf_head.load(std::memory_order_acquire);
+    return queued + 1 < std::max<size_t>(numBuffers, 2);
+}
+
+void SoapySDRPlay::replay_end(void)
+{
+    // the reader gets the last samples right away rather than at its timeout
+    int state = DIRECT_PARTIAL;
+    if (_direct_state.compare_exchange_strong(state, DIRECT_DONE))
+    {
+        notifyReader();
+    }
+    rx_flush(true);
+}
+
 /*******************************************************************
  * Stream API
  ******************************************************************/
@@ -154,63 +1196,329 @@ SoapySDR::Stream *SoapySDRPlay::setupStream(const int direction,
                                             const std::vector<size_t> &channels,
                                             const SoapySDR::Kwargs &args)
 {
-    // check the channel configuration
-    if (channels.size() > 1 or (channels.size() > 0 and channels.at(0) != 0)) 
+    // check the channel configuration, each virtual channel streams on its own
+    if (channels.size() > 1 or (channels.size() > 0 and channels.at(0) > _channelStreams.size()))
     {
        throw std::runtime_error("setupStream invalid channel selection");
     }
-    
+    if (channels.size() > 0 and channels.at(0) > 0)
+    {
+       return this->setupChannelStream(channels.at(0), format, args);
+    }
+    if (format == "F32")
+    {
+       return this->setupSpectrumStream(args);
+    }
+
     // check the format
     if (format == "CS16") 
     {
-        useShort = true;
-        shortsPerWord = 1;
-        bufferLength = bufferElems * elementsPerSample * shortsPerWord;
+        streamFormat = FORMAT_CS16;
+        bytesPerSample = 2 * sizeof(short);
         SoapySDR_log(SOAPY_SDR_INFO, "Using format CS16.");
     } 
     else if (format == "CF32") 
     {
-        useShort = false;
-        shortsPerWord = sizeof(float) / sizeof(short);
-        bufferLength = bufferElems * elementsPerSample * shortsPerWord;  // allocate enough space for floats instead of shorts
+        streamFormat = FORMAT_CF32;
+        bytesPerSample = 2 * sizeof(float);
         SoapySDR_log(SOAPY_SDR_INFO, "Using format CF32.");
     } 
+    else if (format == "CS8")
+    {
+        streamFormat = FORMAT_CS8;
+        bytesPerSample = 2;
+        SoapySDR_logf(SOAPY_SDR_INFO, "Using format CS8, samples shifted right by %d bits.", (int)cs8Shift);
+    }
+    else if (format == "CS12")
+    {
+        streamFormat = FORMAT_CS12;
+        bytesPerSample = 3;  // packed, two 12 bit components
+        SoapySDR_log(SOAPY_SDR_INFO, "Using format CS12.");
+    }
     else 
     {
        throw std::runtime_error( "setupStream invalid format '" + format +
-                                  "' -- Only CS16 or CF32 are supported by the SoapySDRPlay module.");
+                                  "' -- Only CS16, CF32, CS8, CS12 or F32 are supported by the SoapySDRPlay module.");
+    }
+
+    if (args.count("overflow") == 0 or args.at("overflow") == "drop_newest")
+    {
+        overflowPolicy = OVERFLOW_DROP_NEWEST;
+    }
+    else if (args.at("overflow") == "drop_oldest")
+    {
+        overflowPolicy = OVERFLOW_DROP_OLDEST;
+    }
+    else if (args.at("overflow") == "drop_queue")
+    {
+        overflowPolicy = OVERFLOW_DROP_QUEUE;
+    }
+    else
+    {
+        throw std::runtime_error("setupStream invalid overflow policy '" + args.at("overflow") + "'");
+    }
+
+    _eventSplit = (args.count("events") == 0 or args.at("events") != "false");
+
+    try
+    {
+        _burstMode = (args.count("burst_threshold") != 0 and not args.at("burst_threshold").empty());
+        _burstThresholdDb = _burstMode ? std::stod(args.at("burst_threshold")) : 0.0;
+        _burstPreMs = (args.count("burst_pre_ms") != 0) ? std::stod(args.at("burst_pre_ms")) : DEFAULT_BURST_PRE_MS;
+        _burstPostMs = (args.count("burst_post_ms") != 0) ? std::stod(args.at("burst_post_ms")) : DEFAULT_BURST_POST_MS;
+        _burstTauMs = (args.count("burst_tau_ms") != 0) ? std::stod(args.at("burst_tau_ms")) : DEFAULT_BURST_TAU_MS;
+    }
+    catch (const std::logic_error &)
+    {
+        throw std::runtime_error("setupStream invalid burst_threshold, burst_pre_ms, burst_post_ms or burst_tau_ms stream argument");
+    }
+    if (_burstPreMs < 0.0 or _burstPostMs < 0.0 or _burstTauMs <= 0.0)
+    {
+        throw std::runtime_error("setupStream burst_pre_ms and burst_post_ms can't be negative, burst_tau_ms must be positive");
     }
 
-    std::lock_guard<std::mutex> lock(_buf_mutex);
+    setupSchedules(0, args);
 
-    // clear async fifo counts
+    // size the buffers from the stream args and the current output rate
+    {
+        std::lock_guard <std::mutex> lock(_general_state_mutex);
+
+        const double rate = getOutputRate();
+        try
+        {
+            latencyMs = (args.count("latency_ms") != 0) ? std::stod(args.at("latency_ms")) : 0.0;
+
+            if (args.count("bufflen") != 0)
+            {
+                bufferElems = (unsigned int)std::stoul(args.at("bufflen"));
+            }
+            else if (latencyMs > 0.0)
+            {
+                bufferElems = (unsigned int)std::ceil(latencyMs * rate / 1000.0);
+            }
+            else
+            {
+                bufferElems = DEFAULT_BUFFER_LENGTH;
+            }
+            bufferElems = std::max<unsigned int>(bufferElems, MIN_BUFFER_LENGTH);
+
+            updateBlockSize();
+
+            if (args.count("buffers") != 0)
+            {
+                numBuffers = std::stoul(args.at("buffers"));
+            }
+            else
+            {
+                // enough buffers to ride out DEFAULT_QUEUE_MS at the output rate
+                const double queueElems = DEFAULT_QUEUE_MS * rate / 1000.0;
+                numBuffers = std::max<size_t>(DEFAULT_NUM_BUFFERS, (size_t)std::ceil(queueElems / _blockElems));
+            }
+            numBuffers = std::max<size_t>(2, std::min<size_t>(numBuffers, MAX_NUM_BUFFERS));
+        }
+        catch (const std::logic_error &)
+        {
+            throw std::runtime_error("setupStream invalid buffers, bufflen or latency_ms stream argument");
+        }
+
+        bufferLength = bufferElems * bytesPerSample;
+
+        SoapySDR_logf(SOAPY_SDR_INFO, "Using %d buffers of %d samples, %d per read.",
+                      (int)numBuffers, (int)bufferElems, (int)_blockElems);
+    }
+
+    // clear async fifo counts, the stream is not active yet
     _buf_tail = 0;
     _buf_head = 0;
-    _buf_count = 0;
+    _buf_acquired = 0;
+    _buf_drain = false;
+    _overflowEvent = false;
+    _gapPending = false;
+    _fillAfterGap = false;
+    _expectValid = false;
+    _overflowPending = false;
+
+    // stream health counters start over with the new stream
+    _statCallbacks = 0;
+    _statSamplesIn = 0;
+    _statSamplesOut = 0;
+    _statFillSum = 0;
+    _statFillMin = SIZE_MAX;
+    _statFillMax = 0;
+    _statConvertNs = 0;
+    _statConvertMaxNs = 0;
+    _statOverflows = 0;
+    _statDropped = 0;
+    _statBursts = 0;
+    {
+        std::lock_guard <std::mutex> lock(_stat_mutex);
+        _statLast.clear();
+    }
 
-    // allocate buffers
-    _buffs.resize(numBuffers);
-    for (auto &buff : _buffs) buff.reserve(bufferLength);
-    for (auto &buff : _buffs) buff.clear();
+    // one arena for all buffers, nothing is allocated while streaming
+    const bool hugePages = (args.count("huge_pages") != 0 and args.at("huge_pages") == "true");
+    const bool lockPages = (args.count("mlock") != 0 and args.at("mlock") == "true");
+    _arena.allocate(numBuffers, bufferLength, hugePages, lockPages);
+    _buffMeta.assign(numBuffers, BufferMeta());
+    if (hugePages or lockPages)
+    {
+        SoapySDR_logf(SOAPY_SDR_INFO, "Buffer arena of %d bytes%s%s.", (int)(numBuffers * bufferLength),
+                      _arena.hugePages() ? " on huge pages" : "", _arena.locked() ? ", locked" : "");
+    }
+
+    // the resampler, its output and the pre-roll ring for the current rates,
+    // later rates are prepared by the thread that sets them
+    _burstRate = 0.0;
+    _burstOn = false;
+    _burstRingPos = 0;
+    _burstRingFill = 0;
+    prepareRx(sampleRate, decM, reqSampleRate, _resampler, _burstRingI, _burstRingQ);
+    _resampleI.resize(rxReserveSamples() + 2);
+    _resampleQ.resize(rxReserveSamples() + 2);
+    if (_burstMode)
+    {
+        SoapySDR_logf(SOAPY_SDR_INFO, "Bursts above %g dBFS, %g ms pre-roll, %g ms post-roll.",
+                      _burstThresholdDb, _burstPreMs, _burstPostMs);
+    }
 
     return (SoapySDR::Stream *) this;
 }
 
-void SoapySDRPlay::closeStream(SoapySDR::Stream *stream)
+void SoapySDRPlay::setupSchedules(const size_t channel, const SoapySDR::Kwargs &args)
 {
-    std::lock_guard <std::mutex> lock(_general_state_mutex);
+    auto schedule = [&args](const std::string &prefix, SoapySDRPlaySchedule &schedule)
+    {
+        const bool hasPriority = args.count(prefix + "_priority") != 0;
+        const bool hasCpu = args.count(prefix + "_cpu") != 0;
+        if (not hasPriority and not hasCpu) return false;
+        schedule = SoapySDRPlay_parseSchedule(hasPriority ? args.at(prefix + "_priority") : "",
+                                              hasCpu ? args.at(prefix + "_cpu") : "");
+        return true;
+    };
 
-    if (streamActive)
+    // the vendor thread and the workers are shared, the last stream that asks sets them
+    SoapySDRPlaySchedule rxSchedule, workerSchedule;
+    const bool hasRx = schedule("rx", rxSchedule);
+    const bool hasWorker = schedule("worker", workerSchedule);
+    schedule("reader", _readerSchedules[channel]);
+
+    if (hasRx)
+    {
+        std::lock_guard <std::mutex> lock(_general_state_mutex);
+        if (streamActive) throw std::runtime_error("setupStream rx_priority and rx_cpu need the hardware stream stopped");
+        _rxSchedule = rxSchedule;
+    }
+    if (hasWorker)
+    {
+        _spectrum.setSchedule(workerSchedule);
+        _recorder.setSchedule(workerSchedule);
+        if (_channelizer) _channelizer->setSchedule(workerSchedule);
+    }
+}
+
+SoapySDR::Stream *SoapySDRPlay::setupChannelStream(const size_t channel, const std::string &format, const SoapySDR::Kwargs &args)
+{
+    SoapySDRPlayChannelizer::Format chanFormat;
+    unsigned int chanBytes;
+    if (format == "CS16")      { chanFormat = SoapySDRPlayChannelizer::FORMAT_CS16; chanBytes = 2 * sizeof(short); }
+    else if (format == "CF32") { chanFormat = SoapySDRPlayChannelizer::FORMAT_CF32; chanBytes = 2 * sizeof(float); }
+    else if (format == "CS8")  { chanFormat = SoapySDRPlayChannelizer::FORMAT_CS8;  chanBytes = 2; }
+    else if (format == "CS12") { chanFormat = SoapySDRPlayChannelizer::FORMAT_CS12; chanBytes = 3; }
+    else
+    {
+       throw std::runtime_error( "setupStream invalid format '" + format +
+                                  "' -- Only CS16, CF32, CS8 or CS12 are supported by the SoapySDRPlay module.");
+    }
+
+    // buffers for DDC_LATENCY_MS at the channel rate unless asked otherwise
+    const double rate = _channelizer->getRate(channel - 1);
+    size_t chanBuffers, chanElems;
+    try
+    {
+        const double chanLatencyMs = (args.count("latency_ms") != 0) ? std::stod(args.at("latency_ms")) : 0.0;
+        if (args.count("bufflen") != 0)
+        {
+            chanElems = std::stoul(args.at("bufflen"));
+        }
+        else
+        {
+            chanElems = (size_t)std::ceil(((chanLatencyMs > 0.0) ? chanLatencyMs : DDC_LATENCY_MS) * rate / 1000.0);
+        }
+        chanBuffers = (args.count("buffers") != 0) ? std::stoul(args.at("buffers")) :
+                      std::max<size_t>(DEFAULT_NUM_BUFFERS, DEFAULT_QUEUE_MS / DDC_LATENCY_MS);
+    }
+    catch (const std::logic_error &)
+    {
+        throw std::runtime_error("setupStream invalid buffers, bufflen or latency_ms stream argument");
+    }
+    chanElems = std::max<size_t>(chanElems, 256);
+    chanBuffers = std::max<size_t>(2, std::min<size_t>(chanBuffers, MAX_NUM_BUFFERS));
+
+    _channelizer->setup(channel - 1, chanFormat, chanBytes, chanBuffers, chanElems, cs8Shift, packRounding);
+    SoapySDR_logf(SOAPY_SDR_INFO, "Channel %d: format %s, %d buffers of %d samples.",
+                  (int)channel, format.c_str(), (int)chanBuffers, (int)chanElems);
+
+    setupSchedules(channel, args);
+
+    return (SoapySDR::Stream *)&_channelStreams[channel - 1];
+}
+
+SoapySDR::Stream *SoapySDRPlay::setupSpectrumStream(const SoapySDR::Kwargs &args)
+{
+    size_t fftSize, average, numFrames;
+    double overlap, frameRate;
+    try
+    {
+        fftSize = (args.count("fft_size") != 0) ? std::stoul(args.at("fft_size")) : DEFAULT_FFT_SIZE;
+        overlap = (args.count("fft_overlap") != 0) ? std::stod(args.at("fft_overlap")) : 0.5;
+        average = (args.count("fft_average") != 0) ? std::stoul(args.at("fft_average")) : 0;
+        frameRate = (args.count("frame_rate") != 0) ? std::stod(args.at("frame_rate")) : DEFAULT_FRAME_RATE;
+
+        // frames for DEFAULT_QUEUE_MS unless asked otherwise
+        numFrames = (args.count("buffers") != 0) ? std::stoul(args.at("buffers")) :
+                    std::max<size_t>(DEFAULT_NUM_BUFFERS, (size_t)std::ceil(DEFAULT_QUEUE_MS * frameRate / 1000.0));
+    }
+    catch (const std::logic_error &)
     {
-        mir_sdr_StreamUninit();
+        throw std::runtime_error("setupStream invalid fft_size, fft_overlap, fft_average, frame_rate or buffers stream argument");
     }
-    streamActive = false;
+    numFrames = std::max<size_t>(2, std::min<size_t>(numFrames, MAX_NUM_BUFFERS));
+    const std::string window = (args.count("fft_window") != 0) ? args.at("fft_window") : "hann";
+
+    _spectrum.setup(fftSize, SoapySDRPlaySpectrum::parseWindow(window), overlap, average, frameRate, numFrames);
+    SoapySDR_logf(SOAPY_SDR_INFO, "Spectrum: %d bins, %s window, %g overlap, %g frames/s, %d frames queued.",
+                  (int)fftSize, window.c_str(), overlap, frameRate, (int)numFrames);
+
+    setupSchedules(_spectrumStream.channel, args);
+
+    return (SoapySDR::Stream *)&_spectrumStream;
+}
+
+size_t SoapySDRPlay::streamChannel(SoapySDR::Stream *stream) const
+{
+    if (stream == (SoapySDR::Stream *)this) return 0;
+    return ((const ChannelStream *)stream)->channel;
+}
+
+void SoapySDRPlay::closeStream(SoapySDR::Stream *stream)
+{
+    this->deactivateStream(stream);
 }
 
 size_t SoapySDRPlay::getStreamMTU(SoapySDR::Stream *stream) const
 {
-    // is a constant in practice
-    return bufferElems;
+    const size_t channel = streamChannel(stream);
+    if (channel == _spectrumStream.channel)
+    {
+        return _spectrum.getMTU();
+    }
+    if (channel > 0)
+    {
+        return _channelizer->getMTU(channel - 1);
+    }
+
+    // largest buffer returned at the current rate
+    return std::max<size_t>(_blockElems, _callbackSamples);
 }
 
 int SoapySDRPlay::activateStream(SoapySDR::Stream *stream,
@@ -222,38 +1530,124 @@ int SoapySDRPlay::activateStream(SoapySDR::Stream *stream,
     {
         return SOAPY_SDR_NOT_SUPPORTED;
     }
-   
-    resetBuffer = true;
-    bufferedElems = 0;
-    
-    mir_sdr_ErrT err;
-    
+
+    const size_t channel = streamChannel(stream);
+    if (channel == 0)
+    {
+        resetBuffer = true;
+        bufferedElems = 0;
+        _corrReset = true;
+        _resampleConfigure = true;
+    }
+
+    // the reader picks its schedule up with the next readStream()
+    _readerScheduleDue[channel] = not _readerSchedules[channel].empty();
+
     std::lock_guard <std::mutex> lock(_general_state_mutex);
 
-    //Enable (= 1) API calls tracing,
-    //but only for debug purposes due to its performance impact. 
-    mir_sdr_DebugEnable(0);
+    // the hardware already streams for another channel
+    if (streamActive)
+    {
+        if (channel == 0) _wideActive = true;
+        else if (channel == _spectrumStream.channel) _spectrum.activate(true);
+        else _channelizer->activate(channel - 1, true);
+        return 0;
+    }
+
+    // nothing fills the queue yet, leaving the reset to the first read
+    // would drop what the new stream delivers before it
+    if (channel == 0 and _buf_acquired == _buf_head)
+    {
+        drainBuffers();
+    }
+
+    // timestamps start from the host clock,
+    // rx_callback counts hardware samples from here
+    _counterValid = false;
+    _timeAnchorNs = hostTimeNs();
+    _resampleOutNext = 0;
 
-    //temporary fix for ARM targets.
-#if defined(__arm__) || defined(__aarch64__)
-    mir_sdr_SetTransferMode(mir_sdr_BULK);
-#endif
+    // the rx callback starts out of any scan, the control thread hops from here
+    _scanState = SCAN_OFF;
+    _scanSeqSeen = _hopSeq.load();
+    _segmentStart = false;
+    _rxEvents = 0;
+    _rxScheduleDue = not _rxSchedule.empty();
+
+    // StreamInit applies the staged values, the rx path starts with them
+    _hwTuning = {sampleRate, decM, reqSampleRate, centerFrequency};
+    {
+        std::lock_guard<std::mutex> tuningLock(_rxTuningMutex);
+        _rxTuningNext = _hwTuning;
+        _rxTuningDue = 0;
+    }
+    _rxTuning = _hwTuning;
+    _rxTuningWait = 0;
+    prepareRx(sampleRate, decM, reqSampleRate, _resampler, _burstRingI, _burstRingQ);
+    _burstRate = 0.0;
 
-    err = mir_sdr_StreamInit(&gRdB, sampleRate / 1e6, centerFrequency / 1e6, bwMode,
-                             ifMode, lnaState, &gRdBsystem, mir_sdr_USE_RSP_SET_GR, &sps,
-                             _rx_callback, _gr_callback, (void *)this);
-    if (err != mir_sdr_Success)
+    if (_replay)
     {
-       //throw std::runtime_error("StreamInit Error: " + std::to_string(err));
-       return SOAPY_SDR_NOT_SUPPORTED;
+        sps = _replay->chunk();
     }
-    mir_sdr_DecimateControl(decEnable, decM, 1);
+    else
+    {
+        mir_sdr_ErrT err;
+        std::lock_guard <std::mutex> api(_api_mutex);
+
+        //Enable (= 1) API calls tracing,
+        //but only for debug purposes due to its performance impact. 
+        mir_sdr_DebugEnable(0);
+
+        //temporary fix for ARM targets.
+#if defined(__arm__) || defined(__aarch64__)
+        mir_sdr_SetTransferMode(mir_sdr_BULK);
+#endif
 
-    mir_sdr_SetDcMode(4,0);
-    mir_sdr_SetDcTrackTime(63);
+        err = mir_sdr_StreamInit(&gRdB, sampleRate / 1e6, centerFrequency / 1e6, bwMode,
+                                 ifMode, lnaState, &gRdBsystem, mir_sdr_USE_RSP_SET_GR, &sps,
+                                 _rx_callback, _gr_callback, (void *)this);
+        if (err != mir_sdr_Success)
+        {
+           //throw std::runtime_error("StreamInit Error: " + std::to_string(err));
+           return SOAPY_SDR_NOT_SUPPORTED;
+        }
+        mir_sdr_DecimateControl(decEnable, decM, 1);
+
+        mir_sdr_SetDcMode(4,0);
+        mir_sdr_SetDcTrackTime(63);
+    }
     
     streamActive = true;
-    
+
+    // StreamInit applied every setting already
+    _reinitPending = 0;
+
+    // restart the scan list at its first entry
+    if (not _scanList.empty())
+    {
+        _scanIndex = _scanList.size() - 1;
+        wakeReinit(true);
+    }
+
+    if (channel == 0) _wideActive = true;
+    else if (channel == _spectrumStream.channel) _spectrum.activate(true);
+    else _channelizer->activate(channel - 1, true);
+
+    // the recording plays from its start through the callbacks of the API,
+    // once the stream takes samples so that none are lost before the first read
+    if (_replay)
+    {
+        SoapySDRPlayReplayCallbacks callbacks;
+        callbacks.stream = _rx_callback;
+        callbacks.gain = _gr_callback;
+        callbacks.tune = _replay_tune;
+        callbacks.ready = _replay_ready;
+        callbacks.end = _replay_end;
+        callbacks.cbContext = (void *)this;
+        _replay->start(callbacks);
+    }
+
     return 0;
 }
 
@@ -266,13 +1660,23 @@ int SoapySDRPlay::deactivateStream(SoapySDR::Stream *stream, const int flags, co
 
     std::lock_guard <std::mutex> lock(_general_state_mutex);
 
-    if (streamActive)
+    const size_t channel = streamChannel(stream);
+    if (channel == 0) _wideActive = false;
+    else if (channel == _spectrumStream.channel) _spectrum.activate(false);
+    else _channelizer->activate(channel - 1, false);
+
+    // the hardware stops with the last active channel
+    if (streamActive and not _wideActive and not (_channelizer and _channelizer->anyActive()) and not _spectrum.active())
     {
-        mir_sdr_StreamUninit();
+        if (_replay) _replay->stop();
+        else
+        {
+            std::lock_guard <std::mutex> api(_api_mutex);
+            mir_sdr_StreamUninit();
+        }
+        streamActive = false;
     }
 
-    streamActive = false;
-    
     return 0;
 }
 
@@ -283,41 +1687,87 @@ int SoapySDRPlay::readStream(SoapySDR::Stream *stream,
                              long long &timeNs,
                              const long timeoutUs)
 {   
+    const size_t channel = streamChannel(stream);
+
+    // the first read after activateStream() runs on the reader thread
+    if (_readerScheduleDue[channel].load(std::memory_order_relaxed) and _readerScheduleDue[channel].exchange(false))
+    {
+        SoapySDRPlay_applySchedule(_readerSchedules[channel], "readStream");
+    }
+
+    if (channel == _spectrumStream.channel)
+    {
+        return _spectrum.read(buffs[0], numElems, flags, timeNs, timeoutUs);
+    }
+    if (channel > 0)
+    {
+        return _channelizer->read(channel - 1, buffs[0], numElems, flags, timeNs, timeoutUs);
+    }
+
     // this is the user's buffer for channel 0
     void *buff0 = buffs[0];
-    
+
+    // nothing queued or pending, let rx_callback convert into buff0,
+    // scanning and bursts split the samples at their boundaries so they need the queue
+    if ((bufferedElems == 0) and (numElems >= _callbackSamples) and (_callbackSamples != 0) and
+        not resetBuffer and not _overflowEvent and not _scanActive and not _burstMode and (_buf_acquired == _buf_head) and
+        (_buf_tail.load(std::memory_order_acquire) == _buf_acquired))
+    {
+        int ret = this->readDirect(buff0, numElems, timeoutUs);
+        if (ret > 0)
+        {
+            flags = SOAPY_SDR_HAS_TIME | _direct_events;
+            timeNs = _direct_timeNs;
+            if (_direct_events != 0)
+            {
+                setReadEvent(_direct_events, _direct_timeNs, _direct_count, _direct_gRdB, _direct_frequency, _direct_rate);
+            }
+            _expectCount = _direct_count + ret;
+            _expectValid = true;
+            _readFrequency = _direct_frequency;
+            _statSamplesOut.fetch_add(ret, std::memory_order_relaxed);
+            return ret;
+        }
+        if (ret != 0)
+        {
+            return ret;
+        }
+        // otherwise the queue got filled meanwhile
+    }
+
     // are elements left in the buffer? if not, do a new read.
     if (bufferedElems == 0)
     {
-        int ret = this->acquireReadBuffer(stream, _currentHandle, (const void **)&_currentBuff, flags, timeNs, timeoutUs);
+        int ret = this->acquireReadBuffer(stream, _currentHandle, (const void **)&_currentBuff, flags, _currentTimeNs, timeoutUs);
   
         if (ret < 0)
         {
+            // overflow reports the time of the first sample after the loss
+            timeNs = _currentTimeNs;
             return ret;
         }
         bufferedElems = ret;
+
+        // the end of a scan dwell goes with its last samples
+        _currentEndBurst = (flags & SOAPY_SDR_END_BURST) != 0;
+        flags &= ~SOAPY_SDR_END_BURST;
     }
 
+    // time of the first returned sample
+    flags |= SOAPY_SDR_HAS_TIME;
+    timeNs = _currentTimeNs;
+
     size_t returnedElems = std::min(bufferedElems.load(), numElems);
 
     // copy into user's buff0
-    if (useShort)
-    {
-        std::memcpy(buff0, _currentBuff, returnedElems * 2 * sizeof(short));
-    }
-    else
-    {
-        std::memcpy(buff0, (float *)_currentBuff, returnedElems * 2 * sizeof(float));
-    }
+    std::memcpy(buff0, _currentBuff, returnedElems * bytesPerSample);
     
     // bump variables for next call into readStream
     bufferedElems -= returnedElems;
 
-    // scope lock here to update _currentBuff position
-    {
-        std::lock_guard <std::mutex> lock(_buf_mutex);
-        _currentBuff += returnedElems * elementsPerSample * shortsPerWord;
-    }
+    // update _currentBuff position, owned by the reader
+    _currentBuff += returnedElems * bytesPerSample;
+    _currentTimeNs += ticksToTimeNs(returnedElems, _readRate);
 
     // return number of elements written to buff0
     if (bufferedElems != 0)
@@ -326,27 +1776,94 @@ int SoapySDRPlay::readStream(SoapySDR::Stream *stream,
     }
     else
     {
+        if (_currentEndBurst) flags |= SOAPY_SDR_END_BURST;
         this->releaseReadBuffer(stream, _currentHandle);
     }
     return (int)returnedElems;
 }
 
+void SoapySDRPlay::setReadEvent(const int events, const long long timeNs, const long long count,
+                                const int gRdB, const double frequency, const double rate)
+{
+    std::lock_guard <std::mutex> lock(_event_mutex);
+    _readEvent.events = events;
+    _readEvent.timeNs = timeNs;
+    _readEvent.count = count;
+    _readEvent.gRdB = gRdB;
+    _readEvent.frequency = frequency;
+    _readEvent.rate = rate;
+}
+
+void SoapySDRPlay::setReadBurst(const bool start, const long long timeNs, const long long count,
+                                const long long samples, const bool complete)
+{
+    std::lock_guard <std::mutex> lock(_event_mutex);
+    if (start)
+    {
+        _readBurst.timeNs = timeNs;
+        _readBurst.count = count;
+        _readBurst.samples = 0;
+    }
+    _readBurst.samples += samples;
+    _readBurst.complete = complete;
+}
+
+int SoapySDRPlay::readDirect(void *buff0, const size_t numElems, const long timeoutUs)
+{
+    _direct_buff = buff0;
+    _direct_capacity = numElems;
+    _direct_elems = 0;
+
+    {
+        std::unique_lock <std::mutex> lock(_buf_mutex);
+        _buf_waiting = true;
+        _direct_state.store(DIRECT_WAITING);
+        _buf_cond.wait_for(lock, std::chrono::microseconds(timeoutUs), [this]{
+            return _direct_state.load() == DIRECT_DONE or _buf_tail.load() != _buf_acquired; });
+        _buf_waiting = false;
+    }
+
+    // take the request back from rx_callback
+    int state = DIRECT_WAITING;
+    if (_direct_state.compare_exchange_strong(state, DIRECT_IDLE))
+    {
+        // untouched: timed out or the samples went to the queue
+        return (_buf_tail.load() != _buf_acquired) ? 0 : SOAPY_SDR_TIMEOUT;
+    }
+
+    while (state != DIRECT_DONE)
+    {
+        // rx_callback is converting right now, this lasts one callback at most
+        if (state == DIRECT_FILLING)
+        {
+            std::this_thread::yield();
+            state = _direct_state.load();
+            continue;
+        }
+        if (_direct_state.compare_exchange_strong(state, DIRECT_IDLE))
+        {
+            return (int)_direct_elems;
+        }
+    }
+    _direct_state.store(DIRECT_IDLE);
+    return (int)_direct_elems;
+}
+
 /*******************************************************************
  * Direct buffer access API
  ******************************************************************/
 
+// only the wideband stream offers direct access
 size_t SoapySDRPlay::getNumDirectAccessBuffers(SoapySDR::Stream *stream)
 {
-    std::lock_guard <std::mutex> lock(_buf_mutex);
-
-    return _buffs.size();
+    if (streamChannel(stream) > 0) return 0;
+    return _arena.numSlots();
 }
 
 int SoapySDRPlay::getDirectAccessBufferAddrs(SoapySDR::Stream *stream, const size_t handle, void **buffs)
 {
-    std::lock_guard <std::mutex> lock(_buf_mutex);
-
-    buffs[0] = (void *)_buffs[handle].data();
+    if (streamChannel(stream) > 0) return SOAPY_SDR_NOT_SUPPORTED;
+    buffs[0] = (void *)_arena.slot(handle);
     return 0;
 }
 
@@ -357,53 +1874,109 @@ int SoapySDRPlay::acquireReadBuffer(SoapySDR::Stream *stream,
                                     long long &timeNs,
                                     const long timeoutUs)
 {
-    std::unique_lock <std::mutex> lock(_buf_mutex);
+    if (streamChannel(stream) > 0) return SOAPY_SDR_NOT_SUPPORTED;
+
+    // the buffer held back for an overflow report is stale after a reset
+    if (resetBuffer && _overflowPending)
+    {
+        _overflowPending = false;
+        this->releaseReadBuffer(stream, _overflowHandle);
+    }
 
     // reset is issued by various settings
-    // overflow set in the rx callback thread
-    if (resetBuffer || _overflowEvent)
-    {
-        // drain all buffers from the fifo
-        _buf_tail = 0;
-        _buf_head = 0;
-        _buf_count = 0;
-        for (auto &buff : _buffs) buff.clear();
+    // overflow set in the rx callback thread with the drop_queue policy
+    // buffers still held by the caller are drained once released
+    if ((resetBuffer || _overflowEvent) && (_buf_acquired == _buf_head))
+    {
+        drainBuffers();
         _overflowEvent = false;
-        if (resetBuffer)
+    }
+
+    // a buffer held back by the last overflow report goes first
+    if (_overflowPending)
+    {
+        _overflowPending = false;
+        handle = _overflowHandle;
+    }
+    else
+    {
+        // wait for a buffer to become available
+        if (_buf_tail.load(std::memory_order_acquire) == _buf_acquired)
         {
-           resetBuffer = false;
+            std::unique_lock <std::mutex> lock(_buf_mutex);
+            _buf_waiting = true;
+            _buf_cond.wait_for(lock, std::chrono::microseconds(timeoutUs),
+                               [this]{ return _buf_tail.load() != _buf_acquired; });
+            _buf_waiting = false;
+            if (_buf_tail.load() == _buf_acquired)
+            {
+               return SOAPY_SDR_TIMEOUT;
+            }
         }
-        else
+
+        // rx_callback may recycle the oldest buffer with the drop_oldest policy
+        size_t acquired = _buf_acquired.load();
+        while (not _buf_acquired.compare_exchange_weak(acquired, acquired + 1));
+        handle = acquired % numBuffers;
+
+        // a new scan dwell does not follow the samples before it
+        if (_buffMeta[handle].segment)
         {
-           SoapySDR_log(SOAPY_SDR_SSI, "O");
-           return SOAPY_SDR_OVERFLOW;
+            _expectValid = false;
         }
-    }
 
-    // wait for a buffer to become available
-    if (_buf_count == 0)
-    {
-        _buf_cond.wait_for(lock, std::chrono::microseconds(timeoutUs));
-        if (_buf_count == 0) 
+        // lost samples show up as a gap in the hardware sample count,
+        // report it before the buffer that follows the gap
+        const long long gap = _buffMeta[handle].count - _expectCount;
+        if (_expectValid and gap > 0)
         {
-           return SOAPY_SDR_TIMEOUT;
+            _overflowPending = true;
+            _overflowHandle = handle;
+            _overflowSamples = gap;
+            _statOverflows.fetch_add(1, std::memory_order_relaxed);
+            _statDropped.fetch_add(gap, std::memory_order_relaxed);
+            _expectValid = false;
+            flags = SOAPY_SDR_HAS_TIME;
+            timeNs = _buffMeta[handle].timeNs;
+            SoapySDR_log(SOAPY_SDR_SSI, "O");
+            return SOAPY_SDR_OVERFLOW;
         }
     }
 
     // extract handle and buffer
-    handle = _buf_head;
-    buffs[0] = (void *)_buffs[handle].data();
-    flags = 0;
+    buffs[0] = (void *)_arena.slot(handle);
+    flags = SOAPY_SDR_HAS_TIME;
+    if (_buffMeta[handle].endBurst) flags |= SOAPY_SDR_END_BURST;
+    timeNs = _buffMeta[handle].timeNs;
+    _readFrequency = _buffMeta[handle].frequency;
+    _readRate = _buffMeta[handle].rate;
+
+    // a hardware change at the first sample of this buffer
+    const BufferMeta &meta = _buffMeta[handle];
+    if (meta.events != 0)
+    {
+        flags |= meta.events;
+        setReadEvent(meta.events, meta.timeNs, meta.count, meta.gRdB, meta.frequency, meta.rate);
+    }
 
-    _buf_head = (_buf_head + 1) % numBuffers;
+    const int numElems = (int)(_buffMeta[handle].bytes / bytesPerSample);
+    _expectCount = _buffMeta[handle].count + numElems;
+    _expectValid = true;
+    if (_burstMode)
+    {
+        setReadBurst(meta.segment, meta.timeNs, meta.count, numElems, meta.endBurst);
+    }
+    _statSamplesOut.fetch_add(numElems, std::memory_order_relaxed);
 
     // return number available
-    return (int)(_buffs[handle].size() / (elementsPerSample * shortsPerWord));
+    return numElems;
 }
 
 void SoapySDRPlay::releaseReadBuffer(SoapySDR::Stream *stream, const size_t handle)
 {
-    std::lock_guard <std::mutex> lock(_buf_mutex);
-    _buffs[handle].clear();
-    _buf_count--;
+    if (streamChannel(stream) > 0) return;
+
+    // buffers are released in order, hand the slot back to rx_callback
+    _buffMeta[handle].bytes = 0;
+    _buf_head.fetch_add(1, std::memory_order_release);
 }
@@ -0,0 +1,572 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*******************************************************************
+ * Streaming hot path benchmark.
+ *
+ * Feeds SoapySDRPlay::rx_callback() with synthetic samples in the
+ * chunk sizes of the SDRplay API while a reader thread consumes them,
+ * the stream is never activated so no samples come from the device.
+ * Results go to stdout as JSON:
+ *
+ *  convert   ns per sample in rx_callback for each kernel and format
+ *  latency   rx_callback to reader handoff latency percentiles
+ *  max_rate  highest rate without overflows for each decimation
+ *  heap      heap allocations on the rx and reader threads while streaming,
+ *            also at a resampled rate with rate changes, retunes and lost
+ *            samples from a control thread, must be 0
+ *  replay    end to end throughput of a SigMF recording replayed through
+ *            the activated stream, replay_speed 0 as fast as it goes
+ *
+ * Usage: SoapySDRPlayBench [serial=MOCK0000] [seconds=1.0] [rate=2e6] [latency_ms=1]
+ *                          [replay=path.sigmf-meta] [replay_speed=0]
+ ******************************************************************/
+
+#include "SoapySDRPlay.hpp"
+#include <SoapySDR/Logger.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+//samples per callback of the SDRplay API without decimation
+#define API_CHUNK_SAMPLES (1008)
+
+typedef std::chrono::steady_clock BenchClock;
+
+//heap allocations while armed, through the replaced operator new,
+//threads that change settings mark themselves as not counted
+static std::atomic_bool countAllocations(false);
+static std::atomic<unsigned long long> allocations(0);
+static thread_local bool uncountedThread = false;
+
+void *operator new(std::size_t size)
+{
+    if (countAllocations.load(std::memory_order_relaxed) and not uncountedThread)
+    {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    void *p = std::malloc(size ? size : 1);
+    if (p == nullptr) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+static long long nowNs(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        BenchClock::now().time_since_epoch()).count();
+}
+
+//hardware sample counter, continuous over all runs
+static unsigned int firstSampleNum = 0;
+
+//the output rate that makes the module pick the given decimation
+static double rateForDecimation(const unsigned int decM)
+{
+    return 2e6 / decM;
+}
+
+//channel 0 stream fed by rx_callback without activating the device
+static SoapySDR::Stream *setupBenchStream(SoapySDRPlay &dev, const std::string &format, const SoapySDR::Kwargs &args = SoapySDR::Kwargs())
+{
+    SoapySDR::Stream *stream = dev.setupStream(SOAPY_SDR_RX, format, std::vector<size_t>(), args);
+    dev._wideActive = true;
+    return stream;
+}
+
+/*******************************************************************
+ * Conversion cost
+ ******************************************************************/
+
+static double benchConvert(SoapySDRPlay &dev, const std::string &format, const double seconds)
+{
+    // drop_oldest keeps rx_callback converting every sample
+    SoapySDR::Kwargs args;
+    args["overflow"] = "drop_oldest";
+    SoapySDR::Stream *stream = setupBenchStream(dev, format, args);
+
+    std::atomic_bool done(false);
+    std::thread reader([&]{
+        std::vector<float> buff(2 * dev.getStreamMTU(stream));
+        void *buffs[1] = {buff.data()};
+        while (not done)
+        {
+            int flags = 0;
+            long long timeNs = 0;
+            dev.readStream(stream, buffs, dev.getStreamMTU(stream), flags, timeNs, 100000);
+        }
+    });
+
+    std::vector<short> xi(API_CHUNK_SAMPLES), xq(API_CHUNK_SAMPLES);
+    for (size_t i = 0; i < xi.size(); i++)
+    {
+        xi[i] = (short)(i * 37);
+        xq[i] = (short)(i * 91);
+    }
+
+    unsigned long long samples = 0;
+    const long long start = nowNs();
+    const long long stop = start + (long long)(seconds * 1e9);
+    long long now = start;
+    while (now < stop)
+    {
+        for (int i = 0; i < 64; i++)
+        {
+            dev.rx_callback(xi.data(), xq.data(), firstSampleNum, API_CHUNK_SAMPLES, 0);
+            firstSampleNum += API_CHUNK_SAMPLES;
+        }
+        samples += 64 * API_CHUNK_SAMPLES;
+        now = nowNs();
+    }
+
+    done = true;
+    reader.join();
+    dev.closeStream(stream);
+    return double(now - start) / samples;
+}
+
+/*******************************************************************
+ * Handoff latency
+ ******************************************************************/
+
+struct Percentiles
+{
+    size_t count;
+    double p50, p90, p99, p999, max;
+};
+
+static Percentiles benchLatency(SoapySDRPlay &dev, const bool acquire, const double rate, const double seconds, const std::string &latencyMs)
+{
+    SoapySDR::Kwargs args;
+    args["latency_ms"] = latencyMs;
+    SoapySDR::Stream *stream = setupBenchStream(dev, "CS16", args);
+    const size_t numCallbacks = (size_t)(seconds * rate / API_CHUNK_SAMPLES) + 1;
+
+    // each chunk carries its index in every sample,
+    // the reader looks up when the chunk ending its buffer entered rx_callback
+    std::vector<long long> entered(numCallbacks);
+    std::vector<double> latencies;
+    latencies.reserve(numCallbacks);
+
+    // a partial buffer flushed by the read timeout at the end does not count
+    std::atomic_bool done(false);
+    std::atomic<long long> producerDoneNs(0);
+    std::thread reader([&]{
+        std::vector<short> buff(2 * dev.getStreamMTU(stream));
+        while (not done)
+        {
+            int flags = 0;
+            long long timeNs = 0;
+            const short *last = nullptr;
+            size_t handle = 0;
+            if (acquire)
+            {
+                const void *buffs[1];
+                const int ret = dev.acquireReadBuffer(stream, handle, buffs, flags, timeNs, 100000);
+                if (ret <= 0) continue;
+                last = (const short *)buffs[0] + 2 * (ret - 1);
+            }
+            else
+            {
+                void *buffs[1] = {buff.data()};
+                const int ret = dev.readStream(stream, buffs, buff.size() / 2, flags, timeNs, 100000);
+                if (ret <= 0) continue;
+                last = buff.data() + 2 * (ret - 1);
+            }
+            const long long arrived = nowNs();
+            const size_t index = (unsigned short)last[0] | ((size_t)(unsigned short)last[1] << 16);
+            if (index < entered.size() and (producerDoneNs == 0 or arrived < producerDoneNs))
+            {
+                latencies.push_back((arrived - entered[index]) / 1e3);
+            }
+            if (acquire) dev.releaseReadBuffer(stream, handle);
+        }
+    });
+
+    std::vector<short> xi(API_CHUNK_SAMPLES), xq(API_CHUNK_SAMPLES);
+    const auto start = BenchClock::now();
+    for (size_t n = 0; n < numCallbacks; n++)
+    {
+        std::this_thread::sleep_until(start + std::chrono::nanoseconds((long long)(n * API_CHUNK_SAMPLES * 1e9 / rate)));
+        std::fill(xi.begin(), xi.end(), (short)(n & 0xffff));
+        std::fill(xq.begin(), xq.end(), (short)(n >> 16));
+        entered[n] = nowNs();
+        dev.rx_callback(xi.data(), xq.data(), firstSampleNum, API_CHUNK_SAMPLES, 0);
+        firstSampleNum += API_CHUNK_SAMPLES;
+    }
+
+    // let the reader pick up the last buffer
+    producerDoneNs = nowNs() + (long long)(1e9 * API_CHUNK_SAMPLES / rate);
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    done = true;
+    reader.join();
+    dev.closeStream(stream);
+
+    Percentiles p = {latencies.size(), 0, 0, 0, 0, 0};
+    if (latencies.empty()) return p;
+    std::sort(latencies.begin(), latencies.end());
+    auto at = [&](const double q){ return latencies[std::min(latencies.size() - 1, (size_t)(q * latencies.size()))]; };
+    p.p50 = at(0.5);
+    p.p90 = at(0.9);
+    p.p99 = at(0.99);
+    p.p999 = at(0.999);
+    p.max = latencies.back();
+    return p;
+}
+
+/*******************************************************************
+ * Maximum sustainable rate
+ ******************************************************************/
+
+static bool sustains(SoapySDRPlay &dev, const unsigned int chunk, const double rate, const double seconds)
+{
+    SoapySDR::Stream *stream = setupBenchStream(dev, "CF32");
+
+    std::atomic_bool done(false);
+    std::thread reader([&]{
+        std::vector<float> buff(2 * dev.getStreamMTU(stream));
+        void *buffs[1] = {buff.data()};
+        while (not done)
+        {
+            int flags = 0;
+            long long timeNs = 0;
+            dev.readStream(stream, buffs, dev.getStreamMTU(stream), flags, timeNs, 100000);
+        }
+    });
+
+    std::vector<short> xi(chunk, 1000), xq(chunk, -1000);
+    const size_t numCallbacks = (size_t)(seconds * rate / chunk) + 1;
+    const long long start = nowNs();
+    for (size_t n = 0; n < numCallbacks; n++)
+    {
+        // spin, sleeping is too coarse at high rates
+        const long long deadline = start + (long long)(n * chunk * 1e9 / rate);
+        while (nowNs() < deadline);
+        dev.rx_callback(xi.data(), xq.data(), firstSampleNum, chunk, 0);
+        firstSampleNum += chunk;
+    }
+    const double late = (nowNs() - start) / 1e9 - seconds;
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    done = true;
+    reader.join();
+    const bool ok = (std::stoll(dev.readSensor("overflows")) == 0) and (late < 0.05 * seconds);
+    dev.closeStream(stream);
+    return ok;
+}
+
+static double benchMaxRate(SoapySDRPlay &dev, const unsigned int decM, const double seconds)
+{
+    dev.setSampleRate(SOAPY_SDR_RX, 0, rateForDecimation(decM));
+    const unsigned int chunk = API_CHUNK_SAMPLES / decM;
+
+    // double until it fails, then bisect
+    double good = 0.0, bad = 1e6;
+    while (bad < 1e10 and sustains(dev, chunk, bad, seconds))
+    {
+        good = bad;
+        bad *= 2;
+    }
+    for (int i = 0; i < 6; i++)
+    {
+        const double rate = (good + bad) / 2;
+        if (sustains(dev, chunk, rate, seconds)) good = rate;
+        else bad = rate;
+    }
+    return good;
+}
+
+/*******************************************************************
+ * Heap allocations while streaming
+ ******************************************************************/
+
+static unsigned long long benchHeap(SoapySDRPlay &dev, const std::string &format, const double rate, const double seconds,
+                                    const SoapySDR::Kwargs &args = SoapySDR::Kwargs(), const bool retune = false)
+{
+    SoapySDR::Stream *stream = setupBenchStream(dev, format, args);
+    const double outputRate = dev.getSampleRate(SOAPY_SDR_RX, 0);
+
+    std::atomic_bool done(false);
+    std::thread reader([&]{
+        std::vector<float> buff(2 * dev.getStreamMTU(stream));
+        void *buffs[1] = {buff.data()};
+        while (not done)
+        {
+            int flags = 0;
+            long long timeNs = 0;
+            dev.readStream(stream, buffs, dev.getStreamMTU(stream), flags, timeNs, 100000);
+        }
+    });
+
+    // the control thread alternates the output rate and the frequency on request,
+    // the module prepares everything for the rx path there
+    std::atomic_uint tuneRequests(0);
+    std::thread control([&]{
+        uncountedThread = true;
+        unsigned int tunes = 0;
+        while (not done)
+        {
+            if (tuneRequests == tunes)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            tunes++;
+            dev.setSampleRate(SOAPY_SDR_RX, 0, (tunes % 2) ? 2 * outputRate : outputRate);
+            dev.setFrequency(SOAPY_SDR_RX, 0, "RF", 100e6 + (tunes % 8) * 1e6, SoapySDR::Kwargs());
+        }
+    });
+
+    // the first callbacks may still size the resampler and converter state
+    std::vector<short> xi(API_CHUNK_SAMPLES, 1000), xq(API_CHUNK_SAMPLES, -1000);
+    std::vector<short> quiet(API_CHUNK_SAMPLES, 0);
+
+    // with burst extraction the signal comes and goes every 64 callbacks
+    const bool keyed = (args.count("burst_threshold") != 0);
+    const size_t numWarmup = (size_t)(0.1 * rate / API_CHUNK_SAMPLES) + 1;
+    const size_t numCallbacks = numWarmup + (size_t)(seconds * rate / API_CHUNK_SAMPLES) + 1;
+    const auto start = BenchClock::now();
+    for (size_t n = 0; n < numCallbacks; n++)
+    {
+        if (n == numWarmup)
+        {
+            allocations = 0;
+            countAllocations = true;
+        }
+        std::this_thread::sleep_until(start + std::chrono::nanoseconds((long long)(n * API_CHUNK_SAMPLES * 1e9 / rate)));
+        const bool on = not keyed or (n / 64) % 2 == 0;
+        dev.rx_callback(on ? xi.data() : quiet.data(), on ? xq.data() : quiet.data(), firstSampleNum, API_CHUNK_SAMPLES, 0);
+        firstSampleNum += API_CHUNK_SAMPLES;
+
+        // a scan hop needs the activated hardware, lost samples restart
+        // the resampler the same way
+        if (retune and n >= numWarmup)
+        {
+            if (n % 32 == 0) tuneRequests++;
+            if (n % 48 == 0) firstSampleNum += API_CHUNK_SAMPLES / 2;
+        }
+    }
+    countAllocations = false;
+
+    done = true;
+    reader.join();
+    control.join();
+    dev.closeStream(stream);
+    dev.setSampleRate(SOAPY_SDR_RX, 0, outputRate);
+    return allocations;
+}
+
+/*******************************************************************
+ * Recording replayed through the device
+ ******************************************************************/
+
+struct ReplayResult
+{
+    unsigned long long samples;
+    double seconds;
+    unsigned long long overflows;
+};
+
+static ReplayResult benchReplay(SoapySDRPlay &dev, const std::string &format)
+{
+    ReplayResult result;
+    result.samples = 0;
+    result.overflows = 0;
+
+    SoapySDR::Stream *stream = dev.setupStream(SOAPY_SDR_RX, format, std::vector<size_t>(), SoapySDR::Kwargs());
+    std::vector<float> buff(2 * dev.getStreamMTU(stream));
+    void *buffs[1] = {buff.data()};
+
+    // from activateStream() to the last sample of the recording
+    const auto start = BenchClock::now();
+    auto end = start;
+    dev.activateStream(stream);
+    while (true)
+    {
+        int flags = 0;
+        long long timeNs = 0;
+        const int ret = dev.readStream(stream, buffs, dev.getStreamMTU(stream), flags, timeNs, 100000);
+        if (ret == SOAPY_SDR_OVERFLOW) result.overflows++;
+        if (ret > 0)
+        {
+            result.samples += ret;
+            end = BenchClock::now();
+        }
+        if (ret == SOAPY_SDR_TIMEOUT and dev.readSensor("replay_done") == "true") break;
+    }
+    dev.deactivateStream(stream);
+    dev.closeStream(stream);
+
+    result.seconds = std::chrono::duration<double>(end - start).count();
+    return result;
+}
+
+/*******************************************************************
+ * Main
+ ******************************************************************/
+
+int main(int argc, char **argv)
+{
+    SoapySDR::Kwargs args;
+    args["serial"] = "MOCK0000";
+    args["seconds"] = "1.0";
+    args["rate"] = "2e6";
+    args["latency_ms"] = "1";
+    args["replay"] = "";
+    args["replay_speed"] = "0";
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg(argv[i]);
+        const size_t eq = arg.find('=');
+        if (eq == std::string::npos or args.count(arg.substr(0, eq)) == 0)
+        {
+            std::fprintf(stderr, "Usage: %s [serial=MOCK0000] [seconds=1.0] [rate=2e6] [latency_ms=1] "
+                         "[replay=path.sigmf-meta] [replay_speed=0]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+        args[arg.substr(0, eq)] = arg.substr(eq + 1);
+    }
+    const double seconds = std::stod(args.at("seconds"));
+    const double rate = std::stod(args.at("rate"));
+
+    // keep stdout clean for the results
+    SoapySDR::setLogLevel(SOAPY_SDR_WARNING);
+
+    SoapySDR::Kwargs devArgs;
+    devArgs["serial"] = args.at("serial");
+    SoapySDRPlay dev(devArgs);
+
+    std::printf("{\n  \"serial\": \"%s\",\n  \"seconds\": %g,\n", args.at("serial").c_str(), seconds);
+
+    std::printf("  \"convert\": [");
+    const std::vector<std::string> kernels = SoapySDRPlay_listConverters();
+    const char *formats[] = {"CS16", "CF32", "CS8", "CS12"};
+    const char *sep = "\n";
+    for (const auto &kernel : kernels)
+    {
+        dev.writeSetting("convert_kernel", kernel);
+        for (const char *format : formats)
+        {
+            const double ns = benchConvert(dev, format, seconds);
+            std::printf("%s    {\"kernel\": \"%s\", \"format\": \"%s\", \"callback_samples\": %d, \"ns_per_sample\": %.4f}",
+                        sep, kernel.c_str(), format, API_CHUNK_SAMPLES, ns);
+            std::fflush(stdout);
+            sep = ",\n";
+        }
+    }
+    dev.writeSetting("convert_kernel", "auto");
+    std::printf("\n  ],\n");
+
+    std::printf("  \"latency\": [");
+    sep = "\n";
+    for (const bool acquire : {false, true})
+    {
+        const Percentiles p = benchLatency(dev, acquire, rate, seconds, args.at("latency_ms"));
+        std::printf("%s    {\"reader\": \"%s\", \"rate\": %g, \"latency_ms\": %s, \"count\": %zu, \"p50_us\": %.2f, "
+                    "\"p90_us\": %.2f, \"p99_us\": %.2f, \"p999_us\": %.2f, \"max_us\": %.2f}",
+                    sep, acquire ? "acquireReadBuffer" : "readStream", rate, args.at("latency_ms").c_str(),
+                    p.count, p.p50, p.p90, p.p99, p.p999, p.max);
+        std::fflush(stdout);
+        sep = ",\n";
+    }
+    std::printf("\n  ],\n");
+
+    std::printf("  \"max_rate\": [");
+    sep = "\n";
+    for (const unsigned int decM : {1u, 2u, 4u, 8u})
+    {
+        const double maxRate = benchMaxRate(dev, decM, seconds / 4);
+        std::printf("%s    {\"decM\": %u, \"callback_samples\": %u, \"format\": \"CF32\", \"max_rate\": %.0f}",
+                    sep, decM, API_CHUNK_SAMPLES / decM, maxRate);
+        std::fflush(stdout);
+        sep = ",\n";
+    }
+    std::printf("\n  ],\n");
+
+    dev.setSampleRate(SOAPY_SDR_RX, 0, rateForDecimation(1));
+    std::printf("  \"heap\": [");
+    sep = "\n";
+    bool heapFree = true;
+    for (const char *format : formats)
+    {
+        const unsigned long long count = benchHeap(dev, format, rate, seconds);
+        std::printf("%s    {\"format\": \"%s\", \"rate\": %g, \"allocations\": %llu}", sep, format, rate, count);
+        std::fflush(stdout);
+        sep = ",\n";
+        heapFree = heapFree and (count == 0);
+    }
+    {
+        SoapySDR::Kwargs burstArgs;
+        burstArgs["burst_threshold"] = "-40";
+        const unsigned long long count = benchHeap(dev, "CS16", rate, seconds, burstArgs);
+        std::printf("%s    {\"format\": \"CS16\", \"burst_threshold\": -40, \"rate\": %g, \"allocations\": %llu}", sep, rate, count);
+        heapFree = heapFree and (count == 0);
+    }
+    dev.setSampleRate(SOAPY_SDR_RX, 0, 48000);
+    for (const bool retune : {false, true})
+    {
+        const unsigned long long count = benchHeap(dev, "CS16", rate, seconds, SoapySDR::Kwargs(), retune);
+        std::printf(",\n    {\"format\": \"CS16\", \"output_rate\": 48000, \"retune\": %s, \"rate\": %g, \"allocations\": %llu}",
+                    retune ? "true" : "false", rate, count);
+        std::fflush(stdout);
+        heapFree = heapFree and (count == 0);
+    }
+    std::printf("\n  ]");
+
+    if (not args.at("replay").empty())
+    {
+        SoapySDR::Kwargs replayArgs;
+        replayArgs["replay"] = args.at("replay");
+        replayArgs["replay_speed"] = args.at("replay_speed");
+        SoapySDRPlay replayDev(replayArgs);
+
+        std::printf(",\n  \"replay\": [");
+        sep = "\n";
+        for (const char *format : formats)
+        {
+            const ReplayResult result = benchReplay(replayDev, format);
+            std::printf("%s    {\"format\": \"%s\", \"replay_speed\": %s, \"samples\": %llu, \"seconds\": %.4f, "
+                        "\"samples_per_second\": %.0f, \"overflows\": %llu}",
+                        sep, format, args.at("replay_speed").c_str(), result.samples, result.seconds,
+                        result.samples / result.seconds, result.overflows);
+            std::fflush(stdout);
+            sep = ",\n";
+        }
+        std::printf("\n  ]");
+    }
+    std::printf("\n}\n");
+
+    return heapFree ? EXIT_SUCCESS : EXIT_FAILURE;
+}
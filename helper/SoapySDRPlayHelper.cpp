@@ -0,0 +1,386 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*******************************************************************
+ * Helper process hosting one device for the helper=true device
+ * argument, see Helper.hpp.
+ *
+ * The module starts it with the control socket on HELPER_CONTROL_FD,
+ * the first call opens the device and the process exits when the
+ * socket closes. Each stream gets a thread that reads straight into
+ * the slots of the shared memory ring. Built with USE_MOCK_SDRPLAY it
+ * streams the synthetic signal of the mock API, which makes it a stub
+ * for testing the transport without hardware.
+ ******************************************************************/
+
+#include "SoapySDRPlay.hpp"
+#include "Helper.hpp"
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+struct HelperStream
+{
+    SoapySDR::Stream *stream;
+    size_t channel;
+    SoapySDRPlayHelperRing *ring;
+    size_t mapBytes;
+    size_t mtu;
+    int notifyFd;
+    std::atomic_bool running;
+    std::thread thread;
+};
+
+static std::unique_ptr<SoapySDRPlay> device;
+static std::map<long long, std::unique_ptr<HelperStream>> streams;
+static long long nextStreamId = 0;
+
+static size_t formatBytes(const std::string &format)
+{
+    if (format == "CS16") return 2 * sizeof(short);
+    if (format == "CF32") return 2 * sizeof(float);
+    if (format == "CS8") return 2;
+    if (format == "CS12") return 3;
+    if (format == "F32") return sizeof(float);
+    throw std::runtime_error("setupStream invalid format '" + format + "'");
+}
+
+//unlinked right away, the descriptor travels to the module
+static int createSharedMemory(const size_t size)
+{
+    static unsigned int counter = 0;
+    while (true)
+    {
+        const std::string name = "/SoapySDRPlay." + std::to_string(getpid()) + "." + std::to_string(counter++);
+        const int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0 and errno == EEXIST) continue;
+        if (fd < 0) throw std::runtime_error("shm_open failed: " + std::string(std::strerror(errno)));
+        shm_unlink(name.c_str());
+        if (ftruncate(fd, size) != 0)
+        {
+            close(fd);
+            throw std::runtime_error("ftruncate failed: " + std::string(std::strerror(errno)));
+        }
+        return fd;
+    }
+}
+
+/*******************************************************************
+ * Stream threads
+ ******************************************************************/
+
+static void publish(HelperStream &s, const uint64_t head)
+{
+    s.ring->head.store(head + 1);
+    if (s.ring->waiting.load() != 0 and s.ring->waiting.exchange(0) != 0)
+    {
+        const char wake = 0;
+        if (write(s.notifyFd, &wake, 1) < 0) return;
+    }
+}
+
+static void streamLoop(HelperStream &s)
+{
+    SoapySDRPlayHelperRing &ring = *s.ring;
+    std::vector<char> scratch(ring.slotBytes);
+    bool lost = false;
+    long long lostTimeNs = 0;
+
+    while (s.running.load(std::memory_order_relaxed))
+    {
+        const uint64_t head = ring.head.load(std::memory_order_relaxed);
+        const bool full = head - ring.tail.load(std::memory_order_acquire) >= ring.numSlots;
+
+        //the module fell behind, the overflow takes the next free slot
+        if (lost and not full)
+        {
+            SoapySDRPlayHelperSlot &slot = ring.slots[head % ring.numSlots];
+            slot.ret = SOAPY_SDR_OVERFLOW;
+            slot.flags = SOAPY_SDR_HAS_TIME;
+            slot.timeNs = lostTimeNs;
+            slot.rate = 0.0;
+            publish(s, head);
+            lost = false;
+            continue;
+        }
+
+        //keep the device queue moving while the ring is full
+        void *buffs[] = {full ? scratch.data() : ring.slotData(head)};
+        int flags = 0;
+        long long timeNs = 0;
+        const int ret = device->readStream(s.stream, buffs, s.mtu, flags, timeNs, 100000);
+        if (ret == SOAPY_SDR_TIMEOUT) continue;
+        if (full)
+        {
+            if (ret > 0 and not lost) lostTimeNs = timeNs;
+            lost = lost or ret > 0;
+            continue;
+        }
+
+        SoapySDRPlayHelperSlot &slot = ring.slots[head % ring.numSlots];
+        slot.ret = ret;
+        slot.flags = flags;
+        slot.timeNs = timeNs;
+        slot.rate = device->getSampleRate(SOAPY_SDR_RX, s.channel);
+        publish(s, head);
+    }
+}
+
+static void stopStream(HelperStream &s)
+{
+    s.running = false;
+    if (s.thread.joinable()) s.thread.join();
+}
+
+/*******************************************************************
+ * Calls from the module
+ ******************************************************************/
+
+static void setupStream(SoapySDRPlayHelperMessage &request, SoapySDRPlayHelperMessage &reply, std::vector<int> &fds, const int direction)
+{
+    const std::string format = request.getString();
+    std::vector<size_t> channels(request.getInt());
+    for (auto &channel : channels) channel = request.getInt();
+    const SoapySDR::Kwargs args = request.getKwargs();
+
+    std::unique_ptr<HelperStream> s(new HelperStream());
+    const size_t bytesPerElem = formatBytes(format);
+    s->stream = device->setupStream(direction, format, channels, args);
+    s->channel = channels.empty() ? 0 : channels.front();
+    s->mtu = device->getStreamMTU(s->stream);
+    s->running = false;
+
+    const size_t slotBytes = s->mtu * bytesPerElem;
+    s->mapBytes = SoapySDRPlayHelperRing::mapBytes(slotBytes);
+    int pipeFds[2] = {-1, -1};
+    int shmFd = -1;
+    void *mem = MAP_FAILED;
+    try
+    {
+        shmFd = createSharedMemory(s->mapBytes);
+        mem = mmap(nullptr, s->mapBytes, PROT_READ | PROT_WRITE, MAP_SHARED, shmFd, 0);
+        if (mem == MAP_FAILED) throw std::runtime_error("mmap failed: " + std::string(std::strerror(errno)));
+        s->ring = new (mem) SoapySDRPlayHelperRing();
+        if (not s->ring->head.is_lock_free()) throw std::runtime_error("no lock free 64 bit atomics");
+        if (pipe(pipeFds) != 0) throw std::runtime_error("pipe failed: " + std::string(std::strerror(errno)));
+    }
+    catch (const std::exception &)
+    {
+        if (mem != MAP_FAILED) munmap(mem, s->mapBytes);
+        if (shmFd >= 0) close(shmFd);
+        device->closeStream(s->stream);
+        throw;
+    }
+    s->ring->magic = HELPER_RING_MAGIC;
+    s->ring->version = HELPER_RING_VERSION;
+    s->ring->numSlots = HELPER_NUM_SLOTS;
+    s->ring->slotBytes = slotBytes;
+    s->ring->head = 0;
+    s->ring->tail = 0;
+    s->ring->waiting = 0;
+
+    //neither end may block
+    fcntl(pipeFds[0], F_SETFL, O_NONBLOCK);
+    fcntl(pipeFds[1], F_SETFL, O_NONBLOCK);
+    s->notifyFd = pipeFds[1];
+    fds.push_back(shmFd);
+    fds.push_back(pipeFds[0]);
+
+    const long long id = nextStreamId++;
+    reply.putInt(id);
+    reply.putInt(s->mtu);
+    reply.putInt(bytesPerElem);
+    reply.putInt(s->mapBytes);
+    streams[id] = std::move(s);
+}
+
+static HelperStream &findStream(SoapySDRPlayHelperMessage &request)
+{
+    const long long id = request.getInt();
+    if (streams.count(id) == 0) throw std::runtime_error("invalid stream " + std::to_string(id));
+    return *streams.at(id);
+}
+
+static void closeStream(const long long id)
+{
+    HelperStream &s = *streams.at(id);
+    stopStream(s);
+    device->closeStream(s.stream);
+    munmap(s.ring, s.mapBytes);
+    close(s.notifyFd);
+    streams.erase(id);
+}
+
+static void handle(SoapySDRPlayHelperMessage &request, SoapySDRPlayHelperMessage &reply, std::vector<int> &fds)
+{
+    const std::string method = request.getString();
+    const int direction = request.getInt();
+    const size_t channel = request.getInt();
+
+    if (method == "open")
+    {
+        if (device) throw std::runtime_error("device already open");
+        device.reset(new SoapySDRPlay(request.getKwargs()));
+        return;
+    }
+    if (not device) throw std::runtime_error("no device open");
+
+    if (method == "getHardwareKey") reply.putString(device->getHardwareKey());
+    else if (method == "getHardwareInfo") reply.putKwargs(device->getHardwareInfo());
+    else if (method == "getNumChannels") reply.putInt(device->getNumChannels(direction));
+    else if (method == "getStreamFormats") reply.putStrings(device->getStreamFormats(direction, channel));
+    else if (method == "getNativeStreamFormat")
+    {
+        double fullScale = 0.0;
+        reply.putString(device->getNativeStreamFormat(direction, channel, fullScale));
+        reply.putDouble(fullScale);
+    }
+    else if (method == "getStreamArgsInfo") reply.putArgInfoList(device->getStreamArgsInfo(direction, channel));
+    else if (method == "setupStream") setupStream(request, reply, fds, direction);
+    else if (method == "closeStream")
+    {
+        const long long id = request.getInt();
+        if (streams.count(id) != 0) closeStream(id);
+    }
+    else if (method == "activateStream")
+    {
+        HelperStream &s = findStream(request);
+        const int flags = request.getInt();
+        const long long timeNs = request.getInt();
+        const size_t numElems = request.getInt();
+        stopStream(s);
+        s.ring->tail.store(s.ring->head.load());
+        const int ret = device->activateStream(s.stream, flags, timeNs, numElems);
+        if (ret == 0)
+        {
+            s.running = true;
+            s.thread = std::thread(streamLoop, std::ref(s));
+        }
+        reply.putInt(ret);
+    }
+    else if (method == "deactivateStream")
+    {
+        HelperStream &s = findStream(request);
+        const int flags = request.getInt();
+        const long long timeNs = request.getInt();
+        stopStream(s);
+        reply.putInt(device->deactivateStream(s.stream, flags, timeNs));
+    }
+    else if (method == "listAntennas") reply.putStrings(device->listAntennas(direction, channel));
+    else if (method == "setAntenna") device->setAntenna(direction, channel, request.getString());
+    else if (method == "getAntenna") reply.putString(device->getAntenna(direction, channel));
+    else if (method == "hasDCOffsetMode") reply.putInt(device->hasDCOffsetMode(direction, channel));
+    else if (method == "setDCOffsetMode") device->setDCOffsetMode(direction, channel, request.getInt() != 0);
+    else if (method == "getDCOffsetMode") reply.putInt(device->getDCOffsetMode(direction, channel));
+    else if (method == "hasDCOffset") reply.putInt(device->hasDCOffset(direction, channel));
+    else if (method == "listGains") reply.putStrings(device->listGains(direction, channel));
+    else if (method == "hasGainMode") reply.putInt(device->hasGainMode(direction, channel));
+    else if (method == "setGainMode") device->setGainMode(direction, channel, request.getInt() != 0);
+    else if (method == "getGainMode") reply.putInt(device->getGainMode(direction, channel));
+    else if (method == "setGain")
+    {
+        const std::string name = request.getString();
+        device->setGain(direction, channel, name, request.getDouble());
+    }
+    else if (method == "getGain") reply.putDouble(device->getGain(direction, channel, request.getString()));
+    else if (method == "getGainRange")
+    {
+        reply.putRangeList(SoapySDR::RangeList(1, device->getGainRange(direction, channel, request.getString())));
+    }
+    else if (method == "setFrequency")
+    {
+        const std::string name = request.getString();
+        const double frequency = request.getDouble();
+        device->setFrequency(direction, channel, name, frequency, request.getKwargs());
+    }
+    else if (method == "getFrequency") reply.putDouble(device->getFrequency(direction, channel, request.getString()));
+    else if (method == "listFrequencies") reply.putStrings(device->listFrequencies(direction, channel));
+    else if (method == "getFrequencyRange") reply.putRangeList(device->getFrequencyRange(direction, channel, request.getString()));
+    else if (method == "getFrequencyArgsInfo") reply.putArgInfoList(device->getFrequencyArgsInfo(direction, channel));
+    else if (method == "setSampleRate") device->setSampleRate(direction, channel, request.getDouble());
+    else if (method == "getSampleRate") reply.putDouble(device->getSampleRate(direction, channel));
+    else if (method == "listSampleRates") reply.putDoubles(device->listSampleRates(direction, channel));
+    else if (method == "getSampleRateRange") reply.putRangeList(device->getSampleRateRange(direction, channel));
+    else if (method == "setBandwidth") device->setBandwidth(direction, channel, request.getDouble());
+    else if (method == "getBandwidth") reply.putDouble(device->getBandwidth(direction, channel));
+    else if (method == "listBandwidths") reply.putDoubles(device->listBandwidths(direction, channel));
+    else if (method == "getBandwidthRange") reply.putRangeList(device->getBandwidthRange(direction, channel));
+    else if (method == "listSensors") reply.putStrings(device->listSensors());
+    else if (method == "getSensorInfo") reply.putArgInfo(device->getSensorInfo(request.getString()));
+    else if (method == "readSensor") reply.putString(device->readSensor(request.getString()));
+    else if (method == "getSettingInfo") reply.putArgInfoList(device->getSettingInfo());
+    else if (method == "writeSetting")
+    {
+        const std::string key = request.getString();
+        device->writeSetting(key, request.getString());
+    }
+    else if (method == "readSetting") reply.putString(device->readSetting(request.getString()));
+    else throw std::runtime_error("SoapySDRPlayHelper: unknown call " + method);
+}
+
+int main(int argc, char *argv[])
+{
+    //a closed module socket shows up as an error, not a signal
+    std::signal(SIGPIPE, SIG_IGN);
+    fcntl(HELPER_CONTROL_FD, F_SETFD, FD_CLOEXEC);
+
+    SoapySDRPlayHelperMessage request;
+    while (request.recv(HELPER_CONTROL_FD))
+    {
+        SoapySDRPlayHelperMessage reply;
+        std::vector<int> fds;
+        try
+        {
+            SoapySDRPlayHelperMessage result;
+            result.putString("ok");
+            handle(request, result, fds);
+            reply = result;
+        }
+        catch (const std::exception &ex)
+        {
+            for (const int fd : fds) close(fd);
+            fds.clear();
+            reply = SoapySDRPlayHelperMessage();
+            reply.putString("error");
+            reply.putString(ex.what());
+        }
+        const bool sent = reply.send(HELPER_CONTROL_FD, fds);
+        for (const int fd : fds) close(fd);
+        if (not sent) break;
+    }
+
+    //the module is gone, close the device like it would
+    while (not streams.empty()) closeStream(streams.begin()->first);
+    device.reset();
+    return 0;
+}
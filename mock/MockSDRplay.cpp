@@ -0,0 +1,360 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*******************************************************************
+ * Hardware free stand-in for the mir_sdr API.
+ *
+ * StreamInit() starts a thread that calls the stream callback with
+ * a synthetic tone at the output rate. Environment variables:
+ *
+ *  SOAPY_SDRPLAY_MOCK_DEVICES        number of devices (1)
+ *  SOAPY_SDRPLAY_MOCK_HWVER          hardware version (255, RSP1A)
+ *  SOAPY_SDRPLAY_MOCK_SPEED          pacing, 1 = real time, 0 = flat out (1)
+ *  SOAPY_SDRPLAY_MOCK_CHUNK          samples per callback before decimation (1008)
+ *  SOAPY_SDRPLAY_MOCK_TONE_HZ        tone offset from the center (100000)
+ *  SOAPY_SDRPLAY_MOCK_BURST_PERIOD_MS  key the tone on and off with this period (0 = always on)
+ *  SOAPY_SDRPLAY_MOCK_BURST_ON_MS      how long the keyed tone is on each period (10)
+ *  SOAPY_SDRPLAY_MOCK_GR_EVERY       callbacks between grChanged events (0 = never)
+ *  SOAPY_SDRPLAY_MOCK_RF_EVERY       callbacks between rfChanged events
+ *  SOAPY_SDRPLAY_MOCK_RESET_EVERY    callbacks between counter resets
+ *  SOAPY_SDRPLAY_MOCK_OVERLOAD_EVERY callbacks between ADC overload messages
+ *  SOAPY_SDRPLAY_MOCK_DROP_EVERY     callbacks between lost USB transfers
+ ******************************************************************/
+
+#include "mirsdrapi-rsp.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct MockConfig
+{
+    unsigned numDevices;
+    unsigned char hwVer;
+    double speed;
+    unsigned chunk;
+    double toneHz;
+    double burstPeriodMs;
+    double burstOnMs;
+    unsigned grEvery;
+    unsigned rfEvery;
+    unsigned resetEvery;
+    unsigned overloadEvery;
+    unsigned dropEvery;
+};
+
+unsigned envUnsigned(const char *name, const unsigned value)
+{
+    const char *env = std::getenv(name);
+    return (env != nullptr) ? (unsigned)std::strtoul(env, nullptr, 10) : value;
+}
+
+double envDouble(const char *name, const double value)
+{
+    const char *env = std::getenv(name);
+    return (env != nullptr) ? std::strtod(env, nullptr) : value;
+}
+
+const MockConfig &config(void)
+{
+    static const MockConfig cfg = {
+        std::max(1u, envUnsigned("SOAPY_SDRPLAY_MOCK_DEVICES", 1)),
+        (unsigned char)envUnsigned("SOAPY_SDRPLAY_MOCK_HWVER", 255),
+        envDouble("SOAPY_SDRPLAY_MOCK_SPEED", 1.0),
+        std::max(8u, envUnsigned("SOAPY_SDRPLAY_MOCK_CHUNK", 1008)),
+        envDouble("SOAPY_SDRPLAY_MOCK_TONE_HZ", 100000.0),
+        envDouble("SOAPY_SDRPLAY_MOCK_BURST_PERIOD_MS", 0.0),
+        envDouble("SOAPY_SDRPLAY_MOCK_BURST_ON_MS", 10.0),
+        envUnsigned("SOAPY_SDRPLAY_MOCK_GR_EVERY", 0),
+        envUnsigned("SOAPY_SDRPLAY_MOCK_RF_EVERY", 0),
+        envUnsigned("SOAPY_SDRPLAY_MOCK_RESET_EVERY", 0),
+        envUnsigned("SOAPY_SDRPLAY_MOCK_OVERLOAD_EVERY", 0),
+        envUnsigned("SOAPY_SDRPLAY_MOCK_DROP_EVERY", 0),
+    };
+    return cfg;
+}
+
+bool every(const unsigned n, const unsigned long long k)
+{
+    return (n != 0) and (k % n == 0);
+}
+
+//tuner state shared between the API calls and the stream thread
+std::mutex mockMutex;
+double mockFsHz = 2e6;
+mir_sdr_If_kHzT mockIfType = mir_sdr_IF_Zero;
+unsigned mockDecimation = 1;
+int mockGRdB = 40;
+int mockLnaState = 0;
+bool mockGrChanged = false;
+bool mockRfChanged = false;
+bool mockFsChanged = false;
+
+std::thread mockThread;
+std::atomic_bool mockRunning(false);
+mir_sdr_StreamCallback_t mockStreamCb = nullptr;
+mir_sdr_GainChangeCallback_t mockGainCb = nullptr;
+void *mockCbContext = nullptr;
+
+const double TWO_PI = 6.283185307179586;
+
+std::vector<std::string> mockSerials;
+char mockName[] = "MockRSP";
+
+double outputRate(void)
+{
+    // low IF 2048 kHz leaves the tuner at a quarter of fs
+    if (mockDecimation > 1) return mockFsHz / mockDecimation;
+    if (mockIfType == mir_sdr_IF_2_048) return mockFsHz / 4;
+    return mockFsHz;
+}
+
+void streamThread(void)
+{
+    const MockConfig &cfg = config();
+    std::vector<short> xi, xq;
+    unsigned int firstSampleNum = 0;
+    unsigned long long callbacks = 0;
+    double phase = 0.0;
+    double keyMs = 0.0;
+    unsigned int noise = 1;
+    auto deadline = std::chrono::steady_clock::now();
+
+    while (mockRunning)
+    {
+        double rate;
+        int grChanged, rfChanged, fsChanged;
+        unsigned int numSamples, gRdB;
+        {
+            std::lock_guard<std::mutex> lock(mockMutex);
+            rate = outputRate();
+            numSamples = std::max(1u, cfg.chunk / mockDecimation);
+            grChanged = mockGrChanged;
+            rfChanged = mockRfChanged;
+            fsChanged = mockFsChanged;
+            mockGrChanged = mockRfChanged = mockFsChanged = false;
+            gRdB = mockGRdB;
+        }
+        callbacks++;
+
+        if (every(cfg.grEvery, callbacks)) grChanged = 1;
+        if (every(cfg.rfEvery, callbacks)) rfChanged = 1;
+        unsigned int reset = every(cfg.resetEvery, callbacks) ? 1 : 0;
+        if (reset) firstSampleNum = 0;
+
+        // a lost transfer still advances the hardware counter
+        if (every(cfg.dropEvery, callbacks)) firstSampleNum += numSamples;
+
+        // tone plus a little noise, about -6 dBFS, keyed when asked to
+        xi.resize(numSamples);
+        xq.resize(numSamples);
+        const double step = TWO_PI * cfg.toneHz / rate;
+        const double keyStep = 1000.0 / rate;
+        for (unsigned int i = 0; i < numSamples; i++)
+        {
+            noise = noise * 1664525u + 1013904223u;
+            const int dither = (int)(noise >> 24) - 128;
+            const double amplitude = (cfg.burstPeriodMs <= 0.0 or keyMs < cfg.burstOnMs) ? 16384.0 : 0.0;
+            xi[i] = (short)(amplitude * std::cos(phase) + dither);
+            xq[i] = (short)(amplitude * std::sin(phase) - dither);
+            phase += step;
+            keyMs += keyStep;
+            if (cfg.burstPeriodMs > 0.0 and keyMs >= cfg.burstPeriodMs) keyMs -= cfg.burstPeriodMs;
+        }
+        phase = std::fmod(phase, TWO_PI);
+
+        mockStreamCb(xi.data(), xq.data(), firstSampleNum, grChanged, rfChanged, fsChanged,
+                     numSamples, reset, 0, mockCbContext);
+        firstSampleNum += numSamples;
+
+        if (grChanged and mockGainCb != nullptr) mockGainCb(gRdB, 0, mockCbContext);
+        if (every(cfg.overloadEvery, callbacks) and mockGainCb != nullptr)
+        {
+            mockGainCb(mir_sdr_ADC_OVERLOAD_DETECTED, 0, mockCbContext);
+            mockGainCb(mir_sdr_ADC_OVERLOAD_CORRECTED, 0, mockCbContext);
+        }
+
+        if (cfg.speed > 0.0)
+        {
+            deadline += std::chrono::nanoseconds((long long)(1e9 * numSamples / rate / cfg.speed));
+            // do not try to catch up after a stall
+            const auto now = std::chrono::steady_clock::now();
+            if (deadline < now - std::chrono::milliseconds(100)) deadline = now;
+            std::this_thread::sleep_until(deadline);
+        }
+    }
+}
+
+} // namespace
+
+mir_sdr_ErrT mir_sdr_ApiVersion(float *version)
+{
+    *version = MIR_SDR_API_VERSION;
+    return mir_sdr_Success;
+}
+
+mir_sdr_ErrT mir_sdr_DebugEnable(unsigned int enable)
+{
+    return mir_sdr_Success;
+}
+
+mir_sdr_ErrT mir_sdr_GetDevices(mir_sdr_DeviceT *devices, unsigned int *numDevs, unsigned int maxDevs)
+{
+    std::lock_guard<std::mutex> lock(mockMutex);
+    const MockConfig &cfg = config();
+    while (mockSerials.size() < cfg.numDevices)
+    {
+        char serial[16];
+        std::snprintf(serial, sizeof(serial), "MOCK%04u", (unsigned)mockSerials.size());
+        mockSerials.push_back(serial);
+    }
+
+    *numDevs = std::min(cfg.numDevices, maxDevs);
+    for (unsigned int i = 0; i < *numDevs; i++)
+    {
+        devices[i].SerNo = (char *)mockSerials[i].c_str();
+        devices[i].DevNm = mockName;
+        devices[i].hwVer = cfg.hwVer;
+        devices[i].devAvail = 1;
+    }
+    return mir_sdr_Success;
+}
+
+mir_sdr_ErrT mir_sdr_SetDeviceIdx(unsigned int idx)
+{
+    return (idx < config().numDevices) ? mir_sdr_Success : mir_sdr_InvalidParam;
+}
+
+mir_sdr_ErrT mir_sdr_ReleaseDeviceIdx(void)
+{
+    return mir_sdr_Success;
+}
+
+mir_sdr_ErrT mir_sdr_StreamInit(int *gRdB, double fsMHz, double rfMHz, mir_sdr_Bw_MHzT bwType, mir_sdr_If_kHzT ifType, int LNAstate, int *gRdBsystem, mir_sdr_SetGrModeT setGrMode, int *samplesPerPacket, mir_sdr_StreamCallback_t StreamCbFn, mir_sdr_GainChangeCallback_t GainChangeCbFn, void *cbContext)
+{
+    if (mockRunning) return mir_sdr_AlreadyInitialised;
+    {
+        std::lock_guard<std::mutex> lock(mockMutex);
+        mockFsHz = fsMHz * 1e6;
+        mockIfType = ifType;
+        mockDecimation = 1;
+        mockGRdB = *gRdB;
+        mockLnaState = LNAstate;
+        mockGrChanged = mockRfChanged = mockFsChanged = false;
+    }
+    *gRdBsystem = *gRdB;
+    *samplesPerPacket = config().chunk;
+
+    mockStreamCb = StreamCbFn;
+    mockGainCb = GainChangeCbFn;
+    mockCbContext = cbContext;
+    mockRunning = true;
+    mockThread = std::thread(streamThread);
+    return mir_sdr_Success;
+}
+
+mir_sdr_ErrT mir_sdr_StreamUninit(void)
+{
+    if (not mockRunning) return mir_sdr_NotInitialised;
+    mockRunning = false;
+    mockThread.join();
+    return mir_sdr_Success;
+}
+
+mir_sdr_ErrT mir_sdr_Reinit(int *gRdB, double fsMHz, double rfMHz, mir_sdr_Bw_MHzT bwType, mir_sdr_If_kHzT ifType, mir_sdr_LoModeT LoMode, int LNAstate, int *gRdBsystem, mir_sdr_SetGrModeT setGrMode, int *samplesPerPacket, mir_sdr_ReasonForReinitT reasonForReinit)
+{
+    if (not mockRunning) return mir_sdr_NotInitialised;
+    std::lock_guard<std::mutex> lock(mockMutex);
+    if (reasonForReinit & mir_sdr_CHANGE_GR)
+    {
+        mockGRdB = *gRdB;
+        mockLnaState = LNAstate;
+        mockGrChanged = true;
+    }
+    if (reasonForReinit & mir_sdr_CHANGE_RF_FREQ)
+    {
+        mockRfChanged = true;
+    }
+    if (reasonForReinit & mir_sdr_CHANGE_FS_FREQ)
+    {
+        mockFsHz = fsMHz * 1e6;
+        mockFsChanged = true;
+    }
+    if (reasonForReinit & mir_sdr_CHANGE_IF_TYPE)
+    {
+        mockIfType = ifType;
+    }
+    *gRdBsystem = mockGRdB;
+    *samplesPerPacket = config().chunk;
+    return mir_sdr_Success;
+}
+
+mir_sdr_ErrT mir_sdr_DecimateControl(unsigned int enable, unsigned int decimationFactor, unsigned int wideBandSignal)
+{
+    std::lock_guard<std::mutex> lock(mockMutex);
+    mockDecimation = (enable and decimationFactor > 1) ? decimationFactor : 1;
+    return mir_sdr_Success;
+}
+
+mir_sdr_ErrT mir_sdr_GetCurrentGain(mir_sdr_GainValuesT *gainVals)
+{
+    std::lock_guard<std::mutex> lock(mockMutex);
+    gainVals->curr = (float)(100 - mockGRdB);
+    gainVals->max = 100.0f;
+    gainVals->min = 0.0f;
+    return mir_sdr_Success;
+}
+
+//the remaining calls only configure the tuner
+
+mir_sdr_ErrT mir_sdr_AgcControl(mir_sdr_AgcControlT enable, int setPoint_dBfs, int knee_dBfs, unsigned int decay_ms, unsigned int hang_ms, int syncUpdate, int LNAstate) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_SetDcMode(int dcCal, int speedUp) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_SetDcTrackTime(int trackTime) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_SetTransferMode(mir_sdr_TransferModeT mode) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_SetPpm(double ppm) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_AmPortSelect(int port) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_DCoffsetIQimbalanceControl(unsigned int DCenable, unsigned int IQenable) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_GainChangeCallbackMessageReceived(void) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_RSPII_AntennaControl(mir_sdr_RSPII_AntennaSelectT select) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_RSPII_ExternalReferenceControl(unsigned int output_enable) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_RSPII_BiasTControl(unsigned int enable) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_RSPII_RfNotchEnable(unsigned int enable) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_rsp1a_BiasT(int enable) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_rsp1a_DabNotch(int enable) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_rsp1a_BroadcastNotch(int enable) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_rspDuo_TunerSel(mir_sdr_rspDuo_TunerSelT sel) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_rspDuo_ExtRef(int enable) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_rspDuo_BiasT(int enable) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_rspDuo_Tuner1AmNotch(int enable) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_rspDuo_BroadcastNotch(int enable) { return mir_sdr_Success; }
+mir_sdr_ErrT mir_sdr_rspDuo_DabNotch(int enable) { return mir_sdr_Success; }
@@ -0,0 +1,195 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*******************************************************************
+ * Declarations of the mir_sdr API 2.x subset used by the module,
+ * implemented by MockSDRplay.cpp when building with USE_MOCK_SDRPLAY
+ ******************************************************************/
+
+#ifndef MIR_SDR_H
+#define MIR_SDR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MIR_SDR_API_VERSION   (float)(2.13)
+
+typedef enum
+{
+   mir_sdr_Success            = 0,
+   mir_sdr_Fail               = 1,
+   mir_sdr_InvalidParam       = 2,
+   mir_sdr_OutOfRange         = 3,
+   mir_sdr_GainUpdateError    = 4,
+   mir_sdr_RfUpdateError      = 5,
+   mir_sdr_FsUpdateError      = 6,
+   mir_sdr_HwError            = 7,
+   mir_sdr_AliasingError      = 8,
+   mir_sdr_AlreadyInitialised = 9,
+   mir_sdr_NotInitialised     = 10,
+   mir_sdr_NotEnabled         = 11,
+   mir_sdr_HwVerError         = 12,
+   mir_sdr_OutOfMemError      = 13,
+   mir_sdr_HwRemoved          = 14
+} mir_sdr_ErrT;
+
+typedef enum
+{
+   mir_sdr_BW_Undefined = 0,
+   mir_sdr_BW_0_200     = 200,
+   mir_sdr_BW_0_300     = 300,
+   mir_sdr_BW_0_600     = 600,
+   mir_sdr_BW_1_536     = 1536,
+   mir_sdr_BW_5_000     = 5000,
+   mir_sdr_BW_6_000     = 6000,
+   mir_sdr_BW_7_000     = 7000,
+   mir_sdr_BW_8_000     = 8000
+} mir_sdr_Bw_MHzT;
+
+typedef enum
+{
+   mir_sdr_IF_Undefined = -1,
+   mir_sdr_IF_Zero      = 0,
+   mir_sdr_IF_0_450     = 450,
+   mir_sdr_IF_1_620     = 1620,
+   mir_sdr_IF_2_048     = 2048
+} mir_sdr_If_kHzT;
+
+typedef enum
+{
+   mir_sdr_ISOCH = 0,
+   mir_sdr_BULK  = 1
+} mir_sdr_TransferModeT;
+
+typedef enum
+{
+   mir_sdr_CHANGE_NONE    = 0x00,
+   mir_sdr_CHANGE_GR      = 0x01,
+   mir_sdr_CHANGE_FS_FREQ = 0x02,
+   mir_sdr_CHANGE_RF_FREQ = 0x04,
+   mir_sdr_CHANGE_BW_TYPE = 0x08,
+   mir_sdr_CHANGE_IF_TYPE = 0x10,
+   mir_sdr_CHANGE_LO_MODE = 0x20,
+   mir_sdr_CHANGE_AM_PORT = 0x40
+} mir_sdr_ReasonForReinitT;
+
+typedef enum
+{
+   mir_sdr_LO_Undefined = 0,
+   mir_sdr_LO_Auto      = 1,
+   mir_sdr_LO_120MHz    = 2,
+   mir_sdr_LO_144MHz    = 3,
+   mir_sdr_LO_168MHz    = 4
+} mir_sdr_LoModeT;
+
+typedef enum
+{
+   mir_sdr_USE_SET_GR          = 0,
+   mir_sdr_USE_SET_GR_ALT_MODE = 1,
+   mir_sdr_USE_RSP_SET_GR      = 2
+} mir_sdr_SetGrModeT;
+
+typedef enum
+{
+   mir_sdr_RSPII_ANTENNA_A = 5,
+   mir_sdr_RSPII_ANTENNA_B = 6
+} mir_sdr_RSPII_AntennaSelectT;
+
+typedef enum
+{
+   mir_sdr_AGC_DISABLE  = 0,
+   mir_sdr_AGC_100HZ    = 1,
+   mir_sdr_AGC_50HZ     = 2,
+   mir_sdr_AGC_5HZ      = 3
+} mir_sdr_AgcControlT;
+
+typedef enum
+{
+   mir_sdr_GAIN_MESSAGE_START_ID  = 0x80000000,
+   mir_sdr_ADC_OVERLOAD_DETECTED  = mir_sdr_GAIN_MESSAGE_START_ID + 1,
+   mir_sdr_ADC_OVERLOAD_CORRECTED = mir_sdr_GAIN_MESSAGE_START_ID + 2
+} mir_sdr_GainMessageIdT;
+
+typedef enum
+{
+   mir_sdr_rspDuo_Tuner_1 = 1,
+   mir_sdr_rspDuo_Tuner_2 = 2
+} mir_sdr_rspDuo_TunerSelT;
+
+typedef struct
+{
+   char *SerNo;
+   char *DevNm;
+   unsigned char hwVer;
+   unsigned char devAvail;
+} mir_sdr_DeviceT;
+
+typedef struct
+{
+   float curr;
+   float max;
+   float min;
+} mir_sdr_GainValuesT;
+
+typedef void (*mir_sdr_StreamCallback_t)(short *xi, short *xq, unsigned int firstSampleNum, int grChanged, int rfChanged, int fsChanged, unsigned int numSamples, unsigned int reset, unsigned int hwRemoved, void *cbContext);
+typedef void (*mir_sdr_GainChangeCallback_t)(unsigned int gRdB, unsigned int lnaGRdB, void *cbContext);
+
+mir_sdr_ErrT mir_sdr_ApiVersion(float *version);
+mir_sdr_ErrT mir_sdr_DebugEnable(unsigned int enable);
+mir_sdr_ErrT mir_sdr_GetDevices(mir_sdr_DeviceT *devices, unsigned int *numDevs, unsigned int maxDevs);
+mir_sdr_ErrT mir_sdr_SetDeviceIdx(unsigned int idx);
+mir_sdr_ErrT mir_sdr_ReleaseDeviceIdx(void);
+mir_sdr_ErrT mir_sdr_StreamInit(int *gRdB, double fsMHz, double rfMHz, mir_sdr_Bw_MHzT bwType, mir_sdr_If_kHzT ifType, int LNAstate, int *gRdBsystem, mir_sdr_SetGrModeT setGrMode, int *samplesPerPacket, mir_sdr_StreamCallback_t StreamCbFn, mir_sdr_GainChangeCallback_t GainChangeCbFn, void *cbContext);
+mir_sdr_ErrT mir_sdr_StreamUninit(void);
+mir_sdr_ErrT mir_sdr_Reinit(int *gRdB, double fsMHz, double rfMHz, mir_sdr_Bw_MHzT bwType, mir_sdr_If_kHzT ifType, mir_sdr_LoModeT LoMode, int LNAstate, int *gRdBsystem, mir_sdr_SetGrModeT setGrMode, int *samplesPerPacket, mir_sdr_ReasonForReinitT reasonForReinit);
+mir_sdr_ErrT mir_sdr_DecimateControl(unsigned int enable, unsigned int decimationFactor, unsigned int wideBandSignal);
+mir_sdr_ErrT mir_sdr_AgcControl(mir_sdr_AgcControlT enable, int setPoint_dBfs, int knee_dBfs, unsigned int decay_ms, unsigned int hang_ms, int syncUpdate, int LNAstate);
+mir_sdr_ErrT mir_sdr_SetDcMode(int dcCal, int speedUp);
+mir_sdr_ErrT mir_sdr_SetDcTrackTime(int trackTime);
+mir_sdr_ErrT mir_sdr_SetTransferMode(mir_sdr_TransferModeT mode);
+mir_sdr_ErrT mir_sdr_SetPpm(double ppm);
+mir_sdr_ErrT mir_sdr_AmPortSelect(int port);
+mir_sdr_ErrT mir_sdr_DCoffsetIQimbalanceControl(unsigned int DCenable, unsigned int IQenable);
+mir_sdr_ErrT mir_sdr_GetCurrentGain(mir_sdr_GainValuesT *gainVals);
+mir_sdr_ErrT mir_sdr_GainChangeCallbackMessageReceived(void);
+mir_sdr_ErrT mir_sdr_RSPII_AntennaControl(mir_sdr_RSPII_AntennaSelectT select);
+mir_sdr_ErrT mir_sdr_RSPII_ExternalReferenceControl(unsigned int output_enable);
+mir_sdr_ErrT mir_sdr_RSPII_BiasTControl(unsigned int enable);
+mir_sdr_ErrT mir_sdr_RSPII_RfNotchEnable(unsigned int enable);
+mir_sdr_ErrT mir_sdr_rsp1a_BiasT(int enable);
+mir_sdr_ErrT mir_sdr_rsp1a_DabNotch(int enable);
+mir_sdr_ErrT mir_sdr_rsp1a_BroadcastNotch(int enable);
+mir_sdr_ErrT mir_sdr_rspDuo_TunerSel(mir_sdr_rspDuo_TunerSelT sel);
+mir_sdr_ErrT mir_sdr_rspDuo_ExtRef(int enable);
+mir_sdr_ErrT mir_sdr_rspDuo_BiasT(int enable);
+mir_sdr_ErrT mir_sdr_rspDuo_Tuner1AmNotch(int enable);
+mir_sdr_ErrT mir_sdr_rspDuo_BroadcastNotch(int enable);
+mir_sdr_ErrT mir_sdr_rspDuo_DabNotch(int enable);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MIR_SDR_H
@@ -0,0 +1,102 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*******************************************************************
+ * Channelizer queue test, run by ctest in USE_MOCK_SDRPLAY builds.
+ *
+ * Fills a channel with two small buffers while the reader stalls,
+ * then reads while more blocks come in. Fails when no read reports
+ * SOAPY_SDR_OVERFLOW, when a read returns more than the MTU or when
+ * the channel stops delivering.
+ ******************************************************************/
+
+#include "Channelizer.hpp"
+#include <SoapySDR/Errors.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define BLOCK_SAMPLES (1008)
+#define WIDE_RATE (2000000)
+
+static int failures = 0;
+
+static void fail(const std::string &what)
+{
+    std::fprintf(stderr, "FAIL: %s\n", what.c_str());
+    failures++;
+}
+
+//one wideband block, the workers get the time to take it
+static void push(SoapySDRPlayChannelizer &ddc, const SoapySDRPlayConverter *conv, long long &count)
+{
+    static std::vector<short> xi(BLOCK_SAMPLES, 1000), xq(BLOCK_SAMPLES, -1000);
+    const long long timeNs = count * 1000000000LL / WIDE_RATE;
+    ddc.push(conv, xi.data(), xq.data(), BLOCK_SAMPLES, timeNs, count, false, WIDE_RATE, 1, 100e6);
+    count += BLOCK_SAMPLES;
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+}
+
+int main(int argc, char **argv)
+{
+    const SoapySDRPlayConverter *conv = SoapySDRPlay_getConverter();
+    SoapySDRPlayChannelizer ddc(1, 1, BLOCK_SAMPLES);
+    const size_t mtu = 256;
+    ddc.setRate(0, 500000);
+    ddc.setFrequency(0, 100.1e6);
+    ddc.setup(0, SoapySDRPlayChannelizer::FORMAT_CS16, 2 * sizeof(short), 2, mtu, 8, true);
+    ddc.activate(0, true);
+
+    // the reader stalls while many more buffers than the queue holds come in
+    long long count = 0;
+    for (int i = 0; i < 200; i++) push(ddc, conv, count);
+
+    // then reads four MTUs at a time, the channel keeps going
+    std::vector<short> buff(2 * 4 * mtu);
+    int overflows = 0, samples = 0, timeouts = 0;
+    for (int i = 0; i < 100; i++)
+    {
+        int flags = 0;
+        long long timeNs = 0;
+        const int ret = ddc.read(0, buff.data(), 4 * mtu, flags, timeNs, 100000);
+        if (ret == SOAPY_SDR_OVERFLOW) overflows++;
+        else if (ret == SOAPY_SDR_TIMEOUT) timeouts++;
+        else if (ret < 0) fail("read returned " + std::to_string(ret));
+        else if ((size_t)ret > mtu) fail("read returned " + std::to_string(ret) + " samples, the MTU is " + std::to_string(mtu));
+        else samples += ret;
+        push(ddc, conv, count);
+    }
+    ddc.activate(0, false);
+
+    if (overflows == 0) fail("no overflow reported");
+    if (samples == 0) fail("no samples after the overflow");
+    if (timeouts > 10) fail(std::to_string(timeouts) + " reads timed out");
+
+    std::printf("%d samples, %d overflows, %d timeouts, %d failures\n", samples, overflows, timeouts, failures);
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,207 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*******************************************************************
+ * Conversion kernel test, run by ctest in USE_MOCK_SDRPLAY builds.
+ *
+ * Runs every kernel SoapySDRPlay_listConverters() offers on this CPU
+ * against "scalar" over lengths with odd tails and unaligned inputs.
+ * The integer formats must match bit for bit, for every CS8 shift and
+ * both rounding modes, and nothing may be written past the output.
+ * The float kernels sum in a different order and must match within
+ * a tolerance.
+ ******************************************************************/
+
+#include "Convert.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+//written past the end of every output, a kernel must leave it alone
+static const int GUARD = 4;
+static const unsigned char GUARD_BYTE = 0xa5;
+
+static int failures = 0;
+
+static void fail(const std::string &what)
+{
+    std::fprintf(stderr, "FAIL: %s\n", what.c_str());
+    failures++;
+}
+
+template <typename T>
+static std::vector<T> guarded(const size_t numElems)
+{
+    std::vector<T> buff(numElems + GUARD);
+    std::fill((unsigned char *)buff.data(), (unsigned char *)(buff.data() + buff.size()), GUARD_BYTE);
+    return buff;
+}
+
+//the outputs must be identical including the guard
+template <typename T>
+static void compareExact(const std::string &what, const std::vector<T> &ref, const std::vector<T> &out)
+{
+    for (size_t i = 0; i < ref.size(); i++)
+    {
+        if (std::memcmp(&ref[i], &out[i], sizeof(T)) == 0) continue;
+        fail(what + ((i + GUARD < ref.size()) ? " differs at " : " wrote past the end at ") + std::to_string(i));
+        return;
+    }
+}
+
+static void compareNear(const std::string &what, const std::vector<float> &ref, const std::vector<float> &out, const double tol)
+{
+    for (size_t i = 0; i < ref.size(); i++)
+    {
+        if (i + GUARD >= ref.size() ? std::memcmp(&ref[i], &out[i], sizeof(float)) == 0 : std::fabs(ref[i] - out[i]) <= tol) continue;
+        fail(what + " differs at " + std::to_string(i) + ": " + std::to_string(out[i]) + " instead of " + std::to_string(ref[i]));
+        return;
+    }
+}
+
+int main(void)
+{
+    const SoapySDRPlayConverter *ref = SoapySDRPlay_getConverter("scalar");
+    const std::vector<std::string> names = SoapySDRPlay_listConverters();
+    const size_t lengths[] = {0, 1, 2, 3, 7, 8, 9, 15, 16, 17, 31, 33, 63, 65, 127, 129, 1008, 1009, 1023};
+
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> sample(-32768, 32767);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+    for (const std::string &name : names)
+    {
+        const SoapySDRPlayConverter *conv = SoapySDRPlay_getConverter(name);
+        for (const size_t len : lengths)
+        {
+            // one sample in, the vector loads are unaligned
+            for (size_t offset = 0; offset < 2; offset++)
+            {
+                const std::string what = name + " length " + std::to_string(len) + " offset " + std::to_string(offset);
+                std::vector<short> xiBuff(len + offset), xqBuff(len + offset);
+                for (size_t i = 0; i < xiBuff.size(); i++)
+                {
+                    xiBuff[i] = (short)sample(rng);
+                    xqBuff[i] = (short)sample(rng);
+                }
+                // the saturating ends and the rounding edges of every shift
+                const short edges[] = {-32768, 32767, 32766, -1, 0, 1, 7, 8, -8, -9, 127, 128, -129, 32760};
+                for (size_t i = 0; i < len and i < sizeof(edges) / sizeof(edges[0]); i++)
+                {
+                    xiBuff[offset + i] = edges[i];
+                    xqBuff[offset + len - 1 - i] = edges[i];
+                }
+                const short *xi = xiBuff.data() + offset;
+                const short *xq = xqBuff.data() + offset;
+
+                std::vector<short> cs16Ref = guarded<short>(2 * len), cs16 = guarded<short>(2 * len);
+                ref->toCS16(xi, xq, cs16Ref.data(), len);
+                conv->toCS16(xi, xq, cs16.data(), len);
+                compareExact(what + " CS16", cs16Ref, cs16);
+
+                std::vector<float> cf32Ref = guarded<float>(2 * len), cf32 = guarded<float>(2 * len);
+                ref->toCF32(xi, xq, cf32Ref.data(), len);
+                conv->toCF32(xi, xq, cf32.data(), len);
+                compareExact(what + " CF32", cf32Ref, cf32);
+
+                for (unsigned int shift = 0; shift <= 8; shift++)
+                {
+                    for (const bool round : {false, true})
+                    {
+                        std::vector<signed char> cs8Ref = guarded<signed char>(2 * len), cs8 = guarded<signed char>(2 * len);
+                        ref->toCS8(xi, xq, cs8Ref.data(), len, shift, round);
+                        conv->toCS8(xi, xq, cs8.data(), len, shift, round);
+                        compareExact(what + " CS8 shift " + std::to_string(shift) + (round ? " rounded" : ""), cs8Ref, cs8);
+                    }
+                }
+
+                for (const bool round : {false, true})
+                {
+                    std::vector<unsigned char> cs12Ref = guarded<unsigned char>(3 * len), cs12 = guarded<unsigned char>(3 * len);
+                    ref->toCS12(xi, xq, cs12Ref.data(), len, round);
+                    conv->toCS12(xi, xq, cs12.data(), len, round);
+                    compareExact(what + " CS12" + (round ? " rounded" : ""), cs12Ref, cs12);
+                }
+
+                SoapySDRPlayCorrection corrRef = SoapySDRPlayCorrection();
+                corrRef.dcI = 0.01f;
+                corrRef.dcQ = -0.02f;
+                corrRef.gainQ = 1.1f;
+                corrRef.crossQ = -0.05f;
+                SoapySDRPlayCorrection corr = corrRef;
+                std::vector<float> corrOutRef = guarded<float>(2 * len), corrOut = guarded<float>(2 * len);
+                ref->toCF32Corr(xi, xq, corrOutRef.data(), len, corrRef);
+                conv->toCF32Corr(xi, xq, corrOut.data(), len, corr);
+                compareNear(what + " CF32 corrected", corrOutRef, corrOut, 1e-6);
+                const double sumTol = 1e-4 * (len + 1);
+                if (std::fabs(corr.sumI - corrRef.sumI) > sumTol or std::fabs(corr.sumQ - corrRef.sumQ) > sumTol or
+                    std::fabs(corr.sumII - corrRef.sumII) > sumTol or std::fabs(corr.sumQQ - corrRef.sumQQ) > sumTol or
+                    std::fabs(corr.sumIQ - corrRef.sumIQ) > sumTol)
+                {
+                    fail(what + " correction sums differ");
+                }
+            }
+
+            // the filter and FFT kernels over planar floats
+            const std::string what = name + " length " + std::to_string(len);
+            std::vector<float> taps(len), fi(len), fq(len), bi(len), bq(len);
+            for (size_t i = 0; i < len; i++)
+            {
+                taps[i] = unit(rng);
+                fi[i] = unit(rng);
+                fq[i] = unit(rng);
+                bi[i] = unit(rng);
+                bq[i] = unit(rng);
+            }
+            float outIRef = 0, outQRef = 0, outI = 0, outQ = 0;
+            ref->firCF32(taps.data(), fi.data(), fq.data(), len, outIRef, outQRef);
+            conv->firCF32(taps.data(), fi.data(), fq.data(), len, outI, outQ);
+            const double firTol = 1e-5 * (len + 1);
+            if (std::fabs(outI - outIRef) > firTol or std::fabs(outQ - outQRef) > firTol)
+            {
+                fail(what + " FIR gives " + std::to_string(outI) + "," + std::to_string(outQ) +
+                     " instead of " + std::to_string(outIRef) + "," + std::to_string(outQRef));
+            }
+
+            const float wr = std::cos(0.3f), wi = -std::sin(0.3f);
+            std::vector<float> crRef = guarded<float>(len), ciRef = guarded<float>(len), drRef = guarded<float>(len), diRef = guarded<float>(len);
+            std::vector<float> cr = guarded<float>(len), ci = guarded<float>(len), dr = guarded<float>(len), di = guarded<float>(len);
+            ref->butterflyCF32(fi.data(), fq.data(), bi.data(), bq.data(), crRef.data(), ciRef.data(), drRef.data(), diRef.data(), wr, wi, len);
+            conv->butterflyCF32(fi.data(), fq.data(), bi.data(), bq.data(), cr.data(), ci.data(), dr.data(), di.data(), wr, wi, len);
+            compareExact(what + " butterfly sum I", crRef, cr);
+            compareExact(what + " butterfly sum Q", ciRef, ci);
+            compareNear(what + " butterfly difference I", drRef, dr, 1e-6);
+            compareNear(what + " butterfly difference Q", diRef, di, 1e-6);
+        }
+    }
+
+    std::printf("%zu kernels checked against scalar, %d failures\n", names.size(), failures);
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
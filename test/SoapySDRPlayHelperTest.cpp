@@ -0,0 +1,141 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*******************************************************************
+ * Helper stream test, run by ctest in USE_MOCK_SDRPLAY builds.
+ *
+ * Opens the mock device in the helper process given as the first
+ * argument and streams it through the shared memory ring. A reader
+ * that stalls until the ring is full must get every published slot
+ * and then the overflow slot, and a reader whose helper is killed
+ * must get an error once the ring is drained instead of timeouts.
+ ******************************************************************/
+
+#include "Helper.hpp"
+#include <SoapySDR/Logger.hpp>
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock TestClock;
+
+static int failures = 0;
+
+static void fail(const std::string &what)
+{
+    std::fprintf(stderr, "FAIL: %s\n", what.c_str());
+    failures++;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::fprintf(stderr, "usage: %s <path to SoapySDRPlayHelper>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    SoapySDR::setLogLevel(SOAPY_SDR_WARNING);
+
+    SoapySDR::Kwargs args;
+    args["serial"] = "MOCK0000";
+    args["helper"] = "true";
+    args["helper_path"] = argv[1];
+    SoapySDRPlayHelperClient dev(args);
+
+    // short slots so that the ring fills quickly
+    dev.setSampleRate(SOAPY_SDR_RX, 0, 2e6);
+    SoapySDR::Kwargs streamArgs;
+    streamArgs["bufflen"] = "8192";
+    SoapySDR::Stream *stream = dev.setupStream(SOAPY_SDR_RX, "CS16", std::vector<size_t>(), streamArgs);
+    const size_t mtu = dev.getStreamMTU(stream);
+    const size_t numSlots = dev.getNumDirectAccessBuffers(stream);
+    dev.activateStream(stream);
+
+    std::vector<short> buff(2 * mtu);
+    void *buffs[1] = {buff.data()};
+    int flags = 0;
+    long long timeNs = 0;
+
+    // a reader that keeps up
+    long long total = 0;
+    const auto end = TestClock::now() + std::chrono::milliseconds(300);
+    while (TestClock::now() < end)
+    {
+        const int ret = dev.readStream(stream, buffs, mtu, flags, timeNs, 200000);
+        if (ret == SOAPY_SDR_OVERFLOW) continue;
+        if (ret < 0) fail("readStream returned " + std::to_string(ret));
+        else if ((size_t)ret > mtu) fail("read of " + std::to_string(ret) + " beyond the MTU");
+        else total += ret;
+    }
+    if (total == 0) fail("no samples through the ring");
+
+    // direct access hands out the slots themselves
+    size_t handle = 0;
+    const void *addrs[1] = {nullptr};
+    const int acquired = dev.acquireReadBuffer(stream, handle, addrs, flags, timeNs, 200000);
+    if (acquired > 0)
+    {
+        if (handle >= numSlots) fail("handle " + std::to_string(handle) + " beyond the ring");
+        dev.releaseReadBuffer(stream, handle);
+    }
+    else if (acquired != SOAPY_SDR_OVERFLOW) fail("acquireReadBuffer returned " + std::to_string(acquired));
+
+    // a stalled reader finds the full ring, then the overflow slot
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    size_t blocks = 0;
+    bool overflow = false;
+    while (not overflow and blocks <= numSlots + 1)
+    {
+        const int ret = dev.readStream(stream, buffs, mtu, flags, timeNs, 200000);
+        if (ret == SOAPY_SDR_OVERFLOW)
+        {
+            overflow = true;
+            if (not (flags & SOAPY_SDR_HAS_TIME)) fail("overflow without the time of the loss");
+        }
+        else if (ret < 0) fail("readStream returned " + std::to_string(ret) + " after the stall");
+        else if ((size_t)ret > mtu) fail("read of " + std::to_string(ret) + " beyond the MTU");
+        else blocks++;
+    }
+    if (not overflow) fail("no overflow after the stall");
+    if (blocks + 1 < numSlots) fail("only " + std::to_string(blocks) + " of " + std::to_string(numSlots) + " slots before the overflow");
+
+    // the slots published before the helper died are still read,
+    // then the hangup ends the stream
+    const int pid = std::stoi(dev.getHardwareInfo().at("helper_pid"));
+    ::kill(pid, SIGKILL);
+    int last = 0;
+    for (size_t i = 0; i <= numSlots + 1 and last != SOAPY_SDR_STREAM_ERROR; i++)
+    {
+        last = dev.readStream(stream, buffs, mtu, flags, timeNs, 200000);
+    }
+    if (last != SOAPY_SDR_STREAM_ERROR) fail("readStream returned " + std::to_string(last) + " after the helper died");
+
+    std::printf("samples %lld, %zu of %zu slots before the overflow, %d failures\n", total, blocks, numSlots, failures);
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
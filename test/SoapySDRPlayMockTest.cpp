@@ -0,0 +1,141 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Charles J. Cliffe
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*******************************************************************
+ * Mock stream test, run by ctest in USE_MOCK_SDRPLAY builds.
+ *
+ * Streams the mock tone through readStream() at the hardware rate,
+ * then changes to a resampled rate and frequency while streaming.
+ * Fails when a read errors or overflows, when consecutive blocks
+ * are not contiguous in time, or when the change never shows up
+ * as a stream event.
+ ******************************************************************/
+
+#include "SoapySDRPlay.hpp"
+#include <SoapySDR/Logger.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock TestClock;
+
+static int failures = 0;
+
+static void fail(const std::string &what)
+{
+    std::fprintf(stderr, "FAIL: %s\n", what.c_str());
+    failures++;
+}
+
+//reads for the given time, the block timestamps must follow the sample
+//counts at the given rate, a rate event switches to newRate from its block
+static long long readFor(SoapySDRPlay &dev, SoapySDR::Stream *stream, const double seconds,
+                         double &rate, const double newRate, int &rateEvents, int &freqEvents)
+{
+    const size_t numElems = dev.getStreamMTU(stream);
+    std::vector<short> buff(2 * numElems);
+    void *buffs[1] = {buff.data()};
+
+    long long total = 0;
+    long long nextNs = -1;
+    const auto end = TestClock::now() + std::chrono::duration_cast<TestClock::duration>(std::chrono::duration<double>(seconds));
+    while (TestClock::now() < end)
+    {
+        int flags = 0;
+        long long timeNs = 0;
+        const int ret = dev.readStream(stream, buffs, numElems, flags, timeNs, 200000);
+        if (ret == SOAPY_SDR_TIMEOUT)
+        {
+            fail("readStream timed out");
+            continue;
+        }
+        if (ret < 0)
+        {
+            fail("readStream returned " + std::to_string(ret));
+            nextNs = -1;
+            continue;
+        }
+        if (not (flags & SOAPY_SDR_HAS_TIME))
+        {
+            fail("block without a timestamp");
+        }
+        if (flags & SOAPY_SDRPLAY_FREQ_CHANGED) freqEvents++;
+        if (flags & SOAPY_SDRPLAY_RATE_CHANGED)
+        {
+            rateEvents++;
+            rate = newRate;
+            nextNs = -1;
+        }
+
+        // a block may be rounded to the next nanosecond
+        if (nextNs >= 0 and std::llabs(timeNs - nextNs) > 1)
+        {
+            fail("block at " + std::to_string(timeNs) + " ns, expected " + std::to_string(nextNs) + " ns");
+        }
+        nextNs = timeNs + std::llround(ret * 1e9 / rate);
+        total += ret;
+    }
+    return total;
+}
+
+int main(int argc, char **argv)
+{
+    SoapySDR::setLogLevel(SOAPY_SDR_WARNING);
+
+    SoapySDR::Kwargs args;
+    args["serial"] = "MOCK0000";
+    SoapySDRPlay dev(args);
+
+    double rate = 2e6;
+    int rateEvents = 0, freqEvents = 0;
+    dev.setSampleRate(SOAPY_SDR_RX, 0, rate);
+    dev.setFrequency(SOAPY_SDR_RX, 0, "RF", 100e6, SoapySDR::Kwargs());
+    SoapySDR::Stream *stream = dev.setupStream(SOAPY_SDR_RX, "CS16", std::vector<size_t>(), SoapySDR::Kwargs());
+    dev.activateStream(stream);
+
+    const long long before = readFor(dev, stream, 0.3, rate, rate, rateEvents, freqEvents);
+    if (before < 0.1 * rate) fail("only " + std::to_string(before) + " samples at 2 MS/s");
+
+    // the resampler takes over from the decimation of the hardware
+    const double outputRate = 48000;
+    dev.setSampleRate(SOAPY_SDR_RX, 0, outputRate);
+    dev.setFrequency(SOAPY_SDR_RX, 0, "RF", 200e6, SoapySDR::Kwargs());
+    const long long after = readFor(dev, stream, 0.5, rate, outputRate, rateEvents, freqEvents);
+
+    dev.deactivateStream(stream);
+    dev.closeStream(stream);
+
+    if (rateEvents != 1) fail(std::to_string(rateEvents) + " rate events");
+    if (freqEvents < 1) fail("no frequency event");
+    if (rate != outputRate) fail("the rate event never arrived");
+    if (after < 0.1 * outputRate) fail("only " + std::to_string(after) + " samples at 48 kS/s");
+    if (dev.getFrequency(SOAPY_SDR_RX, 0, "RF") != 200e6) fail("frequency not applied");
+
+    std::printf("samples %lld at 2 MS/s, %lld after the change, %d failures\n", before, after, failures);
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}